@@ -5,8 +5,17 @@
 
 #include "libriot.h"
 #include "libriot/wad.h"
+#include "libriot/wad_io.h"
 #include "libriot/inibin.h"
+#include "libriot/thread_pool.h"
+#include "libriot/hash_dict.h"
+#include "libriot/stats.h"
+#include "libriot/trace.h"
 
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #endif /* BRZESZCZOT_H */
@@ -10,11 +10,22 @@ extern "C" {
 enum brzeszczot_mode {
 	WAD_DUMP,
 	INIBIN_DUMP,
+	WAD_EXTRACT,
+	WAD_VERIFY,
+	WAD_PACK,
+	WAD_PATCH,
 };
 
 struct opts {
 	enum brzeszczot_mode mode;
 	char const *src, *dst;
+	char const *hashes;
+	char const *cache;
+	char const *trace;
+	u32 threads;
+	u32 io_depth;
+	b8 io;
+	b8 stats;
 };
 
 extern b32
@@ -16,7 +16,7 @@ BRZESZCZOT_CFLAGS	:= \
 
 BRZESZCZOT_FLAGS	:= \
 			   $(BRZESZCZOT_CFLAGS) \
-			   $(LDFLAGS) -lriot
+			   $(LDFLAGS) -lriot $(LIBRIOT_LDLIBS)
 
 BRZESZCZOT_SOURCES	:= brzeszczot/src/brzeszczot.c \
 			   brzeszczot/src/argparse.c
@@ -38,8 +38,17 @@ brzeszczot-deps: $(LIB)/libriot.a
 
 brzeszczot-build: $(BIN)/brzeszczot
 
-brzeszczot-test-deps:
+BRZESZCZOT_TEST_SOURCES	:= brzeszczot/test/argparse.c
 
-brzeszczot-test:
+BRZESZCZOT_TESTS	:= $(BRZESZCZOT_TEST_SOURCES:brzeszczot/test/%.c=$(TST)/brzeszczot-%)
+
+# tests link against the objects of the sources they cover
+$(BRZESZCZOT_TESTS): $(TST)/brzeszczot-%: brzeszczot/test/%.c $(OBJ)/brzeszczot/src/%.c.o | $(TST)
+	$(CC) -o $@ $^ $(BRZESZCZOT_FLAGS)
+
+brzeszczot-test-deps: $(LIB)/libriot.a
+
+brzeszczot-test: brzeszczot-test-deps $(BRZESZCZOT_TESTS)
+	@for test in $(BRZESZCZOT_TESTS); do ./$$test || exit 1; done
 
 brzeszczot: brzeszczot-build brzeszczot-test
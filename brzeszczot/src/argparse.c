@@ -4,7 +4,7 @@ void
 usage(s32 argc, char **argv) {
 	(void) argc;
 
-	fprintf(stderr, "Usage: %s <src-file> <dst-file> <wad|inibin>\n", argv[0]);
+	fprintf(stderr, "Usage: %s <src-file> <dst-file> <wad|inibin|extract|verify|pack|patch> [-j threads] [-H hash-list] [-C toc-cache] [-A io-depth] [-T trace-file] [--stats]\n", argv[0]);
 }
 
 b32
@@ -21,15 +21,64 @@ argparse(s32 argc, char **argv, struct opts *out) {
 
 	out->src = argv[1];
 	out->dst = argv[2];
+	out->hashes = NULL;
+	out->cache = NULL;
+	out->trace = NULL;
+	out->threads = 0;
+	out->io_depth = 0;
+	out->io = false;
+	out->stats = false;
 
 	if (strcmp(argv[3], "wad") == 0) {
 		out->mode = WAD_DUMP;
 	} else if (strcmp(argv[3], "inibin") == 0) {
 		out->mode = INIBIN_DUMP;
+	} else if (strcmp(argv[3], "extract") == 0) {
+		out->mode = WAD_EXTRACT;
+	} else if (strcmp(argv[3], "verify") == 0) {
+		out->mode = WAD_VERIFY;
+	} else if (strcmp(argv[3], "pack") == 0) {
+		out->mode = WAD_PACK;
+	} else if (strcmp(argv[3], "patch") == 0) {
+		out->mode = WAD_PATCH;
 	} else {
 		usage(argc, argv);
 		return false;
 	}
 
+	for (s32 i = 4; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			char *end;
+			unsigned long threads = strtoul(argv[++i], &end, 10);
+			if (*end || !threads || threads > UINT16_MAX) {
+				errlog("Invalid thread count: %s", argv[i]);
+				return false;
+			}
+
+			out->threads = threads;
+		} else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+			out->hashes = argv[++i];
+		} else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+			out->cache = argv[++i];
+		} else if (strcmp(argv[i], "-A") == 0 && i + 1 < argc) {
+			char *end;
+			unsigned long depth = strtoul(argv[++i], &end, 10);
+			if (*end || depth > 4096) {
+				errlog("Invalid I/O queue depth: %s", argv[i]);
+				return false;
+			}
+
+			out->io_depth = depth;
+			out->io = true;
+		} else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+			out->trace = argv[++i];
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			out->stats = true;
+		} else {
+			usage(argc, argv);
+			return false;
+		}
+	}
+
 	return true;
 }
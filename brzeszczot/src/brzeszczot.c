@@ -6,20 +6,24 @@ read_file(char const *fp, u8 **out) {
 	FILE *f = fopen(fp, "rb");
 	if (!f) return 0;
 
-	u64 len;
-	fseek(f, 0, SEEK_END);
-	len = ftell(f);
-	fseek(f, 0, SEEK_SET);
+	/* the size is taken from the descriptor rather than with fseek() and
+	 * ftell(), as stdio may satisfy the seek back to the start from its
+	 * buffer without moving the descriptor's offset
+	 */
+	int fd = fileno(f);
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) { fclose(f); return 0; }
+
+	u64 len = st.st_size;
 
 	u8 *buf = malloc(len);
 	if (!buf) { fclose(f); return 0; }
 
-	int fd = fileno(f);
-
 	u64 total_read = 0;
 	do {
-		u64 curr = read(fd, buf + total_read, len - total_read);
-		if (!curr) { free(buf); fclose(f); return 0; }
+		ssize_t curr = read(fd, buf + total_read, len - total_read);
+		if (curr <= 0) { free(buf); fclose(f); return 0; }
 
 		total_read += curr;
 	} while (total_read < len);
@@ -40,8 +44,8 @@ write_file(char const *fp, u64 len, u8 *buf) {
 
 	u64 total_written = 0;
 	do {
-		u64 curr = write(fd, buf + total_written, len - total_written);
-		if (!curr) { fclose(f); return total_written; }
+		ssize_t curr = write(fd, buf + total_written, len - total_written);
+		if (curr <= 0) { fclose(f); return total_written; }
 
 		total_written += curr;
 	} while (total_written < len);
@@ -51,128 +55,808 @@ write_file(char const *fp, u64 len, u8 *buf) {
 	return total_written;
 }
 
+/* rejects names that would escape the extraction directory: absolute paths,
+ * and paths with a `..` component. dots elsewhere, as in `a..b`, are fine
+ */
+static b32
+extract_path_is_safe(struct str_view name) {
+	if (!name.len || name.ptr[0] == '/') return false;
+
+	for (u64 begin = 0; begin < name.len;) {
+		char const *sep = memchr(name.ptr + begin, '/', name.len - begin);
+		u64 end = sep ? (u64)(sep - name.ptr) : name.len;
+
+		if (end - begin == 2 && name.ptr[begin] == '.' && name.ptr[begin + 1] == '.')
+			return false;
+
+		begin = end + 1;
+	}
+
+	return true;
+}
+
+static b32
+make_parent_dirs(char *path) {
+	assert(path);
+
+	for (char *sep = strchr(path + 1, '/'); sep; sep = strchr(sep + 1, '/')) {
+		*sep = '\0';
+		b32 ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+		*sep = '/';
+
+		if (!ok) return false;
+	}
+
+	return true;
+}
+
+struct wad_extract_job {
+	struct riot_wad_ctx *ctx;
+	struct riot_hash_dict *names;
+	struct riot_wad_decompressor *decompressors;
+	u32 *order;
+
+	/* payloads of the chunks in `order`, when read in batches rather than
+	 * taken from a mapped archive
+	 */
+	struct mem_stream *data;
+
+	char const *dir;
+	atomic_uint failures;
+};
+
+static void
+wad_extract_chunk(void *arg, u32 worker, u64 idx) {
+	struct wad_extract_job *job = arg;
+
+	struct riot_wad_chunk *chunk = (struct riot_wad_chunk *)job->ctx->chunk_pool.ptr + job->order[idx];
+
+	struct mem_stream data;
+	b32 ok = job->data
+		? riot_wad_chunk_decompress_data(&job->decompressors[worker], job->ctx, chunk, job->data[idx],
+						 NULL, 0, &data)
+		: riot_wad_chunk_decompress(&job->decompressors[worker], job->ctx, chunk, NULL, 0, &data);
+
+	if (!ok) {
+		errlog("Failed to decompress chunk: %016lx", chunk->path_hash);
+		atomic_fetch_add(&job->failures, 1);
+		return;
+	}
+
+	char path[PATH_MAX];
+	struct str_view name;
+	if (riot_hash_dict_find(job->names, chunk->path_hash, &name) && extract_path_is_safe(name) &&
+	    (u64)snprintf(path, sizeof path, "%s/%.*s", job->dir, (int)name.len, name.ptr) < sizeof path) {
+		if (!make_parent_dirs(path)) {
+			errlog("Failed to create parent directories: %s", path);
+			atomic_fetch_add(&job->failures, 1);
+			return;
+		}
+	} else {
+		snprintf(path, sizeof path, "%s/%016lx", job->dir, chunk->path_hash);
+	}
+
+	u64 span = riot_trace_begin();
+
+	if (write_file(path, data.len, data.ptr) < data.len) {
+		errlog("Failed to write chunk file: %s", path);
+		atomic_fetch_add(&job->failures, 1);
+	}
+
+	riot_trace_end("write", span, data.len);
+}
+
+/* moves the chunks whose sub-chunks are decoded across the pool to the back
+ * of `order`, keeping both groups in order. returns the number of chunks
+ * left in front of them
+ */
+static u32
+wad_extract_split(struct riot_wad_ctx *ctx, u32 *order, u32 count, u64 *scratch) {
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+
+	u32 narrow = 0, wide = 0;
+	for (u32 i = 0; i < count; i++) {
+		if (riot_wad_chunk_decompresses_in_parallel(&chunks[order[i]])) {
+			scratch[wide++] = order[i];
+		} else {
+			order[narrow++] = order[i];
+		}
+	}
+
+	for (u32 i = 0; i < wide; i++)
+		order[narrow + i] = (u32)scratch[i];
+
+	return narrow;
+}
+
+/* extracts the first `narrow` chunks of the job one per worker, then the
+ * rest one at a time on the calling thread, whose decompressor spreads their
+ * sub-chunks across the now idle pool
+ */
+static void
+wad_extract_run(struct wad_extract_job *job, struct riot_thread_pool *pool, u32 count, u32 narrow) {
+	riot_thread_pool_run(pool, narrow, wad_extract_chunk, job);
+
+	for (u32 i = narrow; i < count; i++)
+		wad_extract_chunk(job, 0, i);
+}
+
+/* loads the sub-chunk table of contents of the archive, if it has one, as
+ * raw-stored sub-chunks can only be located through it. archives opened for
+ * batched reads have it read through `io`
+ */
+static b32
+wad_load_subchunk_toc(struct riot_wad_ctx *ctx, struct riot_wad_decompressor *dec, struct riot_wad_io *io,
+		      char const *path) {
+	xxh64_u64 toc_path_hash = riot_wad_subchunk_toc_path_hash(path);
+
+	struct riot_wad_chunk *toc_chunk = riot_wad_find_chunk(ctx, toc_path_hash);
+	if (!toc_chunk) return true;
+
+	if (!io) return riot_wad_ctx_load_subchunk_toc(ctx, dec, toc_path_hash);
+
+	u32 idx = toc_chunk - (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+
+	struct mem_stream src, toc;
+	return riot_wad_io_read(io, ctx, &idx, 1, &src) &&
+		riot_wad_chunk_decompress_data(dec, ctx, toc_chunk, src, NULL, 0, &toc) &&
+		riot_wad_ctx_read_subchunk_toc(ctx, toc);
+}
+
+static int
+wad_extract_cmp(void const *lhs, void const *rhs) {
+	u64 a = *(u64 const *)lhs, b = *(u64 const *)rhs;
+
+	return (a > b) - (a < b);
+}
+
+static b32
+names_load(struct opts *opts, struct riot_thread_pool *pool, struct riot_hash_dict *names) {
+	assert(opts);
+	assert(names);
+
+	if (!riot_hash_dict_init(names)) {
+		errlog("Failed to initialise hash dictionary");
+		return false;
+	}
+
+	if (opts->hashes && !riot_hash_dict_load(names, opts->hashes, pool)) {
+		errlog("Failed to load hash list: %s", opts->hashes);
+		riot_hash_dict_free(names);
+		return false;
+	}
+
+	return true;
+}
+
+static b32
+wad_open(struct riot_wad_ctx *ctx, struct opts *opts) {
+	if (opts->cache)
+		return riot_wad_open_cached(ctx, opts->src, opts->cache);
+
+	return riot_wad_open_mapped(ctx, opts->src);
+}
+
 static s32
 wad_dump(struct opts *opts) {
 	assert(opts);
 
-	u8 *filebuf;
-	u64 filelen = read_file(opts->src, &filebuf);
-	if (!filelen) {
-		errlog("Failed to read source file: %s", opts->src);
+	s32 res = 1;
+
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx)) {
+		errlog("Failed to initialise WAD context");
 		return 1;
 	}
 
-	struct mem_stream in = {
-		.ptr = filebuf,
-		.len = filelen,
-		.cur = 0,
-	};
+	if (!wad_open(&ctx, opts)) {
+		errlog("Failed to read WAD file: %s", opts->src);
+		goto ctx_cleanup;
+	}
+
+	u32 threads = opts->threads ? opts->threads : riot_thread_pool_default_thread_count();
+
+	struct riot_thread_pool pool;
+	if (!riot_thread_pool_init(&pool, threads)) {
+		errlog("Failed to initialise thread pool (%u threads)", threads);
+		goto ctx_cleanup;
+	}
+
+	struct riot_hash_dict names;
+	if (!names_load(opts, &pool, &names))
+		goto pool_cleanup;
+
+	riot_wad_print(&ctx, &names, stdout);
+
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) {
+		errlog("Failed to initialise output writer");
+		goto names_cleanup;
+	}
+
+	void *wad_data_buf = ctx.src.ptr + ctx.wad.data_start;
+	u64 wad_data_len = ctx.src.len - ctx.wad.data_start;
+	if (!riot_wad_write(&ctx, wad_data_buf, wad_data_len, &pool, &out)) {
+		errlog("Failed to write WAD file");
+		goto out_cleanup;
+	}
+
+	fprintf(stdout, "WAD written: %lu bytes (source: %lu bytes)\n", out.len, ctx.src.len);
+
+	int fd = open(opts->dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		errlog("Failed to open destination file: %s", opts->dst);
+		goto out_cleanup;
+	}
+
+	b32 flushed = riot_writer_flush(&out, fd);
+	if (close(fd) < 0 || !flushed) {
+		errlog("Failed to write destination file: %s", opts->dst);
+		goto out_cleanup;
+	}
+
+	res = 0;
+
+out_cleanup:
+	riot_writer_free(&out);
+names_cleanup:
+	riot_hash_dict_free(&names);
+pool_cleanup:
+	riot_thread_pool_free(&pool);
+ctx_cleanup:
+	riot_wad_ctx_free(&ctx);
+
+	return res;
+}
+
+/* compressed bytes read in per batch when extracting through a
+ * `struct riot_wad_io` rather than from a mapping
+ */
+#define WAD_EXTRACT_BATCH_SZ 64 * MiB
+
+/* orders `count` chunk indices in `order` largest first, so that no worker
+ * picks up a huge chunk just as everyone else runs out of work. the sort key
+ * packs the inverted size above the chunk index
+ */
+static void
+wad_extract_order(struct riot_wad_ctx *ctx, u64 *keys, u32 *order, u32 count) {
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	for (u32 i = 0; i < count; i++)
+		keys[i] = ((u64)~chunks[order[i]].decompressed_size << 32) | order[i];
+
+	qsort(keys, count, sizeof *keys, wad_extract_cmp);
+
+	for (u32 i = 0; i < count; i++)
+		order[i] = (u32)keys[i];
+}
+
+/* walks the archive in data offset order, reading each batch of payloads in
+ * one go before handing it to the workers to decompress and write out
+ */
+static void
+wad_extract_batches(struct wad_extract_job *job, struct riot_wad_io *io, struct riot_thread_pool *pool,
+		    u64 *keys, struct mem_stream *data) {
+	struct riot_wad_ctx *ctx = job->ctx;
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	u32 count = ctx->wad.chunk_count;
+
+	for (u32 i = 0; i < count; i++)
+		keys[i] = ((u64)chunks[i].data_offset << 32) | i;
+
+	qsort(keys, count, sizeof *keys, wad_extract_cmp);
+
+	u32 *order = job->order;
+	for (u32 i = 0; i < count; i++)
+		order[i] = (u32)keys[i];
+
+	for (u32 start = 0, end; start < count; start = end) {
+		u64 len = chunks[order[start]].compressed_size;
+		for (end = start + 1; end < count && len + chunks[order[end]].compressed_size <= WAD_EXTRACT_BATCH_SZ; end++)
+			len += chunks[order[end]].compressed_size;
+
+		u32 batch = end - start;
+		wad_extract_order(ctx, keys, order + start, batch);
+
+		u32 narrow = wad_extract_split(ctx, order + start, batch, keys);
+
+		if (!riot_wad_io_read(io, ctx, order + start, batch, data)) {
+			errlog("Failed to read WAD chunks %u-%u/%u", start + 1, end, count);
+			atomic_fetch_add(&job->failures, batch);
+			continue;
+		}
+
+		struct wad_extract_job batch_job = *job;
+		batch_job.order = order + start;
+		batch_job.data = data;
+		atomic_init(&batch_job.failures, 0);
+
+		wad_extract_run(&batch_job, pool, batch, narrow);
+
+		atomic_fetch_add(&job->failures, atomic_load(&batch_job.failures));
+	}
+}
+
+static s32
+wad_extract(struct opts *opts) {
+	assert(opts);
+
+	s32 res = 1;
 
 	struct riot_wad_ctx ctx;
 	if (!riot_wad_ctx_init(&ctx)) {
 		errlog("Failed to initialise WAD context");
-		free(filebuf);
 		return 1;
 	}
 
-	if (!riot_wad_read(&ctx, in)) {
-		errlog("Failed to read WAD file");
-		riot_wad_ctx_free(&ctx);
-		free(filebuf);
-		return 1;
+	if (mkdir(opts->dst, 0755) < 0 && errno != EEXIST) {
+		errlog("Failed to create destination directory: %s", opts->dst);
+		goto ctx_cleanup;
+	}
+
+	u32 threads = opts->threads ? opts->threads : riot_thread_pool_default_thread_count();
+
+	struct riot_thread_pool pool;
+	if (!riot_thread_pool_init(&pool, threads)) {
+		errlog("Failed to initialise thread pool (%u threads)", threads);
+		goto ctx_cleanup;
+	}
+
+	struct riot_wad_io io;
+	b32 opened = opts->io
+		? riot_wad_io_open(&io, &ctx, opts->src, opts->io_depth, &pool)
+		: wad_open(&ctx, opts);
+
+	if (!opened) {
+		errlog("Failed to read WAD file: %s", opts->src);
+		goto pool_cleanup;
+	}
+
+	struct riot_hash_dict names;
+	if (!names_load(opts, &pool, &names))
+		goto io_cleanup;
+
+	struct riot_wad_decompressor *decompressors = calloc(threads, sizeof *decompressors);
+	u64 *keys = malloc(ctx.wad.chunk_count * sizeof *keys);
+	u32 *order = malloc(ctx.wad.chunk_count * sizeof *order);
+	struct mem_stream *data = opts->io ? malloc(ctx.wad.chunk_count * sizeof *data) : NULL;
+	if (!decompressors || !keys || !order || (opts->io && !data)) {
+		errlog("Failed to allocate extraction state");
+		goto job_cleanup;
 	}
 
-	riot_wad_print(&ctx, stdout);
+	u32 initialised = 0;
+	for (; initialised < threads; initialised++) {
+		if (!riot_wad_decompressor_init(&decompressors[initialised])) {
+			errlog("Failed to initialise decompressor %u/%u", initialised + 1, threads);
+			goto decompressor_cleanup;
+		}
+	}
+
+	if (!wad_load_subchunk_toc(&ctx, &decompressors[0], opts->io ? &io : NULL, opts->src)) {
+		errlog("Failed to load WAD sub-chunk table of contents");
+		goto decompressor_cleanup;
+	}
+
+	if (threads > 1 && !riot_wad_decompressor_set_workers(&decompressors[0], &pool)) {
+		errlog("Failed to set up parallel sub-chunk decoding");
+		goto decompressor_cleanup;
+	}
 
-	struct mem_stream out = {
-		.ptr = filebuf,
-		.len = filelen,
-		.cur = 0,
+	struct wad_extract_job job = {
+		.ctx = &ctx,
+		.names = &names,
+		.decompressors = decompressors,
+		.order = order,
+		.data = NULL,
+		.dir = opts->dst,
 	};
 
-	void *wad_data_buf = filebuf + ctx.wad.data_start;
-	u64 wad_data_len = filelen - ctx.wad.data_start;
-	if (!riot_wad_write(&ctx, wad_data_buf, wad_data_len, out)) {
-		errlog("Failed to write WAD file");
-		riot_wad_ctx_free(&ctx);
-		free(filebuf);
-		return 1;
+	atomic_init(&job.failures, 0);
+
+	if (opts->io) {
+		wad_extract_batches(&job, &io, &pool, keys, data);
+	} else {
+		for (u32 i = 0; i < ctx.wad.chunk_count; i++)
+			order[i] = i;
+
+		wad_extract_order(&ctx, keys, order, ctx.wad.chunk_count);
+
+		u32 narrow = wad_extract_split(&ctx, order, ctx.wad.chunk_count, keys);
+		wad_extract_run(&job, &pool, ctx.wad.chunk_count, narrow);
+	}
+
+	u32 failures = atomic_load(&job.failures);
+	if (failures) {
+		errlog("Failed to extract %u/%u chunks", failures, ctx.wad.chunk_count);
+	} else {
+		res = 0;
 	}
 
+decompressor_cleanup:
+	for (u32 i = 0; i < initialised; i++)
+		riot_wad_decompressor_free(&decompressors[i]);
+job_cleanup:
+	free(data);
+	free(order);
+	free(keys);
+	free(decompressors);
+	riot_hash_dict_free(&names);
+io_cleanup:
+	if (opts->io)
+		riot_wad_io_close(&io);
+pool_cleanup:
+	riot_thread_pool_free(&pool);
+ctx_cleanup:
 	riot_wad_ctx_free(&ctx);
 
-	u64 written = write_file(opts->dst, filelen, filebuf);
-	if (!written || written < filelen) {
-		errlog("Failed to write destination file: %s", opts->dst);
-		free(filebuf);
+	return res;
+}
+
+static s32
+wad_verify(struct opts *opts) {
+	assert(opts);
+
+	s32 res = 1;
+
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx)) {
+		errlog("Failed to initialise WAD context");
 		return 1;
 	}
 
-	free(filebuf);
+	if (!wad_open(&ctx, opts)) {
+		errlog("Failed to read WAD file: %s", opts->src);
+		goto ctx_cleanup;
+	}
+
+	FILE *report = strcmp(opts->dst, "-") == 0 ? stdout : fopen(opts->dst, "w");
+	if (!report) {
+		errlog("Failed to open report file: %s", opts->dst);
+		goto ctx_cleanup;
+	}
+
+	u32 threads = opts->threads ? opts->threads : riot_thread_pool_default_thread_count();
+
+	struct riot_thread_pool pool;
+	if (!riot_thread_pool_init(&pool, threads)) {
+		errlog("Failed to initialise thread pool (%u threads)", threads);
+		goto report_cleanup;
+	}
+
+	u64 *computed = malloc(ctx.wad.chunk_count * sizeof *computed);
+	if (!computed) {
+		errlog("Failed to allocate checksum buffer");
+		goto pool_cleanup;
+	}
+
+	u32 mismatches;
+	if (!riot_wad_verify_checksums(&ctx, &pool, computed, &mismatches)) {
+		errlog("Failed to verify WAD chunk checksums");
+		goto computed_cleanup;
+	}
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx.chunk_pool.ptr;
+	for (u32 i = 0; i < ctx.wad.chunk_count; i++) {
+		if (chunks[i].checksum == computed[i]) continue;
+
+		fprintf(report, "Checksum mismatch: path_hash=0x%016lx,stored=0x%016lx,computed=0x%016lx\n",
+			chunks[i].path_hash, chunks[i].checksum, computed[i]);
+	}
+
+	struct riot_wad_decompressor dec;
+	if (!riot_wad_decompressor_init(&dec)) {
+		errlog("Failed to initialise decompressor");
+		goto computed_cleanup;
+	}
+
+	if (!wad_load_subchunk_toc(&ctx, &dec, NULL, opts->src) ||
+	    (threads > 1 && !riot_wad_decompressor_set_workers(&dec, &pool))) {
+		errlog("Failed to set up sub-chunk decoding");
+		goto decompressor_cleanup;
+	}
+
+	/* the checksums only cover stored bytes, so zstd-chunked entries are
+	 * decoded as well, which checks their sub-chunk layout. large ones are
+	 * spread across the pool
+	 */
+	u32 broken = 0;
+	for (u32 i = 0; i < ctx.wad.chunk_count; i++) {
+		if (chunks[i].compression != RIOT_WAD_COMPRESSION_ZSTD_CHUNK) continue;
+
+		struct mem_stream data;
+		if (riot_wad_chunk_decompress(&dec, &ctx, &chunks[i], NULL, 0, &data)) continue;
+
+		fprintf(report, "Sub-chunk decode failure: path_hash=0x%016lx\n", chunks[i].path_hash);
+		broken++;
+	}
+
+	fprintf(report, "Verified %u chunks, %u mismatches, %u undecodable\n", ctx.wad.chunk_count,
+		mismatches, broken);
+	fflush(report);
+
+	res = mismatches || broken ? 1 : 0;
+
+decompressor_cleanup:
+	riot_wad_decompressor_free(&dec);
+computed_cleanup:
+	free(computed);
+pool_cleanup:
+	riot_thread_pool_free(&pool);
+report_cleanup:
+	if (report != stdout) fclose(report);
+ctx_cleanup:
+	riot_wad_ctx_free(&ctx);
+
+	return res;
+}
+
+/* nftw() offers no user pointer, so the directory walk collects into these */
+static char **pack_paths;
+static u32 pack_path_count, pack_path_cap;
+
+static int
+pack_collect(char const *path, struct stat const *st, int type, struct FTW *ftw) {
+	(void) st;
+	(void) ftw;
+
+	if (type != FTW_F) return 0;
+
+	if (pack_path_count == pack_path_cap) {
+		u32 cap = pack_path_cap ? pack_path_cap * 2 : 1024;
+		char **paths = realloc(pack_paths, cap * sizeof *paths);
+		if (!paths) return -1;
+
+		pack_paths = paths;
+		pack_path_cap = cap;
+	}
+
+	char *copy = strdup(path);
+	if (!copy) return -1;
+
+	pack_paths[pack_path_count++] = copy;
 
 	return 0;
 }
 
+static void
+pack_paths_free(void) {
+	for (u32 i = 0; i < pack_path_count; i++)
+		free(pack_paths[i]);
+
+	free(pack_paths);
+	pack_paths = NULL;
+	pack_path_count = pack_path_cap = 0;
+}
+
+/* the path hash for a packed file: files named by a bare hash (as written by
+ * `extract` for chunks without a known name) keep that hash, and everything
+ * else is hashed by its path relative to the source directory
+ */
+static xxh64_u64
+pack_path_hash(char const *dir, char const *path) {
+	u64 prefix_len = strlen(dir);
+	while (prefix_len > 1 && dir[prefix_len - 1] == '/')
+		prefix_len--;
+
+	char const *relpath = path + prefix_len;
+	while (*relpath == '/') relpath++;
+
+	u64 len = strlen(relpath);
+
+	if (len == 16 && strspn(relpath, "0123456789abcdef") == len)
+		return strtoull(relpath, NULL, 16);
+
+	return riot_wad_path_hash(relpath, len);
+}
+
 static s32
-inibin_dump(struct opts *opts) {
+wad_pack(struct opts *opts) {
 	assert(opts);
 
-	u8 *filebuf;
-	u64 filelen = read_file(opts->src, &filebuf);
-	if (!filelen) {
-		errlog("Failed to read source file: %s", opts->src);
-		return 1;
+	s32 res = 1;
+
+	if (nftw(opts->src, pack_collect, 64, FTW_PHYS) != 0) {
+		errlog("Failed to walk source directory: %s", opts->src);
+		goto paths_cleanup;
 	}
 
-	struct mem_stream in = {
-		.ptr = filebuf,
-		.len = filelen,
-		.cur = 0,
-	};
+	int fd = open(opts->dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		errlog("Failed to open destination file: %s", opts->dst);
+		goto paths_cleanup;
+	}
+
+	u32 threads = opts->threads ? opts->threads : riot_thread_pool_default_thread_count();
+
+	struct riot_thread_pool pool;
+	if (!riot_thread_pool_init(&pool, threads)) {
+		errlog("Failed to initialise thread pool (%u threads)", threads);
+		goto fd_cleanup;
+	}
+
+	struct riot_wad_builder builder;
+	if (!riot_wad_builder_init(&builder, fd, pack_path_count, &pool)) {
+		errlog("Failed to initialise WAD builder");
+		goto pool_cleanup;
+	}
+
+	for (u32 i = 0; i < pack_path_count; i++) {
+		xxh64_u64 path_hash = pack_path_hash(opts->src, pack_paths[i]);
+		if (!riot_wad_builder_add_file(&builder, path_hash, pack_paths[i])) {
+			errlog("Failed to pack files into WAD file: %s", opts->dst);
+			goto builder_cleanup;
+		}
+	}
+
+	if (!riot_wad_builder_finish(&builder)) {
+		errlog("Failed to finish WAD file: %s", opts->dst);
+		goto builder_cleanup;
+	}
+
+	printf("WAD packed: %u chunks, %lu bytes\n", builder.ctx.wad.chunk_count, builder.data_cur);
+
+	res = 0;
+
+builder_cleanup:
+	riot_wad_builder_free(&builder);
+pool_cleanup:
+	riot_thread_pool_free(&pool);
+fd_cleanup:
+	close(fd);
+paths_cleanup:
+	pack_paths_free();
+
+	return res;
+}
+
+static s32
+wad_patch(struct opts *opts) {
+	assert(opts);
+
+	s32 res = 1;
+
+	if (nftw(opts->src, pack_collect, 64, FTW_PHYS) != 0) {
+		errlog("Failed to walk source directory: %s", opts->src);
+		goto paths_cleanup;
+	}
+
+	struct riot_wad_patch patch;
+	if (!riot_wad_patch_open(&patch, opts->dst)) {
+		errlog("Failed to open WAD file for patching: %s", opts->dst);
+		goto paths_cleanup;
+	}
+
+	u64 patched_bytes = 0;
+	for (u32 i = 0; i < pack_path_count; i++) {
+		struct stat st;
+		if (stat(pack_paths[i], &st) < 0) {
+			errlog("Failed to stat file: %s", pack_paths[i]);
+			goto patch_cleanup;
+		}
+
+		u8 *filebuf = NULL;
+		if (st.st_size && read_file(pack_paths[i], &filebuf) < (u64)st.st_size) {
+			errlog("Failed to read file: %s", pack_paths[i]);
+			goto patch_cleanup;
+		}
+
+		b32 ok = riot_wad_patch_put(&patch, pack_path_hash(opts->src, pack_paths[i]), filebuf, st.st_size);
+		free(filebuf);
+
+		if (!ok) {
+			errlog("Failed to patch file: %s", pack_paths[i]);
+			goto patch_cleanup;
+		}
+
+		patched_bytes += st.st_size;
+	}
+
+	if (!riot_wad_patch_commit(&patch)) {
+		errlog("Failed to commit WAD patch: %s", opts->dst);
+		goto patch_cleanup;
+	}
+
+	printf("WAD patched: %u files (%lu bytes), %u chunks, %lu bytes\n",
+	       pack_path_count, patched_bytes, patch.ctx.wad.chunk_count, patch.file_len);
+
+	res = 0;
+
+patch_cleanup:
+	riot_wad_patch_close(&patch);
+paths_cleanup:
+	pack_paths_free();
+
+	return res;
+}
+
+static s32
+inibin_dump(struct opts *opts) {
+	assert(opts);
 
 	struct riot_inibin_ctx ctx;
 	if (!riot_inibin_ctx_init(&ctx)) {
 		errlog("Failed to initialise INIBIN context");
-		free(filebuf);
 		return 1;
 	}
 
-	if (!riot_inibin_read(&ctx, in)) {
-		errlog("Failed to read INIBIN file");
+	/* strings stay borrowed from the mapping, which the ctx owns */
+	if (!riot_inibin_open_mapped(&ctx, opts->src)) {
+		errlog("Failed to read INIBIN file: %s", opts->src);
+		riot_inibin_ctx_free(&ctx);
+		return 1;
+	}
+
+	struct riot_hash_dict names;
+	if (!names_load(opts, NULL, &names)) {
 		riot_inibin_ctx_free(&ctx);
-		free(filebuf);
 		return 1;
 	}
 
-	riot_inibin_print(&ctx, stdout);
+	riot_inibin_print(&ctx, &names, stdout);
 
-	struct mem_stream out = {
-		.ptr = filebuf,
-		.len = filelen,
-		.cur = 0,
-	};
+	riot_hash_dict_free(&names);
 
-	if (!riot_inibin_write(&ctx, out)) {
-		errlog("Failed to write INIBIN file");
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) {
+		errlog("Failed to initialise output writer");
 		riot_inibin_ctx_free(&ctx);
-		free(filebuf);
 		return 1;
 	}
 
-	riot_inibin_ctx_free(&ctx);
+	if (!riot_inibin_write(&ctx, &out)) {
+		errlog("Failed to write INIBIN file");
+		riot_writer_free(&out);
+		riot_inibin_ctx_free(&ctx);
+		return 1;
+	}
 
-	u64 written = write_file(opts->dst, filelen, filebuf);
-	if (!written || written < filelen) {
+	/* the ctx outlives the flush, as output segments may borrow from it */
+	int fd = open(opts->dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	b32 flushed = fd >= 0 && riot_writer_flush(&out, fd);
+	if (fd < 0 || close(fd) < 0 || !flushed) {
 		errlog("Failed to write destination file: %s", opts->dst);
-		free(filebuf);
+		riot_writer_free(&out);
+		riot_inibin_ctx_free(&ctx);
 		return 1;
 	}
 
-	free(filebuf);
+	riot_writer_free(&out);
+	riot_inibin_ctx_free(&ctx);
 
 	return 0;
 }
 
+/* the report goes to stderr, as stdout may be the destination of a dump */
+static void
+print_stats(char const *mode, s32 res, u64 elapsed_ns) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) < 0)
+		memset(&usage, 0, sizeof usage);
+
+	fprintf(stderr, "{\"mode\":\"%s\",\"status\":%d,\"elapsed_ns\":%lu,\"max_rss_kib\":%ld,\"counters\":",
+		mode, res, elapsed_ns, usage.ru_maxrss);
+	riot_stats_print_json(stderr);
+	fprintf(stderr, "}\n");
+}
+
+static b32
+write_trace(char const *path) {
+	riot_trace_stop();
+
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		errlog("Failed to open trace file: %s", path);
+		return false;
+	}
+
+	b32 res = riot_trace_write_json(fp);
+	if (fclose(fp) != 0) res = false;
+
+	if (!res) errlog("Failed to write trace file: %s", path);
+
+	return res;
+}
+
 s32
 main(s32 argc, char **argv) {
 	dbglog("Version: " BRZESZCZOT_VERSION);
@@ -180,15 +864,46 @@ main(s32 argc, char **argv) {
 	struct opts opts;
 	if (!argparse(argc, argv, &opts)) return 1;
 
+	if (opts.trace) riot_trace_start();
+
+	u64 start = riot_stats_clock();
+
+	s32 res;
 	switch (opts.mode) {
 	case WAD_DUMP:
-		return wad_dump(&opts);
+		res = wad_dump(&opts);
+		break;
 
 	case INIBIN_DUMP:
-		return inibin_dump(&opts);
+		res = inibin_dump(&opts);
+		break;
+
+	case WAD_EXTRACT:
+		res = wad_extract(&opts);
+		break;
+
+	case WAD_VERIFY:
+		res = wad_verify(&opts);
+		break;
+
+	case WAD_PACK:
+		res = wad_pack(&opts);
+		break;
+
+	case WAD_PATCH:
+		res = wad_patch(&opts);
+		break;
 
 	default:
 		errlog("Unknown mode: %d", opts.mode);
 		return 1;
 	}
+
+	if (opts.stats)
+		print_stats(argv[3], res, riot_stats_clock() - start);
+
+	if (opts.trace && !write_trace(opts.trace))
+		res = res ? res : 1;
+
+	return res;
 }
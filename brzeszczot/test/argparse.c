@@ -0,0 +1,85 @@
+#include "test.h"
+
+#include "brzeszczot/argparse.h"
+
+#define TEST_ARGC(argv) ((s32)(sizeof (argv) / sizeof (argv)[0]))
+
+static s32
+test_argparse_defaults(void) {
+	char *argv[] = { "brzeszczot", "in.wad", "out.wad", "wad", };
+
+	struct opts opts;
+	TEST_ASSERT(argparse(TEST_ARGC(argv), argv, &opts), "failed to parse arguments");
+
+	TEST_ASSERT(opts.mode == WAD_DUMP, "wrong mode");
+	TEST_ASSERT(strcmp(opts.src, "in.wad") == 0 && strcmp(opts.dst, "out.wad") == 0, "wrong files");
+	TEST_ASSERT(!opts.hashes && !opts.cache && !opts.trace, "unexpected optional files");
+	TEST_ASSERT(!opts.threads && !opts.io_depth && !opts.io && !opts.stats, "unexpected options");
+	TEST_PASS()
+}
+
+static s32
+test_argparse_options(void) {
+	char *argv[] = {
+		"brzeszczot", "in.bin", "out.bin", "inibin",
+		"-j", "8", "-H", "hashes.txt", "-C", "toc.cache", "-A", "64", "-T", "trace.json", "--stats",
+	};
+
+	struct opts opts;
+	TEST_ASSERT(argparse(TEST_ARGC(argv), argv, &opts), "failed to parse arguments");
+
+	TEST_ASSERT(opts.mode == INIBIN_DUMP, "wrong mode");
+	TEST_ASSERT(opts.threads == 8, "wrong thread count");
+	TEST_ASSERT(opts.hashes && strcmp(opts.hashes, "hashes.txt") == 0, "wrong hash list");
+	TEST_ASSERT(opts.cache && strcmp(opts.cache, "toc.cache") == 0, "wrong toc cache");
+	TEST_ASSERT(opts.io && opts.io_depth == 64, "wrong io depth");
+	TEST_ASSERT(opts.trace && strcmp(opts.trace, "trace.json") == 0, "wrong trace file");
+	TEST_ASSERT(opts.stats, "stats not enabled");
+	TEST_PASS()
+}
+
+static s32
+test_argparse_modes(void) {
+	char const *names[] = { "wad", "inibin", "extract", "verify", "pack", "patch", };
+	enum brzeszczot_mode modes[] = { WAD_DUMP, INIBIN_DUMP, WAD_EXTRACT, WAD_VERIFY, WAD_PACK, WAD_PATCH, };
+
+	for (u32 i = 0; i < sizeof modes / sizeof modes[0]; i++) {
+		char *argv[] = { "brzeszczot", "src", "dst", (char *)names[i], };
+
+		struct opts opts;
+		TEST_ASSERT(argparse(TEST_ARGC(argv), argv, &opts) && opts.mode == modes[i], names[i]);
+	}
+
+	TEST_PASS()
+}
+
+static s32
+test_argparse_invalid(void) {
+	char *too_few[] = { "brzeszczot", "src", "dst", };
+	char *bad_mode[] = { "brzeszczot", "src", "dst", "unwad", };
+	char *bad_threads[] = { "brzeszczot", "src", "dst", "wad", "-j", "0", };
+	char *bad_depth[] = { "brzeszczot", "src", "dst", "wad", "-A", "4097", };
+	char *missing_value[] = { "brzeszczot", "src", "dst", "wad", "-H", };
+	char *unknown[] = { "brzeszczot", "src", "dst", "wad", "--fast", };
+
+	struct opts opts;
+	TEST_ASSERT(!argparse(TEST_ARGC(too_few), too_few, &opts), "missing mode accepted");
+	TEST_ASSERT(!argparse(TEST_ARGC(bad_mode), bad_mode, &opts), "unknown mode accepted");
+	TEST_ASSERT(!argparse(TEST_ARGC(bad_threads), bad_threads, &opts), "zero threads accepted");
+	TEST_ASSERT(!argparse(TEST_ARGC(bad_depth), bad_depth, &opts), "io depth over limit accepted");
+	TEST_ASSERT(!argparse(TEST_ARGC(missing_value), missing_value, &opts), "option without value accepted");
+	TEST_ASSERT(!argparse(TEST_ARGC(unknown), unknown, &opts), "unknown option accepted");
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_argparse_defaults)
+	TEST_RUN(test_argparse_options)
+	TEST_RUN(test_argparse_modes)
+	TEST_RUN(test_argparse_invalid)
+
+	TESTS_END()
+}
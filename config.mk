@@ -14,6 +14,7 @@ BIN		:= bin
 OBJ		:= obj
 LIB		:= lib
 TST		:= $(BIN)/tests
+BNC		:= $(BIN)/bench
 
 $(BIN):
 	@mkdir -p $(BIN)
@@ -27,6 +28,9 @@ $(LIB):
 $(TST): $(BIN)
 	@mkdir -p $(TST)
 
+$(BNC): $(BIN)
+	@mkdir -p $(BNC)
+
 ## project-wide includes
 INC		:= include
 
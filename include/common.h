@@ -65,7 +65,7 @@ typedef double f64;
 
 #define BITS_SET(value, mask) (((value) & mask) == (mask))
 
-#define RELPTR_MASK(relptr_ty) ((relptr_ty)1 << ((sizeof(relptr_ty) * 8) - 1))
+#define RELPTR_MASK(relptr_ty) ((relptr_ty)((u64)1 << ((sizeof(relptr_ty) * 8) - 1)))
 #define RELPTR_NULL (0)
 
 #define RELPTR_ENC(relptr_ty, ptroff) \
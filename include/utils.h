@@ -28,6 +28,17 @@ struct mem_stream {
 	u64 cur, len;
 };
 
+enum mem_resize_kind {
+	MEM_RESIZE_STREAM,
+	MEM_RESIZE_POOL,
+};
+
+/* observer of every successful stream and pool resize, from and to the given
+ * capacities in bytes. defined by the library linking these helpers in, which
+ * may leave it NULL
+ */
+extern void (*mem_resize_hook)(enum mem_resize_kind kind, u64 from, u64 to);
+
 static inline bool
 mem_stream_eof(struct mem_stream *self) {
 	assert(self);
@@ -82,6 +93,8 @@ mem_stream_resize(struct mem_stream *self, u64 capacity) {
 	u8 *ptr = realloc(self->ptr, capacity);
 	if (!ptr) return false;
 
+	if (mem_resize_hook) mem_resize_hook(MEM_RESIZE_STREAM, self->len, capacity);
+
 	self->ptr = ptr;
 	self->len = capacity;
 
@@ -93,7 +106,7 @@ mem_stream_push(struct mem_stream *self, void *buf, u64 len) {
 	assert(self);
 	assert(buf);
 
-	if (self->len - self->cur < len && !mem_stream_resize(self, self->cur + len))
+	if (self->len - self->cur < len && !mem_stream_resize(self, MAX(self->cur + len, 2 * self->len)))
 		return 0;
 
 	memcpy(self->ptr + self->cur, buf, len);
@@ -114,10 +127,14 @@ mem_pool_resize(struct mem_pool *self, u64 alignment, u64 capacity) {
 #ifdef _WIN32
 	u8 *ptr = _aligned_realloc(self->ptr, capacity, alignment);
 #else
+	(void) alignment;
+
 	u8 *ptr = realloc(self->ptr, capacity);
 #endif
 	if (!ptr) return false;
 
+	if (mem_resize_hook) mem_resize_hook(MEM_RESIZE_POOL, self->cap, capacity);
+
 	self->ptr = ptr;
 	self->cap = capacity;
 
@@ -170,8 +187,11 @@ static inline bool
 mem_pool_prealloc(struct mem_pool *self, u64 alignment, u64 size) {
 	assert(self);
 
+	/* capacity at least doubles on every resize, so that pushing many
+	 * small allocations stays amortised linear
+	 */
 	return self->len + size <= self->cap ||
-		mem_pool_resize(self, alignment, self->len + size);
+		mem_pool_resize(self, alignment, MAX(self->len + size, 2 * self->cap));
 }
 
 static inline void *
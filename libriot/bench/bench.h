@@ -0,0 +1,83 @@
+#ifndef LIBRIOT_BENCH_H
+#define LIBRIOT_BENCH_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+
+#include <time.h>
+
+/* shared scaffolding of the benchmarks: a clock, a deterministic prng,
+ * `key=value` options, and result reporting. every result is printed as a
+ * single json object per line on stdout, so runs can be collected and
+ * compared mechanically
+ */
+
+static inline f64
+bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* splitmix64, seeded per benchmark so that corpora are reproducible */
+struct bench_rng {
+	u64 state;
+};
+
+static inline u64
+bench_rng_next(struct bench_rng *rng) {
+	u64 z = (rng->state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* uniform in [0, bound) */
+static inline u64
+bench_rng_below(struct bench_rng *rng, u64 bound) {
+	return bound ? bench_rng_next(rng) % bound : 0;
+}
+
+/* uniform in [0, 1) */
+static inline f64
+bench_rng_unit(struct bench_rng *rng) {
+	return (bench_rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+/* looks up `key=value` among the arguments, falling back to `fallback` */
+static inline char const *
+bench_opt_str(s32 argc, char **argv, char const *key, char const *fallback) {
+	u64 len = strlen(key);
+	for (s32 i = 1; i < argc; i++) {
+		if (strncmp(argv[i], key, len) == 0 && argv[i][len] == '=')
+			return argv[i] + len + 1;
+	}
+
+	return fallback;
+}
+
+static inline u64
+bench_opt_u64(s32 argc, char **argv, char const *key, u64 fallback) {
+	char const *val = bench_opt_str(argc, argv, key, NULL);
+	return val ? strtoull(val, NULL, 0) : fallback;
+}
+
+static inline void
+bench_report(char const *bench, char const *name, u64 iters, u64 bytes, f64 elapsed, u64 sink) {
+	elapsed = MAX(elapsed, 1e-9);
+
+	printf("{\"bench\":\"%s\",\"case\":\"%s\",\"iters\":%lu,\"bytes\":%lu,\"seconds\":%.6f,"
+	       "\"mib_per_s\":%.2f,\"ops_per_s\":%.1f,\"sink\":\"%016lx\"}\n",
+	       bench, name, iters, bytes, elapsed,
+	       bytes / elapsed / (1024.0 * 1024.0), iters / elapsed, sink);
+}
+
+/* reported in place of a result for cases the library cannot run yet */
+static inline void
+bench_report_skip(char const *bench, char const *name, char const *reason) {
+	printf("{\"bench\":\"%s\",\"case\":\"%s\",\"skipped\":\"%s\"}\n", bench, name, reason);
+}
+
+#endif /* LIBRIOT_BENCH_H */
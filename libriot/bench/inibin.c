@@ -0,0 +1,506 @@
+#include "libriot/inibin.h"
+
+#include "bench.h"
+
+/* reading and writing of a synthetic property tree (`PROP` v3). the corpus
+ * is generated from a fixed seed, and shaped by:
+ *
+ *   seed=N      prng seed (1)
+ *   entries=N   top-level entry count (2048)
+ *   depth=N     maximum nesting depth of embedded structures and
+ *               containers (3)
+ *   fanout=N    maximum field, element and pair count per level (8)
+ *   threads=N   workers of the parallel read cases (all cores)
+ *   iters=N     passes over the corpus per case (20)
+ */
+
+#define BENCH_NAME "inibin"
+#define BENCH_CLASSES 16
+
+struct bench_corpus_opts {
+	u64 seed;
+	u32 entries, depth, fanout;
+};
+
+struct bench_corpus {
+	struct bench_corpus_opts const *opts;
+	struct bench_rng rng;
+	struct mem_stream out;
+	u32 classes[BENCH_CLASSES];
+	b32 ok;
+};
+
+static enum riot_inibin_node_type const bench_primitives[] = {
+	RIOT_INIBIN_NODE_B8, RIOT_INIBIN_NODE_S8, RIOT_INIBIN_NODE_U8, RIOT_INIBIN_NODE_S16,
+	RIOT_INIBIN_NODE_U16, RIOT_INIBIN_NODE_S32, RIOT_INIBIN_NODE_U32, RIOT_INIBIN_NODE_S64,
+	RIOT_INIBIN_NODE_U64, RIOT_INIBIN_NODE_F32, RIOT_INIBIN_NODE_FVEC2, RIOT_INIBIN_NODE_FVEC3,
+	RIOT_INIBIN_NODE_FVEC4, RIOT_INIBIN_NODE_FMAT4X4, RIOT_INIBIN_NODE_RGBA, RIOT_INIBIN_NODE_STR,
+	RIOT_INIBIN_NODE_HASH, RIOT_INIBIN_NODE_FILE, RIOT_INIBIN_NODE_LINK, RIOT_INIBIN_NODE_FLAG,
+};
+
+static enum riot_inibin_node_type const bench_containers[] = {
+	RIOT_INIBIN_NODE_LIST, RIOT_INIBIN_NODE_LIST2, RIOT_INIBIN_NODE_PTR,
+	RIOT_INIBIN_NODE_EMBED, RIOT_INIBIN_NODE_OPT, RIOT_INIBIN_NODE_MAP,
+};
+
+#define BENCH_COUNT(arr) (sizeof (arr) / sizeof *(arr))
+
+static void
+bench_emit(struct bench_corpus *corpus, void const *buf, u64 len) {
+	if (corpus->ok && len && !mem_stream_push(&corpus->out, (void *)buf, len))
+		corpus->ok = false;
+}
+
+static void
+bench_emit_u8(struct bench_corpus *corpus, u8 val) {
+	bench_emit(corpus, &val, sizeof val);
+}
+
+static void
+bench_emit_u16(struct bench_corpus *corpus, u16 val) {
+	u8 buf[sizeof val];
+	riot_store_le16(buf, val);
+	bench_emit(corpus, buf, sizeof buf);
+}
+
+static void
+bench_emit_u32(struct bench_corpus *corpus, u32 val) {
+	u8 buf[sizeof val];
+	riot_store_le32(buf, val);
+	bench_emit(corpus, buf, sizeof buf);
+}
+
+static void
+bench_emit_u64(struct bench_corpus *corpus, u64 val) {
+	u8 buf[sizeof val];
+	riot_store_le64(buf, val);
+	bench_emit(corpus, buf, sizeof buf);
+}
+
+static void
+bench_emit_f32(struct bench_corpus *corpus, struct bench_rng *rng) {
+	f32 val = (f32)(bench_rng_unit(rng) * 2048.0 - 1024.0);
+
+	u32 bits;
+	memcpy(&bits, &val, sizeof bits);
+	bench_emit_u32(corpus, bits);
+}
+
+/* reserves a u32 size prefix, to be patched by `bench_size_end()` with the
+ * number of bytes that followed it
+ */
+static u64
+bench_size_begin(struct bench_corpus *corpus) {
+	u64 pos = corpus->out.cur;
+	bench_emit_u32(corpus, 0);
+	return pos;
+}
+
+static void
+bench_size_end(struct bench_corpus *corpus, u64 pos) {
+	if (corpus->ok)
+		riot_store_le32(corpus->out.ptr + pos, corpus->out.cur - pos - sizeof(u32));
+}
+
+static enum riot_inibin_node_type
+bench_pick_type(struct bench_corpus *corpus, u32 depth) {
+	struct bench_rng *rng = &corpus->rng;
+
+	/* containers make up a quarter of the fields above the leaves */
+	if (depth && bench_rng_below(rng, 4) == 0)
+		return bench_containers[bench_rng_below(rng, BENCH_COUNT(bench_containers))];
+
+	return bench_primitives[bench_rng_below(rng, BENCH_COUNT(bench_primitives))];
+}
+
+static void
+bench_emit_fields(struct bench_corpus *corpus, u32 depth);
+
+static void
+bench_emit_value(struct bench_corpus *corpus, enum riot_inibin_node_type type, u32 depth) {
+	struct bench_rng *rng = &corpus->rng;
+	u32 fanout = corpus->opts->fanout;
+
+	switch (type) {
+	case RIOT_INIBIN_NODE_B8:
+	case RIOT_INIBIN_NODE_FLAG:
+		bench_emit_u8(corpus, bench_rng_below(rng, 2));
+		break;
+
+	case RIOT_INIBIN_NODE_S8:
+	case RIOT_INIBIN_NODE_U8:
+		bench_emit_u8(corpus, bench_rng_next(rng));
+		break;
+
+	case RIOT_INIBIN_NODE_S16:
+	case RIOT_INIBIN_NODE_U16:
+		bench_emit_u16(corpus, bench_rng_next(rng));
+		break;
+
+	case RIOT_INIBIN_NODE_S32:
+	case RIOT_INIBIN_NODE_U32:
+	case RIOT_INIBIN_NODE_HASH:
+	case RIOT_INIBIN_NODE_LINK:
+	case RIOT_INIBIN_NODE_RGBA:
+		bench_emit_u32(corpus, bench_rng_next(rng));
+		break;
+
+	case RIOT_INIBIN_NODE_S64:
+	case RIOT_INIBIN_NODE_U64:
+	case RIOT_INIBIN_NODE_FILE:
+		bench_emit_u64(corpus, bench_rng_next(rng));
+		break;
+
+	case RIOT_INIBIN_NODE_F32:
+		bench_emit_f32(corpus, rng);
+		break;
+
+	case RIOT_INIBIN_NODE_FVEC2:
+	case RIOT_INIBIN_NODE_FVEC3:
+	case RIOT_INIBIN_NODE_FVEC4:
+	case RIOT_INIBIN_NODE_FMAT4X4: {
+		u32 count = type == RIOT_INIBIN_NODE_FVEC2 ? 2
+			: type == RIOT_INIBIN_NODE_FVEC3 ? 3
+			: type == RIOT_INIBIN_NODE_FVEC4 ? 4
+			: 16;
+
+		for (u32 i = 0; i < count; i++)
+			bench_emit_f32(corpus, rng);
+	} break;
+
+	case RIOT_INIBIN_NODE_STR: {
+		char buf[32];
+		u16 len = 4 + bench_rng_below(rng, sizeof buf - 4);
+		for (u16 i = 0; i < len; i++)
+			buf[i] = i && bench_rng_below(rng, 8) == 0 ? '/' : 'a' + bench_rng_below(rng, 26);
+
+		bench_emit_u16(corpus, len);
+		bench_emit(corpus, buf, len);
+	} break;
+
+	case RIOT_INIBIN_NODE_LIST:
+	case RIOT_INIBIN_NODE_LIST2: {
+		enum riot_inibin_node_type elem = bench_rng_below(rng, 2) ? bench_pick_type(corpus, depth - 1)
+			: depth > 1 ? RIOT_INIBIN_NODE_EMBED : RIOT_INIBIN_NODE_U32;
+
+		/* nested containers are not valid list elements */
+		if (elem != RIOT_INIBIN_NODE_EMBED && elem != RIOT_INIBIN_NODE_PTR && (elem & RIOT_INIBIN_NODE_COMPLEX_TYPE_FLAG))
+			elem = RIOT_INIBIN_NODE_HASH;
+
+		bench_emit_u8(corpus, elem);
+
+		u64 size = bench_size_begin(corpus);
+		u32 count = bench_rng_below(rng, fanout + 1);
+		bench_emit_u32(corpus, count);
+
+		for (u32 i = 0; i < count; i++)
+			bench_emit_value(corpus, elem, depth - 1);
+
+		bench_size_end(corpus, size);
+	} break;
+
+	case RIOT_INIBIN_NODE_PTR:
+	case RIOT_INIBIN_NODE_EMBED: {
+		/* one null pointer in eight */
+		u32 class_hash = type == RIOT_INIBIN_NODE_PTR && bench_rng_below(rng, 8) == 0
+			? 0 : corpus->classes[bench_rng_below(rng, BENCH_CLASSES)];
+
+		bench_emit_u32(corpus, class_hash);
+		if (!class_hash) break;
+
+		u64 size = bench_size_begin(corpus);
+		bench_emit_fields(corpus, depth - 1);
+		bench_size_end(corpus, size);
+	} break;
+
+	case RIOT_INIBIN_NODE_OPT: {
+		enum riot_inibin_node_type inner = bench_pick_type(corpus, 0);
+		b32 exists = bench_rng_below(rng, 2);
+
+		bench_emit_u8(corpus, inner);
+		bench_emit_u8(corpus, exists);
+
+		if (exists)
+			bench_emit_value(corpus, inner, 0);
+	} break;
+
+	case RIOT_INIBIN_NODE_MAP: {
+		static enum riot_inibin_node_type const keys[] = {
+			RIOT_INIBIN_NODE_U32, RIOT_INIBIN_NODE_HASH, RIOT_INIBIN_NODE_STR, RIOT_INIBIN_NODE_U64,
+		};
+
+		enum riot_inibin_node_type key = keys[bench_rng_below(rng, BENCH_COUNT(keys))];
+		enum riot_inibin_node_type val = depth > 1 && bench_rng_below(rng, 2)
+			? RIOT_INIBIN_NODE_EMBED : bench_pick_type(corpus, 0);
+
+		bench_emit_u8(corpus, key);
+		bench_emit_u8(corpus, val);
+
+		u64 size = bench_size_begin(corpus);
+		u32 count = bench_rng_below(rng, fanout + 1);
+		bench_emit_u32(corpus, count);
+
+		for (u32 i = 0; i < count; i++) {
+			bench_emit_value(corpus, key, 0);
+			bench_emit_value(corpus, val, depth - 1);
+		}
+
+		bench_size_end(corpus, size);
+	} break;
+
+	case RIOT_INIBIN_NODE_NONE:
+	default:
+		corpus->ok = false;
+		break;
+	}
+}
+
+static void
+bench_emit_fields(struct bench_corpus *corpus, u32 depth) {
+	struct bench_rng *rng = &corpus->rng;
+
+	u16 count = 1 + bench_rng_below(rng, corpus->opts->fanout);
+	bench_emit_u16(corpus, count);
+
+	for (u16 i = 0; i < count; i++) {
+		enum riot_inibin_node_type type = bench_pick_type(corpus, depth);
+
+		bench_emit_u32(corpus, bench_rng_next(rng));
+		bench_emit_u8(corpus, type);
+		bench_emit_value(corpus, type, depth);
+	}
+}
+
+static b32
+bench_corpus_generate(struct bench_corpus_opts const *opts, struct mem_stream *out) {
+	struct bench_corpus corpus = {
+		.opts = opts,
+		.rng = { .state = opts->seed, },
+		.out = {0},
+		.ok = true,
+	};
+
+	for (u32 i = 0; i < BENCH_CLASSES; i++)
+		corpus.classes[i] = bench_rng_next(&corpus.rng) | 1;
+
+	bench_emit(&corpus, "PROP", 4);
+	bench_emit_u32(&corpus, 3);
+
+	/* linked files */
+	u32 links = bench_rng_below(&corpus.rng, 4);
+	bench_emit_u32(&corpus, links);
+	for (u32 i = 0; i < links; i++)
+		bench_emit_value(&corpus, RIOT_INIBIN_NODE_STR, 0);
+
+	bench_emit_u32(&corpus, opts->entries);
+	for (u32 i = 0; i < opts->entries; i++)
+		bench_emit_u32(&corpus, corpus.classes[bench_rng_below(&corpus.rng, BENCH_CLASSES)]);
+
+	for (u32 i = 0; i < opts->entries; i++) {
+		u64 size = bench_size_begin(&corpus);
+		bench_emit_u32(&corpus, bench_rng_next(&corpus.rng));
+		bench_emit_fields(&corpus, opts->depth);
+		bench_size_end(&corpus, size);
+	}
+
+	if (!corpus.ok) {
+		free(corpus.out.ptr);
+		return false;
+	}
+
+	*out = corpus.out;
+
+	return true;
+}
+
+/* `borrowed` reads leave strings as views into the corpus, rather than
+ * copying them into the ctx
+ */
+static b32
+bench_read(struct mem_stream corpus, u64 iters, char const *name, b32 borrowed,
+	   struct riot_thread_pool *workers) {
+	struct riot_inibin_ctx ctx;
+
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	for (u64 i = 0; i < iters; i++) {
+		if (!riot_inibin_ctx_init(&ctx)) return false;
+
+		b32 ok = riot_inibin_read_parallel(&ctx, corpus, borrowed, workers);
+		sink += ctx.node_pool.len + ctx.str_pool.len;
+
+		riot_inibin_ctx_free(&ctx);
+
+		if (!ok) {
+			bench_report_skip(BENCH_NAME, name, "riot_inibin_read failed");
+			return false;
+		}
+	}
+
+	bench_report(BENCH_NAME, name, iters, iters * corpus.len, bench_now() - start, sink);
+
+	return true;
+}
+
+/* the access pattern lazy opening is meant for: a handful of entries looked
+ * up by path out of the whole file
+ */
+#define BENCH_LAZY_LOOKUPS 5
+
+static void
+bench_open_lazy(struct mem_stream corpus, u64 iters) {
+	struct riot_inibin_ctx ctx;
+
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	for (u64 i = 0; i < iters; i++) {
+		if (!riot_inibin_ctx_init(&ctx)) return;
+
+		if (!riot_inibin_open_lazy(&ctx, corpus)) {
+			riot_inibin_ctx_free(&ctx);
+			bench_report_skip(BENCH_NAME, "open_lazy", "riot_inibin_open_lazy failed");
+			return;
+		}
+
+		for (u32 j = 0; j < BENCH_LAZY_LOOKUPS && ctx.entry_count; j++) {
+			u32 idx = (u64)ctx.entry_count * j / BENCH_LAZY_LOOKUPS;
+			struct riot_inibin_entry *entry =
+				riot_inibin_ctx_find_entry(&ctx, riot_inibin_ctx_entry(&ctx, idx)->path_hash);
+			sink += entry ? entry->fields.count : 0;
+		}
+
+		sink += ctx.node_pool.len;
+
+		riot_inibin_ctx_free(&ctx);
+	}
+
+	bench_report(BENCH_NAME, "open_lazy", iters, iters * corpus.len, bench_now() - start, sink);
+}
+
+/* looks up every entry by path, then every field of it by name */
+static void
+bench_find(struct mem_stream corpus, u64 iters) {
+	struct riot_inibin_ctx ctx;
+	if (!riot_inibin_ctx_init(&ctx)) return;
+
+	if (!riot_inibin_read(&ctx, corpus)) {
+		bench_report_skip(BENCH_NAME, "find", "riot_inibin_read failed");
+		goto cleanup;
+	}
+
+	u64 lookups = 0, sink = 0;
+	f64 start = bench_now();
+
+	for (u64 i = 0; i < iters; i++) {
+		for (u32 j = 0; j < ctx.entry_count; j++) {
+			struct riot_inibin_entry *entry =
+				riot_inibin_ctx_find_entry(&ctx, riot_inibin_ctx_entry(&ctx, j)->path_hash);
+			if (!entry) continue;
+
+			for (u16 k = 0; k < entry->fields.count; k++) {
+				fnv1a_u32 name_hash = riot_inibin_ctx_field(&ctx, entry->fields.root_field + k)->name_hash;
+				struct riot_inibin_field *field = riot_inibin_ctx_find_field(&ctx, &entry->fields, name_hash);
+				sink += field ? field->value : 0;
+			}
+
+			lookups += 1 + entry->fields.count;
+		}
+	}
+
+	bench_report(BENCH_NAME, "find", lookups, 0, bench_now() - start, sink);
+
+cleanup:
+	riot_inibin_ctx_free(&ctx);
+}
+
+static void
+bench_read_write(struct mem_stream corpus, u64 iters, struct riot_thread_pool *workers) {
+	corpus.len = corpus.cur;
+	corpus.cur = 0;
+
+	bench_open_lazy(corpus, iters);
+	bench_find(corpus, iters);
+
+	if (workers) {
+		(void) bench_read(corpus, iters, "read_parallel", false, workers);
+		(void) bench_read(corpus, iters, "read_borrowed_parallel", true, workers);
+	}
+
+	if (!bench_read(corpus, iters, "read", false, NULL) || !bench_read(corpus, iters, "read_borrowed", true, NULL)) {
+		bench_report_skip(BENCH_NAME, "write", "no tree to write");
+		return;
+	}
+
+	struct riot_inibin_ctx ctx;
+	if (!riot_inibin_ctx_init(&ctx)) return;
+
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) {
+		riot_inibin_ctx_free(&ctx);
+		return;
+	}
+
+	if (!riot_inibin_read(&ctx, corpus)) goto cleanup;
+
+	u64 sink = 0, bytes = 0;
+	f64 start = bench_now();
+
+	for (u64 i = 0; i < iters; i++) {
+		riot_writer_reset(&out);
+
+		if (!riot_inibin_write(&ctx, &out)) {
+			bench_report_skip(BENCH_NAME, "write", "riot_inibin_write failed");
+			goto cleanup;
+		}
+
+		bytes += out.len;
+		sink += out.len;
+	}
+
+	bench_report(BENCH_NAME, "write", iters, bytes, bench_now() - start, sink);
+
+cleanup:
+	riot_writer_free(&out);
+	riot_inibin_ctx_free(&ctx);
+}
+
+s32
+main(s32 argc, char **argv) {
+	struct bench_corpus_opts opts = {
+		.seed = bench_opt_u64(argc, argv, "seed", 1),
+		.entries = bench_opt_u64(argc, argv, "entries", 2048),
+		.depth = bench_opt_u64(argc, argv, "depth", 3),
+		.fanout = MAX(1, bench_opt_u64(argc, argv, "fanout", 8)),
+	};
+
+	u64 iters = bench_opt_u64(argc, argv, "iters", 20);
+	u32 threads = bench_opt_u64(argc, argv, "threads", riot_thread_pool_default_thread_count());
+
+	struct mem_stream corpus;
+
+	f64 start = bench_now();
+
+	if (!bench_corpus_generate(&opts, &corpus)) {
+		errlog("Failed to generate INIBIN corpus");
+		return 1;
+	}
+
+	printf("{\"bench\":\"%s\",\"corpus\":{\"seed\":%lu,\"entries\":%u,\"depth\":%u,\"fanout\":%u,"
+	       "\"bytes\":%lu}}\n",
+	       BENCH_NAME, opts.seed, opts.entries, opts.depth, opts.fanout, corpus.cur);
+
+	bench_report(BENCH_NAME, "generate", opts.entries, corpus.cur, bench_now() - start, corpus.cur);
+
+	struct riot_thread_pool pool;
+	b32 pooled = threads > 1 && riot_thread_pool_init(&pool, threads);
+
+	bench_read_write(corpus, iters, pooled ? &pool : NULL);
+
+	if (pooled) riot_thread_pool_free(&pool);
+
+	free(corpus.ptr);
+
+	return 0;
+}
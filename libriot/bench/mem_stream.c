@@ -0,0 +1,179 @@
+#include "libriot/utils.h"
+
+#include "bench.h"
+
+/* throughput of the `riot_mem_stream_{read,write}_*` primitives, against the
+ * byte-at-a-time implementation they replaced (reproduced below)
+ */
+
+#define BENCH_WORDS (16 * 1024 * 1024)
+#define BENCH_RECORDS (1024 * 1024)
+#define BENCH_RECORD_SZ 32
+
+#define LEGACY_READ_BYTES(stream, type, out) \
+do { \
+	type _tmp = 0; \
+	u8 buf; \
+	for (u64 i = 0; i < sizeof(type); i++) { \
+		if (!mem_stream_consume(stream, &buf, 1)) return false; \
+		_tmp |= ((type)buf << (i * 8)); \
+	} \
+	*out = _tmp; \
+} while (0);
+
+#define LEGACY_MAKE_READ_FN(name, type) \
+static b32 name(struct mem_stream *self, type *out) { \
+	assert(self); \
+	assert(out); \
+	LEGACY_READ_BYTES(self, type, out) \
+	return true; \
+}
+
+#define LEGACY_WRITE_BYTES(stream, type, val) \
+do { \
+	u8 buf; \
+	for (u64 i = 0; i < sizeof(type); i++) { \
+		buf = ((val >> (i * 8)) & 0xff); \
+		if (!mem_stream_push(stream, &buf, 1)) return false; \
+	} \
+} while (0);
+
+#define LEGACY_MAKE_WRITE_FN(name, type) \
+static b32 name(struct mem_stream *self, type val) { \
+	assert(self); \
+	LEGACY_WRITE_BYTES(self, type, val) \
+	return true; \
+}
+
+LEGACY_MAKE_READ_FN(legacy_read_u8, u8)
+LEGACY_MAKE_READ_FN(legacy_read_u16, u16)
+LEGACY_MAKE_READ_FN(legacy_read_u32, u32)
+LEGACY_MAKE_READ_FN(legacy_read_u64, u64)
+LEGACY_MAKE_WRITE_FN(legacy_write_u32, u32)
+
+static b32
+bench_read_u32(struct mem_stream stream, b32 (*read)(struct mem_stream *, u32 *), char const *name) {
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	u32 val;
+	for (u32 i = 0; i < BENCH_WORDS; i++) {
+		if (!read(&stream, &val)) return false;
+		sink += val;
+	}
+
+	bench_report("mem_stream", name, stream.cur / sizeof val, stream.cur, bench_now() - start, sink);
+
+	return true;
+}
+
+static b32
+bench_read_u64(struct mem_stream stream, b32 (*read)(struct mem_stream *, u64 *), char const *name) {
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	u64 val;
+	for (u32 i = 0; i < BENCH_WORDS / 2; i++) {
+		if (!read(&stream, &val)) return false;
+		sink ^= val;
+	}
+
+	bench_report("mem_stream", name, stream.cur / sizeof val, stream.cur, bench_now() - start, sink);
+
+	return true;
+}
+
+static b32
+bench_write_u32(struct mem_stream stream, b32 (*write)(struct mem_stream *, u32), char const *name) {
+	f64 start = bench_now();
+
+	for (u32 i = 0; i < BENCH_WORDS; i++) {
+		if (!write(&stream, i)) return false;
+	}
+
+	bench_report("mem_stream", name, BENCH_WORDS, stream.cur, bench_now() - start,
+		     riot_load_le64(stream.ptr + stream.cur - 8));
+
+	return true;
+}
+
+/* a wad table of contents entry, decoded field by field as the reader used
+ * to, and as a single fixed-layout record
+ */
+static b32
+bench_records_legacy(struct mem_stream stream) {
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	for (u32 i = 0; i < BENCH_RECORDS; i++) {
+		u64 hash, checksum;
+		u32 offset, compressed, decompressed;
+		u16 sub_chunk_start;
+		u8 type, duplicated;
+
+		if (!legacy_read_u64(&stream, &hash) || !legacy_read_u32(&stream, &offset) ||
+		    !legacy_read_u32(&stream, &compressed) || !legacy_read_u32(&stream, &decompressed) ||
+		    !legacy_read_u8(&stream, &type) || !legacy_read_u8(&stream, &duplicated) ||
+		    !legacy_read_u16(&stream, &sub_chunk_start) || !legacy_read_u64(&stream, &checksum))
+			return false;
+
+		sink += hash ^ offset ^ compressed ^ decompressed ^ type ^ duplicated ^ sub_chunk_start ^ checksum;
+	}
+
+	bench_report("mem_stream", "toc_records_per_byte", BENCH_RECORDS, stream.cur, bench_now() - start, sink);
+
+	return true;
+}
+
+static b32
+bench_records_fast(struct mem_stream stream) {
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	for (u32 i = 0; i < BENCH_RECORDS; i++) {
+		u8 const *record = riot_mem_stream_take(&stream, BENCH_RECORD_SZ);
+		if (!record) return false;
+
+		sink += riot_load_le64(record + 0) ^ riot_load_le32(record + 8) ^ riot_load_le32(record + 12) ^
+			riot_load_le32(record + 16) ^ riot_load_le8(record + 20) ^ riot_load_le8(record + 21) ^
+			riot_load_le16(record + 22) ^ riot_load_le64(record + 24);
+	}
+
+	bench_report("mem_stream", "toc_records_fixed", BENCH_RECORDS, stream.cur, bench_now() - start, sink);
+
+	return true;
+}
+
+s32
+main(void) {
+	u64 len = MAX((u64)BENCH_WORDS * sizeof(u32), (u64)BENCH_RECORDS * BENCH_RECORD_SZ);
+
+	u8 *buf = malloc(len);
+	if (!buf) {
+		errlog("Failed to allocate benchmark buffer (%lu bytes)", len);
+		return 1;
+	}
+
+	for (u64 i = 0; i < len; i++)
+		buf[i] = (u8)(i * 2654435761u >> 13);
+
+	struct mem_stream stream = { .ptr = buf, .len = len, .cur = 0, };
+
+	b32 ok = bench_read_u32(stream, legacy_read_u32, "read_u32_per_byte") &&
+		bench_read_u32(stream, riot_mem_stream_read_u32, "read_u32") &&
+		bench_read_u64(stream, legacy_read_u64, "read_u64_per_byte") &&
+		bench_read_u64(stream, riot_mem_stream_read_u64, "read_u64") &&
+		bench_write_u32(stream, legacy_write_u32, "write_u32_per_byte") &&
+		bench_write_u32(stream, riot_mem_stream_write_u32, "write_u32") &&
+		bench_records_legacy(stream) &&
+		bench_records_fast(stream);
+
+	free(buf);
+
+	if (!ok) {
+		errlog("Benchmark stream ran out of data");
+		return 1;
+	}
+
+	return 0;
+}
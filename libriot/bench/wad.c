@@ -0,0 +1,431 @@
+#include "libriot/wad.h"
+
+#include "bench.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <zstd.h>
+
+/* table of contents parsing, path hash lookups, chunk table scans and chunk
+ * decompression over a synthetic wad. the corpus is generated from a fixed seed, and shaped by:
+ *
+ *   seed=N      prng seed (1)
+ *   chunks=N    chunk count (4096)
+ *   size=N      mean decompressed chunk size in bytes (16384)
+ *   dist=D      chunk size distribution: fixed, uniform or pareto (pareto)
+ *   zstd=N      percentage of zstd compressed chunks, the rest stored (75)
+ *   level=N     zstd compression level (3)
+ *   parses=N    table of contents parses (200)
+ *   lookups=N   path hash lookups (1048576)
+ *   scans=N     chunk table filter and sum scans (1000)
+ */
+
+#define BENCH_NAME "wad"
+#define BENCH_VOCABULARY 256
+#define BENCH_LOOKUP_BATCH 1024
+
+struct bench_corpus_opts {
+	u64 seed;
+	u32 chunks;
+	u64 size;
+	char const *dist;
+	u32 zstd_pct;
+	s32 level;
+};
+
+static u64
+bench_chunk_size(struct bench_rng *rng, struct bench_corpus_opts const *opts) {
+	if (strcmp(opts->dist, "fixed") == 0)
+		return opts->size;
+
+	if (strcmp(opts->dist, "uniform") == 0)
+		return 1 + bench_rng_below(rng, 2 * opts->size);
+
+	/* pareto with shape 1.5 (mean 3 * scale), cut off at 64 times the
+	 * mean: mostly small chunks, and a few very large ones
+	 */
+	f64 scale = opts->size / 3.0, u = 1.0 - bench_rng_unit(rng);
+	f64 size = scale / pow(u, 1.0 / 1.5);
+
+	return (u64)MAX(1.0, MIN(size, 64.0 * opts->size));
+}
+
+/* fills `buf` with words from a fixed vocabulary, sprinkled with random
+ * bytes, for a compression ratio in the range of real game assets
+ */
+static void
+bench_chunk_fill(struct bench_rng *rng, char const vocabulary[][16], u8 *buf, u64 len) {
+	u64 cur = 0;
+	while (cur < len) {
+		if (bench_rng_below(rng, 16) == 0) {
+			buf[cur++] = (u8)bench_rng_next(rng);
+			continue;
+		}
+
+		char const *word = vocabulary[bench_rng_below(rng, BENCH_VOCABULARY)];
+		for (u64 i = 0; word[i] && cur < len; i++)
+			buf[cur++] = word[i];
+	}
+}
+
+static b32
+bench_corpus_generate(struct bench_corpus_opts const *opts, struct riot_wad_ctx *ctx, struct mem_stream *data) {
+	struct bench_rng rng = { .state = opts->seed, };
+
+	char vocabulary[BENCH_VOCABULARY][16];
+	for (u32 i = 0; i < BENCH_VOCABULARY; i++) {
+		u32 len = 2 + bench_rng_below(&rng, sizeof vocabulary[i] - 3);
+		for (u32 j = 0; j < len; j++)
+			vocabulary[i][j] = 'a' + bench_rng_below(&rng, 26);
+
+		vocabulary[i][len] = '\0';
+	}
+
+	ZSTD_CCtx *cctx = ZSTD_createCCtx();
+	if (!cctx) return false;
+
+	b32 res = false;
+
+	riot_offptr_t chunk_offptr;
+	if (!riot_wad_ctx_pushn_chunk(ctx, opts->chunks, &chunk_offptr))
+		goto cleanup;
+
+	ctx->wad.major = 3;
+	ctx->wad.minor = 1;
+	ctx->wad.chunk_count = opts->chunks;
+	ctx->wad.data_start = 0;
+
+	struct mem_pool raw_pool, compressed_pool;
+	if (!MEM_POOL_INIT(&raw_pool, u8, 64 * KiB))
+		goto cleanup;
+
+	if (!MEM_POOL_INIT(&compressed_pool, u8, 64 * KiB)) {
+		mem_pool_free(&raw_pool);
+		goto cleanup;
+	}
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr + chunk_offptr;
+	for (u32 i = 0; i < opts->chunks; i++) {
+		u64 size = bench_chunk_size(&rng, opts);
+
+		mem_pool_reset(&raw_pool);
+		u8 *raw = MEM_POOL_ALLOC(&raw_pool, u8, size);
+		if (!raw) goto pool_cleanup;
+
+		bench_chunk_fill(&rng, (char const (*)[16])vocabulary, raw, size);
+
+		struct riot_wad_chunk *chunk = &chunks[i];
+		memset(chunk, 0, sizeof *chunk);
+
+		char path[64];
+		s32 path_len = snprintf(path, sizeof path, "bench/%08u.bin", i);
+		chunk->path_hash = riot_wad_path_hash(path, path_len);
+		chunk->data_offset = data->cur;
+		chunk->decompressed_size = size;
+		chunk->compression = RIOT_WAD_COMPRESSION_NONE;
+
+		u8 *payload = raw;
+		u64 payload_len = size;
+
+		if (bench_rng_below(&rng, 100) < opts->zstd_pct) {
+			u64 bound = ZSTD_compressBound(size);
+
+			mem_pool_reset(&compressed_pool);
+			u8 *compressed = MEM_POOL_ALLOC(&compressed_pool, u8, bound);
+			if (!compressed) goto pool_cleanup;
+
+			u64 compressed_len = ZSTD_compressCCtx(cctx, compressed, bound, raw, size, opts->level);
+			if (ZSTD_isError(compressed_len)) goto pool_cleanup;
+
+			if (compressed_len < size) {
+				chunk->compression = RIOT_WAD_COMPRESSION_ZSTD;
+				payload = compressed;
+				payload_len = compressed_len;
+			}
+		}
+
+		chunk->compressed_size = payload_len;
+
+		if (!mem_stream_push(data, payload, payload_len))
+			goto pool_cleanup;
+	}
+
+	res = true;
+
+pool_cleanup:
+	mem_pool_free(&compressed_pool);
+	mem_pool_free(&raw_pool);
+cleanup:
+	ZSTD_freeCCtx(cctx);
+
+	return res;
+}
+
+static b32
+bench_write(struct riot_wad_ctx *ctx, struct mem_stream *data, char const *path) {
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) return false;
+
+	b32 res = false;
+
+	f64 start = bench_now();
+
+	if (!riot_wad_write(ctx, data->ptr, data->cur, NULL, &out))
+		goto cleanup;
+
+	u64 len = out.len;
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) goto cleanup;
+
+	b32 flushed = riot_writer_flush(&out, fd);
+	if (close(fd) < 0 || !flushed) goto cleanup;
+
+	bench_report(BENCH_NAME, "write", ctx->wad.chunk_count, len, bench_now() - start, len);
+
+	res = true;
+
+cleanup:
+	riot_writer_free(&out);
+
+	return res;
+}
+
+static b32
+bench_toc_parse(struct riot_wad_ctx *src, u64 parses) {
+	struct mem_stream stream = src->src;
+	stream.cur = 0;
+
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	for (u64 i = 0; i < parses; i++) {
+		struct riot_wad_ctx ctx;
+		if (!riot_wad_ctx_init(&ctx)) return false;
+
+		b32 ok = riot_wad_read(&ctx, stream);
+		sink += ctx.wad.chunk_count;
+
+		riot_wad_ctx_free(&ctx);
+
+		if (!ok) return false;
+	}
+
+	bench_report(BENCH_NAME, "toc_parse", parses, parses * src->wad.data_start, bench_now() - start, sink);
+
+	return true;
+}
+
+static b32
+bench_lookup(struct riot_wad_ctx *ctx, u64 lookups, u64 seed) {
+	struct bench_rng rng = { .state = seed ^ 0x6c6f6f6b7570ull, };
+
+	/* one lookup in eight misses */
+	xxh64_u64 *hashes = malloc(BENCH_LOOKUP_BATCH * sizeof *hashes);
+	struct riot_wad_chunk **found = malloc(BENCH_LOOKUP_BATCH * sizeof *found);
+	if (!hashes || !found) {
+		free(hashes);
+		free(found);
+		return false;
+	}
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	for (u32 i = 0; i < BENCH_LOOKUP_BATCH; i++) {
+		hashes[i] = ctx->wad.chunk_count && bench_rng_below(&rng, 8)
+			? chunks[bench_rng_below(&rng, ctx->wad.chunk_count)].path_hash
+			: bench_rng_next(&rng);
+	}
+
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	for (u64 i = 0; i < lookups; i++)
+		sink += riot_wad_find_chunk(ctx, hashes[i % BENCH_LOOKUP_BATCH]) != NULL;
+
+	bench_report(BENCH_NAME, "lookup", lookups, 0, bench_now() - start, sink);
+
+	sink = 0;
+	start = bench_now();
+
+	u64 batches = MAX(1, lookups / BENCH_LOOKUP_BATCH);
+	for (u64 i = 0; i < batches; i++)
+		sink += riot_wad_find_chunks(ctx, hashes, BENCH_LOOKUP_BATCH, found);
+
+	bench_report(BENCH_NAME, "lookup_batched", batches * BENCH_LOOKUP_BATCH, 0, bench_now() - start, sink);
+
+	free(found);
+	free(hashes);
+
+	return true;
+}
+
+/* selects the zstd chunks of a mid-size range and sums the sizes of the
+ * whole table, once by walking the chunk table and once over its columns
+ */
+static b32
+bench_scan(struct riot_wad_ctx *ctx, u64 scans) {
+	u32 *selected = malloc(MAX(1, ctx->wad.chunk_count) * sizeof *selected);
+	if (!selected) return false;
+
+	struct riot_wad_column_query query = {
+		.compression_mask = 1 << RIOT_WAD_COMPRESSION_ZSTD,
+		.size_min = 4 * KiB, .size_max = 64 * KiB,
+		.offset_min = 0, .offset_max = UINT32_MAX,
+	};
+
+	u64 bytes = scans * ctx->wad.chunk_count * sizeof(struct riot_wad_chunk);
+	u64 sink = 0;
+	f64 start = bench_now();
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	for (u64 i = 0; i < scans; i++) {
+		u32 found = 0;
+		u64 compressed = 0, decompressed = 0;
+
+		for (u32 j = 0; j < ctx->wad.chunk_count; j++) {
+			struct riot_wad_chunk *chunk = &chunks[j];
+
+			if (chunk->compression == RIOT_WAD_COMPRESSION_ZSTD &&
+			    query.size_min <= chunk->decompressed_size && chunk->decompressed_size <= query.size_max)
+				selected[found++] = j;
+
+			compressed += chunk->compressed_size;
+			decompressed += chunk->decompressed_size;
+		}
+
+		sink += found + compressed + decompressed;
+	}
+
+	bench_report(BENCH_NAME, "scan_rows", scans, bytes, bench_now() - start, sink);
+
+	start = bench_now();
+
+	if (!riot_wad_ctx_build_columns(ctx)) {
+		free(selected);
+		return false;
+	}
+
+	bench_report(BENCH_NAME, "columns_build", 1, ctx->column_pool.len, bench_now() - start, ctx->columns.count);
+
+	bytes = scans * ctx->column_pool.len;
+	sink = 0;
+	start = bench_now();
+
+	for (u64 i = 0; i < scans; i++) {
+		struct riot_wad_column_totals totals;
+		riot_wad_columns_totals(&ctx->columns, &totals);
+
+		sink += riot_wad_columns_select(&ctx->columns, &query, selected) +
+			totals.compressed_size + totals.decompressed_size;
+	}
+
+	bench_report(BENCH_NAME, "scan_columns", scans, bytes, bench_now() - start, sink);
+
+	free(selected);
+
+	return true;
+}
+
+static b32
+bench_decompress(struct riot_wad_ctx *ctx) {
+	struct riot_wad_decompressor dec;
+	if (!riot_wad_decompressor_init(&dec)) return false;
+
+	b32 res = false;
+
+	u64 bytes = 0, sink = 0;
+	f64 start = bench_now();
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	for (u32 i = 0; i < ctx->wad.chunk_count; i++) {
+		struct mem_stream out;
+		if (!riot_wad_chunk_decompress(&dec, ctx, &chunks[i], NULL, 0, &out))
+			goto cleanup;
+
+		bytes += out.len;
+		sink += out.len ? out.ptr[out.len - 1] : 0;
+	}
+
+	bench_report(BENCH_NAME, "decompress", ctx->wad.chunk_count, bytes, bench_now() - start, sink);
+
+	res = true;
+
+cleanup:
+	riot_wad_decompressor_free(&dec);
+
+	return res;
+}
+
+s32
+main(s32 argc, char **argv) {
+	struct bench_corpus_opts opts = {
+		.seed = bench_opt_u64(argc, argv, "seed", 1),
+		.chunks = bench_opt_u64(argc, argv, "chunks", 4096),
+		.size = MAX(1, bench_opt_u64(argc, argv, "size", 16 * KiB)),
+		.dist = bench_opt_str(argc, argv, "dist", "pareto"),
+		.zstd_pct = bench_opt_u64(argc, argv, "zstd", 75),
+		.level = bench_opt_u64(argc, argv, "level", 3),
+	};
+
+	u64 parses = bench_opt_u64(argc, argv, "parses", 200);
+	u64 lookups = bench_opt_u64(argc, argv, "lookups", 1024 * 1024);
+	u64 scans = bench_opt_u64(argc, argv, "scans", 1000);
+
+	s32 res = 1;
+
+	struct riot_wad_ctx src;
+	if (!riot_wad_ctx_init(&src)) return 1;
+
+	struct mem_stream data = {0};
+	if (!bench_corpus_generate(&opts, &src, &data)) {
+		errlog("Failed to generate WAD corpus");
+		goto src_cleanup;
+	}
+
+	printf("{\"bench\":\"%s\",\"corpus\":{\"seed\":%lu,\"chunks\":%u,\"size\":%lu,\"dist\":\"%s\","
+	       "\"zstd\":%u,\"level\":%d,\"data_bytes\":%lu}}\n",
+	       BENCH_NAME, opts.seed, opts.chunks, opts.size, opts.dist, opts.zstd_pct, opts.level, data.cur);
+
+	char path[] = "/tmp/libriot-bench-wad-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		errlog("Failed to create temporary WAD file");
+		goto src_cleanup;
+	}
+
+	close(fd);
+
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx))
+		goto file_cleanup;
+
+	if (!bench_write(&src, &data, path)) {
+		errlog("Failed to write WAD corpus");
+		goto ctx_cleanup;
+	}
+
+	if (!riot_wad_open_mapped(&ctx, path)) {
+		errlog("Failed to read WAD corpus");
+		goto ctx_cleanup;
+	}
+
+	if (!bench_toc_parse(&ctx, parses) || !bench_lookup(&ctx, lookups, opts.seed) || !bench_scan(&ctx, scans) ||
+	    !bench_decompress(&ctx)) {
+		errlog("WAD benchmark failed");
+		goto ctx_cleanup;
+	}
+
+	res = 0;
+
+ctx_cleanup:
+	riot_wad_ctx_free(&ctx);
+file_cleanup:
+	unlink(path);
+src_cleanup:
+	free(data.ptr);
+	riot_wad_ctx_free(&src);
+
+	return res;
+}
@@ -69,6 +69,27 @@ riot_intrusive_list_push(struct riot_intrusive_list *self,
 typedef u32 fnv1a_u32;
 typedef u64 xxh64_u64;
 
+/* branch-free binary search over a sorted array of hashes; the loop trip
+ * count depends only on `count`, and the comparison compiles down to a
+ * conditional move. returns the index of the last element not greater than
+ * `key`, or 0 when there is none, so callers still compare the element found
+ * against `key`
+ */
+inline u32
+riot_hash_search(u64 const *hashes, u32 count, u64 key) {
+	assert(hashes || !count);
+
+	u32 base = 0, len = count;
+
+	while (len > 1) {
+		u32 half = len / 2;
+		base = (hashes[base + half] <= key) ? base + half : base;
+		len -= half;
+	}
+
+	return base;
+}
+
 struct riot_fvec2 {
 	f32 vs[2];
 };
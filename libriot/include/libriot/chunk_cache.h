@@ -0,0 +1,123 @@
+#ifndef LIBRIOT_CHUNK_CACHE_H
+#define LIBRIOT_CHUNK_CACHE_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+#include "libriot/wad.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define RIOT_CHUNK_CACHE_DEFAULT_SHARDS 16
+#define RIOT_CHUNK_CACHE_MIN_BUCKETS 64
+
+/* share of each shard's budget that protected entries may hold, in percent */
+#define RIOT_CHUNK_CACHE_PROTECTED_PCT 80
+
+enum riot_chunk_cache_segment {
+	RIOT_CHUNK_CACHE_PROBATION,
+	RIOT_CHUNK_CACHE_PROTECTED,
+	RIOT_CHUNK_CACHE_SEGMENTS,
+};
+
+/* a cached decompressed chunk, allocated together with its data. entries are
+ * handed out referenced, and stay valid until released, even if evicted in
+ * the meantime
+ */
+struct riot_chunk_cache_entry {
+	xxh64_u64 path_hash;
+	u8 *data;
+	u64 len;
+
+	struct riot_chunk_cache_entry *chain;
+	struct riot_chunk_cache_entry *prev, *next;
+
+	u32 refs;
+	u8 segment;
+	b8 cached;
+};
+
+/* intrusive lru list, from the least (`head`) to the most (`tail`) recently
+ * used entry
+ */
+struct riot_chunk_cache_list {
+	struct riot_chunk_cache_entry *head, *tail;
+	u64 len;
+};
+
+struct riot_chunk_cache_stats {
+	u64 hits, misses, inserts, evictions;
+	u64 len, count;
+};
+
+/* one independently locked slice of the cache, holding the path hashes that
+ * map to it. aligned to keep shards off each others' cache lines
+ */
+struct riot_chunk_cache_shard {
+	alignas(64) pthread_mutex_t lock;
+
+	struct riot_chunk_cache_entry **buckets;
+	u32 bucket_mask, count;
+
+	struct riot_chunk_cache_list segments[RIOT_CHUNK_CACHE_SEGMENTS];
+	u64 cap;
+
+	struct riot_chunk_cache_stats stats;
+};
+
+/* thread-safe cache of decompressed chunks keyed by path hash, bounded by the
+ * total size of the data it holds. eviction is segmented lru: new entries
+ * start on probation, and are only promoted to the protected segment when
+ * hit again, so a one-off scan over many chunks only ever displaces other
+ * probationary entries
+ */
+struct riot_chunk_cache {
+	struct riot_chunk_cache_shard *shards;
+	u32 shard_mask;
+	u64 cap;
+};
+
+/* `cap` is the budget in decompressed bytes, split evenly across
+ * `shard_count` shards (rounded up to a power of two)
+ */
+extern b32
+riot_chunk_cache_init(struct riot_chunk_cache *self, u64 cap, u32 shard_count);
+
+/* frees the cache. entries must all have been released */
+extern void
+riot_chunk_cache_free(struct riot_chunk_cache *self);
+
+/* returns the referenced entry for `path_hash`, or NULL on a miss */
+extern struct riot_chunk_cache_entry *
+riot_chunk_cache_get(struct riot_chunk_cache *self, xxh64_u64 path_hash);
+
+/* inserts a copy of `data`, and returns it referenced. if the path hash is
+ * already cached, the existing entry is returned instead
+ */
+extern struct riot_chunk_cache_entry *
+riot_chunk_cache_put(struct riot_chunk_cache *self, xxh64_u64 path_hash, void const *data, u64 len);
+
+extern void
+riot_chunk_cache_release(struct riot_chunk_cache *self, struct riot_chunk_cache_entry *entry);
+
+extern void
+riot_chunk_cache_get_stats(struct riot_chunk_cache *self, struct riot_chunk_cache_stats *out);
+
+/* returns the decompressed data of `chunk` from the cache, decompressing and
+ * inserting it on a miss. chunks larger than a shard's budget are returned
+ * uncached, and freed on release
+ */
+extern struct riot_chunk_cache_entry *
+riot_chunk_cache_read(struct riot_chunk_cache *self, struct riot_wad_decompressor *dec,
+		      struct riot_wad_ctx *ctx, struct riot_wad_chunk *chunk);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* LIBRIOT_CHUNK_CACHE_H */
@@ -0,0 +1,55 @@
+#ifndef LIBRIOT_HASH_DICT_H
+#define LIBRIOT_HASH_DICT_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+#include "libriot/thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* location of a name within the dictionary source buffer */
+struct riot_hash_dict_str {
+	u32 off, len;
+};
+
+#define RIOT_HASH_DICT_POOL_SZ 64 * KiB
+
+/* hash to name table, loaded from a community hash list: one entry per line,
+ * as a hex hash followed by a single space and the name. the list is mapped
+ * read-only and doubles as the string arena, so names are borrowed views
+ * into it. hashes are kept sorted in their own array, with a parallel array
+ * of name locations, so lookups only touch the dense hash array until they
+ * hit. both xxh64 path hashes and fnv1a name hashes are stored widened to
+ * 64 bits
+ */
+struct riot_hash_dict {
+	struct mem_stream src;
+	struct mem_pool hash_pool, str_pool;
+	u32 count;
+};
+
+extern b32
+riot_hash_dict_init(struct riot_hash_dict *self);
+
+extern void
+riot_hash_dict_free(struct riot_hash_dict *self);
+
+/* maps and parses the hash list at `path`, splitting it into line-aligned
+ * segments parsed and sorted on `workers` (if given). on duplicate hashes, the
+ * first line wins
+ */
+extern b32
+riot_hash_dict_load(struct riot_hash_dict *self, char const *path, struct riot_thread_pool *workers);
+
+extern b32
+riot_hash_dict_find(struct riot_hash_dict *self, u64 hash, struct str_view *out);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* LIBRIOT_HASH_DICT_H */
@@ -5,6 +5,9 @@
 #include "utils.h"
 
 #include "libriot.h"
+#include "libriot/hash_dict.h"
+#include "libriot/thread_pool.h"
+#include "libriot/writer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,8 +47,12 @@ enum riot_inibin_node_type {
 	RIOT_INIBIN_NODE_FLAG		= 7 | RIOT_INIBIN_NODE_COMPLEX_TYPE_FLAG,
 };
 
+/* a string is either borrowed, with `data` an offset into the source buffer
+ * the ctx was read from, or owned, with `data` an offset into `str_pool`
+ */
 struct riot_inibin_str {
 	u16 count;
+	b8 borrowed;
 	riot_offptr_t data;
 };
 
@@ -55,18 +62,31 @@ struct riot_inibin_field {
 	struct riot_intrusive_list_node list;
 };
 
+/* a list of at least `RIOT_INIBIN_FIELD_INDEX_MIN` fields also has a run of
+ * `count` keys from `root_key`, sorted by name hash, to be searched instead
+ * of the fields themselves
+ */
 struct riot_inibin_field_list {
 	fnv1a_u32 name_hash;
 	u16 count;
 	riot_offptr_t root_field;
+	riot_offptr_t root_key;
+};
+
+/* `field` is relative to the root of the list the key belongs to */
+struct riot_inibin_field_key {
+	fnv1a_u32 name_hash;
+	u16 field;
 };
 
 struct riot_inibin_opt {
+	u8 type;
 	b8 exists;
 	riot_relptr_t value;
 };
 
 struct riot_inibin_list {
+	u8 type;
 	u32 count;
 	riot_offptr_t root_node;
 };
@@ -77,6 +97,7 @@ struct riot_inibin_pair {
 };
 
 struct riot_inibin_map {
+	u8 key_type, val_type;
 	u32 count;
 	riot_offptr_t root_pair;
 };
@@ -112,13 +133,72 @@ struct riot_inibin_node {
 	struct riot_intrusive_list_node list;
 };
 
+/* a top-level object of a property file. `fields.name_hash` holds the hash
+ * of the entry's type. `offset` and `size` locate the entry's body in the
+ * source; an entry of a lazily opened file only has its fields once loaded
+ */
+struct riot_inibin_entry {
+	fnv1a_u32 path_hash;
+	u32 offset, size;
+	b8 loaded;
+	struct riot_inibin_field_list fields;
+};
+
 #define RIOT_INIBIN_CTX_STR_POOL_SZ 32 * KiB
 #define RIOT_INIBIN_CTX_FIELD_POOL_SZ 8 * KiB
 #define RIOT_INIBIN_CTX_PAIR_POOL_SZ 8 * KiB
 #define RIOT_INIBIN_CTX_NODE_POOL_SZ 8 * KiB
+#define RIOT_INIBIN_CTX_ENTRY_POOL_SZ 1 * KiB
+#define RIOT_INIBIN_CTX_LINK_POOL_SZ 16
+#define RIOT_INIBIN_CTX_KEY_POOL_SZ 1 * KiB
+
+/* smaller field lists span eight cache lines at most, and are as cheap to
+ * scan in place as to search through a separate run of keys
+ */
+#define RIOT_INIBIN_FIELD_INDEX_MIN 32
+
+/* strings at least this long are written out by reference rather than
+ * copied into the output, see `riot_inibin_write()`
+ */
+#define RIOT_INIBIN_STR_REF_MIN 32
 
+/* nesting limit of embedded structures and containers, guarding the
+ * recursive reader against hostile input
+ */
+#define RIOT_INIBIN_MAX_DEPTH 64
+
+/* exact number of elements of each pool needed to hold a property file */
+struct riot_inibin_counts {
+	u64 nodes, fields, pairs, keys, str_bytes;
+	u32 entries, links;
+};
+
+/* children of a field list, list or map are laid out contiguously from
+ * their root, and are also linked in order through their intrusive list
+ * nodes. references between pool elements are offsets rather than pointers,
+ * so that they survive the pools growing
+ */
 struct riot_inibin_ctx {
 	struct mem_pool str_pool, field_pool, pair_pool, node_pool;
+	struct mem_pool entry_pool, link_pool, key_pool;
+
+	/* path hash index over `entry_pool`, as a sorted array of path hashes
+	 * and a parallel array of the entries they belong to. built by every
+	 * read, and rebuilt by `riot_inibin_ctx_build_index()`
+	 */
+	struct mem_pool index_hash_pool, index_entry_pool;
+	u32 index_count;
+
+	u32 version;
+	u32 entry_count, link_count;
+
+	/* source buffer the property file was read from. borrowed strings are
+	 * views into this buffer, which must then outlive the ctx. when
+	 * `mapped` is set, the buffer is a read-only mapping owned by the ctx
+	 * and is unmapped by `riot_inibin_ctx_free()`
+	 */
+	struct mem_stream src;
+	b8 mapped;
 };
 
 extern b32
@@ -139,14 +219,163 @@ riot_inibin_ctx_pushn_pair(struct riot_inibin_ctx *self, u32 count, riot_offptr_
 extern b32
 riot_inibin_ctx_pushn_node(struct riot_inibin_ctx *self, u32 count, riot_offptr_t *out);
 
+/* sizes every pool to hold exactly `counts` more elements than it does now,
+ * so that pushing them performs no further allocation
+ */
+extern b32
+riot_inibin_ctx_reserve(struct riot_inibin_ctx *self, struct riot_inibin_counts const *counts);
+
+static inline struct riot_inibin_node *
+riot_inibin_ctx_node(struct riot_inibin_ctx *self, riot_offptr_t off) {
+	return (struct riot_inibin_node *)self->node_pool.ptr + off;
+}
+
+static inline struct riot_inibin_field *
+riot_inibin_ctx_field(struct riot_inibin_ctx *self, riot_offptr_t off) {
+	return (struct riot_inibin_field *)self->field_pool.ptr + off;
+}
+
+static inline struct riot_inibin_pair *
+riot_inibin_ctx_pair(struct riot_inibin_ctx *self, riot_offptr_t off) {
+	return (struct riot_inibin_pair *)self->pair_pool.ptr + off;
+}
+
+static inline struct riot_inibin_entry *
+riot_inibin_ctx_entry(struct riot_inibin_ctx *self, u32 idx) {
+	return (struct riot_inibin_entry *)self->entry_pool.ptr + idx;
+}
+
+static inline struct riot_inibin_field_key *
+riot_inibin_ctx_field_key(struct riot_inibin_ctx *self, riot_offptr_t off) {
+	return (struct riot_inibin_field_key *)self->key_pool.ptr + off;
+}
+
+static inline struct riot_inibin_str *
+riot_inibin_ctx_link(struct riot_inibin_ctx *self, u32 idx) {
+	return (struct riot_inibin_str *)self->link_pool.ptr + idx;
+}
+
+/* the characters of `str`, wherever they are stored. not nul-terminated */
+static inline struct str_view
+riot_inibin_ctx_str(struct riot_inibin_ctx *self, struct riot_inibin_str const *str) {
+	u8 *base = str->borrowed ? self->src.ptr : self->str_pool.ptr;
+	return (struct str_view){ .ptr = (char *)base + str->data, .len = str->count, };
+}
+
+/* reads the fields of an entry of a lazily opened file, if not done yet */
+extern b32
+riot_inibin_ctx_load_entry(struct riot_inibin_ctx *self, struct riot_inibin_entry *entry);
+
+/* loads every entry not loaded yet */
+extern b32
+riot_inibin_ctx_load_entries(struct riot_inibin_ctx *self);
+
+/* branch-free binary search over sorted 32-bit hashes, shaped like
+ * `riot_hash_search()`, but returning the index of the first element not
+ * less than `key`, so that the first of equal elements is found. returns
+ * `count` when every element is less than `key`
+ */
+static inline u32
+riot_inibin_hash_lower_bound(fnv1a_u32 const *hashes, u32 count, fnv1a_u32 key) {
+	if (!count) return 0;
+
+	u32 base = 0, len = count;
+
+	while (len > 1) {
+		u32 half = len / 2;
+		base = (hashes[base + half - 1] < key) ? base + half : base;
+		len -= half;
+	}
+
+	return base + (hashes[base] < key);
+}
+
+extern b32
+riot_inibin_ctx_build_index(struct riot_inibin_ctx *self);
+
+/* returns the loaded entry at `path_hash`, or NULL when there is none or it
+ * failed to load. of entries sharing a path, the first is returned
+ */
+extern struct riot_inibin_entry *
+riot_inibin_ctx_find_entry(struct riot_inibin_ctx *self, fnv1a_u32 path_hash);
+
+/* pushes the sorted keys of a field list whose fields have been read, if it
+ * is large enough to have any
+ */
+extern b32
+riot_inibin_ctx_index_fields(struct riot_inibin_ctx *self, struct riot_inibin_field_list *list);
+
+/* returns the field of `list` named `name_hash`, or NULL when there is none.
+ * of fields sharing a name, the first is returned
+ */
+extern struct riot_inibin_field *
+riot_inibin_ctx_find_field(struct riot_inibin_ctx *self, struct riot_inibin_field_list const *list,
+			   fnv1a_u32 name_hash);
+
+/* copies a borrowed string into `str_pool`, making it owned by the ctx */
+extern b32
+riot_inibin_ctx_own_str(struct riot_inibin_ctx *self, struct riot_inibin_str *str);
+
+/* copies every borrowed string, after which the source buffer is no longer
+ * needed. a mapped source is unmapped. entries not loaded yet are loaded
+ * first
+ */
+extern b32
+riot_inibin_ctx_own_strs(struct riot_inibin_ctx *self);
+
+/* reads a property file, copying every string into the ctx. `stream` may be
+ * released as soon as this returns. reading is done in two passes: a scan
+ * counting the elements of every pool, which are then sized exactly, and a
+ * second pass filling them in without any reallocation
+ */
 extern b32
 riot_inibin_read(struct riot_inibin_ctx *ctx, struct mem_stream stream);
 
+/* reads a property file without copying strings, which are instead left as
+ * views into `stream`. the buffer must outlive the ctx, or be detached from
+ * it with `riot_inibin_ctx_own_strs()` first
+ */
+extern b32
+riot_inibin_read_borrowed(struct riot_inibin_ctx *ctx, struct mem_stream stream);
+
+/* reads a property file, parsing ranges of its entries concurrently on
+ * `workers`, strings being borrowed from `stream` if `borrow`. the result is
+ * the same as that of a serial read, which is done instead without workers
+ */
+extern b32
+riot_inibin_read_parallel(struct riot_inibin_ctx *ctx, struct mem_stream stream, b32 borrow,
+			  struct riot_thread_pool *workers);
+
+/* maps a property file read-only and reads it borrowed. the mapping is owned
+ * by the ctx
+ */
+extern b32
+riot_inibin_open_mapped(struct riot_inibin_ctx *ctx, char const *path);
+
+/* reads only the header, linked files and entry table of a property file,
+ * skipping every entry body. entries are then loaded on demand, borrowing
+ * from `stream`, which must outlive the ctx
+ */
+extern b32
+riot_inibin_open_lazy(struct riot_inibin_ctx *ctx, struct mem_stream stream);
+
+/* maps a property file read-only and opens it lazily. the mapping is owned
+ * by the ctx
+ */
+extern b32
+riot_inibin_open_mapped_lazy(struct riot_inibin_ctx *ctx, char const *path);
+
+/* encodes the property file held by the ctx, loading any entry not loaded
+ * yet. section sizes are patched in once each section has been written, so
+ * the tree is only walked once. long strings are only referenced, wherever
+ * the ctx stores them, so the ctx (and its source buffer) must outlive the
+ * flush of `out`, and not be modified before it
+ */
 extern b32
-riot_inibin_write(struct riot_inibin_ctx *ctx, struct mem_stream stream);
+riot_inibin_write(struct riot_inibin_ctx *ctx, struct riot_writer *out);
 
 extern void
-riot_inibin_print(struct riot_inibin_ctx *ctx, FILE *f);
+riot_inibin_print(struct riot_inibin_ctx *ctx, struct riot_hash_dict *names, FILE *f);
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,118 @@
+#ifndef LIBRIOT_STATS_H
+#define LIBRIOT_STATS_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* process-wide counters of the library's hot paths. counts are plain event
+ * or byte totals, and `_NS` counters accumulate monotonic nanoseconds spent
+ * in the named operation
+ */
+enum riot_stat {
+	RIOT_STAT_WAD_TOC_PARSES,
+	RIOT_STAT_WAD_TOC_BYTES,
+	RIOT_STAT_WAD_TOC_CHUNKS,
+	RIOT_STAT_WAD_TOC_NS,
+
+	RIOT_STAT_WAD_TOC_CACHE_HITS,
+	RIOT_STAT_WAD_TOC_CACHE_MISSES,
+
+	RIOT_STAT_WAD_CHECKSUM_BYTES,
+
+	/* chunks, decompressed bytes and time of each codec, in that order */
+	RIOT_STAT_DECOMPRESS_NONE_CHUNKS,
+	RIOT_STAT_DECOMPRESS_NONE_BYTES,
+	RIOT_STAT_DECOMPRESS_NONE_NS,
+	RIOT_STAT_DECOMPRESS_ZSTD_CHUNKS,
+	RIOT_STAT_DECOMPRESS_ZSTD_BYTES,
+	RIOT_STAT_DECOMPRESS_ZSTD_NS,
+	RIOT_STAT_DECOMPRESS_ZSTD_CHUNK_CHUNKS,
+	RIOT_STAT_DECOMPRESS_ZSTD_CHUNK_BYTES,
+	RIOT_STAT_DECOMPRESS_ZSTD_CHUNK_NS,
+
+	RIOT_STAT_CHUNK_CACHE_HITS,
+	RIOT_STAT_CHUNK_CACHE_MISSES,
+	RIOT_STAT_CHUNK_CACHE_EVICTIONS,
+
+	RIOT_STAT_INIBIN_PARSES,
+	RIOT_STAT_INIBIN_BYTES,
+	RIOT_STAT_INIBIN_ENTRIES,
+	RIOT_STAT_INIBIN_NS,
+	RIOT_STAT_INIBIN_STR_COPY_BYTES,
+	RIOT_STAT_INIBIN_STR_BORROW_BYTES,
+	RIOT_STAT_INIBIN_ENTRY_LOADS,
+
+	RIOT_STAT_IO_READS,
+	RIOT_STAT_IO_BYTES,
+	RIOT_STAT_IO_NS,
+
+	RIOT_STAT_WRITER_BYTES,
+	RIOT_STAT_WRITER_NS,
+
+	/* the `_GROW_BYTES` counters total the capacity each resize grew from,
+	 * which is what a realloc may have to copy
+	 */
+	RIOT_STAT_POOL_GROWS,
+	RIOT_STAT_POOL_GROW_BYTES,
+	RIOT_STAT_STREAM_GROWS,
+	RIOT_STAT_STREAM_GROW_BYTES,
+
+	RIOT_STAT_COUNT,
+};
+
+/* each thread counts into a block of its own, registered on first use, so
+ * that updates never contend. blocks are only ever written by their owner,
+ * and read with relaxed loads when taking a snapshot. when a thread exits,
+ * its counts are folded into a shared block, and its block is recycled for
+ * the next thread to register
+ */
+struct riot_stats_block {
+	alignas(64) atomic_uint_fast64_t counters[RIOT_STAT_COUNT];
+	struct riot_stats_block *next;
+};
+
+extern void
+riot_stats_add(enum riot_stat stat, u64 val);
+
+/* monotonic clock for the `_NS` counters */
+extern u64
+riot_stats_clock(void);
+
+/* adds the time elapsed since `start`, as returned by `riot_stats_clock()` */
+static inline void
+riot_stats_time(enum riot_stat stat, u64 start) {
+	riot_stats_add(stat, riot_stats_clock() - start);
+}
+
+/* sums the counters of every thread into `out` */
+extern void
+riot_stats_snapshot(u64 out[RIOT_STAT_COUNT]);
+
+extern u64
+riot_stats_get(enum riot_stat stat);
+
+/* zeroes every counter. updates racing with a reset may survive it */
+extern void
+riot_stats_reset(void);
+
+/* lower snake case name of `stat`, as used in the json report */
+extern char const *
+riot_stats_name(enum riot_stat stat);
+
+/* prints a snapshot as a single json object, with no trailing newline */
+extern void
+riot_stats_print_json(FILE *fp);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* LIBRIOT_STATS_H */
@@ -0,0 +1,78 @@
+#ifndef LIBRIOT_THREAD_POOL_H
+#define LIBRIOT_THREAD_POOL_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* task callback, invoked once per item index of a job. `worker` is in the
+ * range [0, thread_count) and identifies the calling worker, so that tasks can
+ * index per-worker state without any locking
+ */
+typedef void (*riot_thread_pool_fn)(void *arg, u32 worker, u64 idx);
+
+struct riot_thread_pool;
+
+/* each worker owns a range of job slots, packed as `begin << 32 | end`. the
+ * owner pops slots off the front of its range, and idle workers steal the
+ * back half of a peer's range. aligned to keep workers off each others'
+ * cache lines
+ */
+struct riot_thread_pool_worker {
+	alignas(64) atomic_uint_fast64_t range;
+	struct riot_thread_pool *pool;
+	pthread_t thread;
+	u32 idx;
+};
+
+/* fixed set of persistent, work-stealing worker threads executing one job at
+ * a time. the thread calling `riot_thread_pool_run()` participates as worker
+ * 0, so a pool of `thread_count` workers spawns `thread_count - 1` threads,
+ * and a pool of one worker runs every job inline
+ */
+struct riot_thread_pool {
+	struct riot_thread_pool_worker *workers;
+	u32 thread_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond, done_cond;
+	u64 generation;
+	u32 active;
+	b8 shutdown;
+
+	riot_thread_pool_fn fn;
+	void *arg;
+	u64 count;
+};
+
+extern u32
+riot_thread_pool_default_thread_count(void);
+
+extern b32
+riot_thread_pool_init(struct riot_thread_pool *self, u32 thread_count);
+
+extern void
+riot_thread_pool_free(struct riot_thread_pool *self);
+
+/* runs `fn` for every index in [0, count) across all workers, and returns
+ * once every index has been processed. indices are dealt out round-robin, so
+ * each worker starts at the low indices and steals from the high ones:
+ * callers that order their work by descending cost get the expensive items
+ * started first. not reentrant: tasks must not call back into the pool that
+ * is running them
+ */
+extern void
+riot_thread_pool_run(struct riot_thread_pool *self, u64 count, riot_thread_pool_fn fn, void *arg);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* LIBRIOT_THREAD_POOL_H */
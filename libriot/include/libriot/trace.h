@@ -0,0 +1,81 @@
+#ifndef LIBRIOT_TRACE_H
+#define LIBRIOT_TRACE_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+#include "libriot/stats.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* events kept per thread. once a ring is full, the oldest events are
+ * overwritten
+ */
+#define RIOT_TRACE_RING_SZ (1 << 16)
+
+/* a completed span. `name` must be a string with static storage duration */
+struct riot_trace_event {
+	char const *name;
+	u64 start, end;
+	u64 bytes;
+};
+
+/* single producer ring, owned and written by one thread. `head` counts every
+ * event ever recorded, and is published with release semantics once the slot
+ * it covers has been filled in. when its thread exits, a ring is retired: its
+ * events are still written out until the ring is handed to the next thread
+ * to register, so rings are bounded by the peak number of live threads
+ */
+struct riot_trace_ring {
+	alignas(64) atomic_uint_fast64_t head;
+	struct riot_trace_ring *next;
+	u32 tid;
+	b8 retired;
+
+	struct riot_trace_event events[RIOT_TRACE_RING_SZ];
+};
+
+/* not to be written directly; see `riot_trace_start()` */
+extern atomic_bool riot_trace_enabled;
+
+/* begins recording spans on every thread. returns false when already started */
+extern b32
+riot_trace_start(void);
+
+/* stops recording. recorded spans are kept until the next start */
+extern void
+riot_trace_stop(void);
+
+extern void
+riot_trace_record(char const *name, u64 start, u64 end, u64 bytes);
+
+/* returns the start of a span, or 0 when tracing is disabled, in which case
+ * the matching `riot_trace_end()` does nothing either
+ */
+static inline u64
+riot_trace_begin(void) {
+	return atomic_load_explicit(&riot_trace_enabled, memory_order_relaxed) ? riot_stats_clock() : 0;
+}
+
+static inline void
+riot_trace_end(char const *name, u64 start, u64 bytes) {
+	if (start) riot_trace_record(name, start, riot_stats_clock(), bytes);
+}
+
+/* writes every recorded span in the chrome trace event format. meant to be
+ * called once the traced work has finished, as spans being recorded
+ * concurrently may be torn
+ */
+extern b32
+riot_trace_write_json(FILE *fp);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* LIBRIOT_TRACE_H */
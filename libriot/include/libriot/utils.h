@@ -6,10 +6,121 @@
 
 #include "libriot.h"
 
+#include <sys/stat.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/* unaligned little-endian word loads and stores. riot formats are
+ * little-endian throughout, so on little-endian hosts these compile down to
+ * single (unaligned) moves
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	#define RIOT_LE16(v) __builtin_bswap16(v)
+	#define RIOT_LE32(v) __builtin_bswap32(v)
+	#define RIOT_LE64(v) __builtin_bswap64(v)
+#else
+	#define RIOT_LE16(v) (v)
+	#define RIOT_LE32(v) (v)
+	#define RIOT_LE64(v) (v)
+#endif
+
+static inline u8
+riot_load_le8(void const *src) {
+	return *(u8 const *)src;
+}
+
+static inline u16
+riot_load_le16(void const *src) {
+	u16 val;
+	memcpy(&val, src, sizeof val);
+	return RIOT_LE16(val);
+}
+
+static inline u32
+riot_load_le32(void const *src) {
+	u32 val;
+	memcpy(&val, src, sizeof val);
+	return RIOT_LE32(val);
+}
+
+static inline u64
+riot_load_le64(void const *src) {
+	u64 val;
+	memcpy(&val, src, sizeof val);
+	return RIOT_LE64(val);
+}
+
+static inline void
+riot_store_le8(void *dst, u8 val) {
+	*(u8 *)dst = val;
+}
+
+static inline void
+riot_store_le16(void *dst, u16 val) {
+	val = RIOT_LE16(val);
+	memcpy(dst, &val, sizeof val);
+}
+
+static inline void
+riot_store_le32(void *dst, u32 val) {
+	val = RIOT_LE32(val);
+	memcpy(dst, &val, sizeof val);
+}
+
+static inline void
+riot_store_le64(void *dst, u64 val) {
+	val = RIOT_LE64(val);
+	memcpy(dst, &val, sizeof val);
+}
+
+/* claims the next `len` bytes of an input stream with a single bounds check,
+ * so that a fixed-layout record can be decoded in place with the loads
+ * above. returns NULL, consuming nothing, if fewer than `len` bytes remain
+ */
+static inline u8 const *
+riot_mem_stream_take(struct mem_stream *self, u64 len) {
+	assert(self);
+
+	if (self->len - self->cur < len)
+		return NULL;
+
+	u8 const *ptr = self->ptr + self->cur;
+	self->cur += len;
+
+	return ptr;
+}
+
+/* claims the next `len` bytes of an output stream, growing it if need be, so
+ * that a fixed-layout record can be encoded in place with the stores above
+ */
+static inline u8 *
+riot_mem_stream_reserve(struct mem_stream *self, u64 len) {
+	assert(self);
+
+	if (self->len - self->cur < len && !mem_stream_resize(self, MAX(self->cur + len, 2 * self->len)))
+		return NULL;
+
+	u8 *ptr = self->ptr + self->cur;
+	self->cur += len;
+
+	return ptr;
+}
+
+/* maps the whole of the file at `path` read-only into `out`, filling `st`
+ * when given. the mapping stays valid after the descriptor is closed, and
+ * pages are only faulted in as they are touched. empty files are rejected,
+ * and nothing is logged, so that callers can treat failure as a miss
+ */
+extern b32
+riot_mem_stream_map_file(struct mem_stream *out, char const *path, struct stat *st);
+
+/* releases a mapping made by `riot_mem_stream_map_file()`
+ */
+extern void
+riot_mem_stream_unmap(struct mem_stream *self);
+
 /* extension methods to `struct mem_stream` to read riot primitives
  */
 
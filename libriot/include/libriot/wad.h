@@ -5,6 +5,9 @@
 #include "utils.h"
 
 #include "libriot.h"
+#include "libriot/thread_pool.h"
+#include "libriot/hash_dict.h"
+#include "libriot/writer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,17 +30,97 @@ struct riot_wad_chunk {
 	u64 checksum;
 };
 
+/* entry of a wad's sub-chunk table of contents (the `.subchunktoc` chunk).
+ * sub-chunks of a zstd-chunked entry are stored back to back, and are either
+ * independent zstd frames, or stored raw when `compressed_size` is equal to
+ * `decompressed_size`
+ */
+struct riot_wad_subchunk {
+	u32 compressed_size, decompressed_size;
+	u64 checksum;
+};
+
+/* on-disk size of a sub-chunk table of contents entry */
+#define RIOT_WAD_SUBCHUNK_SZ 16
+
 struct riot_wad {
 	u8 major, minor;
 	u32 chunk_count;
 	u32 data_start;
 };
 
+/* on-disk sizes of the v3 header (up to and including the chunk count), and
+ * of a single v3 table of contents entry
+ */
+#define RIOT_WAD_V3_HEADER_SZ 272
+#define RIOT_WAD_V3_CHUNK_SZ 32
+
+/* structure-of-arrays copy of a chunk table, one dense column per field.
+ * column `i` of every array belongs to chunk `i` of the source table
+ */
+struct riot_wad_columns {
+	u32 count;
+	xxh64_u64 *path_hash;
+	u32 *data_offset, *compressed_size, *decompressed_size;
+	u8 *compression;
+};
+
+/* predicate evaluated by `riot_wad_columns_select()`. a chunk matches when
+ * `compression_mask` has bit `1 << compression` set, and both its
+ * decompressed size and data offset lie within the inclusive ranges given
+ */
+struct riot_wad_column_query {
+	u32 compression_mask;
+	u32 size_min, size_max;
+	u32 offset_min, offset_max;
+};
+
+#define RIOT_WAD_COLUMN_QUERY_ALL (struct riot_wad_column_query) { \
+	.compression_mask = UINT32_MAX, \
+	.size_min = 0, .size_max = UINT32_MAX, \
+	.offset_min = 0, .offset_max = UINT32_MAX, \
+}
+
+struct riot_wad_column_totals {
+	u64 compressed_size, decompressed_size;
+};
+
 #define RIOT_WAD_CTX_CHUNK_POOL_SZ 4 * KiB
+#define RIOT_WAD_CTX_SUBCHUNK_POOL_SZ 1 * KiB
 
 struct riot_wad_ctx {
 	struct riot_wad wad;
 	struct mem_pool chunk_pool;
+
+	/* path hash index over `chunk_pool`, as a sorted array of path hashes
+	 * and a parallel array of the chunk indices they belong to. rebuilt by
+	 * `riot_wad_ctx_build_index()` whenever the chunk table changes
+	 */
+	struct mem_pool index_hash_pool, index_chunk_pool;
+	u32 index_count;
+
+	/* optional columnar view of `chunk_pool`, for scans over the whole
+	 * table. empty (and unallocated) until built by
+	 * `riot_wad_ctx_build_columns()`, and likewise rebuilt by it whenever
+	 * the chunk table changes
+	 */
+	struct mem_pool column_pool;
+	struct riot_wad_columns columns;
+
+	/* sub-chunk table, indexed by `struct riot_wad_chunk::sub_chunk_start`.
+	 * empty unless loaded by `riot_wad_ctx_load_subchunk_toc()` or
+	 * `riot_wad_ctx_read_subchunk_toc()`
+	 */
+	struct mem_pool subchunk_pool;
+	u32 subchunk_count;
+
+	/* source buffer the wad was read from. chunk data handed out by the
+	 * ctx are borrowed views into this buffer, which must outlive the ctx.
+	 * when `mapped` is set, the buffer is a read-only mapping owned by the
+	 * ctx and is unmapped by `riot_wad_ctx_free()`
+	 */
+	struct mem_stream src;
+	b8 mapped;
 };
 
 extern b32
@@ -49,14 +132,344 @@ riot_wad_ctx_free(struct riot_wad_ctx *self);
 extern b32
 riot_wad_ctx_pushn_chunk(struct riot_wad_ctx *self, u32 count, riot_offptr_t *out);
 
+extern b32
+riot_wad_ctx_build_index(struct riot_wad_ctx *self);
+
+extern struct riot_wad_chunk *
+riot_wad_find_chunk(struct riot_wad_ctx *ctx, xxh64_u64 path_hash);
+
+extern u32
+riot_wad_find_chunks(struct riot_wad_ctx *ctx, xxh64_u64 const *path_hashes, u32 count,
+		     struct riot_wad_chunk **out);
+
+extern b32
+riot_wad_ctx_build_columns(struct riot_wad_ctx *self);
+
+/* writes the indices of all chunks matching the query to `out`, which must
+ * have room for `columns->count` entries, in ascending order. returns the
+ * number of matches
+ */
+extern u32
+riot_wad_columns_select(struct riot_wad_columns const *columns, struct riot_wad_column_query const *query,
+			u32 *out);
+
+extern void
+riot_wad_columns_totals(struct riot_wad_columns const *columns, struct riot_wad_column_totals *out);
+
+extern b32
+riot_wad_chunk_data(struct riot_wad_ctx *ctx, struct riot_wad_chunk *chunk, struct mem_stream *out);
+
 extern b32
 riot_wad_read(struct riot_wad_ctx *ctx, struct mem_stream stream);
 
 extern b32
-riot_wad_write(struct riot_wad_ctx *ctx, void *data, u64 len, struct mem_stream stream);
+riot_wad_open_mapped(struct riot_wad_ctx *ctx, char const *path);
+
+#define RIOT_WAD_CACHE_VERSION 1
+
+/* header of a table of contents cache sidecar, followed by the chunk table,
+ * the sorted index hashes and the index chunk numbers, each laid out exactly
+ * as held in a `struct riot_wad_ctx`. a sidecar is only valid for the
+ * archive whose size, modification time and header checksum (xxh3 over the
+ * v3 header) it records, and only for builds with the same chunk layout
+ */
+struct riot_wad_cache_header {
+	char magic[4];
+	u32 version;
+	u32 chunk_sz, chunk_count;
+	u64 archive_size;
+	s64 mtime_sec, mtime_nsec;
+	u64 header_checksum;
+	u8 major, minor;
+	u16 reserved;
+	u32 data_start;
+};
+
+/* maps a wad as per `riot_wad_open_mapped()`, but takes the table of
+ * contents and index from the sidecar at `cache_path` when it matches the
+ * archive. otherwise the table of contents is parsed, and the sidecar is
+ * (re)written for the next run; failing to write it is not an error
+ */
+extern b32
+riot_wad_open_cached(struct riot_wad_ctx *ctx, char const *path, char const *cache_path);
+
+/* writes the wad header and table of contents followed by the chunk payloads
+ * taken from the data segment `data`, which is laid out starting at
+ * `ctx->wad.data_start`. chunk checksums are recomputed over the data
+ * segment, on `workers` if given, and chunks with identical payloads are
+ * stored once and flagged as duplicated. the header and table of contents
+ * are appended to `out`, and payloads are appended as references into
+ * `data`, which must stay valid until `out` is flushed
+ */
+extern b32
+riot_wad_write(struct riot_wad_ctx *ctx, void *data, u64 len, struct riot_thread_pool *workers,
+	       struct riot_writer *out);
+
+/* writes a v3 header and the table of contents exactly as held in the ctx */
+extern b32
+riot_wad_write_toc(struct riot_wad_ctx *ctx, struct mem_stream *stream);
+
+/* xxh64 path hash of a chunk path, as used in the table of contents. the
+ * path is lowercased before hashing
+ */
+extern xxh64_u64
+riot_wad_path_hash(char const *path, u64 len);
+
+/* xxh3 checksum over the stored (possibly compressed) bytes of a chunk, as
+ * recorded in v3.1+ tables of contents
+ */
+extern u64
+riot_wad_checksum(void const *data, u64 len);
+
+/* incremental form of `riot_wad_checksum()`, for payloads too large to be
+ * hashed in one go
+ */
+struct riot_wad_checksum_state;
+
+extern struct riot_wad_checksum_state *
+riot_wad_checksum_state_create(void);
 
 extern void
-riot_wad_print(struct riot_wad_ctx *ctx, FILE *f);
+riot_wad_checksum_state_free(struct riot_wad_checksum_state *state);
+
+extern void
+riot_wad_checksum_reset(struct riot_wad_checksum_state *state);
+
+extern void
+riot_wad_checksum_update(struct riot_wad_checksum_state *state, void const *data, u64 len);
+
+extern u64
+riot_wad_checksum_digest(struct riot_wad_checksum_state *state);
+
+/* v3.0 tables of contents record checksums of another algorithm, and v1
+ * ones none at all
+ */
+static inline b32
+riot_wad_version_has_xxh3_checksums(u8 major, u8 minor) {
+	return major > 3 || (major == 3 && minor >= 1);
+}
+
+extern b32
+riot_wad_ctx_compute_checksums(struct riot_wad_ctx *ctx, void *data, u64 len,
+			       struct riot_thread_pool *workers);
+
+/* recomputes the checksum of every chunk over the ctx source buffer and
+ * compares it against the stored one. `computed`, if given, receives one
+ * checksum per chunk. returns false if the checksums could not be computed,
+ * otherwise stores the number of mismatching chunks in `mismatches`
+ */
+extern b32
+riot_wad_verify_checksums(struct riot_wad_ctx *ctx, struct riot_thread_pool *workers,
+			  u64 *computed, u32 *mismatches);
+
+/* prints the wad table of contents, resolving chunk path hashes against
+ * `names` when given
+ */
+extern void
+riot_wad_print(struct riot_wad_ctx *ctx, struct riot_hash_dict *names, FILE *f);
+
+#define RIOT_WAD_DECOMPRESSOR_BUF_POOL_SZ 64 * KiB
+#define RIOT_WAD_DECOMPRESSOR_SPAN_POOL_SZ 64
+
+/* zstd-chunked entries smaller than this are decoded inline, as handing
+ * their sub-chunks to the worker pool costs more than it saves
+ */
+#define RIOT_WAD_DECOMPRESSOR_PARALLEL_MIN_SZ 256 * KiB
+
+/* whether decompressing `chunk` may spread it across the workers of the
+ * decompressor, which must then not be running a job of their own
+ */
+static inline b32
+riot_wad_chunk_decompresses_in_parallel(struct riot_wad_chunk const *chunk) {
+	return chunk->compression == RIOT_WAD_COMPRESSION_ZSTD_CHUNK &&
+		chunk->decompressed_size >= RIOT_WAD_DECOMPRESSOR_PARALLEL_MIN_SZ;
+}
+
+struct ZSTD_DCtx_s;
+
+/* per-thread decompression state. the codec contexts are created once and
+ * reused for every chunk, and `buf_pool` backs decompressed chunk data when
+ * the caller does not supply its own buffer
+ */
+struct riot_wad_decompressor {
+	struct ZSTD_DCtx_s *zstd_dctx;
+	struct mem_pool buf_pool, span_pool;
+
+	/* optional worker pool used to decode the sub-chunks of a single
+	 * zstd-chunked entry concurrently, with one decoder context per worker
+	 */
+	struct riot_thread_pool *workers;
+	struct ZSTD_DCtx_s **worker_dctxs;
+};
+
+extern b32
+riot_wad_decompressor_init(struct riot_wad_decompressor *self);
+
+extern void
+riot_wad_decompressor_free(struct riot_wad_decompressor *self);
+
+extern b32
+riot_wad_decompressor_set_workers(struct riot_wad_decompressor *self, struct riot_thread_pool *workers);
+
+/* path hash of the sub-chunk table of contents of the wad at `path`. its
+ * game path, from the last `data/` directory on, has its `.client` suffix
+ * replaced with `.subchunktoc`
+ */
+extern xxh64_u64
+riot_wad_subchunk_toc_path_hash(char const *path);
+
+/* parses the decompressed contents of a sub-chunk table of contents into
+ * `subchunk_pool`, replacing any table loaded before
+ */
+extern b32
+riot_wad_ctx_read_subchunk_toc(struct riot_wad_ctx *ctx, struct mem_stream toc);
+
+/* decompresses the sub-chunk table of contents stored as chunk
+ * `toc_path_hash` of the ctx source buffer, and reads it
+ */
+extern b32
+riot_wad_ctx_load_subchunk_toc(struct riot_wad_ctx *ctx, struct riot_wad_decompressor *dec,
+			       xxh64_u64 toc_path_hash);
+
+/* decompresses `chunk` into `buf` (which must hold at least the chunk's
+ * decompressed size), or into the decompressor's pooled buffer if `buf` is
+ * NULL. pooled data is only valid until the next call on the decompressor.
+ * uncompressed chunks are returned as a borrowed view into the ctx source
+ * buffer when no `buf` is given
+ */
+extern b32
+riot_wad_chunk_decompress(struct riot_wad_decompressor *dec, struct riot_wad_ctx *ctx,
+			  struct riot_wad_chunk *chunk, u8 *buf, u64 len,
+			  struct mem_stream *out);
+
+/* as per `riot_wad_chunk_decompress()`, but decompresses the payload bytes
+ * given in `src` (which must hold exactly the chunk's compressed size)
+ * rather than those in the ctx source buffer, for chunks that were read in
+ * by other means. uncompressed chunks are then returned as a view into `src`
+ */
+extern b32
+riot_wad_chunk_decompress_data(struct riot_wad_decompressor *dec, struct riot_wad_ctx *ctx,
+			       struct riot_wad_chunk *chunk, struct mem_stream src, u8 *buf, u64 len,
+			       struct mem_stream *out);
+
+#define RIOT_WAD_BUILDER_SLOTS_PER_WORKER 2
+#define RIOT_WAD_BUILDER_SLOT_POOL_SZ 64 * KiB
+#define RIOT_WAD_BUILDER_BLOCK_SZ 4 * MiB
+#define RIOT_WAD_BUILDER_DEFAULT_LEVEL 3
+
+struct ZSTD_CCtx_s;
+
+/* a file queued in the builder, along with the buffers it is read and
+ * compressed into. slots are reused across batches. files larger than
+ * `RIOT_WAD_BUILDER_BLOCK_SZ` are left with a NULL `stored`, and are read
+ * and compressed a block at a time as they are written, straight into the
+ * output
+ */
+struct riot_wad_builder_slot {
+	char *path;
+	struct riot_wad_chunk chunk;
+	struct mem_pool raw, packed;
+	u8 *stored;
+	b8 failed;
+};
+
+/* streaming wad writer. files are queued one at a time into one of two
+ * banks of slots, and every time a bank fills up, its files are read and
+ * zstd-compressed on the worker pool, while the previous bank is appended
+ * to the output, in order, by one more task of the same job. payload memory
+ * is thus bounded by the queue depth and block size rather than the archive
+ * size. the header and table of contents are written once all files have
+ * been added, into space reserved up front for `chunk_count` entries: that
+ * count is only a hint, as unused entries are left as slack, and payloads
+ * a larger table of contents would overwrite are moved to the end of the
+ * file
+ */
+struct riot_wad_builder {
+	struct riot_wad_ctx ctx;
+	int fd;
+	s32 level;
+	u32 reserved;
+	u64 data_cur;
+
+	struct riot_thread_pool *workers;
+	struct ZSTD_CCtx_s **cctxs;
+	struct riot_wad_checksum_state **checksums;
+	u32 cctx_count;
+
+	/* `bank` is being filled with `pending` files, while the other one
+	 * holds `queued` compressed files, waiting to be written out
+	 */
+	struct riot_wad_builder_slot *slots;
+	u32 slot_count, bank, pending, queued;
+	b8 write_failed;
+};
+
+extern b32
+riot_wad_builder_init(struct riot_wad_builder *self, int fd, u32 chunk_count,
+		      struct riot_thread_pool *workers);
+
+extern void
+riot_wad_builder_free(struct riot_wad_builder *self);
+
+/* queues the file at `path`. every few files, this packs and writes out the
+ * files queued before it, so a failure may be that of an earlier file, which
+ * is then logged by path
+ */
+extern b32
+riot_wad_builder_add_file(struct riot_wad_builder *self, xxh64_u64 path_hash, char const *path);
+
+extern b32
+riot_wad_builder_finish(struct riot_wad_builder *self);
+
+/* byte range of a wad file not referenced by any chunk */
+struct riot_wad_extent {
+	u64 off, len;
+};
+
+#define RIOT_WAD_PATCH_EXTENT_POOL_SZ 256
+#define RIOT_WAD_PATCH_SCRATCH_POOL_SZ 64 * KiB
+
+/* in-place editor for an existing v3 wad. only the table of contents is
+ * loaded; new payloads are written into unreferenced extents of the file,
+ * or appended to its end, and the header and table of contents are
+ * rewritten by `riot_wad_patch_commit()`. payloads referenced by the table
+ * of contents on disk are never overwritten before the commit, so an
+ * interrupted patch leaves the previous archive readable, short of the
+ * final table of contents write itself
+ */
+struct riot_wad_patch {
+	struct riot_wad_ctx ctx;
+	int fd;
+	s32 level;
+	u64 file_len;
+
+	struct ZSTD_CCtx_s *cctx;
+	struct mem_pool scratch_pool;
+
+	/* extents available for new payloads, and extents released since the
+	 * last commit, which only become available once it has happened
+	 */
+	struct mem_pool free_pool, released_pool;
+	u32 free_count, released_count;
+};
+
+extern b32
+riot_wad_patch_open(struct riot_wad_patch *self, char const *path);
+
+extern void
+riot_wad_patch_close(struct riot_wad_patch *self);
+
+/* replaces the chunk with the given path hash, or adds it if not present.
+ * the payload is zstd-compressed, or stored raw if that does not shrink it
+ */
+extern b32
+riot_wad_patch_put(struct riot_wad_patch *self, xxh64_u64 path_hash, void const *data, u64 len);
+
+extern b32
+riot_wad_patch_remove(struct riot_wad_patch *self, xxh64_u64 path_hash);
+
+extern b32
+riot_wad_patch_commit(struct riot_wad_patch *self);
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,92 @@
+#ifndef LIBRIOT_WAD_IO_H
+#define LIBRIOT_WAD_IO_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+#include "libriot/wad.h"
+#include "libriot/thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define RIOT_WAD_IO_DEFAULT_DEPTH 64
+#define RIOT_WAD_IO_MAX_RUN_SZ 16 * MiB
+#define RIOT_WAD_IO_POOL_SZ 64 * KiB
+
+/* a contiguous byte range of the archive, read with a single request. `cur`
+ * tracks how much of it has been read so far, across short reads
+ */
+struct riot_wad_io_run {
+	u64 off, len, cur;
+	u64 buf_off;
+};
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/* an io_uring instance set up with raw syscalls, and its mapped rings */
+struct riot_wad_io_ring {
+	int fd;
+	u32 entries;
+
+	void *sq_ptr, *cq_ptr;
+	u64 sq_len, cq_len, sqes_len;
+
+	u32 *sq_head, *sq_tail, *sq_mask, *sq_array;
+	u32 *cq_head, *cq_tail, *cq_mask;
+
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+/* reads chunk payloads out of a wad that is not mapped. each batch of chunks
+ * is sorted by data offset, coalesced into runs of adjacent (or shared)
+ * payloads, and read into `buf_pool` with up to `depth` reads in flight on
+ * an io_uring. where io_uring is unavailable (or a depth of 0 was asked for),
+ * runs are read with blocking preads spread across the worker pool instead
+ */
+struct riot_wad_io {
+	int fd;
+	u64 size;
+
+	b8 uring;
+	struct riot_wad_io_ring ring;
+	struct riot_thread_pool *workers;
+
+	/* header and table of contents of the archive, read by
+	 * `riot_wad_io_open()` and parsed into the ctx, which is left without
+	 * a source buffer rather than pointing into this one
+	 */
+	struct mem_pool toc_pool;
+
+	struct mem_pool key_pool, run_pool, buf_pool;
+};
+
+/* opens the wad at `path` for batched reads, and reads its header and table
+ * of contents into `ctx`, without reading any chunk payloads. the ctx holds
+ * no references into the io, and its payloads are only ever read through
+ * `riot_wad_io_read()`
+ */
+extern b32
+riot_wad_io_open(struct riot_wad_io *self, struct riot_wad_ctx *ctx, char const *path, u32 depth,
+		 struct riot_thread_pool *workers);
+
+extern void
+riot_wad_io_close(struct riot_wad_io *self);
+
+/* reads the payloads of the `count` chunks whose indices are given in
+ * `chunks`. `out[i]` receives a view of the payload of chunk `chunks[i]`,
+ * valid until the next batch is read
+ */
+extern b32
+riot_wad_io_read(struct riot_wad_io *self, struct riot_wad_ctx *ctx, u32 const *chunks, u32 count,
+		 struct mem_stream *out);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* LIBRIOT_WAD_IO_H */
@@ -0,0 +1,73 @@
+#ifndef LIBRIOT_WAD_MOUNT_H
+#define LIBRIOT_WAD_MOUNT_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+#include "libriot/wad.h"
+#include "libriot/thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* location of a chunk within a mount set */
+struct riot_wad_mount_ref {
+	u32 archive, chunk;
+};
+
+#define RIOT_WAD_MOUNT_POOL_SZ 64 * KiB
+
+/* a set of wads mounted as one namespace. archives are ordered by
+ * precedence: when several archives hold the same path hash, the one mounted
+ * last wins. the merged index holds one entry per distinct path hash, as a
+ * sorted hash array and a parallel array of the chunks they resolve to.
+ * when `cache_dir` is set, archives are opened through their table of
+ * contents cache sidecars kept in that directory
+ */
+struct riot_wad_mount {
+	struct riot_wad_ctx *archives;
+	char **paths;
+	u32 archive_count;
+
+	char const *cache_dir;
+
+	struct mem_pool index_hash_pool, index_ref_pool;
+	u32 index_count;
+};
+
+extern b32
+riot_wad_mount_init(struct riot_wad_mount *self);
+
+extern void
+riot_wad_mount_free(struct riot_wad_mount *self);
+
+/* maps and reads every archive in `paths` (on `workers`, if given), in the
+ * given precedence order, and builds the merged index
+ */
+extern b32
+riot_wad_mount_open(struct riot_wad_mount *self, char const **paths, u32 count,
+		    struct riot_thread_pool *workers);
+
+/* mounts every `.wad` and `.wad.client` file below `dir`, with precedence in
+ * ascending path order
+ */
+extern b32
+riot_wad_mount_open_dir(struct riot_wad_mount *self, char const *dir, struct riot_thread_pool *workers);
+
+extern struct riot_wad_chunk *
+riot_wad_mount_find(struct riot_wad_mount *self, xxh64_u64 path_hash, struct riot_wad_ctx **archive);
+
+/* resolves a path hash across the mount set and decompresses its chunk, as
+ * per `riot_wad_chunk_decompress()`
+ */
+extern b32
+riot_wad_mount_read(struct riot_wad_mount *self, struct riot_wad_decompressor *dec, xxh64_u64 path_hash,
+		    u8 *buf, u64 len, struct mem_stream *out);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* LIBRIOT_WAD_MOUNT_H */
@@ -0,0 +1,81 @@
+#ifndef LIBRIOT_WRITER_H
+#define LIBRIOT_WRITER_H
+
+#include "common.h"
+#include "utils.h"
+
+#include "libriot.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* a run of output bytes. owned runs live in the writer's byte pool at `off`
+ * (an offset, as the pool may move as it grows), while borrowed runs point
+ * at caller memory, which must stay valid until the writer is flushed
+ */
+struct riot_writer_segment {
+	u8 const *ptr;
+	u64 off, len;
+};
+
+#define RIOT_WRITER_BUF_POOL_SZ 64 * KiB
+#define RIOT_WRITER_SEGMENT_POOL_SZ 256
+
+/* scatter-gather output buffer. small fields are encoded into a pool of
+ * owned bytes, whose capacity grows geometrically, and large payloads are
+ * referenced in place rather than copied. the segment list is written out
+ * with writev()
+ */
+struct riot_writer {
+	struct mem_pool buf_pool, segment_pool;
+	u32 segment_count;
+	u64 len;
+};
+
+extern b32
+riot_writer_init(struct riot_writer *self);
+
+extern void
+riot_writer_free(struct riot_writer *self);
+
+extern void
+riot_writer_reset(struct riot_writer *self);
+
+/* appends `len` owned bytes and returns them for the caller to fill in. the
+ * pointer is only valid until the next call that appends to the writer
+ */
+extern u8 *
+riot_writer_reserve(struct riot_writer *self, u64 len);
+
+/* offset of owned bytes returned by `riot_writer_reserve()`, which unlike
+ * the pointer stays valid as the writer grows. used to patch in values only
+ * known once later output has been appended, such as section sizes
+ */
+static inline u64
+riot_writer_owned_off(struct riot_writer *self, u8 const *ptr) {
+	return ptr - self->buf_pool.ptr;
+}
+
+static inline u8 *
+riot_writer_owned_ptr(struct riot_writer *self, u64 off) {
+	return self->buf_pool.ptr + off;
+}
+
+/* appends a copy of `len` bytes */
+extern b32
+riot_writer_push(struct riot_writer *self, void const *buf, u64 len);
+
+/* appends a reference to `len` bytes, without copying them */
+extern b32
+riot_writer_push_ref(struct riot_writer *self, void const *buf, u64 len);
+
+/* writes every segment to `fd` in order, and resets the writer */
+extern b32
+riot_writer_flush(struct riot_writer *self, int fd);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* LIBRIOT_WRITER_H */
@@ -1,4 +1,4 @@
-.PHONY: libriot libriot-build libriot-test
+.PHONY: libriot libriot-build libriot-test libriot-bench
 
 LIBRIOT_MAJOR	:= 0
 LIBRIOT_MINOR	:= 1
@@ -14,18 +14,38 @@ LIBRIOT_CFLAGS	:= \
 		   -DLIBRIOT_VERSION="\"$(LIBRIOT_VERSION)"\" \
 		   -Ilibriot/include
 
+# besides libzstd, libriot needs the headers of xxHash (xxhash.h), which it
+# uses header-only and so does not link against
+LIBRIOT_LDLIBS	:= -lzstd -lpthread
+
 LIBRIOT_FLAGS	:= \
 		   $(LIBRIOT_CFLAGS) \
-		   $(LDFLAGS)
+		   $(LDFLAGS) $(LIBRIOT_LDLIBS)
 
 LIBRIOT_SOURCES	:= libriot/src/libriot.c \
 		   libriot/src/utils.c \
+		   libriot/src/stats.c \
+		   libriot/src/trace.c \
+		   libriot/src/writer.c \
+		   libriot/src/thread_pool.c \
+		   libriot/src/hash_dict.c \
 		   libriot/src/wad.c \
+		   libriot/src/wad_index.c \
+		   libriot/src/wad_columns.c \
 		   libriot/src/wad_reader.c \
 		   libriot/src/wad_writer.c \
+		   libriot/src/wad_decompress.c \
+		   libriot/src/wad_checksum.c \
+		   libriot/src/wad_builder.c \
+		   libriot/src/wad_patch.c \
+		   libriot/src/wad_mount.c \
+		   libriot/src/wad_cache.c \
+		   libriot/src/wad_io.c \
+		   libriot/src/chunk_cache.c \
 		   libriot/src/wad_printer.c \
 		   libriot/src/inibin.c \
 		   libriot/src/inibin_reader.c \
+		   libriot/src/inibin_index.c \
 		   libriot/src/inibin_writer.c \
 		   libriot/src/inibin_printer.c
 
@@ -46,8 +66,46 @@ libriot-deps:
 
 libriot-build: $(LIB)/libriot.a
 
-libriot-test-deps:
+LIBRIOT_TEST_SOURCES	:= libriot/test/chunk_cache.c \
+			   libriot/test/hash_dict.c \
+			   libriot/test/inibin.c \
+			   libriot/test/search.c \
+			   libriot/test/wad.c \
+			   libriot/test/wad_builder.c \
+			   libriot/test/wad_cache.c \
+			   libriot/test/wad_checksum.c \
+			   libriot/test/wad_columns.c \
+			   libriot/test/wad_decompress.c \
+			   libriot/test/wad_io.c \
+			   libriot/test/wad_mount.c \
+			   libriot/test/writer.c
+
+LIBRIOT_TESTS	:= $(LIBRIOT_TEST_SOURCES:libriot/test/%.c=$(TST)/libriot-%)
+
+$(LIBRIOT_TESTS): $(TST)/libriot-%: libriot/test/%.c $(LIB)/libriot.a | $(TST)
+	$(CC) -o $@ $< $(LIBRIOT_CFLAGS) $(LDFLAGS) -lriot $(LIBRIOT_LDLIBS)
+
+libriot-test-deps: $(LIB)/libriot.a
+
+libriot-test: libriot-test-deps $(LIBRIOT_TESTS)
+	@for test in $(LIBRIOT_TESTS); do ./$$test || exit 1; done
+
+LIBRIOT_BENCH_SOURCES	:= libriot/bench/mem_stream.c \
+			   libriot/bench/wad.c \
+			   libriot/bench/inibin.c
+
+LIBRIOT_BENCH_LDLIBS	:= -lm
+
+LIBRIOT_BENCHES	:= $(LIBRIOT_BENCH_SOURCES:libriot/bench/%.c=$(BNC)/libriot-%)
+
+# corpus options are passed to every benchmark as `key=value` pairs, e.g.
+# `make bench BENCH_ARGS="chunks=65536 dist=uniform"`
+BENCH_ARGS	?=
+
+$(LIBRIOT_BENCHES): $(BNC)/libriot-%: libriot/bench/%.c libriot/bench/bench.h $(LIB)/libriot.a | $(BNC)
+	$(CC) -o $@ $< $(LIBRIOT_CFLAGS) $(LDFLAGS) -lriot $(LIBRIOT_LDLIBS) $(LIBRIOT_BENCH_LDLIBS)
 
-libriot-test:
+libriot-bench: $(LIBRIOT_BENCHES)
+	@for bench in $^; do ./$$bench $(BENCH_ARGS) || exit 1; done
 
 libriot: libriot-build libriot-test
@@ -0,0 +1,357 @@
+#include "libriot/chunk_cache.h"
+#include "libriot/stats.h"
+
+static inline struct riot_chunk_cache_shard *
+riot_chunk_cache_shard_of(struct riot_chunk_cache *self, xxh64_u64 path_hash) {
+	/* buckets are picked with the low bits, so shards use the high ones */
+	return &self->shards[(path_hash >> 32) & self->shard_mask];
+}
+
+static void
+riot_chunk_cache_list_remove(struct riot_chunk_cache_list *list, struct riot_chunk_cache_entry *entry) {
+	if (entry->prev) entry->prev->next = entry->next;
+	else list->head = entry->next;
+
+	if (entry->next) entry->next->prev = entry->prev;
+	else list->tail = entry->prev;
+
+	entry->prev = entry->next = NULL;
+	list->len -= entry->len;
+}
+
+static void
+riot_chunk_cache_list_push(struct riot_chunk_cache_list *list, struct riot_chunk_cache_entry *entry) {
+	entry->prev = list->tail;
+	entry->next = NULL;
+
+	if (list->tail) list->tail->next = entry;
+	else list->head = entry;
+
+	list->tail = entry;
+	list->len += entry->len;
+}
+
+static struct riot_chunk_cache_entry **
+riot_chunk_cache_shard_slot(struct riot_chunk_cache_shard *shard, xxh64_u64 path_hash) {
+	struct riot_chunk_cache_entry **slot = &shard->buckets[path_hash & shard->bucket_mask];
+	while (*slot && (*slot)->path_hash != path_hash)
+		slot = &(*slot)->chain;
+
+	return slot;
+}
+
+static void
+riot_chunk_cache_shard_grow(struct riot_chunk_cache_shard *shard) {
+	u32 count = (shard->bucket_mask + 1) * 2;
+
+	struct riot_chunk_cache_entry **buckets = calloc(count, sizeof *buckets);
+	if (!buckets) return; /* longer chains are slower, but still correct */
+
+	for (u32 i = 0; i <= shard->bucket_mask; i++) {
+		struct riot_chunk_cache_entry *entry = shard->buckets[i];
+		while (entry) {
+			struct riot_chunk_cache_entry *chain = entry->chain;
+
+			u32 idx = entry->path_hash & (count - 1);
+			entry->chain = buckets[idx];
+			buckets[idx] = entry;
+
+			entry = chain;
+		}
+	}
+
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->bucket_mask = count - 1;
+}
+
+static void
+riot_chunk_cache_shard_unlink(struct riot_chunk_cache_shard *shard, struct riot_chunk_cache_entry *entry) {
+	struct riot_chunk_cache_entry **slot = riot_chunk_cache_shard_slot(shard, entry->path_hash);
+	assert(*slot == entry);
+
+	*slot = entry->chain;
+	entry->chain = NULL;
+
+	riot_chunk_cache_list_remove(&shard->segments[entry->segment], entry);
+	entry->cached = false;
+	shard->count--;
+}
+
+/* evicts least recently used entries, probationary ones first, until the
+ * shard is back within its budget. `keep` (the entry being inserted) is
+ * never chosen
+ */
+static void
+riot_chunk_cache_shard_evict(struct riot_chunk_cache_shard *shard, struct riot_chunk_cache_entry *keep) {
+	struct riot_chunk_cache_list *probation = &shard->segments[RIOT_CHUNK_CACHE_PROBATION];
+	struct riot_chunk_cache_list *protected = &shard->segments[RIOT_CHUNK_CACHE_PROTECTED];
+
+	while (probation->len + protected->len > shard->cap) {
+		struct riot_chunk_cache_entry *victim = probation->head;
+		if (!victim || victim == keep) victim = protected->head;
+		if (!victim) break;
+
+		riot_chunk_cache_shard_unlink(shard, victim);
+		shard->stats.evictions++;
+		riot_stats_add(RIOT_STAT_CHUNK_CACHE_EVICTIONS, 1);
+
+		if (!victim->refs) free(victim);
+	}
+}
+
+static void
+riot_chunk_cache_shard_touch(struct riot_chunk_cache_shard *shard, struct riot_chunk_cache_entry *entry) {
+	struct riot_chunk_cache_list *probation = &shard->segments[RIOT_CHUNK_CACHE_PROBATION];
+	struct riot_chunk_cache_list *protected = &shard->segments[RIOT_CHUNK_CACHE_PROTECTED];
+
+	riot_chunk_cache_list_remove(&shard->segments[entry->segment], entry);
+
+	entry->segment = RIOT_CHUNK_CACHE_PROTECTED;
+	riot_chunk_cache_list_push(protected, entry);
+
+	/* entries pushed out of the protected segment get another chance on
+	 * probation, rather than being evicted outright
+	 */
+	u64 protected_cap = shard->cap / 100 * RIOT_CHUNK_CACHE_PROTECTED_PCT;
+	while (protected->len > protected_cap && protected->head != entry) {
+		struct riot_chunk_cache_entry *demoted = protected->head;
+
+		riot_chunk_cache_list_remove(protected, demoted);
+		demoted->segment = RIOT_CHUNK_CACHE_PROBATION;
+		riot_chunk_cache_list_push(probation, demoted);
+	}
+}
+
+b32
+riot_chunk_cache_init(struct riot_chunk_cache *self, u64 cap, u32 shard_count) {
+	assert(self);
+
+	u32 shards = 1;
+	while (shards < shard_count) shards *= 2;
+
+	self->shard_mask = shards - 1;
+	self->cap = cap;
+
+	u64 shards_size = shards * sizeof *self->shards;
+	self->shards = aligned_alloc(alignof(struct riot_chunk_cache_shard), shards_size);
+	if (!self->shards)
+		goto shards_alloc_failure;
+
+	memset(self->shards, 0, shards_size);
+
+	u32 initialised = 0;
+	for (; initialised < shards; initialised++) {
+		struct riot_chunk_cache_shard *shard = &self->shards[initialised];
+
+		shard->cap = cap / shards;
+		shard->bucket_mask = RIOT_CHUNK_CACHE_MIN_BUCKETS - 1;
+
+		shard->buckets = calloc(RIOT_CHUNK_CACHE_MIN_BUCKETS, sizeof *shard->buckets);
+		if (!shard->buckets)
+			goto shard_init_failure;
+
+		if (pthread_mutex_init(&shard->lock, NULL)) {
+			free(shard->buckets);
+			goto shard_init_failure;
+		}
+	}
+
+	return true;
+
+shard_init_failure:
+	for (u32 i = 0; i < initialised; i++) {
+		pthread_mutex_destroy(&self->shards[i].lock);
+		free(self->shards[i].buckets);
+	}
+
+	free(self->shards);
+shards_alloc_failure:
+	return false;
+}
+
+void
+riot_chunk_cache_free(struct riot_chunk_cache *self) {
+	assert(self);
+
+	for (u32 i = 0; i <= self->shard_mask; i++) {
+		struct riot_chunk_cache_shard *shard = &self->shards[i];
+
+		for (u32 s = 0; s < RIOT_CHUNK_CACHE_SEGMENTS; s++) {
+			struct riot_chunk_cache_entry *entry = shard->segments[s].head;
+			while (entry) {
+				struct riot_chunk_cache_entry *next = entry->next;
+				assert(!entry->refs);
+
+				free(entry);
+				entry = next;
+			}
+		}
+
+		pthread_mutex_destroy(&shard->lock);
+		free(shard->buckets);
+	}
+
+	free(self->shards);
+}
+
+struct riot_chunk_cache_entry *
+riot_chunk_cache_get(struct riot_chunk_cache *self, xxh64_u64 path_hash) {
+	assert(self);
+
+	struct riot_chunk_cache_shard *shard = riot_chunk_cache_shard_of(self, path_hash);
+
+	pthread_mutex_lock(&shard->lock);
+
+	struct riot_chunk_cache_entry *entry = *riot_chunk_cache_shard_slot(shard, path_hash);
+	if (entry) {
+		entry->refs++;
+		riot_chunk_cache_shard_touch(shard, entry);
+		shard->stats.hits++;
+	} else {
+		shard->stats.misses++;
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	riot_stats_add(entry ? RIOT_STAT_CHUNK_CACHE_HITS : RIOT_STAT_CHUNK_CACHE_MISSES, 1);
+
+	return entry;
+}
+
+static struct riot_chunk_cache_entry *
+riot_chunk_cache_entry_alloc(xxh64_u64 path_hash, u64 len) {
+	struct riot_chunk_cache_entry *entry = malloc(sizeof *entry + len);
+	if (!entry) {
+		errlog("Failed to allocate chunk cache entry (%lu bytes)", len);
+		return NULL;
+	}
+
+	entry->path_hash = path_hash;
+	entry->data = (u8 *)(entry + 1);
+	entry->len = len;
+	entry->chain = entry->prev = entry->next = NULL;
+	entry->refs = 1;
+	entry->segment = RIOT_CHUNK_CACHE_PROBATION;
+	entry->cached = false;
+
+	return entry;
+}
+
+/* takes ownership of a referenced, not yet cached `entry` */
+static struct riot_chunk_cache_entry *
+riot_chunk_cache_insert(struct riot_chunk_cache *self, struct riot_chunk_cache_entry *entry) {
+	struct riot_chunk_cache_shard *shard = riot_chunk_cache_shard_of(self, entry->path_hash);
+
+	/* too large to ever fit: handed back uncached, and freed on release */
+	if (entry->len > shard->cap) return entry;
+
+	pthread_mutex_lock(&shard->lock);
+
+	/* another thread may have inserted the same chunk since our miss */
+	struct riot_chunk_cache_entry **slot = riot_chunk_cache_shard_slot(shard, entry->path_hash);
+	if (*slot) {
+		struct riot_chunk_cache_entry *existing = *slot;
+		existing->refs++;
+
+		pthread_mutex_unlock(&shard->lock);
+
+		free(entry);
+		return existing;
+	}
+
+	*slot = entry;
+	entry->cached = true;
+	riot_chunk_cache_list_push(&shard->segments[RIOT_CHUNK_CACHE_PROBATION], entry);
+
+	shard->count++;
+	shard->stats.inserts++;
+
+	riot_chunk_cache_shard_evict(shard, entry);
+
+	if (shard->count > shard->bucket_mask + 1)
+		riot_chunk_cache_shard_grow(shard);
+
+	pthread_mutex_unlock(&shard->lock);
+
+	return entry;
+}
+
+struct riot_chunk_cache_entry *
+riot_chunk_cache_put(struct riot_chunk_cache *self, xxh64_u64 path_hash, void const *data, u64 len) {
+	assert(self);
+	assert(data || !len);
+
+	struct riot_chunk_cache_entry *entry = riot_chunk_cache_entry_alloc(path_hash, len);
+	if (!entry) return NULL;
+
+	memcpy(entry->data, data, len);
+
+	return riot_chunk_cache_insert(self, entry);
+}
+
+void
+riot_chunk_cache_release(struct riot_chunk_cache *self, struct riot_chunk_cache_entry *entry) {
+	assert(self);
+	assert(entry);
+
+	struct riot_chunk_cache_shard *shard = riot_chunk_cache_shard_of(self, entry->path_hash);
+
+	pthread_mutex_lock(&shard->lock);
+
+	assert(entry->refs);
+	b32 dead = --entry->refs == 0 && !entry->cached;
+
+	pthread_mutex_unlock(&shard->lock);
+
+	if (dead) free(entry);
+}
+
+void
+riot_chunk_cache_get_stats(struct riot_chunk_cache *self, struct riot_chunk_cache_stats *out) {
+	assert(self);
+	assert(out);
+
+	memset(out, 0, sizeof *out);
+
+	for (u32 i = 0; i <= self->shard_mask; i++) {
+		struct riot_chunk_cache_shard *shard = &self->shards[i];
+
+		pthread_mutex_lock(&shard->lock);
+
+		out->hits += shard->stats.hits;
+		out->misses += shard->stats.misses;
+		out->inserts += shard->stats.inserts;
+		out->evictions += shard->stats.evictions;
+		out->count += shard->count;
+
+		for (u32 s = 0; s < RIOT_CHUNK_CACHE_SEGMENTS; s++)
+			out->len += shard->segments[s].len;
+
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+struct riot_chunk_cache_entry *
+riot_chunk_cache_read(struct riot_chunk_cache *self, struct riot_wad_decompressor *dec,
+		      struct riot_wad_ctx *ctx, struct riot_wad_chunk *chunk) {
+	assert(self);
+	assert(dec);
+	assert(ctx);
+	assert(chunk);
+
+	struct riot_chunk_cache_entry *entry = riot_chunk_cache_get(self, chunk->path_hash);
+	if (entry) return entry;
+
+	entry = riot_chunk_cache_entry_alloc(chunk->path_hash, chunk->decompressed_size);
+	if (!entry) return NULL;
+
+	struct mem_stream out;
+	if (!riot_wad_chunk_decompress(dec, ctx, chunk, entry->data, entry->len, &out)) {
+		errlog("Failed to decompress chunk: %016lx", chunk->path_hash);
+		free(entry);
+		return NULL;
+	}
+
+	return riot_chunk_cache_insert(self, entry);
+}
@@ -0,0 +1,324 @@
+#include "libriot/hash_dict.h"
+
+#include <sys/mman.h>
+
+struct riot_hash_dict_entry {
+	u64 hash;
+	struct riot_hash_dict_str str;
+};
+
+struct riot_hash_dict_segment {
+	u64 src_begin, src_end;
+	u64 begin, count;
+};
+
+struct riot_hash_dict_job {
+	u8 const *src;
+	struct riot_hash_dict_segment *segments, *merged;
+	struct riot_hash_dict_entry *entries, *scratch;
+	u32 segment_count;
+};
+
+b32
+riot_hash_dict_init(struct riot_hash_dict *self) {
+	assert(self);
+
+	memset(&self->src, 0, sizeof self->src);
+	self->count = 0;
+
+	if (!MEM_POOL_INIT(&self->hash_pool, u64, RIOT_HASH_DICT_POOL_SZ))
+		goto hash_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->str_pool, struct riot_hash_dict_str, RIOT_HASH_DICT_POOL_SZ))
+		goto str_pool_alloc_failure;
+
+	return true;
+
+str_pool_alloc_failure:
+	mem_pool_free(&self->hash_pool);
+hash_pool_alloc_failure:
+	return false;
+}
+
+void
+riot_hash_dict_free(struct riot_hash_dict *self) {
+	assert(self);
+
+	mem_pool_free(&self->hash_pool);
+	mem_pool_free(&self->str_pool);
+
+	if (self->src.ptr)
+		munmap(self->src.ptr, self->src.len);
+}
+
+static void
+riot_hash_dict_run(struct riot_thread_pool *workers, u64 count, riot_thread_pool_fn fn, void *arg) {
+	if (workers) {
+		riot_thread_pool_run(workers, count, fn, arg);
+	} else {
+		for (u64 i = 0; i < count; i++)
+			fn(arg, 0, i);
+	}
+}
+
+static void
+riot_hash_dict_count_task(void *arg, u32 worker, u64 idx) {
+	struct riot_hash_dict_job *job = arg;
+	struct riot_hash_dict_segment *segment = &job->segments[idx];
+
+	(void) worker;
+
+	u8 const *cur = job->src + segment->src_begin, *end = job->src + segment->src_end;
+
+	u64 lines = 0;
+	while (cur < end) {
+		u8 const *eol = memchr(cur, '\n', end - cur);
+		lines++;
+		cur = eol ? eol + 1 : end;
+	}
+
+	segment->count = lines;
+}
+
+static inline s32
+riot_hash_dict_hexval(u8 c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static inline b32
+riot_hash_dict_parse_line(u8 const *src, u64 begin, u64 end, struct riot_hash_dict_entry *out) {
+	u64 hash = 0, cur = begin;
+
+	for (; cur < end && cur - begin < 16; cur++) {
+		s32 val = riot_hash_dict_hexval(src[cur]);
+		if (val < 0) break;
+
+		hash = (hash << 4) | (u64)val;
+	}
+
+	if (cur == begin || cur >= end || src[cur] != ' ')
+		return false;
+
+	u64 name_begin = cur + 1, name_end = end;
+	if (name_end > name_begin && src[name_end - 1] == '\r')
+		name_end--;
+
+	if (name_end == name_begin)
+		return false;
+
+	out->hash = hash;
+	out->str.off = name_begin;
+	out->str.len = name_end - name_begin;
+
+	return true;
+}
+
+static int
+riot_hash_dict_entry_cmp(void const *lhs, void const *rhs) {
+	struct riot_hash_dict_entry const *a = lhs, *b = rhs;
+
+	if (a->hash != b->hash)
+		return (a->hash > b->hash) - (a->hash < b->hash);
+
+	return (a->str.off > b->str.off) - (a->str.off < b->str.off);
+}
+
+static void
+riot_hash_dict_parse_task(void *arg, u32 worker, u64 idx) {
+	struct riot_hash_dict_job *job = arg;
+	struct riot_hash_dict_segment *segment = &job->segments[idx];
+
+	(void) worker;
+
+	struct riot_hash_dict_entry *out = job->entries + segment->begin;
+
+	u64 cur = segment->src_begin, count = 0;
+	while (cur < segment->src_end) {
+		u8 const *eol = memchr(job->src + cur, '\n', segment->src_end - cur);
+		u64 end = eol ? (u64)(eol - job->src) : segment->src_end;
+
+		if (riot_hash_dict_parse_line(job->src, cur, end, &out[count]))
+			count++;
+
+		cur = end + 1;
+	}
+
+	segment->count = count;
+
+	qsort(out, count, sizeof *out, riot_hash_dict_entry_cmp);
+}
+
+static void
+riot_hash_dict_merge_task(void *arg, u32 worker, u64 idx) {
+	struct riot_hash_dict_job *job = arg;
+
+	(void) worker;
+
+	struct riot_hash_dict_segment *lhs = &job->segments[2 * idx];
+	struct riot_hash_dict_segment *rhs = 2 * idx + 1 < job->segment_count ? lhs + 1 : NULL;
+	struct riot_hash_dict_segment *dst = &job->merged[idx];
+
+	struct riot_hash_dict_entry *a = job->entries + lhs->begin, *a_end = a + lhs->count;
+	struct riot_hash_dict_entry *b = rhs ? job->entries + rhs->begin : NULL, *b_end = rhs ? b + rhs->count : NULL;
+	struct riot_hash_dict_entry *out = job->scratch + dst->begin;
+
+	while (a < a_end && b < b_end)
+		*out++ = (riot_hash_dict_entry_cmp(b, a) < 0) ? *b++ : *a++;
+
+	memcpy(out, a, (a_end - a) * sizeof *a);
+	out += a_end - a;
+
+	if (b) memcpy(out, b, (b_end - b) * sizeof *b);
+}
+
+b32
+riot_hash_dict_load(struct riot_hash_dict *self, char const *path, struct riot_thread_pool *workers) {
+	assert(self);
+	assert(path);
+	assert(!self->src.ptr);
+
+	if (!riot_mem_stream_map_file(&self->src, path, NULL)) {
+		errlog("Failed to map hash list: %s", path);
+		return false;
+	}
+
+	if (self->src.len > UINT32_MAX) {
+		errlog("Hash list size unsupported: %s", path);
+		riot_mem_stream_unmap(&self->src);
+		return false;
+	}
+
+	b32 res = false;
+
+	u32 segment_count = workers ? workers->thread_count : 1;
+
+	struct riot_hash_dict_job job = {
+		.src = self->src.ptr,
+		.segments = calloc(segment_count, sizeof *job.segments),
+		.merged = calloc(segment_count, sizeof *job.merged),
+		.segment_count = segment_count,
+	};
+
+	if (!job.segments || !job.merged) {
+		errlog("Failed to allocate hash list segments");
+		goto segments_cleanup;
+	}
+
+	/* split at the first line break after each even split point, so that
+	 * every line belongs to exactly one segment
+	 */
+	for (u32 i = 0; i < segment_count; i++) {
+		u64 split = self->src.len * (i + 1) / segment_count;
+
+		u8 const *eol = memchr(job.src + split, '\n', self->src.len - split);
+		u64 end = (i + 1 == segment_count || !eol) ? self->src.len : (u64)(eol - job.src) + 1;
+
+		job.segments[i].src_begin = i ? job.segments[i - 1].src_end : 0;
+		job.segments[i].src_end = MAX(end, job.segments[i].src_begin);
+	}
+
+	riot_hash_dict_run(workers, segment_count, riot_hash_dict_count_task, &job);
+
+	u64 capacity = 0;
+	for (u32 i = 0; i < segment_count; i++) {
+		job.segments[i].begin = capacity;
+		capacity += job.segments[i].count;
+	}
+
+	job.entries = malloc(capacity * sizeof *job.entries);
+	job.scratch = malloc(capacity * sizeof *job.scratch);
+	if (capacity && (!job.entries || !job.scratch)) {
+		errlog("Failed to allocate %lu hash list entries", capacity);
+		goto entries_cleanup;
+	}
+
+	riot_hash_dict_run(workers, segment_count, riot_hash_dict_parse_task, &job);
+
+	/* pairwise merge of the sorted segments, halving the segment count
+	 * each round and ping-ponging between the two entry buffers
+	 */
+	while (job.segment_count > 1) {
+		u32 merged_count = (job.segment_count + 1) / 2;
+
+		u64 begin = 0;
+		for (u32 i = 0; i < merged_count; i++) {
+			job.merged[i].begin = begin;
+			job.merged[i].count = job.segments[2 * i].count;
+			if (2 * i + 1 < job.segment_count)
+				job.merged[i].count += job.segments[2 * i + 1].count;
+
+			begin += job.merged[i].count;
+		}
+
+		riot_hash_dict_run(workers, merged_count, riot_hash_dict_merge_task, &job);
+
+		struct riot_hash_dict_segment *segments = job.segments;
+		job.segments = job.merged;
+		job.merged = segments;
+
+		struct riot_hash_dict_entry *entries = job.entries;
+		job.entries = job.scratch;
+		job.scratch = entries;
+
+		job.segment_count = merged_count;
+	}
+
+	struct riot_hash_dict_entry *entries = job.entries + job.segments[0].begin;
+	u64 count = job.segments[0].count;
+
+	mem_pool_reset(&self->hash_pool);
+	mem_pool_reset(&self->str_pool);
+
+	u64 *hashes = MEM_POOL_ALLOC(&self->hash_pool, u64, count);
+	struct riot_hash_dict_str *strs = MEM_POOL_ALLOC(&self->str_pool, struct riot_hash_dict_str, count);
+	if (count && (!hashes || !strs)) {
+		errlog("Failed to allocate hash dictionary (%lu entries)", count);
+		goto entries_cleanup;
+	}
+
+	u64 unique = 0;
+	for (u64 i = 0; i < count; i++) {
+		if (unique && hashes[unique - 1] == entries[i].hash) continue;
+
+		hashes[unique] = entries[i].hash;
+		strs[unique] = entries[i].str;
+		unique++;
+	}
+
+	self->count = unique;
+
+	dbglog("Loaded %lu hash names (%lu duplicates) from %s", unique, count - unique, path);
+
+	res = true;
+
+entries_cleanup:
+	free(job.entries);
+	free(job.scratch);
+segments_cleanup:
+	free(job.segments);
+	free(job.merged);
+
+	return res;
+}
+
+b32
+riot_hash_dict_find(struct riot_hash_dict *self, u64 hash, struct str_view *out) {
+	assert(self);
+	assert(out);
+
+	if (!self->count) return false;
+
+	u64 *hashes = (u64 *)self->hash_pool.ptr;
+
+	u32 idx = riot_hash_search(hashes, self->count, hash);
+	if (hashes[idx] != hash) return false;
+
+	struct riot_hash_dict_str *str = (struct riot_hash_dict_str *)self->str_pool.ptr + idx;
+	out->ptr = (char *)self->src.ptr + str->off;
+	out->len = str->len;
+
+	return true;
+}
@@ -1,4 +1,7 @@
 #include "libriot/inibin.h"
+#include "libriot/stats.h"
+
+#include <sys/mman.h>
 
 b32
 riot_inibin_ctx_init(struct riot_inibin_ctx *self) {
@@ -16,8 +19,41 @@ riot_inibin_ctx_init(struct riot_inibin_ctx *self) {
 	if (!MEM_POOL_INIT(&self->node_pool, struct riot_inibin_node, RIOT_INIBIN_CTX_NODE_POOL_SZ))
 		goto node_pool_alloc_failure;
 
+	if (!MEM_POOL_INIT(&self->entry_pool, struct riot_inibin_entry, RIOT_INIBIN_CTX_ENTRY_POOL_SZ))
+		goto entry_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->link_pool, struct riot_inibin_str, RIOT_INIBIN_CTX_LINK_POOL_SZ))
+		goto link_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->key_pool, struct riot_inibin_field_key, RIOT_INIBIN_CTX_KEY_POOL_SZ))
+		goto key_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->index_hash_pool, fnv1a_u32, RIOT_INIBIN_CTX_ENTRY_POOL_SZ))
+		goto index_hash_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->index_entry_pool, u32, RIOT_INIBIN_CTX_ENTRY_POOL_SZ))
+		goto index_entry_pool_alloc_failure;
+
+	self->index_count = 0;
+
+	self->version = 0;
+	self->entry_count = self->link_count = 0;
+
+	memset(&self->src, 0, sizeof self->src);
+	self->mapped = false;
+
 	return true;
 
+index_entry_pool_alloc_failure:
+	mem_pool_free(&self->index_hash_pool);
+index_hash_pool_alloc_failure:
+	mem_pool_free(&self->key_pool);
+key_pool_alloc_failure:
+	mem_pool_free(&self->link_pool);
+link_pool_alloc_failure:
+	mem_pool_free(&self->entry_pool);
+entry_pool_alloc_failure:
+	mem_pool_free(&self->node_pool);
 node_pool_alloc_failure:
 	mem_pool_free(&self->pair_pool);
 pair_pool_alloc_failure:
@@ -36,6 +72,14 @@ riot_inibin_ctx_free(struct riot_inibin_ctx *self) {
 	mem_pool_free(&self->field_pool);
 	mem_pool_free(&self->pair_pool);
 	mem_pool_free(&self->node_pool);
+	mem_pool_free(&self->entry_pool);
+	mem_pool_free(&self->link_pool);
+	mem_pool_free(&self->key_pool);
+	mem_pool_free(&self->index_hash_pool);
+	mem_pool_free(&self->index_entry_pool);
+
+	if (self->mapped && self->src.ptr)
+		munmap(self->src.ptr, self->src.len);
 }
 
 b32
@@ -89,3 +133,87 @@ riot_inibin_ctx_pushn_node(struct riot_inibin_ctx *self, u32 count, riot_offptr_
 
 	return true;
 }
+
+/* an empty pool is sized exactly, trimming it if need be, while one that is
+ * already in use only ever grows
+ */
+static b32
+riot_inibin_pool_reserve(struct mem_pool *pool, u64 alignment, u64 size) {
+	if (!size) return true;
+
+	u64 need = pool->len + size;
+	if (need == pool->cap || (pool->len && need < pool->cap))
+		return true;
+
+	return mem_pool_resize(pool, alignment, need);
+}
+
+b32
+riot_inibin_ctx_reserve(struct riot_inibin_ctx *self, struct riot_inibin_counts const *counts) {
+	assert(self);
+	assert(counts);
+
+	return riot_inibin_pool_reserve(&self->node_pool, alignof(struct riot_inibin_node),
+					counts->nodes * sizeof(struct riot_inibin_node)) &&
+		riot_inibin_pool_reserve(&self->field_pool, alignof(struct riot_inibin_field),
+					 counts->fields * sizeof(struct riot_inibin_field)) &&
+		riot_inibin_pool_reserve(&self->pair_pool, alignof(struct riot_inibin_pair),
+					 counts->pairs * sizeof(struct riot_inibin_pair)) &&
+		riot_inibin_pool_reserve(&self->key_pool, alignof(struct riot_inibin_field_key),
+					 counts->keys * sizeof(struct riot_inibin_field_key)) &&
+		riot_inibin_pool_reserve(&self->str_pool, alignof(char), counts->str_bytes) &&
+		riot_inibin_pool_reserve(&self->entry_pool, alignof(struct riot_inibin_entry),
+					 counts->entries * sizeof(struct riot_inibin_entry)) &&
+		riot_inibin_pool_reserve(&self->link_pool, alignof(struct riot_inibin_str),
+					 counts->links * sizeof(struct riot_inibin_str));
+}
+
+b32
+riot_inibin_ctx_own_str(struct riot_inibin_ctx *self, struct riot_inibin_str *str) {
+	assert(self);
+	assert(str);
+
+	if (!str->borrowed) return true;
+
+	riot_offptr_t data;
+	if (!riot_inibin_ctx_push_str(self, str->count, &data))
+		return false;
+
+	memcpy(self->str_pool.ptr + data, self->src.ptr + str->data, str->count);
+	riot_stats_add(RIOT_STAT_INIBIN_STR_COPY_BYTES, str->count);
+
+	str->borrowed = false;
+	str->data = data;
+
+	return true;
+}
+
+b32
+riot_inibin_ctx_own_strs(struct riot_inibin_ctx *self) {
+	assert(self);
+
+	/* unloaded entries could no longer be read once the source is gone */
+	if (!riot_inibin_ctx_load_entries(self))
+		return false;
+
+	/* every string of the tree lives in a node, whatever its container */
+	u64 node_count = self->node_pool.len / sizeof(struct riot_inibin_node);
+	for (u64 i = 0; i < node_count; i++) {
+		struct riot_inibin_node *node = riot_inibin_ctx_node(self, i);
+		if (node->type == RIOT_INIBIN_NODE_STR && !riot_inibin_ctx_own_str(self, &node->tag.node_str))
+			return false;
+	}
+
+	for (u32 i = 0; i < self->link_count; i++) {
+		if (!riot_inibin_ctx_own_str(self, riot_inibin_ctx_link(self, i)))
+			return false;
+	}
+
+	if (self->mapped && self->src.ptr)
+		munmap(self->src.ptr, self->src.len);
+
+	memset(&self->src, 0, sizeof self->src);
+	self->mapped = false;
+
+	return true;
+}
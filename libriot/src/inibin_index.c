@@ -0,0 +1,139 @@
+#include "libriot/inibin.h"
+
+struct riot_inibin_index_entry {
+	fnv1a_u32 path_hash;
+	u32 entry;
+};
+
+/* ties are broken on the entry, keeping duplicates in table order */
+static int
+riot_inibin_index_entry_cmp(void const *lhs, void const *rhs) {
+	struct riot_inibin_index_entry const *a = lhs, *b = rhs;
+
+	if (a->path_hash != b->path_hash)
+		return (a->path_hash > b->path_hash) - (a->path_hash < b->path_hash);
+
+	return (a->entry > b->entry) - (a->entry < b->entry);
+}
+
+b32
+riot_inibin_ctx_build_index(struct riot_inibin_ctx *self) {
+	assert(self);
+
+	u32 count = self->entry_count;
+
+	mem_pool_reset(&self->index_hash_pool);
+	mem_pool_reset(&self->index_entry_pool);
+	self->index_count = 0;
+
+	if (!count) return true;
+
+	fnv1a_u32 *hashes = MEM_POOL_ALLOC(&self->index_hash_pool, fnv1a_u32, count);
+	u32 *entries = MEM_POOL_ALLOC(&self->index_entry_pool, u32, count);
+	if (!hashes || !entries) return false;
+
+	struct riot_inibin_index_entry *sorted = malloc(count * sizeof *sorted);
+	if (!sorted) return false;
+
+	for (u32 i = 0; i < count; i++) {
+		sorted[i].path_hash = riot_inibin_ctx_entry(self, i)->path_hash;
+		sorted[i].entry = i;
+	}
+
+	qsort(sorted, count, sizeof *sorted, riot_inibin_index_entry_cmp);
+
+	for (u32 i = 0; i < count; i++) {
+		hashes[i] = sorted[i].path_hash;
+		entries[i] = sorted[i].entry;
+	}
+
+	free(sorted);
+
+	self->index_count = count;
+
+	dbglog("Built INIBIN entry index over %u entries", count);
+
+	return true;
+}
+
+struct riot_inibin_entry *
+riot_inibin_ctx_find_entry(struct riot_inibin_ctx *self, fnv1a_u32 path_hash) {
+	assert(self);
+
+	if (!self->index_count) return NULL;
+
+	fnv1a_u32 *hashes = (fnv1a_u32 *)self->index_hash_pool.ptr;
+	u32 *entries = (u32 *)self->index_entry_pool.ptr;
+
+	u32 idx = riot_inibin_hash_lower_bound(hashes, self->index_count, path_hash);
+	if (idx == self->index_count || hashes[idx] != path_hash) return NULL;
+
+	struct riot_inibin_entry *entry = riot_inibin_ctx_entry(self, entries[idx]);
+
+	return riot_inibin_ctx_load_entry(self, entry) ? entry : NULL;
+}
+
+static int
+riot_inibin_field_key_cmp(void const *lhs, void const *rhs) {
+	struct riot_inibin_field_key const *a = lhs, *b = rhs;
+
+	if (a->name_hash != b->name_hash)
+		return (a->name_hash > b->name_hash) - (a->name_hash < b->name_hash);
+
+	return (a->field > b->field) - (a->field < b->field);
+}
+
+b32
+riot_inibin_ctx_index_fields(struct riot_inibin_ctx *self, struct riot_inibin_field_list *list) {
+	assert(self);
+	assert(list);
+
+	list->root_key = 0;
+
+	if (list->count < RIOT_INIBIN_FIELD_INDEX_MIN) return true;
+
+	struct riot_inibin_field_key *keys = MEM_POOL_ALLOC(&self->key_pool, struct riot_inibin_field_key, list->count);
+	if (!keys) return false;
+
+	for (u16 i = 0; i < list->count; i++) {
+		keys[i].name_hash = riot_inibin_ctx_field(self, list->root_field + i)->name_hash;
+		keys[i].field = i;
+	}
+
+	qsort(keys, list->count, sizeof *keys, riot_inibin_field_key_cmp);
+
+	list->root_key = keys - (struct riot_inibin_field_key *)self->key_pool.ptr;
+
+	return true;
+}
+
+struct riot_inibin_field *
+riot_inibin_ctx_find_field(struct riot_inibin_ctx *self, struct riot_inibin_field_list const *list,
+			   fnv1a_u32 name_hash) {
+	assert(self);
+	assert(list);
+
+	if (list->count < RIOT_INIBIN_FIELD_INDEX_MIN) {
+		for (u16 i = 0; i < list->count; i++) {
+			struct riot_inibin_field *field = riot_inibin_ctx_field(self, list->root_field + i);
+			if (field->name_hash == name_hash) return field;
+		}
+
+		return NULL;
+	}
+
+	struct riot_inibin_field_key *keys = riot_inibin_ctx_field_key(self, list->root_key);
+
+	u32 base = 0, len = list->count;
+
+	while (len > 1) {
+		u32 half = len / 2;
+		base = (keys[base + half - 1].name_hash < name_hash) ? base + half : base;
+		len -= half;
+	}
+
+	base += keys[base].name_hash < name_hash;
+	if (base == list->count || keys[base].name_hash != name_hash) return NULL;
+
+	return riot_inibin_ctx_field(self, list->root_field + keys[base].field);
+}
@@ -1,7 +1,277 @@
 #include "libriot/inibin.h"
 
+static void
+riot_inibin_value_print(struct riot_inibin_ctx *ctx, struct riot_inibin_node *node,
+			struct riot_hash_dict *names, u32 depth, FILE *f);
+
+static void
+riot_inibin_fields_print(struct riot_inibin_ctx *ctx, struct riot_inibin_field_list *list,
+			 struct riot_hash_dict *names, u32 depth, FILE *f);
+
+/* both hash widths share the dictionary, fnv1a hashes being widened */
+static void
+riot_inibin_fnv1a_print(fnv1a_u32 hash, struct riot_hash_dict *names, FILE *f) {
+	struct str_view name;
+	if (names && riot_hash_dict_find(names, hash, &name)) {
+		fprintf(f, "%.*s", (int)name.len, name.ptr);
+	} else {
+		fprintf(f, "0x%08x", hash);
+	}
+}
+
+static void
+riot_inibin_xxh64_print(xxh64_u64 hash, struct riot_hash_dict *names, FILE *f) {
+	struct str_view name;
+	if (names && riot_hash_dict_find(names, hash, &name)) {
+		fprintf(f, "\"%.*s\"", (int)name.len, name.ptr);
+	} else {
+		fprintf(f, "0x%016lx", hash);
+	}
+}
+
+static void
+riot_inibin_indent_print(u32 depth, FILE *f) {
+	for (u32 i = 0; i < depth; i++)
+		fputc('\t', f);
+}
+
+static char const *
+riot_inibin_type_name(u8 type) {
+	switch (type) {
+	case RIOT_INIBIN_NODE_NONE: return "none";
+	case RIOT_INIBIN_NODE_B8: return "bool";
+	case RIOT_INIBIN_NODE_S8: return "i8";
+	case RIOT_INIBIN_NODE_U8: return "u8";
+	case RIOT_INIBIN_NODE_S16: return "i16";
+	case RIOT_INIBIN_NODE_U16: return "u16";
+	case RIOT_INIBIN_NODE_S32: return "i32";
+	case RIOT_INIBIN_NODE_U32: return "u32";
+	case RIOT_INIBIN_NODE_S64: return "i64";
+	case RIOT_INIBIN_NODE_U64: return "u64";
+	case RIOT_INIBIN_NODE_F32: return "f32";
+	case RIOT_INIBIN_NODE_FVEC2: return "vec2";
+	case RIOT_INIBIN_NODE_FVEC3: return "vec3";
+	case RIOT_INIBIN_NODE_FVEC4: return "vec4";
+	case RIOT_INIBIN_NODE_FMAT4X4: return "mtx44";
+	case RIOT_INIBIN_NODE_RGBA: return "rgba";
+	case RIOT_INIBIN_NODE_STR: return "string";
+	case RIOT_INIBIN_NODE_HASH: return "hash";
+	case RIOT_INIBIN_NODE_FILE: return "file";
+	case RIOT_INIBIN_NODE_LIST: return "list";
+	case RIOT_INIBIN_NODE_LIST2: return "list2";
+	case RIOT_INIBIN_NODE_PTR: return "pointer";
+	case RIOT_INIBIN_NODE_EMBED: return "embed";
+	case RIOT_INIBIN_NODE_LINK: return "link";
+	case RIOT_INIBIN_NODE_OPT: return "option";
+	case RIOT_INIBIN_NODE_MAP: return "map";
+	case RIOT_INIBIN_NODE_FLAG: return "flag";
+	}
+
+	return "unknown";
+}
+
+/* the full type of a node, with the element types of containers */
+static void
+riot_inibin_type_print(struct riot_inibin_node *node, FILE *f) {
+	union riot_inibin_node_tag *tag = &node->tag;
+
+	fprintf(f, "%s", riot_inibin_type_name(node->type));
+
+	switch (node->type) {
+	case RIOT_INIBIN_NODE_LIST:
+	case RIOT_INIBIN_NODE_LIST2:
+		fprintf(f, "[%s]", riot_inibin_type_name(tag->node_list.type));
+		break;
+
+	case RIOT_INIBIN_NODE_OPT:
+		fprintf(f, "[%s]", riot_inibin_type_name(tag->node_opt.type));
+		break;
+
+	case RIOT_INIBIN_NODE_MAP:
+		fprintf(f, "[%s,%s]", riot_inibin_type_name(tag->node_map.key_type),
+			riot_inibin_type_name(tag->node_map.val_type));
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void
+riot_inibin_f32s_print(f32 const *src, u32 count, FILE *f) {
+	fprintf(f, "{ ");
+	for (u32 i = 0; i < count; i++)
+		fprintf(f, i ? ", %g" : "%g", src[i]);
+	fprintf(f, " }");
+}
+
+static void
+riot_inibin_value_print(struct riot_inibin_ctx *ctx, struct riot_inibin_node *node,
+			struct riot_hash_dict *names, u32 depth, FILE *f) {
+	union riot_inibin_node_tag *tag = &node->tag;
+
+	switch (node->type) {
+	case RIOT_INIBIN_NODE_NONE: fprintf(f, "null"); break;
+	case RIOT_INIBIN_NODE_B8: fprintf(f, "%s", tag->node_b8 ? "true" : "false"); break;
+	case RIOT_INIBIN_NODE_S8: fprintf(f, "%d", tag->node_s8); break;
+	case RIOT_INIBIN_NODE_U8: fprintf(f, "%u", tag->node_u8); break;
+	case RIOT_INIBIN_NODE_S16: fprintf(f, "%d", tag->node_s16); break;
+	case RIOT_INIBIN_NODE_U16: fprintf(f, "%u", tag->node_u16); break;
+	case RIOT_INIBIN_NODE_S32: fprintf(f, "%d", tag->node_s32); break;
+	case RIOT_INIBIN_NODE_U32: fprintf(f, "%u", tag->node_u32); break;
+	case RIOT_INIBIN_NODE_S64: fprintf(f, "%ld", tag->node_s64); break;
+	case RIOT_INIBIN_NODE_U64: fprintf(f, "%lu", tag->node_u64); break;
+	case RIOT_INIBIN_NODE_F32: fprintf(f, "%g", tag->node_f32); break;
+	case RIOT_INIBIN_NODE_FVEC2: riot_inibin_f32s_print(tag->node_fvec2.vs, 2, f); break;
+	case RIOT_INIBIN_NODE_FVEC3: riot_inibin_f32s_print(tag->node_fvec3.vs, 3, f); break;
+	case RIOT_INIBIN_NODE_FVEC4: riot_inibin_f32s_print(tag->node_fvec4.vs, 4, f); break;
+	case RIOT_INIBIN_NODE_FMAT4X4: riot_inibin_f32s_print(tag->node_fmat4x4.vs, 16, f); break;
+	case RIOT_INIBIN_NODE_HASH: riot_inibin_fnv1a_print(tag->node_hash, names, f); break;
+	case RIOT_INIBIN_NODE_FILE: riot_inibin_xxh64_print(tag->node_file, names, f); break;
+	case RIOT_INIBIN_NODE_LINK: riot_inibin_fnv1a_print(tag->node_link, names, f); break;
+	case RIOT_INIBIN_NODE_FLAG: fprintf(f, "%s", tag->node_flag ? "true" : "false"); break;
+
+	case RIOT_INIBIN_NODE_RGBA: {
+		u8 const *vs = tag->node_rgba.vs;
+		fprintf(f, "{ %u, %u, %u, %u }", vs[0], vs[1], vs[2], vs[3]);
+	} break;
+
+	case RIOT_INIBIN_NODE_STR: {
+		struct str_view str = riot_inibin_ctx_str(ctx, &tag->node_str);
+		fprintf(f, "\"%.*s\"", (int)str.len, str.ptr);
+	} break;
+
+	case RIOT_INIBIN_NODE_LIST:
+	case RIOT_INIBIN_NODE_LIST2: {
+		struct riot_inibin_list *list = &tag->node_list;
+
+		if (!list->count) {
+			fprintf(f, "{}");
+			break;
+		}
+
+		fprintf(f, "{\n");
+		for (u32 i = 0; i < list->count; i++) {
+			riot_inibin_indent_print(depth + 1, f);
+			riot_inibin_value_print(ctx, riot_inibin_ctx_node(ctx, list->root_node + i), names, depth + 1, f);
+			fprintf(f, "\n");
+		}
+		riot_inibin_indent_print(depth, f);
+		fprintf(f, "}");
+	} break;
+
+	case RIOT_INIBIN_NODE_PTR:
+	case RIOT_INIBIN_NODE_EMBED:
+		/* a null structure has no class, nor fields */
+		if (!tag->node_ptr.name_hash) {
+			fprintf(f, "null");
+			break;
+		}
+
+		riot_inibin_fields_print(ctx, &tag->node_ptr, names, depth, f);
+		break;
+
+	case RIOT_INIBIN_NODE_OPT: {
+		struct riot_inibin_opt *opt = &tag->node_opt;
+
+		if (!opt->exists) {
+			fprintf(f, "{}");
+			break;
+		}
+
+		struct riot_inibin_node *value =
+			RELPTR_REL2ABS(struct riot_inibin_node *, riot_relptr_t, node, opt->value);
+
+		fprintf(f, "{ ");
+		riot_inibin_value_print(ctx, value, names, depth, f);
+		fprintf(f, " }");
+	} break;
+
+	case RIOT_INIBIN_NODE_MAP: {
+		struct riot_inibin_map *map = &tag->node_map;
+
+		if (!map->count) {
+			fprintf(f, "{}");
+			break;
+		}
+
+		fprintf(f, "{\n");
+		for (u32 i = 0; i < map->count; i++) {
+			struct riot_inibin_pair *pair = riot_inibin_ctx_pair(ctx, map->root_pair + i);
+
+			riot_inibin_indent_print(depth + 1, f);
+			riot_inibin_value_print(ctx, riot_inibin_ctx_node(ctx, pair->key), names, depth + 1, f);
+			fprintf(f, " = ");
+			riot_inibin_value_print(ctx, riot_inibin_ctx_node(ctx, pair->val), names, depth + 1, f);
+			fprintf(f, "\n");
+		}
+		riot_inibin_indent_print(depth, f);
+		fprintf(f, "}");
+	} break;
+
+	default:
+		fprintf(f, "<unknown type 0x%02x>", node->type);
+		break;
+	}
+}
+
+/* a structure, as its class followed by one field per line */
+static void
+riot_inibin_fields_print(struct riot_inibin_ctx *ctx, struct riot_inibin_field_list *list,
+			 struct riot_hash_dict *names, u32 depth, FILE *f) {
+	riot_inibin_fnv1a_print(list->name_hash, names, f);
+
+	if (!list->count) {
+		fprintf(f, " {}");
+		return;
+	}
+
+	fprintf(f, " {\n");
+	for (u16 i = 0; i < list->count; i++) {
+		struct riot_inibin_field *field = riot_inibin_ctx_field(ctx, list->root_field + i);
+		struct riot_inibin_node *node = riot_inibin_ctx_node(ctx, field->value);
+
+		riot_inibin_indent_print(depth + 1, f);
+		riot_inibin_fnv1a_print(field->name_hash, names, f);
+		fprintf(f, ": ");
+		riot_inibin_type_print(node, f);
+		fprintf(f, " = ");
+		riot_inibin_value_print(ctx, node, names, depth + 1, f);
+		fprintf(f, "\n");
+	}
+	riot_inibin_indent_print(depth, f);
+	fprintf(f, "}");
+}
+
 void
-riot_inibin_print(struct riot_inibin_ctx *ctx, FILE *f) {
+riot_inibin_print(struct riot_inibin_ctx *ctx, struct riot_hash_dict *names, FILE *f) {
 	assert(ctx);
 	assert(f);
+
+	/* the bodies of a lazily opened file are only known once loaded */
+	if (!riot_inibin_ctx_load_entries(ctx)) {
+		errlog("Failed to load INIBIN entries");
+		return;
+	}
+
+	fprintf(f, "INIBIN version %u\n", ctx->version);
+	fprintf(f, "INIBIN linked files: %u\n", ctx->link_count);
+
+	for (u32 i = 0; i < ctx->link_count; i++) {
+		struct str_view link = riot_inibin_ctx_str(ctx, riot_inibin_ctx_link(ctx, i));
+		fprintf(f, "\t\"%.*s\"\n", (int)link.len, link.ptr);
+	}
+
+	fprintf(f, "INIBIN entries: %u\n", ctx->entry_count);
+
+	for (u32 i = 0; i < ctx->entry_count; i++) {
+		struct riot_inibin_entry *entry = riot_inibin_ctx_entry(ctx, i);
+		fprintf(f, "\t");
+		riot_inibin_fnv1a_print(entry->path_hash, names, f);
+		fprintf(f, " = ");
+		riot_inibin_fields_print(ctx, &entry->fields, names, 1, f);
+		fprintf(f, "\n");
+	}
+
+	fflush(f);
 }
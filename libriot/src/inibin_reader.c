@@ -1,10 +1,1354 @@
 #include "libriot/inibin.h"
+#include "libriot/stats.h"
+#include "libriot/trace.h"
+
+struct riot_inibin_reader {
+	struct riot_inibin_ctx *ctx;
+	struct mem_stream stream;
+	b32 borrow;
+};
+
+/* encoded size of each fixed-size value type; zero for everything else */
+static u8 const riot_inibin_value_sz[RIOT_INIBIN_NODE_FILE + 1] = {
+	[RIOT_INIBIN_NODE_B8] = 1,
+	[RIOT_INIBIN_NODE_S8] = 1,
+	[RIOT_INIBIN_NODE_U8] = 1,
+	[RIOT_INIBIN_NODE_S16] = 2,
+	[RIOT_INIBIN_NODE_U16] = 2,
+	[RIOT_INIBIN_NODE_S32] = 4,
+	[RIOT_INIBIN_NODE_U32] = 4,
+	[RIOT_INIBIN_NODE_S64] = 8,
+	[RIOT_INIBIN_NODE_U64] = 8,
+	[RIOT_INIBIN_NODE_F32] = 4,
+	[RIOT_INIBIN_NODE_FVEC2] = 8,
+	[RIOT_INIBIN_NODE_FVEC3] = 12,
+	[RIOT_INIBIN_NODE_FVEC4] = 16,
+	[RIOT_INIBIN_NODE_FMAT4X4] = 64,
+	[RIOT_INIBIN_NODE_RGBA] = 4,
+	[RIOT_INIBIN_NODE_HASH] = 4,
+	[RIOT_INIBIN_NODE_FILE] = 8,
+};
+
+/* encoded size of every fixed-size value type, or 0 for the others */
+static u32
+riot_inibin_fixed_sz(u8 type) {
+	if (type <= RIOT_INIBIN_NODE_FILE) return riot_inibin_value_sz[type];
+	if (type == RIOT_INIBIN_NODE_LINK) return sizeof(u32);
+	if (type == RIOT_INIBIN_NODE_FLAG) return sizeof(u8);
+	return 0;
+}
+
+static b32
+riot_inibin_type_valid(u8 type) {
+	return type <= RIOT_INIBIN_NODE_FILE || (type >= RIOT_INIBIN_NODE_LIST && type <= RIOT_INIBIN_NODE_FLAG);
+}
+
+/* containers only ever nest through embedded structures and pointers */
+static b32
+riot_inibin_type_is_container(u8 type) {
+	return type == RIOT_INIBIN_NODE_LIST || type == RIOT_INIBIN_NODE_LIST2 ||
+		type == RIOT_INIBIN_NODE_OPT || type == RIOT_INIBIN_NODE_MAP;
+}
+
+static b32
+riot_inibin_type_is_element(u8 type) {
+	return type != RIOT_INIBIN_NODE_NONE && riot_inibin_type_valid(type) && !riot_inibin_type_is_container(type);
+}
+
+static void
+riot_inibin_load_f32s(u8 const *src, f32 *dst, u32 count) {
+	for (u32 i = 0; i < count; i++) {
+		u32 bits = riot_load_le32(src + i * sizeof bits);
+		memcpy(&dst[i], &bits, sizeof bits);
+	}
+}
+
+/* links `count` contiguous elements, `stride` bytes apart, into a ring in
+ * order, given the list node of the first
+ */
+static void
+riot_inibin_link_run(u8 *first, u64 stride, u32 count) {
+	for (u32 i = 0; i < count; i++) {
+		struct riot_intrusive_list_node *node = (struct riot_intrusive_list_node *)(first + i * stride);
+		u8 *prev = first + ((i + count - 1) % count) * stride;
+		u8 *next = first + ((i + 1) % count) * stride;
+
+		node->prev = RELPTR_ABS2REL(riot_relptr_t, node, prev);
+		node->next = RELPTR_ABS2REL(riot_relptr_t, node, next);
+	}
+}
+
+/* reads a u32 size prefix, and bounds the stream to the section it covers.
+ * the previous bound is returned in `outer`, to be restored by
+ * `riot_inibin_section_end()`
+ */
+static b32
+riot_inibin_section_begin(struct riot_inibin_reader *self, u64 *outer) {
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u32));
+	if (!src) {
+		errlog("Failed to read INIBIN section size");
+		return false;
+	}
+
+	u32 size = riot_load_le32(src);
+	if (self->stream.len - self->stream.cur < size) {
+		errlog("INIBIN section out of bounds: %u bytes, %lu remaining", size, self->stream.len - self->stream.cur);
+		return false;
+	}
+
+	*outer = self->stream.len;
+	self->stream.len = self->stream.cur + size;
+
+	return true;
+}
+
+static b32
+riot_inibin_section_end(struct riot_inibin_reader *self, u64 outer) {
+	b32 exact = mem_stream_eof(&self->stream);
+	if (!exact)
+		errlog("INIBIN section size mismatch: %lu bytes left unread", self->stream.len - self->stream.cur);
+
+	self->stream.len = outer;
+
+	return exact;
+}
+
+/* the first pass only walks the structure, and skips over runs of fixed-size
+ * values altogether. it bounds every read, but otherwise leaves validation
+ * to the second pass
+ */
+struct riot_inibin_scan {
+	struct mem_stream stream;
+	struct riot_inibin_counts counts;
+	b32 borrow;
+};
+
+static b32
+riot_inibin_scan_skip(struct riot_inibin_scan *self, u64 len) {
+	return mem_stream_skip(&self->stream, len);
+}
+
+static b32
+riot_inibin_scan_u32(struct riot_inibin_scan *self, u32 *out) {
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u32));
+	if (!src) return false;
+
+	*out = riot_load_le32(src);
+	return true;
+}
+
+static b32
+riot_inibin_scan_str(struct riot_inibin_scan *self) {
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u16));
+	if (!src) return false;
+
+	u16 len = riot_load_le16(src);
+	if (!self->borrow) self->counts.str_bytes += len;
+
+	return riot_inibin_scan_skip(self, len);
+}
+
+/* scans a size-prefixed section, which is always skipped in full */
+static b32
+riot_inibin_scan_section(struct riot_inibin_scan *self, u64 *end) {
+	u32 size;
+	if (!riot_inibin_scan_u32(self, &size) || self->stream.len - self->stream.cur < size)
+		return false;
+
+	*end = self->stream.cur + size;
+	return true;
+}
+
+static b32
+riot_inibin_scan_fields(struct riot_inibin_scan *self, u32 depth);
+
+static b32
+riot_inibin_scan_value(struct riot_inibin_scan *self, u8 type, u32 depth) {
+	if (depth > RIOT_INIBIN_MAX_DEPTH) return false;
+
+	u32 fixed_sz = riot_inibin_fixed_sz(type);
+	if (fixed_sz) return riot_inibin_scan_skip(self, fixed_sz);
+
+	u8 const *src;
+	u64 end, len = self->stream.len;
+	u32 count;
+
+	switch (type) {
+	case RIOT_INIBIN_NODE_NONE:
+		return true;
+
+	case RIOT_INIBIN_NODE_STR:
+		return riot_inibin_scan_str(self);
+
+	case RIOT_INIBIN_NODE_LIST:
+	case RIOT_INIBIN_NODE_LIST2: {
+		if (!(src = riot_mem_stream_take(&self->stream, sizeof(u8))))
+			return false;
+
+		u8 elem = *src;
+		if (!riot_inibin_scan_section(self, &end)) return false;
+
+		self->stream.len = end;
+
+		b32 ok = riot_inibin_scan_u32(self, &count) && count <= end - self->stream.cur;
+		if (ok) self->counts.nodes += count;
+
+		if (ok && !riot_inibin_fixed_sz(elem)) {
+			for (u32 i = 0; ok && i < count; i++)
+				ok = riot_inibin_scan_value(self, elem, depth + 1);
+		}
+
+		self->stream.len = len;
+		self->stream.cur = end;
+		return ok;
+	}
+
+	case RIOT_INIBIN_NODE_PTR:
+	case RIOT_INIBIN_NODE_EMBED: {
+		u32 class_hash;
+		if (!riot_inibin_scan_u32(self, &class_hash)) return false;
+		if (!class_hash) return true;
+
+		if (!riot_inibin_scan_section(self, &end)) return false;
+
+		self->stream.len = end;
+		b32 ok = riot_inibin_scan_fields(self, depth + 1);
+
+		self->stream.len = len;
+		self->stream.cur = end;
+		return ok;
+	}
+
+	case RIOT_INIBIN_NODE_OPT:
+		if (!(src = riot_mem_stream_take(&self->stream, 2 * sizeof(u8))))
+			return false;
+
+		if (!src[1]) return true;
+
+		self->counts.nodes++;
+		return riot_inibin_scan_value(self, src[0], depth + 1);
+
+	case RIOT_INIBIN_NODE_MAP: {
+		if (!(src = riot_mem_stream_take(&self->stream, 2 * sizeof(u8))))
+			return false;
+
+		u8 key = src[0], val = src[1];
+		if (!riot_inibin_scan_section(self, &end)) return false;
+
+		self->stream.len = end;
+
+		b32 ok = riot_inibin_scan_u32(self, &count) && count <= (end - self->stream.cur) / 2;
+		if (ok) {
+			self->counts.pairs += count;
+			self->counts.nodes += 2 * (u64)count;
+		}
+
+		if (ok && !(riot_inibin_fixed_sz(key) && riot_inibin_fixed_sz(val))) {
+			for (u32 i = 0; ok && i < count; i++)
+				ok = riot_inibin_scan_value(self, key, depth + 1) && riot_inibin_scan_value(self, val, depth + 1);
+		}
+
+		self->stream.len = len;
+		self->stream.cur = end;
+		return ok;
+	}
+
+	default:
+		return false;
+	}
+}
+
+static b32
+riot_inibin_scan_fields(struct riot_inibin_scan *self, u32 depth) {
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u16));
+	if (!src) return false;
+
+	u16 count = riot_load_le16(src);
+	self->counts.fields += count;
+	self->counts.nodes += count;
+	if (count >= RIOT_INIBIN_FIELD_INDEX_MIN) self->counts.keys += count;
+
+	for (u16 i = 0; i < count; i++) {
+		if (!(src = riot_mem_stream_take(&self->stream, sizeof(u32) + sizeof(u8))))
+			return false;
+
+		/* most fields are scalars, which need not go through the switch */
+		u32 fixed_sz = riot_inibin_fixed_sz(src[4]);
+		if (fixed_sz ? !riot_inibin_scan_skip(self, fixed_sz) : !riot_inibin_scan_value(self, src[4], depth))
+			return false;
+	}
+
+	return true;
+}
+
+/* counts what the rest of the file, following its header, holds */
+static b32
+riot_inibin_scan_file(struct riot_inibin_scan *self, u32 version) {
+	if (version >= 2) {
+		u32 links;
+		if (!riot_inibin_scan_u32(self, &links)) return false;
+
+		for (u32 i = 0; i < links; i++) {
+			if (!riot_inibin_scan_str(self)) return false;
+		}
+
+		self->counts.links = links;
+	}
+
+	u32 entries;
+	if (!riot_inibin_scan_u32(self, &entries) || !riot_inibin_scan_skip(self, (u64)entries * sizeof(u32)))
+		return false;
+
+	u64 len = self->stream.len;
+	for (u32 i = 0; i < entries; i++) {
+		u64 end;
+		if (!riot_inibin_scan_section(self, &end)) return false;
+
+		self->stream.len = end;
+		b32 ok = riot_inibin_scan_skip(self, sizeof(u32)) && riot_inibin_scan_fields(self, 0);
+
+		self->stream.len = len;
+		self->stream.cur = end;
+		if (!ok) return false;
+	}
+
+	self->counts.entries = entries;
+
+	/* offsets into the pools are 32-bit */
+	return self->counts.nodes <= UINT32_MAX && self->counts.fields <= UINT32_MAX &&
+		self->counts.pairs <= UINT32_MAX && self->counts.keys <= UINT32_MAX &&
+		self->counts.str_bytes <= UINT32_MAX;
+}
+
+static b32
+riot_inibin_str_read(struct riot_inibin_reader *self, struct riot_inibin_str *out) {
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u16));
+	if (!src) {
+		errlog("Failed to read INIBIN string length");
+		return false;
+	}
+
+	u16 len = riot_load_le16(src);
+
+	u8 const *chars = riot_mem_stream_take(&self->stream, len);
+	if (!chars) {
+		errlog("Failed to read INIBIN string (%u bytes)", len);
+		return false;
+	}
+
+	out->count = len;
+
+	if (self->borrow) {
+		out->borrowed = true;
+		out->data = chars - self->stream.ptr;
+
+		riot_stats_add(RIOT_STAT_INIBIN_STR_BORROW_BYTES, len);
+		return true;
+	}
+
+	riot_offptr_t data;
+	if (!riot_inibin_ctx_push_str(self->ctx, len, &data)) {
+		errlog("Failed to allocate INIBIN string (%u bytes)", len);
+		return false;
+	}
+
+	memcpy(self->ctx->str_pool.ptr + data, chars, len);
+
+	out->borrowed = false;
+	out->data = data;
+
+	riot_stats_add(RIOT_STAT_INIBIN_STR_COPY_BYTES, len);
+	return true;
+}
+
+static b32
+riot_inibin_fields_read(struct riot_inibin_reader *self, fnv1a_u32 name_hash,
+			struct riot_inibin_field_list *out, u32 depth);
+
+static b32
+riot_inibin_value_read(struct riot_inibin_reader *self, u8 type, riot_offptr_t node_off, u32 depth);
+
+static b32
+riot_inibin_list_read(struct riot_inibin_reader *self, struct riot_inibin_list *out, u32 depth) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u8));
+	if (!src || !riot_inibin_type_is_element(*src)) {
+		errlog("Failed to read INIBIN list element type, or type invalid");
+		return false;
+	}
+
+	out->type = *src;
+
+	u64 outer;
+	if (!riot_inibin_section_begin(self, &outer))
+		return false;
+
+	src = riot_mem_stream_take(&self->stream, sizeof(u32));
+	if (!src) {
+		errlog("Failed to read INIBIN list count");
+		return false;
+	}
+
+	/* every element takes at least a byte, which bounds the allocation */
+	out->count = riot_load_le32(src);
+	if (out->count > self->stream.len - self->stream.cur) {
+		errlog("INIBIN list count out of bounds: %u", out->count);
+		return false;
+	}
+
+	if (!riot_inibin_ctx_pushn_node(ctx, out->count, &out->root_node)) {
+		errlog("Failed to allocate %u INIBIN list elements", out->count);
+		return false;
+	}
+
+	for (u32 i = 0; i < out->count; i++) {
+		if (!riot_inibin_value_read(self, out->type, out->root_node + i, depth + 1)) {
+			errlog("Failed to read INIBIN list element %u/%u", i + 1, out->count);
+			return false;
+		}
+	}
+
+	if (out->count) {
+		struct riot_inibin_node *first = riot_inibin_ctx_node(ctx, out->root_node);
+		riot_inibin_link_run((u8 *)&first->list, sizeof *first, out->count);
+	}
+
+	return riot_inibin_section_end(self, outer);
+}
+
+static b32
+riot_inibin_map_read(struct riot_inibin_reader *self, struct riot_inibin_map *out, u32 depth) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+
+	u8 const *src = riot_mem_stream_take(&self->stream, 2 * sizeof(u8));
+	if (!src) {
+		errlog("Failed to read INIBIN map key and value types");
+		return false;
+	}
+
+	out->key_type = src[0];
+	out->val_type = src[1];
+
+	if (!riot_inibin_type_is_element(out->key_type) || (out->key_type & RIOT_INIBIN_NODE_COMPLEX_TYPE_FLAG) ||
+	    !riot_inibin_type_is_element(out->val_type)) {
+		errlog("Invalid INIBIN map types: key: %02x, value: %02x", out->key_type, out->val_type);
+		return false;
+	}
+
+	u64 outer;
+	if (!riot_inibin_section_begin(self, &outer))
+		return false;
+
+	src = riot_mem_stream_take(&self->stream, sizeof(u32));
+	if (!src) {
+		errlog("Failed to read INIBIN map count");
+		return false;
+	}
+
+	out->count = riot_load_le32(src);
+	if (out->count > (self->stream.len - self->stream.cur) / 2) {
+		errlog("INIBIN map count out of bounds: %u", out->count);
+		return false;
+	}
+
+	/* keys and values are interleaved, each pair taking two nodes */
+	riot_offptr_t nodes;
+	if (!riot_inibin_ctx_pushn_pair(ctx, out->count, &out->root_pair) ||
+	    !riot_inibin_ctx_pushn_node(ctx, 2 * out->count, &nodes)) {
+		errlog("Failed to allocate %u INIBIN map pairs", out->count);
+		return false;
+	}
+
+	for (u32 i = 0; i < out->count; i++) {
+		struct riot_inibin_pair *pair = riot_inibin_ctx_pair(ctx, out->root_pair + i);
+		pair->key = nodes + 2 * i;
+		pair->val = nodes + 2 * i + 1;
+
+		if (!riot_inibin_value_read(self, out->key_type, nodes + 2 * i, depth + 1) ||
+		    !riot_inibin_value_read(self, out->val_type, nodes + 2 * i + 1, depth + 1)) {
+			errlog("Failed to read INIBIN map pair %u/%u", i + 1, out->count);
+			return false;
+		}
+	}
+
+	if (out->count) {
+		struct riot_inibin_pair *first = riot_inibin_ctx_pair(ctx, out->root_pair);
+		riot_inibin_link_run((u8 *)&first->list, sizeof *first, out->count);
+	}
+
+	return riot_inibin_section_end(self, outer);
+}
+
+static b32
+riot_inibin_value_read(struct riot_inibin_reader *self, u8 type, riot_offptr_t node_off, u32 depth) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+
+	if (depth > RIOT_INIBIN_MAX_DEPTH) {
+		errlog("INIBIN nesting exceeds %u levels", RIOT_INIBIN_MAX_DEPTH);
+		return false;
+	}
+
+	/* nested values may grow the node pool, so the tag is only stored once
+	 * complete, through a fresh pointer
+	 */
+	union riot_inibin_node_tag tag;
+	memset(&tag, 0, sizeof tag);
+
+	if (type <= RIOT_INIBIN_NODE_FILE && type != RIOT_INIBIN_NODE_STR) {
+		u8 const *src = riot_mem_stream_take(&self->stream, riot_inibin_value_sz[type]);
+		if (!src) {
+			errlog("Failed to read INIBIN value of type %u (%u bytes)", type, riot_inibin_value_sz[type]);
+			return false;
+		}
+
+		switch (type) {
+		case RIOT_INIBIN_NODE_NONE: break;
+		case RIOT_INIBIN_NODE_B8: tag.node_b8 = riot_load_le8(src); break;
+		case RIOT_INIBIN_NODE_S8: tag.node_s8 = (s8)riot_load_le8(src); break;
+		case RIOT_INIBIN_NODE_U8: tag.node_u8 = riot_load_le8(src); break;
+		case RIOT_INIBIN_NODE_S16: tag.node_s16 = (s16)riot_load_le16(src); break;
+		case RIOT_INIBIN_NODE_U16: tag.node_u16 = riot_load_le16(src); break;
+		case RIOT_INIBIN_NODE_S32: tag.node_s32 = (s32)riot_load_le32(src); break;
+		case RIOT_INIBIN_NODE_U32: tag.node_u32 = riot_load_le32(src); break;
+		case RIOT_INIBIN_NODE_S64: tag.node_s64 = (s64)riot_load_le64(src); break;
+		case RIOT_INIBIN_NODE_U64: tag.node_u64 = riot_load_le64(src); break;
+		case RIOT_INIBIN_NODE_F32: riot_inibin_load_f32s(src, &tag.node_f32, 1); break;
+		case RIOT_INIBIN_NODE_FVEC2: riot_inibin_load_f32s(src, tag.node_fvec2.vs, 2); break;
+		case RIOT_INIBIN_NODE_FVEC3: riot_inibin_load_f32s(src, tag.node_fvec3.vs, 3); break;
+		case RIOT_INIBIN_NODE_FVEC4: riot_inibin_load_f32s(src, tag.node_fvec4.vs, 4); break;
+		case RIOT_INIBIN_NODE_FMAT4X4: riot_inibin_load_f32s(src, tag.node_fmat4x4.vs, 16); break;
+		case RIOT_INIBIN_NODE_RGBA: memcpy(tag.node_rgba.vs, src, sizeof tag.node_rgba.vs); break;
+		case RIOT_INIBIN_NODE_HASH: tag.node_hash = riot_load_le32(src); break;
+		case RIOT_INIBIN_NODE_FILE: tag.node_file = riot_load_le64(src); break;
+		}
+	} else switch (type) {
+	case RIOT_INIBIN_NODE_STR:
+		if (!riot_inibin_str_read(self, &tag.node_str))
+			return false;
+		break;
+
+	case RIOT_INIBIN_NODE_LIST:
+	case RIOT_INIBIN_NODE_LIST2:
+		if (!riot_inibin_list_read(self, &tag.node_list, depth))
+			return false;
+		break;
+
+	case RIOT_INIBIN_NODE_PTR:
+	case RIOT_INIBIN_NODE_EMBED: {
+		u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u32));
+		if (!src) {
+			errlog("Failed to read INIBIN structure class hash");
+			return false;
+		}
+
+		/* a null structure has no size, nor fields */
+		fnv1a_u32 class_hash = riot_load_le32(src);
+		if (!class_hash) {
+			tag.node_ptr.name_hash = 0;
+			break;
+		}
+
+		u64 outer;
+		if (!riot_inibin_section_begin(self, &outer) ||
+		    !riot_inibin_fields_read(self, class_hash, &tag.node_ptr, depth + 1) ||
+		    !riot_inibin_section_end(self, outer))
+			return false;
+	} break;
+
+	case RIOT_INIBIN_NODE_LINK: {
+		u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u32));
+		if (!src) {
+			errlog("Failed to read INIBIN link");
+			return false;
+		}
+
+		tag.node_link = riot_load_le32(src);
+	} break;
+
+	case RIOT_INIBIN_NODE_OPT: {
+		u8 const *src = riot_mem_stream_take(&self->stream, 2 * sizeof(u8));
+		if (!src || !riot_inibin_type_is_element(src[0]) || src[1] > 1) {
+			errlog("Failed to read INIBIN option header, or header invalid");
+			return false;
+		}
+
+		tag.node_opt.type = src[0];
+		tag.node_opt.exists = src[1];
+
+		if (!tag.node_opt.exists) break;
+
+		riot_offptr_t value;
+		if (!riot_inibin_ctx_pushn_node(ctx, 1, &value)) {
+			errlog("Failed to allocate INIBIN option value");
+			return false;
+		}
+
+		if (!riot_inibin_value_read(self, tag.node_opt.type, value, depth + 1))
+			return false;
+
+		tag.node_opt.value = RELPTR_ABS2REL(riot_relptr_t, riot_inibin_ctx_node(ctx, node_off),
+						    riot_inibin_ctx_node(ctx, value));
+	} break;
+
+	case RIOT_INIBIN_NODE_MAP:
+		if (!riot_inibin_map_read(self, &tag.node_map, depth))
+			return false;
+		break;
+
+	case RIOT_INIBIN_NODE_FLAG: {
+		u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u8));
+		if (!src) {
+			errlog("Failed to read INIBIN flag");
+			return false;
+		}
+
+		tag.node_flag = riot_load_le8(src);
+	} break;
+
+	default:
+		errlog("Unknown INIBIN value type: %02x", type);
+		return false;
+	}
+
+	struct riot_inibin_node *node = riot_inibin_ctx_node(ctx, node_off);
+	node->type = (enum riot_inibin_node_type)type;
+	node->tag = tag;
+	node->list.prev = node->list.next = RELPTR_NULL;
+
+	return true;
+}
+
+static b32
+riot_inibin_fields_read(struct riot_inibin_reader *self, fnv1a_u32 name_hash,
+			struct riot_inibin_field_list *out, u32 depth) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u16));
+	if (!src) {
+		errlog("Failed to read INIBIN field count");
+		return false;
+	}
+
+	out->name_hash = name_hash;
+	out->count = riot_load_le16(src);
+
+	/* a field takes at least its name hash and type */
+	if ((u64)out->count * 5 > self->stream.len - self->stream.cur) {
+		errlog("INIBIN field count out of bounds: %u", out->count);
+		return false;
+	}
+
+	riot_offptr_t nodes;
+	if (!riot_inibin_ctx_pushn_field(ctx, out->count, &out->root_field) ||
+	    !riot_inibin_ctx_pushn_node(ctx, out->count, &nodes)) {
+		errlog("Failed to allocate %u INIBIN fields", out->count);
+		return false;
+	}
+
+	for (u16 i = 0; i < out->count; i++) {
+		src = riot_mem_stream_take(&self->stream, sizeof(u32) + sizeof(u8));
+		if (!src || !riot_inibin_type_valid(src[4])) {
+			errlog("Failed to read INIBIN field %u/%u header, or type invalid", i + 1, out->count);
+			return false;
+		}
+
+		struct riot_inibin_field *field = riot_inibin_ctx_field(ctx, out->root_field + i);
+		field->name_hash = riot_load_le32(src);
+		field->value = nodes + i;
+
+		if (!riot_inibin_value_read(self, src[4], nodes + i, depth)) {
+			errlog("Failed to read INIBIN field %u/%u", i + 1, out->count);
+			return false;
+		}
+	}
+
+	if (out->count) {
+		struct riot_inibin_field *first = riot_inibin_ctx_field(ctx, out->root_field);
+		riot_inibin_link_run((u8 *)&first->list, sizeof *first, out->count);
+	}
+
+	if (!riot_inibin_ctx_index_fields(ctx, out)) {
+		errlog("Failed to allocate %u INIBIN field keys", out->count);
+		return false;
+	}
+
+	return true;
+}
+
+static b32
+riot_inibin_links_read(struct riot_inibin_reader *self) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u32));
+	if (!src) {
+		errlog("Failed to read INIBIN linked file count");
+		return false;
+	}
+
+	u32 count = riot_load_le32(src);
+	if ((u64)count * sizeof(u16) > self->stream.len - self->stream.cur) {
+		errlog("INIBIN linked file count out of bounds: %u", count);
+		return false;
+	}
+
+	struct riot_inibin_str *links = MEM_POOL_ALLOC(&ctx->link_pool, struct riot_inibin_str, count);
+	if (!links && count) {
+		errlog("Failed to allocate %u INIBIN linked files", count);
+		return false;
+	}
+
+	for (u32 i = 0; i < count; i++) {
+		/* strings may grow the string pool, never the link pool */
+		if (!riot_inibin_str_read(self, &links[i])) {
+			errlog("Failed to read INIBIN linked file %u/%u", i + 1, count);
+			return false;
+		}
+	}
+
+	ctx->link_count = count;
+
+	return true;
+}
+
+/* reads the entry table and, unless `lazy`, every entry body */
+static b32
+riot_inibin_entries_read(struct riot_inibin_reader *self, b32 lazy) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+
+	u8 const *src = riot_mem_stream_take(&self->stream, sizeof(u32));
+	if (!src) {
+		errlog("Failed to read INIBIN entry count");
+		return false;
+	}
+
+	u32 count = riot_load_le32(src);
+
+	u8 const *types = riot_mem_stream_take(&self->stream, (u64)count * sizeof(u32));
+	if (!types) {
+		errlog("Failed to read %u INIBIN entry types", count);
+		return false;
+	}
+
+	struct riot_inibin_entry *entries = MEM_POOL_ALLOC(&ctx->entry_pool, struct riot_inibin_entry, count);
+	if (!entries && count) {
+		errlog("Failed to allocate %u INIBIN entries", count);
+		return false;
+	}
+
+	for (u32 i = 0; i < count; i++) {
+		struct riot_inibin_entry *entry = &entries[i];
+
+		u64 outer;
+		if (!riot_inibin_section_begin(self, &outer))
+			goto entry_failure;
+
+		entry->offset = self->stream.cur;
+		entry->size = self->stream.len - self->stream.cur;
+
+		src = riot_mem_stream_take(&self->stream, sizeof(u32));
+		if (!src)
+			goto entry_failure;
+
+		/* fields only ever grow the field and node pools */
+		entry->path_hash = riot_load_le32(src);
+		entry->fields.name_hash = riot_load_le32(types + i * sizeof(u32));
+		entry->fields.count = 0;
+		entry->fields.root_field = entry->fields.root_key = 0;
+		entry->loaded = !lazy;
+
+		if (lazy) {
+			self->stream.cur = self->stream.len;
+		} else if (!riot_inibin_fields_read(self, entry->fields.name_hash, &entry->fields, 0)) {
+			goto entry_failure;
+		}
+
+		if (!riot_inibin_section_end(self, outer))
+			goto entry_failure;
+
+		continue;
+
+entry_failure:
+		errlog("Failed to read INIBIN entry %u/%u", i + 1, count);
+		return false;
+	}
+
+	ctx->entry_count = count;
+
+	return true;
+}
+
+/* reads the magic and version, leaving the stream at the linked files */
+static b32
+riot_inibin_header_read(struct riot_inibin_reader *self) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+
+	char magic[4] = { 'P', 'R', 'O', 'P', }, buf[sizeof(magic)];
+	if (!mem_stream_consume(&self->stream, buf, sizeof buf)) {
+		errlog("Failed to read INIBIN magic");
+		return false;
+	}
+
+	if (memcmp(magic, buf, sizeof magic) != 0) {
+		errlog("Bad INIBIN magic value, or unsupported patch file: %.4s", buf);
+		return false;
+	}
+
+	if (!riot_mem_stream_read_u32(&self->stream, &ctx->version)) {
+		errlog("Failed to read INIBIN version");
+		return false;
+	}
+
+	if (ctx->version < 1 || ctx->version > 3) {
+		errlog("Unsupported INIBIN version: %u", ctx->version);
+		return false;
+	}
+
+	dbglog("INIBIN version: %u", ctx->version);
+
+	return true;
+}
+
+static b32
+riot_inibin_read_stream(struct riot_inibin_ctx *ctx, struct mem_stream stream, b32 borrow) {
+	assert(ctx);
+
+	u64 start = riot_stats_clock(), span = riot_trace_begin();
+
+	/* borrowed strings address the source with 32-bit offsets */
+	if (borrow && stream.len > UINT32_MAX) {
+		errlog("INIBIN source too large to borrow from: %lu bytes", stream.len);
+		return false;
+	}
+
+	struct riot_inibin_reader reader = {
+		.ctx = ctx,
+		.stream = stream,
+		.borrow = borrow,
+	};
+
+	if (!riot_inibin_header_read(&reader))
+		return false;
+
+	u64 scan_span = riot_trace_begin();
+
+	struct riot_inibin_scan scan = {
+		.stream = reader.stream,
+		.borrow = borrow,
+	};
+
+	if (!riot_inibin_scan_file(&scan, ctx->version)) {
+		errlog("Malformed INIBIN file, or file too large");
+		return false;
+	}
+
+	riot_trace_end("scan", scan_span, scan.stream.cur);
+
+	if (!riot_inibin_ctx_reserve(ctx, &scan.counts)) {
+		errlog("Failed to allocate INIBIN pools: %lu nodes, %lu fields, %lu pairs, %lu string bytes",
+		       scan.counts.nodes, scan.counts.fields, scan.counts.pairs, scan.counts.str_bytes);
+		return false;
+	}
+
+	if (ctx->version >= 2 && !riot_inibin_links_read(&reader))
+		return false;
+
+	if (!riot_inibin_entries_read(&reader, false))
+		return false;
+
+	if (!riot_inibin_ctx_build_index(ctx)) {
+		errlog("Failed to build INIBIN entry index");
+		return false;
+	}
+
+	if (!mem_stream_eof(&reader.stream)) {
+		dbglog("Ignoring %lu trailing INIBIN bytes", reader.stream.len - reader.stream.cur);
+	}
+
+	dbglog("Read %u INIBIN entries, %u linked files", ctx->entry_count, ctx->link_count);
+
+	if (borrow) {
+		ctx->src = stream;
+		ctx->src.cur = 0;
+	}
+
+	riot_stats_add(RIOT_STAT_INIBIN_PARSES, 1);
+	riot_stats_add(RIOT_STAT_INIBIN_BYTES, reader.stream.cur);
+	riot_stats_add(RIOT_STAT_INIBIN_ENTRIES, ctx->entry_count);
+	riot_stats_time(RIOT_STAT_INIBIN_NS, start);
+	riot_trace_end("parse", span, reader.stream.cur);
+
+	return true;
+}
+
+/* reads the fields of an entry whose body was skipped, from the source the
+ * entry table was read from, which bounds every body. `entry` may live in
+ * another ctx than the reader's, as the fields are read into the latter
+ */
+static b32
+riot_inibin_entry_body_read(struct riot_inibin_reader *self, struct riot_inibin_entry *entry) {
+	self->stream.len = (u64)entry->offset + entry->size;
+	self->stream.cur = (u64)entry->offset + sizeof(u32);
+
+	/* the entry pool never grows past the table, so `entry` stays valid */
+	return riot_inibin_fields_read(self, entry->fields.name_hash, &entry->fields, 0) &&
+		mem_stream_eof(&self->stream);
+}
+
+b32
+riot_inibin_ctx_load_entry(struct riot_inibin_ctx *self, struct riot_inibin_entry *entry) {
+	assert(self);
+	assert(entry);
+
+	if (entry->loaded) return true;
+
+	u64 start = riot_stats_clock(), span = riot_trace_begin();
+
+	struct riot_inibin_reader reader = {
+		.ctx = self,
+		.stream = self->src,
+		.borrow = true,
+	};
+
+	/* a failed load is rolled back, leaving no partially read elements
+	 * behind in a ctx that remains in use
+	 */
+	u64 str_len = self->str_pool.len, field_len = self->field_pool.len;
+	u64 pair_len = self->pair_pool.len, node_len = self->node_pool.len;
+	u64 key_len = self->key_pool.len;
+
+	if (!riot_inibin_entry_body_read(&reader, entry)) {
+		errlog("Failed to load INIBIN entry %08x", entry->path_hash);
+
+		self->str_pool.len = str_len;
+		self->field_pool.len = field_len;
+		self->pair_pool.len = pair_len;
+		self->node_pool.len = node_len;
+		self->key_pool.len = key_len;
+
+		entry->fields.count = 0;
+		entry->fields.root_field = entry->fields.root_key = 0;
+
+		return false;
+	}
+
+	entry->loaded = true;
+
+	riot_stats_add(RIOT_STAT_INIBIN_ENTRY_LOADS, 1);
+	riot_stats_time(RIOT_STAT_INIBIN_NS, start);
+	riot_trace_end("load", span, entry->size);
+
+	return true;
+}
+
+b32
+riot_inibin_ctx_load_entries(struct riot_inibin_ctx *self) {
+	assert(self);
+
+	for (u32 i = 0; i < self->entry_count; i++) {
+		if (!riot_inibin_ctx_load_entry(self, riot_inibin_ctx_entry(self, i)))
+			return false;
+	}
+
+	return true;
+}
 
 b32
 riot_inibin_read(struct riot_inibin_ctx *ctx, struct mem_stream stream) {
+	return riot_inibin_read_stream(ctx, stream, false);
+}
+
+b32
+riot_inibin_read_borrowed(struct riot_inibin_ctx *ctx, struct mem_stream stream) {
+	return riot_inibin_read_stream(ctx, stream, true);
+}
+
+b32
+riot_inibin_open_lazy(struct riot_inibin_ctx *ctx, struct mem_stream stream) {
 	assert(ctx);
 
-	(void) stream;
+	u64 start = riot_stats_clock(), span = riot_trace_begin();
+
+	/* entries are located, and strings borrowed, with 32-bit offsets */
+	if (stream.len > UINT32_MAX) {
+		errlog("INIBIN source too large to open lazily: %lu bytes", stream.len);
+		return false;
+	}
+
+	struct riot_inibin_reader reader = {
+		.ctx = ctx,
+		.stream = stream,
+		.borrow = true,
+	};
+
+	if (!riot_inibin_header_read(&reader))
+		return false;
+
+	if (ctx->version >= 2 && !riot_inibin_links_read(&reader))
+		return false;
+
+	if (!riot_inibin_entries_read(&reader, true))
+		return false;
+
+	if (!riot_inibin_ctx_build_index(ctx)) {
+		errlog("Failed to build INIBIN entry index");
+		return false;
+	}
+
+	dbglog("Opened %u INIBIN entries, %u linked files", ctx->entry_count, ctx->link_count);
+
+	ctx->src = stream;
+	ctx->src.cur = 0;
+
+	riot_stats_add(RIOT_STAT_INIBIN_PARSES, 1);
+	riot_stats_add(RIOT_STAT_INIBIN_BYTES, reader.stream.cur);
+	riot_stats_time(RIOT_STAT_INIBIN_NS, start);
+	riot_trace_end("open", span, reader.stream.cur);
+
+	return true;
+}
+
+/* entries of a parallel read are parsed in contiguous ranges, each into a
+ * ctx of its own, which are then concatenated in order into the result. as
+ * elements only ever reference each other through offsets within their
+ * pool, or through offsets relative to themselves, concatenating a part
+ * only needs the former rebased. ranges are ordered like the file, so the
+ * result matches a serial read exactly
+ */
+struct riot_inibin_part {
+	struct riot_inibin_ctx ctx;
+	u32 first, end;
+
+	/* where the part's pools start within the result's */
+	u64 str_base;
+	riot_offptr_t field_base, pair_base, node_base, key_base;
+};
+
+struct riot_inibin_parallel_job {
+	struct riot_inibin_ctx *ctx;
+	struct riot_inibin_part *parts;
+	b8 borrow;
+	atomic_bool failed;
+};
+
+/* ranges per worker, evening out the cost of entries of differing sizes */
+#define RIOT_INIBIN_PARALLEL_SPLIT 4
+
+static void
+riot_inibin_parse_task(void *arg, u32 worker, u64 idx) {
+	struct riot_inibin_parallel_job *job = arg;
+
+	(void) worker;
+
+	struct riot_inibin_part *part = &job->parts[idx];
+	u64 span = riot_trace_begin(), bytes = 0;
+
+	struct riot_inibin_reader reader = {
+		.ctx = &part->ctx,
+		.stream = job->ctx->src,
+		.borrow = job->borrow,
+	};
+
+	for (u32 i = part->first; i < part->end; i++) {
+		if (atomic_load_explicit(&job->failed, memory_order_relaxed)) return;
+
+		struct riot_inibin_entry *entry = riot_inibin_ctx_entry(job->ctx, i);
+		if (!riot_inibin_entry_body_read(&reader, entry)) {
+			errlog("Failed to read INIBIN entry %u/%u", i + 1, job->ctx->entry_count);
+			atomic_store_explicit(&job->failed, true, memory_order_relaxed);
+			return;
+		}
+
+		bytes += entry->size;
+	}
+
+	riot_trace_end("parse", span, bytes);
+}
+
+static void
+riot_inibin_part_rebase_fields(struct riot_inibin_part const *part, struct riot_inibin_field_list *list) {
+	list->root_field += part->field_base;
+	if (list->count >= RIOT_INIBIN_FIELD_INDEX_MIN) list->root_key += part->key_base;
+}
+
+static void
+riot_inibin_merge_task(void *arg, u32 worker, u64 idx) {
+	struct riot_inibin_parallel_job *job = arg;
+
+	(void) worker;
+
+	struct riot_inibin_ctx *ctx = job->ctx;
+	struct riot_inibin_part *part = &job->parts[idx];
+	struct riot_inibin_ctx *src = &part->ctx;
+
+	u64 span = riot_trace_begin();
+
+	memcpy(ctx->str_pool.ptr + part->str_base, src->str_pool.ptr, src->str_pool.len);
+	memcpy(riot_inibin_ctx_field(ctx, part->field_base), src->field_pool.ptr, src->field_pool.len);
+	memcpy(riot_inibin_ctx_pair(ctx, part->pair_base), src->pair_pool.ptr, src->pair_pool.len);
+	memcpy(riot_inibin_ctx_node(ctx, part->node_base), src->node_pool.ptr, src->node_pool.len);
+	memcpy(riot_inibin_ctx_field_key(ctx, part->key_base), src->key_pool.ptr, src->key_pool.len);
+
+	u64 field_count = src->field_pool.len / sizeof(struct riot_inibin_field);
+	for (u64 i = 0; i < field_count; i++)
+		riot_inibin_ctx_field(ctx, part->field_base + i)->value += part->node_base;
+
+	u64 pair_count = src->pair_pool.len / sizeof(struct riot_inibin_pair);
+	for (u64 i = 0; i < pair_count; i++) {
+		struct riot_inibin_pair *pair = riot_inibin_ctx_pair(ctx, part->pair_base + i);
+		pair->key += part->node_base;
+		pair->val += part->node_base;
+	}
+
+	u64 node_count = src->node_pool.len / sizeof(struct riot_inibin_node);
+	for (u64 i = 0; i < node_count; i++) {
+		struct riot_inibin_node *node = riot_inibin_ctx_node(ctx, part->node_base + i);
+
+		switch (node->type) {
+		case RIOT_INIBIN_NODE_STR:
+			if (!node->tag.node_str.borrowed) node->tag.node_str.data += part->str_base;
+			break;
+
+		case RIOT_INIBIN_NODE_LIST:
+		case RIOT_INIBIN_NODE_LIST2:
+			node->tag.node_list.root_node += part->node_base;
+			break;
+
+		/* a null structure has no fields to reference */
+		case RIOT_INIBIN_NODE_PTR:
+		case RIOT_INIBIN_NODE_EMBED:
+			if (node->tag.node_ptr.name_hash) riot_inibin_part_rebase_fields(part, &node->tag.node_ptr);
+			break;
+
+		case RIOT_INIBIN_NODE_MAP:
+			node->tag.node_map.root_pair += part->pair_base;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	for (u32 i = part->first; i < part->end; i++) {
+		struct riot_inibin_entry *entry = riot_inibin_ctx_entry(ctx, i);
+		riot_inibin_part_rebase_fields(part, &entry->fields);
+		entry->loaded = true;
+	}
+
+	riot_trace_end("merge", span, src->str_pool.len + src->field_pool.len + src->pair_pool.len + src->node_pool.len);
+}
+
+/* splits the entries into ranges of roughly even size */
+static void
+riot_inibin_parts_split(struct riot_inibin_ctx *ctx, struct riot_inibin_part *parts, u32 part_count) {
+	u64 total = 0;
+	for (u32 i = 0; i < ctx->entry_count; i++)
+		total += riot_inibin_ctx_entry(ctx, i)->size;
+
+	u64 acc = 0;
+	u32 entry = 0;
+
+	for (u32 i = 0; i < part_count; i++) {
+		u64 target = total * (i + 1) / part_count;
+
+		parts[i].first = entry;
+		while (entry < ctx->entry_count && (acc < target || i == part_count - 1))
+			acc += riot_inibin_ctx_entry(ctx, entry++)->size;
+
+		parts[i].end = entry;
+	}
+}
+
+/* places every part within the result's pools, and sizes them to fit */
+static b32
+riot_inibin_parts_place(struct riot_inibin_ctx *ctx, struct riot_inibin_part *parts, u32 part_count) {
+	struct riot_inibin_counts counts = { 0 };
+
+	u64 str_len = ctx->str_pool.len;
+	u64 field_len = ctx->field_pool.len / sizeof(struct riot_inibin_field);
+	u64 pair_len = ctx->pair_pool.len / sizeof(struct riot_inibin_pair);
+	u64 node_len = ctx->node_pool.len / sizeof(struct riot_inibin_node);
+	u64 key_len = ctx->key_pool.len / sizeof(struct riot_inibin_field_key);
+
+	for (u32 i = 0; i < part_count; i++) {
+		struct riot_inibin_ctx *src = &parts[i].ctx;
+
+		parts[i].str_base = str_len + counts.str_bytes;
+		parts[i].field_base = field_len + counts.fields;
+		parts[i].pair_base = pair_len + counts.pairs;
+		parts[i].node_base = node_len + counts.nodes;
+		parts[i].key_base = key_len + counts.keys;
+
+		counts.str_bytes += src->str_pool.len;
+		counts.fields += src->field_pool.len / sizeof(struct riot_inibin_field);
+		counts.pairs += src->pair_pool.len / sizeof(struct riot_inibin_pair);
+		counts.nodes += src->node_pool.len / sizeof(struct riot_inibin_node);
+		counts.keys += src->key_pool.len / sizeof(struct riot_inibin_field_key);
+	}
+
+	/* offsets into the pools are 32-bit */
+	if (str_len + counts.str_bytes > UINT32_MAX || field_len + counts.fields > UINT32_MAX ||
+	    pair_len + counts.pairs > UINT32_MAX || node_len + counts.nodes > UINT32_MAX ||
+	    key_len + counts.keys > UINT32_MAX) {
+		errlog("INIBIN file too large: %lu nodes, %lu fields, %lu pairs, %lu string bytes",
+		       node_len + counts.nodes, field_len + counts.fields, pair_len + counts.pairs,
+		       str_len + counts.str_bytes);
+		return false;
+	}
+
+	if (!riot_inibin_ctx_reserve(ctx, &counts)) {
+		errlog("Failed to allocate INIBIN pools: %lu nodes, %lu fields, %lu pairs, %lu string bytes",
+		       counts.nodes, counts.fields, counts.pairs, counts.str_bytes);
+		return false;
+	}
+
+	/* claims the space reserved, which cannot fail */
+	ctx->str_pool.len += counts.str_bytes;
+	ctx->field_pool.len += counts.fields * sizeof(struct riot_inibin_field);
+	ctx->pair_pool.len += counts.pairs * sizeof(struct riot_inibin_pair);
+	ctx->node_pool.len += counts.nodes * sizeof(struct riot_inibin_node);
+	ctx->key_pool.len += counts.keys * sizeof(struct riot_inibin_field_key);
+
+	return true;
+}
+
+b32
+riot_inibin_read_parallel(struct riot_inibin_ctx *ctx, struct mem_stream stream, b32 borrow,
+			  struct riot_thread_pool *workers) {
+	assert(ctx);
+
+	if (!workers || workers->thread_count < 2)
+		return riot_inibin_read_stream(ctx, stream, borrow);
+
+	u64 start = riot_stats_clock(), span = riot_trace_begin();
+
+	/* entries are located, and strings borrowed, with 32-bit offsets */
+	if (stream.len > UINT32_MAX) {
+		errlog("INIBIN source too large to read in parallel: %lu bytes", stream.len);
+		return false;
+	}
+
+	struct riot_inibin_reader reader = {
+		.ctx = ctx,
+		.stream = stream,
+		.borrow = borrow,
+	};
+
+	if (!riot_inibin_header_read(&reader))
+		return false;
+
+	if (ctx->version >= 2 && !riot_inibin_links_read(&reader))
+		return false;
+
+	if (!riot_inibin_entries_read(&reader, true))
+		return false;
+
+	b32 res = false;
+
+	ctx->src = stream;
+	ctx->src.cur = 0;
+
+	u32 part_count = MIN(ctx->entry_count, workers->thread_count * RIOT_INIBIN_PARALLEL_SPLIT);
+
+	struct riot_inibin_part *parts = calloc(part_count, sizeof *parts);
+	if (!parts && part_count) {
+		errlog("Failed to allocate %u INIBIN entry ranges", part_count);
+		goto cleanup;
+	}
+
+	u32 inited = 0;
+	for (; inited < part_count; inited++) {
+		if (!riot_inibin_ctx_init(&parts[inited].ctx)) {
+			errlog("Failed to initialise INIBIN entry range %u/%u", inited + 1, part_count);
+			goto parts_cleanup;
+		}
+	}
+
+	riot_inibin_parts_split(ctx, parts, part_count);
+
+	struct riot_inibin_parallel_job job = {
+		.ctx = ctx,
+		.parts = parts,
+		.borrow = borrow,
+	};
+
+	atomic_init(&job.failed, false);
+
+	riot_thread_pool_run(workers, part_count, riot_inibin_parse_task, &job);
+	if (atomic_load(&job.failed))
+		goto parts_cleanup;
+
+	if (!riot_inibin_parts_place(ctx, parts, part_count))
+		goto parts_cleanup;
+
+	riot_thread_pool_run(workers, part_count, riot_inibin_merge_task, &job);
+
+	if (!riot_inibin_ctx_build_index(ctx)) {
+		errlog("Failed to build INIBIN entry index");
+		goto parts_cleanup;
+	}
+
+	dbglog("Read %u INIBIN entries, %u linked files, in %u ranges", ctx->entry_count, ctx->link_count, part_count);
+
+	riot_stats_add(RIOT_STAT_INIBIN_PARSES, 1);
+	riot_stats_add(RIOT_STAT_INIBIN_BYTES, stream.len);
+	riot_stats_add(RIOT_STAT_INIBIN_ENTRIES, ctx->entry_count);
+	riot_stats_time(RIOT_STAT_INIBIN_NS, start);
+	riot_trace_end("read", span, stream.len);
+
+	res = true;
+
+parts_cleanup:
+	for (u32 i = 0; i < inited; i++)
+		riot_inibin_ctx_free(&parts[i].ctx);
+
+	free(parts);
+cleanup:
+	/* a copying read leaves no reference to the source behind */
+	if (!borrow || !res)
+		memset(&ctx->src, 0, sizeof ctx->src);
+
+	return res;
+}
+
+b32
+riot_inibin_open_mapped(struct riot_inibin_ctx *ctx, char const *path) {
+	assert(ctx);
+	assert(path);
+
+	struct mem_stream stream;
+	if (!riot_mem_stream_map_file(&stream, path, NULL)) {
+		errlog("Failed to map INIBIN file: %s", path);
+		return false;
+	}
+
+	if (!riot_inibin_read_borrowed(ctx, stream)) {
+		riot_mem_stream_unmap(&stream);
+		return false;
+	}
+
+	ctx->mapped = true;
+
+	return true;
+}
+
+b32
+riot_inibin_open_mapped_lazy(struct riot_inibin_ctx *ctx, char const *path) {
+	assert(ctx);
+	assert(path);
+
+	struct mem_stream stream;
+	if (!riot_mem_stream_map_file(&stream, path, NULL)) {
+		errlog("Failed to map INIBIN file: %s", path);
+		return false;
+	}
+
+	if (!riot_inibin_open_lazy(ctx, stream)) {
+		riot_mem_stream_unmap(&stream);
+		return false;
+	}
+
+	ctx->mapped = true;
 
-	return false;
+	return true;
 }
@@ -1,10 +1,307 @@
 #include "libriot/inibin.h"
+#include "libriot/trace.h"
+
+struct riot_inibin_writer {
+	struct riot_inibin_ctx *ctx;
+	struct riot_writer *out;
+};
+
+/* a u32 size prefix, reserved before the section it covers is written, and
+ * patched in once its length is known
+ */
+struct riot_inibin_section {
+	u64 size_off, start;
+};
+
+static b32
+riot_inibin_section_begin(struct riot_inibin_writer *self, struct riot_inibin_section *out) {
+	u8 *dst = riot_writer_reserve(self->out, sizeof(u32));
+	if (!dst) return false;
+
+	out->size_off = riot_writer_owned_off(self->out, dst);
+	out->start = self->out->len;
+
+	return true;
+}
+
+static b32
+riot_inibin_section_end(struct riot_inibin_writer *self, struct riot_inibin_section const *section) {
+	u64 size = self->out->len - section->start;
+	if (size > UINT32_MAX) {
+		errlog("INIBIN section too large: %lu bytes", size);
+		return false;
+	}
+
+	riot_store_le32(riot_writer_owned_ptr(self->out, section->size_off), size);
+
+	return true;
+}
+
+static b32
+riot_inibin_u8_write(struct riot_inibin_writer *self, u8 val) {
+	u8 *dst = riot_writer_reserve(self->out, sizeof val);
+	if (!dst) return false;
+
+	riot_store_le8(dst, val);
+	return true;
+}
+
+static b32
+riot_inibin_u16_write(struct riot_inibin_writer *self, u16 val) {
+	u8 *dst = riot_writer_reserve(self->out, sizeof val);
+	if (!dst) return false;
+
+	riot_store_le16(dst, val);
+	return true;
+}
+
+static b32
+riot_inibin_u32_write(struct riot_inibin_writer *self, u32 val) {
+	u8 *dst = riot_writer_reserve(self->out, sizeof val);
+	if (!dst) return false;
+
+	riot_store_le32(dst, val);
+	return true;
+}
+
+static b32
+riot_inibin_u64_write(struct riot_inibin_writer *self, u64 val) {
+	u8 *dst = riot_writer_reserve(self->out, sizeof val);
+	if (!dst) return false;
+
+	riot_store_le64(dst, val);
+	return true;
+}
+
+static b32
+riot_inibin_f32s_write(struct riot_inibin_writer *self, f32 const *src, u32 count) {
+	u8 *dst = riot_writer_reserve(self->out, count * sizeof(u32));
+	if (!dst) return false;
+
+	for (u32 i = 0; i < count; i++) {
+		u32 bits;
+		memcpy(&bits, &src[i], sizeof bits);
+		riot_store_le32(dst + i * sizeof bits, bits);
+	}
+
+	return true;
+}
+
+/* long strings are referenced where they are stored, be it the source
+ * buffer or the string pool, and short ones copied, as they are cheaper to
+ * copy than to give an output segment of their own
+ */
+static b32
+riot_inibin_str_write(struct riot_inibin_writer *self, struct riot_inibin_str const *str) {
+	if (!riot_inibin_u16_write(self, str->count))
+		return false;
+
+	struct str_view chars = riot_inibin_ctx_str(self->ctx, str);
+
+	if (chars.len >= RIOT_INIBIN_STR_REF_MIN)
+		return riot_writer_push_ref(self->out, chars.ptr, chars.len);
+
+	return riot_writer_push(self->out, chars.ptr, chars.len);
+}
+
+static b32
+riot_inibin_fields_write(struct riot_inibin_writer *self, struct riot_inibin_field_list const *list);
+
+static b32
+riot_inibin_value_write(struct riot_inibin_writer *self, struct riot_inibin_node const *node) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+	union riot_inibin_node_tag const *tag = &node->tag;
+
+	switch (node->type) {
+	case RIOT_INIBIN_NODE_NONE: return true;
+	case RIOT_INIBIN_NODE_B8: return riot_inibin_u8_write(self, tag->node_b8);
+	case RIOT_INIBIN_NODE_S8: return riot_inibin_u8_write(self, (u8)tag->node_s8);
+	case RIOT_INIBIN_NODE_U8: return riot_inibin_u8_write(self, tag->node_u8);
+	case RIOT_INIBIN_NODE_S16: return riot_inibin_u16_write(self, (u16)tag->node_s16);
+	case RIOT_INIBIN_NODE_U16: return riot_inibin_u16_write(self, tag->node_u16);
+	case RIOT_INIBIN_NODE_S32: return riot_inibin_u32_write(self, (u32)tag->node_s32);
+	case RIOT_INIBIN_NODE_U32: return riot_inibin_u32_write(self, tag->node_u32);
+	case RIOT_INIBIN_NODE_S64: return riot_inibin_u64_write(self, (u64)tag->node_s64);
+	case RIOT_INIBIN_NODE_U64: return riot_inibin_u64_write(self, tag->node_u64);
+	case RIOT_INIBIN_NODE_F32: return riot_inibin_f32s_write(self, &tag->node_f32, 1);
+	case RIOT_INIBIN_NODE_FVEC2: return riot_inibin_f32s_write(self, tag->node_fvec2.vs, 2);
+	case RIOT_INIBIN_NODE_FVEC3: return riot_inibin_f32s_write(self, tag->node_fvec3.vs, 3);
+	case RIOT_INIBIN_NODE_FVEC4: return riot_inibin_f32s_write(self, tag->node_fvec4.vs, 4);
+	case RIOT_INIBIN_NODE_FMAT4X4: return riot_inibin_f32s_write(self, tag->node_fmat4x4.vs, 16);
+	case RIOT_INIBIN_NODE_RGBA: return riot_writer_push(self->out, tag->node_rgba.vs, sizeof tag->node_rgba.vs);
+	case RIOT_INIBIN_NODE_STR: return riot_inibin_str_write(self, &tag->node_str);
+	case RIOT_INIBIN_NODE_HASH: return riot_inibin_u32_write(self, tag->node_hash);
+	case RIOT_INIBIN_NODE_FILE: return riot_inibin_u64_write(self, tag->node_file);
+	case RIOT_INIBIN_NODE_LINK: return riot_inibin_u32_write(self, tag->node_link);
+	case RIOT_INIBIN_NODE_FLAG: return riot_inibin_u8_write(self, tag->node_flag);
+
+	case RIOT_INIBIN_NODE_LIST:
+	case RIOT_INIBIN_NODE_LIST2: {
+		struct riot_inibin_list const *list = &tag->node_list;
+
+		struct riot_inibin_section section;
+		if (!riot_inibin_u8_write(self, list->type) ||
+		    !riot_inibin_section_begin(self, &section) ||
+		    !riot_inibin_u32_write(self, list->count))
+			return false;
+
+		for (u32 i = 0; i < list->count; i++) {
+			if (!riot_inibin_value_write(self, riot_inibin_ctx_node(ctx, list->root_node + i)))
+				return false;
+		}
+
+		return riot_inibin_section_end(self, &section);
+	}
+
+	case RIOT_INIBIN_NODE_PTR:
+	case RIOT_INIBIN_NODE_EMBED: {
+		struct riot_inibin_field_list const *fields = &tag->node_ptr;
+
+		/* a null structure has no size, nor fields */
+		if (!riot_inibin_u32_write(self, fields->name_hash))
+			return false;
+
+		if (!fields->name_hash) return true;
+
+		struct riot_inibin_section section;
+		return riot_inibin_section_begin(self, &section) &&
+			riot_inibin_fields_write(self, fields) &&
+			riot_inibin_section_end(self, &section);
+	}
+
+	case RIOT_INIBIN_NODE_OPT: {
+		struct riot_inibin_opt const *opt = &tag->node_opt;
+
+		if (!riot_inibin_u8_write(self, opt->type) || !riot_inibin_u8_write(self, opt->exists))
+			return false;
+
+		if (!opt->exists) return true;
+
+		struct riot_inibin_node const *value =
+			RELPTR_REL2ABS(struct riot_inibin_node const *, riot_relptr_t, node, opt->value);
+
+		return riot_inibin_value_write(self, value);
+	}
+
+	case RIOT_INIBIN_NODE_MAP: {
+		struct riot_inibin_map const *map = &tag->node_map;
+
+		struct riot_inibin_section section;
+		if (!riot_inibin_u8_write(self, map->key_type) ||
+		    !riot_inibin_u8_write(self, map->val_type) ||
+		    !riot_inibin_section_begin(self, &section) ||
+		    !riot_inibin_u32_write(self, map->count))
+			return false;
+
+		for (u32 i = 0; i < map->count; i++) {
+			struct riot_inibin_pair *pair = riot_inibin_ctx_pair(ctx, map->root_pair + i);
+
+			if (!riot_inibin_value_write(self, riot_inibin_ctx_node(ctx, pair->key)) ||
+			    !riot_inibin_value_write(self, riot_inibin_ctx_node(ctx, pair->val)))
+				return false;
+		}
+
+		return riot_inibin_section_end(self, &section);
+	}
+	}
+
+	errlog("Unknown INIBIN value type: %02x", node->type);
+	return false;
+}
+
+static b32
+riot_inibin_fields_write(struct riot_inibin_writer *self, struct riot_inibin_field_list const *list) {
+	struct riot_inibin_ctx *ctx = self->ctx;
+
+	if (!riot_inibin_u16_write(self, list->count))
+		return false;
+
+	for (u16 i = 0; i < list->count; i++) {
+		struct riot_inibin_field *field = riot_inibin_ctx_field(ctx, list->root_field + i);
+		struct riot_inibin_node *node = riot_inibin_ctx_node(ctx, field->value);
+
+		if (!riot_inibin_u32_write(self, field->name_hash) ||
+		    !riot_inibin_u8_write(self, node->type) ||
+		    !riot_inibin_value_write(self, node))
+			return false;
+	}
+
+	return true;
+}
 
 b32
-riot_inibin_write(struct riot_inibin_ctx *ctx, struct mem_stream stream) {
+riot_inibin_write(struct riot_inibin_ctx *ctx, struct riot_writer *out) {
 	assert(ctx);
+	assert(out);
 
-	(void) stream;
+	u64 span = riot_trace_begin(), start = out->len;
 
-	return false;
+	if (ctx->version < 1 || ctx->version > 3) {
+		errlog("Unsupported INIBIN version: %u", ctx->version);
+		return false;
+	}
+
+	/* the bodies of a lazily opened file are only known once loaded */
+	if (!riot_inibin_ctx_load_entries(ctx)) {
+		errlog("Failed to load INIBIN entries");
+		return false;
+	}
+
+	struct riot_inibin_writer writer = {
+		.ctx = ctx,
+		.out = out,
+	};
+
+	char magic[4] = { 'P', 'R', 'O', 'P', };
+	if (!riot_writer_push(out, magic, sizeof magic) || !riot_inibin_u32_write(&writer, ctx->version)) {
+		errlog("Failed to write INIBIN header");
+		return false;
+	}
+
+	if (ctx->version >= 2) {
+		if (!riot_inibin_u32_write(&writer, ctx->link_count)) {
+			errlog("Failed to write INIBIN linked file count");
+			return false;
+		}
+
+		for (u32 i = 0; i < ctx->link_count; i++) {
+			if (!riot_inibin_str_write(&writer, riot_inibin_ctx_link(ctx, i))) {
+				errlog("Failed to write INIBIN linked file %u/%u", i + 1, ctx->link_count);
+				return false;
+			}
+		}
+	} else if (ctx->link_count) {
+		errlog("INIBIN version %u cannot hold %u linked files", ctx->version, ctx->link_count);
+		return false;
+	}
+
+	u8 *types = riot_writer_reserve(out, sizeof(u32) + (u64)ctx->entry_count * sizeof(u32));
+	if (!types) {
+		errlog("Failed to write %u INIBIN entry types", ctx->entry_count);
+		return false;
+	}
+
+	riot_store_le32(types, ctx->entry_count);
+	for (u32 i = 0; i < ctx->entry_count; i++)
+		riot_store_le32(types + (i + 1) * sizeof(u32), riot_inibin_ctx_entry(ctx, i)->fields.name_hash);
+
+	for (u32 i = 0; i < ctx->entry_count; i++) {
+		struct riot_inibin_entry *entry = riot_inibin_ctx_entry(ctx, i);
+
+		struct riot_inibin_section section;
+		if (!riot_inibin_section_begin(&writer, &section) ||
+		    !riot_inibin_u32_write(&writer, entry->path_hash) ||
+		    !riot_inibin_fields_write(&writer, &entry->fields) ||
+		    !riot_inibin_section_end(&writer, &section)) {
+			errlog("Failed to write INIBIN entry %u/%u", i + 1, ctx->entry_count);
+			return false;
+		}
+	}
+
+	dbglog("Wrote %u INIBIN entries, %u linked files (%lu bytes)", ctx->entry_count, ctx->link_count,
+	       out->len - start);
+
+	riot_trace_end("encode", span, out->len - start);
+
+	return true;
 }
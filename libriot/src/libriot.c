@@ -14,3 +14,6 @@ riot_intrusive_list_init(struct riot_intrusive_list *self);
 extern inline void
 riot_intrusive_list_push(struct riot_intrusive_list *self,
 			 struct riot_intrusive_list_node *elem);
+
+extern inline u32
+riot_hash_search(u64 const *hashes, u32 count, u64 key);
@@ -0,0 +1,233 @@
+#include "libriot/stats.h"
+
+#include <pthread.h>
+#include <time.h>
+
+static char const *riot_stats_names[RIOT_STAT_COUNT] = {
+	[RIOT_STAT_WAD_TOC_PARSES] = "wad_toc_parses",
+	[RIOT_STAT_WAD_TOC_BYTES] = "wad_toc_bytes",
+	[RIOT_STAT_WAD_TOC_CHUNKS] = "wad_toc_chunks",
+	[RIOT_STAT_WAD_TOC_NS] = "wad_toc_ns",
+
+	[RIOT_STAT_WAD_TOC_CACHE_HITS] = "wad_toc_cache_hits",
+	[RIOT_STAT_WAD_TOC_CACHE_MISSES] = "wad_toc_cache_misses",
+
+	[RIOT_STAT_WAD_CHECKSUM_BYTES] = "wad_checksum_bytes",
+
+	[RIOT_STAT_DECOMPRESS_NONE_CHUNKS] = "decompress_none_chunks",
+	[RIOT_STAT_DECOMPRESS_NONE_BYTES] = "decompress_none_bytes",
+	[RIOT_STAT_DECOMPRESS_NONE_NS] = "decompress_none_ns",
+	[RIOT_STAT_DECOMPRESS_ZSTD_CHUNKS] = "decompress_zstd_chunks",
+	[RIOT_STAT_DECOMPRESS_ZSTD_BYTES] = "decompress_zstd_bytes",
+	[RIOT_STAT_DECOMPRESS_ZSTD_NS] = "decompress_zstd_ns",
+	[RIOT_STAT_DECOMPRESS_ZSTD_CHUNK_CHUNKS] = "decompress_zstd_chunk_chunks",
+	[RIOT_STAT_DECOMPRESS_ZSTD_CHUNK_BYTES] = "decompress_zstd_chunk_bytes",
+	[RIOT_STAT_DECOMPRESS_ZSTD_CHUNK_NS] = "decompress_zstd_chunk_ns",
+
+	[RIOT_STAT_CHUNK_CACHE_HITS] = "chunk_cache_hits",
+	[RIOT_STAT_CHUNK_CACHE_MISSES] = "chunk_cache_misses",
+	[RIOT_STAT_CHUNK_CACHE_EVICTIONS] = "chunk_cache_evictions",
+
+	[RIOT_STAT_INIBIN_PARSES] = "inibin_parses",
+	[RIOT_STAT_INIBIN_BYTES] = "inibin_bytes",
+	[RIOT_STAT_INIBIN_ENTRIES] = "inibin_entries",
+	[RIOT_STAT_INIBIN_NS] = "inibin_ns",
+	[RIOT_STAT_INIBIN_STR_COPY_BYTES] = "inibin_str_copy_bytes",
+	[RIOT_STAT_INIBIN_STR_BORROW_BYTES] = "inibin_str_borrow_bytes",
+	[RIOT_STAT_INIBIN_ENTRY_LOADS] = "inibin_entry_loads",
+
+	[RIOT_STAT_IO_READS] = "io_reads",
+	[RIOT_STAT_IO_BYTES] = "io_bytes",
+	[RIOT_STAT_IO_NS] = "io_ns",
+
+	[RIOT_STAT_WRITER_BYTES] = "writer_bytes",
+	[RIOT_STAT_WRITER_NS] = "writer_ns",
+
+	[RIOT_STAT_POOL_GROWS] = "pool_grows",
+	[RIOT_STAT_POOL_GROW_BYTES] = "pool_grow_bytes",
+	[RIOT_STAT_STREAM_GROWS] = "stream_grows",
+	[RIOT_STAT_STREAM_GROW_BYTES] = "stream_grow_bytes",
+};
+
+static pthread_mutex_t riot_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct riot_stats_block *riot_stats_blocks;
+static struct riot_stats_block *riot_stats_free_blocks;
+
+static pthread_once_t riot_stats_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t riot_stats_key;
+static b8 riot_stats_key_ok;
+
+static _Thread_local struct riot_stats_block *riot_stats_local;
+
+/* a block that could not be allocated falls back to a shared one, which is
+ * still correct, if contended. blocks of exited threads are folded into it
+ */
+static struct riot_stats_block riot_stats_shared;
+
+static void
+riot_stats_unregister(void *arg) {
+	struct riot_stats_block *block = arg;
+
+	pthread_mutex_lock(&riot_stats_lock);
+
+	for (u32 i = 0; i < RIOT_STAT_COUNT; i++) {
+		u64 val = atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+		atomic_fetch_add_explicit(&riot_stats_shared.counters[i], val, memory_order_relaxed);
+	}
+
+	struct riot_stats_block **link = &riot_stats_blocks;
+	while (*link != block) link = &(*link)->next;
+	*link = block->next;
+
+	block->next = riot_stats_free_blocks;
+	riot_stats_free_blocks = block;
+
+	pthread_mutex_unlock(&riot_stats_lock);
+
+	riot_stats_local = NULL;
+}
+
+static void
+riot_stats_key_init(void) {
+	riot_stats_key_ok = pthread_key_create(&riot_stats_key, riot_stats_unregister) == 0;
+}
+
+static struct riot_stats_block *
+riot_stats_register(void) {
+	pthread_once(&riot_stats_key_once, riot_stats_key_init);
+
+	/* without a key, an exiting thread could not give its block back */
+	if (!riot_stats_key_ok) return riot_stats_local = &riot_stats_shared;
+
+	pthread_mutex_lock(&riot_stats_lock);
+
+	struct riot_stats_block *block = riot_stats_free_blocks;
+	if (block) riot_stats_free_blocks = block->next;
+
+	pthread_mutex_unlock(&riot_stats_lock);
+
+	if (!block) block = aligned_alloc(alignof(struct riot_stats_block), sizeof *block);
+	if (!block) return riot_stats_local = &riot_stats_shared;
+
+	for (u32 i = 0; i < RIOT_STAT_COUNT; i++)
+		atomic_init(&block->counters[i], 0);
+
+	if (pthread_setspecific(riot_stats_key, block) != 0) {
+		free(block);
+		return riot_stats_local = &riot_stats_shared;
+	}
+
+	pthread_mutex_lock(&riot_stats_lock);
+	block->next = riot_stats_blocks;
+	riot_stats_blocks = block;
+	pthread_mutex_unlock(&riot_stats_lock);
+
+	return riot_stats_local = block;
+}
+
+void
+riot_stats_add(enum riot_stat stat, u64 val) {
+	assert(stat < RIOT_STAT_COUNT);
+
+	struct riot_stats_block *block = riot_stats_local;
+	if (!block) block = riot_stats_register();
+
+	if (block == &riot_stats_shared) {
+		atomic_fetch_add_explicit(&block->counters[stat], val, memory_order_relaxed);
+		return;
+	}
+
+	/* the owning thread is the only writer, so there is no need for a
+	 * locked read-modify-write
+	 */
+	u64 cur = atomic_load_explicit(&block->counters[stat], memory_order_relaxed);
+	atomic_store_explicit(&block->counters[stat], cur + val, memory_order_relaxed);
+}
+
+u64
+riot_stats_clock(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+void
+riot_stats_snapshot(u64 out[RIOT_STAT_COUNT]) {
+	assert(out);
+
+	for (u32 i = 0; i < RIOT_STAT_COUNT; i++)
+		out[i] = atomic_load_explicit(&riot_stats_shared.counters[i], memory_order_relaxed);
+
+	pthread_mutex_lock(&riot_stats_lock);
+
+	for (struct riot_stats_block *block = riot_stats_blocks; block; block = block->next) {
+		for (u32 i = 0; i < RIOT_STAT_COUNT; i++)
+			out[i] += atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+	}
+
+	pthread_mutex_unlock(&riot_stats_lock);
+}
+
+u64
+riot_stats_get(enum riot_stat stat) {
+	assert(stat < RIOT_STAT_COUNT);
+
+	u64 counters[RIOT_STAT_COUNT];
+	riot_stats_snapshot(counters);
+
+	return counters[stat];
+}
+
+void
+riot_stats_reset(void) {
+	for (u32 i = 0; i < RIOT_STAT_COUNT; i++)
+		atomic_store_explicit(&riot_stats_shared.counters[i], 0, memory_order_relaxed);
+
+	pthread_mutex_lock(&riot_stats_lock);
+
+	for (struct riot_stats_block *block = riot_stats_blocks; block; block = block->next) {
+		for (u32 i = 0; i < RIOT_STAT_COUNT; i++)
+			atomic_store_explicit(&block->counters[i], 0, memory_order_relaxed);
+	}
+
+	pthread_mutex_unlock(&riot_stats_lock);
+}
+
+char const *
+riot_stats_name(enum riot_stat stat) {
+	assert(stat < RIOT_STAT_COUNT);
+
+	return riot_stats_names[stat];
+}
+
+void
+riot_stats_print_json(FILE *fp) {
+	assert(fp);
+
+	u64 counters[RIOT_STAT_COUNT];
+	riot_stats_snapshot(counters);
+
+	fputc('{', fp);
+	for (u32 i = 0; i < RIOT_STAT_COUNT; i++)
+		fprintf(fp, "%s\"%s\":%lu", i ? "," : "", riot_stats_names[i], counters[i]);
+	fputc('}', fp);
+}
+
+static void
+riot_stats_mem_resize(enum mem_resize_kind kind, u64 from, u64 to) {
+	(void) to;
+
+	switch (kind) {
+	case MEM_RESIZE_POOL:
+		riot_stats_add(RIOT_STAT_POOL_GROWS, 1);
+		riot_stats_add(RIOT_STAT_POOL_GROW_BYTES, from);
+		break;
+
+	case MEM_RESIZE_STREAM:
+		riot_stats_add(RIOT_STAT_STREAM_GROWS, 1);
+		riot_stats_add(RIOT_STAT_STREAM_GROW_BYTES, from);
+		break;
+	}
+}
+
+void (*mem_resize_hook)(enum mem_resize_kind kind, u64 from, u64 to) = riot_stats_mem_resize;
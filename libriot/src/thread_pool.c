@@ -0,0 +1,239 @@
+#include "libriot/thread_pool.h"
+
+#include <unistd.h>
+
+#define RANGE_PACK(begin, end) (((u64)(begin) << 32) | (u32)(end))
+#define RANGE_BEGIN(range) ((u32)((range) >> 32))
+#define RANGE_END(range) ((u32)(range))
+
+/* maps a slot in a worker's initial range back to a job index. worker `w`
+ * initially owns the indices w, w + T, w + 2T, ..., so that every worker
+ * starts on the lowest indices and steals the highest ones from its peers
+ */
+static inline u64
+riot_thread_pool_slot_to_idx(struct riot_thread_pool *self, u32 slot) {
+	u32 workers = self->thread_count;
+	u64 quot = self->count / workers, rem = self->count % workers;
+
+	u64 big_span = rem * (quot + 1);
+	u64 worker, off;
+	if (slot < big_span) {
+		worker = slot / (quot + 1);
+		off = slot % (quot + 1);
+	} else {
+		worker = rem + (slot - big_span) / quot;
+		off = (slot - big_span) % quot;
+	}
+
+	return off * workers + worker;
+}
+
+static inline b32
+riot_thread_pool_pop(struct riot_thread_pool_worker *worker, u32 *out) {
+	u64 range = atomic_load_explicit(&worker->range, memory_order_acquire);
+
+	do {
+		if (RANGE_BEGIN(range) >= RANGE_END(range))
+			return false;
+	} while (!atomic_compare_exchange_weak_explicit(&worker->range, &range,
+							RANGE_PACK(RANGE_BEGIN(range) + 1, RANGE_END(range)),
+							memory_order_acq_rel, memory_order_acquire));
+
+	*out = RANGE_BEGIN(range);
+
+	return true;
+}
+
+static b32
+riot_thread_pool_steal(struct riot_thread_pool *self, u32 thief) {
+	assert(self);
+
+	for (u32 i = 1; i < self->thread_count; i++) {
+		struct riot_thread_pool_worker *victim = &self->workers[(thief + i) % self->thread_count];
+
+		u64 range = atomic_load_explicit(&victim->range, memory_order_acquire);
+		while (RANGE_BEGIN(range) < RANGE_END(range)) {
+			u32 remaining = RANGE_END(range) - RANGE_BEGIN(range);
+			u32 split = RANGE_END(range) - (remaining + 1) / 2;
+
+			if (atomic_compare_exchange_weak_explicit(&victim->range, &range,
+								  RANGE_PACK(RANGE_BEGIN(range), split),
+								  memory_order_acq_rel, memory_order_acquire)) {
+				atomic_store_explicit(&self->workers[thief].range,
+						      RANGE_PACK(split, RANGE_END(range)),
+						      memory_order_release);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static void
+riot_thread_pool_work(struct riot_thread_pool *self, u32 worker) {
+	assert(self);
+
+	u32 slot;
+	do {
+		while (riot_thread_pool_pop(&self->workers[worker], &slot))
+			self->fn(self->arg, worker, riot_thread_pool_slot_to_idx(self, slot));
+	} while (riot_thread_pool_steal(self, worker));
+}
+
+static void *
+riot_thread_pool_worker_main(void *arg) {
+	struct riot_thread_pool_worker *worker = arg;
+	struct riot_thread_pool *self = worker->pool;
+
+	u64 seen = 0;
+
+	pthread_mutex_lock(&self->lock);
+	while (true) {
+		while (!self->shutdown && self->generation == seen)
+			pthread_cond_wait(&self->work_cond, &self->lock);
+
+		if (self->shutdown) break;
+
+		seen = self->generation;
+		pthread_mutex_unlock(&self->lock);
+
+		riot_thread_pool_work(self, worker->idx);
+
+		pthread_mutex_lock(&self->lock);
+		if (--self->active == 0)
+			pthread_cond_signal(&self->done_cond);
+	}
+	pthread_mutex_unlock(&self->lock);
+
+	return NULL;
+}
+
+u32
+riot_thread_pool_default_thread_count(void) {
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return online > 0 ? (u32)online : 1;
+}
+
+b32
+riot_thread_pool_init(struct riot_thread_pool *self, u32 thread_count) {
+	assert(self);
+	assert(thread_count);
+
+	self->thread_count = thread_count;
+	self->generation = 0;
+	self->active = 0;
+	self->shutdown = false;
+	self->fn = NULL;
+	self->arg = NULL;
+	self->count = 0;
+
+	u64 workers_size = thread_count * sizeof *self->workers;
+	self->workers = aligned_alloc(alignof(struct riot_thread_pool_worker), workers_size);
+	if (!self->workers)
+		goto workers_alloc_failure;
+
+	memset(self->workers, 0, workers_size);
+	for (u32 i = 0; i < thread_count; i++) {
+		self->workers[i].pool = self;
+		self->workers[i].idx = i;
+		atomic_init(&self->workers[i].range, 0);
+	}
+
+	if (pthread_mutex_init(&self->lock, NULL))
+		goto lock_init_failure;
+
+	if (pthread_cond_init(&self->work_cond, NULL))
+		goto work_cond_init_failure;
+
+	if (pthread_cond_init(&self->done_cond, NULL))
+		goto done_cond_init_failure;
+
+	u32 spawned = 1;
+	for (; spawned < thread_count; spawned++) {
+		struct riot_thread_pool_worker *worker = &self->workers[spawned];
+		if (pthread_create(&worker->thread, NULL, riot_thread_pool_worker_main, worker)) {
+			errlog("Failed to spawn worker thread %u/%u", spawned, thread_count);
+			goto thread_spawn_failure;
+		}
+	}
+
+	return true;
+
+thread_spawn_failure:
+	pthread_mutex_lock(&self->lock);
+	self->shutdown = true;
+	pthread_cond_broadcast(&self->work_cond);
+	pthread_mutex_unlock(&self->lock);
+
+	for (u32 i = 1; i < spawned; i++)
+		pthread_join(self->workers[i].thread, NULL);
+
+	pthread_cond_destroy(&self->done_cond);
+done_cond_init_failure:
+	pthread_cond_destroy(&self->work_cond);
+work_cond_init_failure:
+	pthread_mutex_destroy(&self->lock);
+lock_init_failure:
+	free(self->workers);
+workers_alloc_failure:
+	return false;
+}
+
+void
+riot_thread_pool_free(struct riot_thread_pool *self) {
+	assert(self);
+
+	pthread_mutex_lock(&self->lock);
+	self->shutdown = true;
+	pthread_cond_broadcast(&self->work_cond);
+	pthread_mutex_unlock(&self->lock);
+
+	for (u32 i = 1; i < self->thread_count; i++)
+		pthread_join(self->workers[i].thread, NULL);
+
+	pthread_cond_destroy(&self->done_cond);
+	pthread_cond_destroy(&self->work_cond);
+	pthread_mutex_destroy(&self->lock);
+
+	free(self->workers);
+}
+
+void
+riot_thread_pool_run(struct riot_thread_pool *self, u64 count, riot_thread_pool_fn fn, void *arg) {
+	assert(self);
+	assert(fn);
+	assert(count <= UINT32_MAX);
+
+	if (!count) return;
+
+	self->fn = fn;
+	self->arg = arg;
+	self->count = count;
+
+	u64 quot = count / self->thread_count, rem = count % self->thread_count;
+	u64 begin = 0;
+	for (u32 i = 0; i < self->thread_count; i++) {
+		u64 end = begin + quot + (i < rem);
+		atomic_store_explicit(&self->workers[i].range, RANGE_PACK(begin, end), memory_order_relaxed);
+		begin = end;
+	}
+
+	if (self->thread_count > 1 && count > 1) {
+		pthread_mutex_lock(&self->lock);
+		self->active = self->thread_count - 1;
+		self->generation++;
+		pthread_cond_broadcast(&self->work_cond);
+		pthread_mutex_unlock(&self->lock);
+
+		riot_thread_pool_work(self, 0);
+
+		pthread_mutex_lock(&self->lock);
+		while (self->active)
+			pthread_cond_wait(&self->done_cond, &self->lock);
+		pthread_mutex_unlock(&self->lock);
+	} else {
+		riot_thread_pool_work(self, 0);
+	}
+}
@@ -0,0 +1,181 @@
+#include "libriot/trace.h"
+
+#include <pthread.h>
+
+atomic_bool riot_trace_enabled;
+
+static u64 riot_trace_epoch;
+
+static pthread_mutex_t riot_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct riot_trace_ring *riot_trace_rings;
+static u32 riot_trace_ring_count;
+
+static pthread_once_t riot_trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t riot_trace_key;
+static b8 riot_trace_key_ok;
+
+static _Thread_local struct riot_trace_ring *riot_trace_local;
+static _Thread_local b8 riot_trace_local_failed;
+
+static void
+riot_trace_unregister(void *arg) {
+	struct riot_trace_ring *ring = arg;
+
+	pthread_mutex_lock(&riot_trace_lock);
+	ring->retired = true;
+	pthread_mutex_unlock(&riot_trace_lock);
+
+	riot_trace_local = NULL;
+}
+
+static void
+riot_trace_key_init(void) {
+	riot_trace_key_ok = pthread_key_create(&riot_trace_key, riot_trace_unregister) == 0;
+}
+
+static struct riot_trace_ring *
+riot_trace_register(void) {
+	pthread_once(&riot_trace_key_once, riot_trace_key_init);
+
+	/* without a key, an exiting thread could not give its ring back */
+	if (!riot_trace_key_ok) {
+		errlog("Failed to create trace ring key, spans on this thread are dropped");
+		riot_trace_local_failed = true;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&riot_trace_lock);
+
+	struct riot_trace_ring *ring = riot_trace_rings;
+	while (ring && !ring->retired) ring = ring->next;
+
+	/* a recycled ring starts over under a new tid, dropping the events of
+	 * the thread that retired it
+	 */
+	if (ring) {
+		atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+		ring->tid = riot_trace_ring_count++;
+		ring->retired = false;
+	}
+
+	pthread_mutex_unlock(&riot_trace_lock);
+
+	b32 recycled = ring != NULL;
+
+	if (!ring) ring = aligned_alloc(alignof(struct riot_trace_ring), sizeof *ring);
+	if (!ring) {
+		errlog("Failed to allocate trace ring (%zu bytes), spans on this thread are dropped", sizeof *ring);
+		riot_trace_local_failed = true;
+		return NULL;
+	}
+
+	if (pthread_setspecific(riot_trace_key, ring) != 0) {
+		errlog("Failed to register trace ring, spans on this thread are dropped");
+		riot_trace_local_failed = true;
+
+		if (recycled) riot_trace_unregister(ring);
+		else free(ring);
+
+		return NULL;
+	}
+
+	if (recycled) return riot_trace_local = ring;
+
+	atomic_init(&ring->head, 0);
+	ring->retired = false;
+
+	pthread_mutex_lock(&riot_trace_lock);
+	ring->tid = riot_trace_ring_count++;
+	ring->next = riot_trace_rings;
+	riot_trace_rings = ring;
+	pthread_mutex_unlock(&riot_trace_lock);
+
+	return riot_trace_local = ring;
+}
+
+b32
+riot_trace_start(void) {
+	if (atomic_load(&riot_trace_enabled)) return false;
+
+	pthread_mutex_lock(&riot_trace_lock);
+
+	for (struct riot_trace_ring *ring = riot_trace_rings; ring; ring = ring->next)
+		atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+
+	pthread_mutex_unlock(&riot_trace_lock);
+
+	riot_trace_epoch = riot_stats_clock();
+	atomic_store(&riot_trace_enabled, true);
+
+	return true;
+}
+
+void
+riot_trace_stop(void) {
+	atomic_store(&riot_trace_enabled, false);
+}
+
+void
+riot_trace_record(char const *name, u64 start, u64 end, u64 bytes) {
+	assert(name);
+
+	struct riot_trace_ring *ring = riot_trace_local;
+	if (!ring) {
+		if (riot_trace_local_failed) return;
+
+		ring = riot_trace_register();
+		if (!ring) return;
+	}
+
+	u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	struct riot_trace_event *event = &ring->events[head % RIOT_TRACE_RING_SZ];
+	event->name = name;
+	event->start = start;
+	event->end = end;
+	event->bytes = bytes;
+
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static f64
+riot_trace_us(u64 ns) {
+	return ns / 1000.0;
+}
+
+b32
+riot_trace_write_json(FILE *fp) {
+	assert(fp);
+
+	pthread_mutex_lock(&riot_trace_lock);
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"libriot\"}}");
+
+	for (struct riot_trace_ring *ring = riot_trace_rings; ring; ring = ring->next) {
+		fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+			ring->tid, ring->tid);
+
+		u64 head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		u64 first = head > RIOT_TRACE_RING_SZ ? head - RIOT_TRACE_RING_SZ : 0;
+
+		for (u64 i = first; i < head; i++) {
+			struct riot_trace_event *event = &ring->events[i % RIOT_TRACE_RING_SZ];
+
+			/* spans started before the current trace began are dropped */
+			if (event->start < riot_trace_epoch) continue;
+
+			fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"libriot\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+				"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bytes\":%lu}}",
+				event->name, ring->tid,
+				riot_trace_us(event->start - riot_trace_epoch),
+				riot_trace_us(event->end - event->start), event->bytes);
+		}
+	}
+
+	fprintf(fp, "\n]}\n");
+
+	pthread_mutex_unlock(&riot_trace_lock);
+
+	return !ferror(fp);
+}
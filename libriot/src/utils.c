@@ -1,62 +1,91 @@
 #include "libriot/utils.h"
 
-#define READ_BYTES(stream, type, out) \
-do { \
-	type _tmp = 0; \
-	u8 buf; \
-	for (u64 i = 0; i < sizeof(type); i++) { \
-		if (!mem_stream_consume(stream, &buf, 1)) return false; \
-		_tmp |= ((type)buf << (i * 8)); \
-	} \
-	*out = _tmp; \
-} while (0);
-
-#define MAKE_READ_FN(name, type) \
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+b32
+riot_mem_stream_map_file(struct mem_stream *out, char const *path, struct stat *st) {
+	assert(out);
+	assert(path);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat tmp;
+	if (!st) st = &tmp;
+
+	if (fstat(fd, st) < 0 || st->st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *ptr = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED) return false;
+
+	out->ptr = ptr;
+	out->len = st->st_size;
+	out->cur = 0;
+
+	return true;
+}
+
+void
+riot_mem_stream_unmap(struct mem_stream *self) {
+	assert(self);
+
+	if (self->ptr) munmap(self->ptr, self->len);
+
+	self->ptr = NULL;
+	self->len = self->cur = 0;
+}
+
+/* every primitive is decoded with a single bounds check and word load (see
+ * `riot_mem_stream_take()`), rather than byte by byte
+ */
+#define MAKE_READ_FN(name, type, bits) \
 b32 name(struct mem_stream *self, type *out) { \
 	assert(self); \
 	assert(out); \
-	READ_BYTES(self, type, out) \
+	u8 const *src = riot_mem_stream_take(self, sizeof(type)); \
+	if (!src) return false; \
+	*out = (type)riot_load_le##bits(src); \
 	return true; \
 }
 
-MAKE_READ_FN(riot_mem_stream_read_chr8, char)
-MAKE_READ_FN(riot_mem_stream_read_b8, b8)
-MAKE_READ_FN(riot_mem_stream_read_s8, s8)
-MAKE_READ_FN(riot_mem_stream_read_s16, s16)
-MAKE_READ_FN(riot_mem_stream_read_s32, s32)
-MAKE_READ_FN(riot_mem_stream_read_s64, s64)
-MAKE_READ_FN(riot_mem_stream_read_u8, u8)
-MAKE_READ_FN(riot_mem_stream_read_u16, u16)
-MAKE_READ_FN(riot_mem_stream_read_u32, u32)
-MAKE_READ_FN(riot_mem_stream_read_u64, u64)
-MAKE_READ_FN(riot_mem_stream_read_fnv1a_u32, fnv1a_u32)
-MAKE_READ_FN(riot_mem_stream_read_xxh64_u64, xxh64_u64)
-
-#define WRITE_BYTES(stream, type, val) \
-do { \
-	u8 buf; \
-	for (u64 i = 0; i < sizeof(type); i++) { \
-		buf = ((val >> (i * 8)) & 0xff); \
-		if (!mem_stream_push(stream, &buf, 1)) return false; \
-	} \
-} while (0);
-
-#define MAKE_WRITE_FN(name, type) \
+MAKE_READ_FN(riot_mem_stream_read_chr8, char, 8)
+MAKE_READ_FN(riot_mem_stream_read_b8, b8, 8)
+MAKE_READ_FN(riot_mem_stream_read_s8, s8, 8)
+MAKE_READ_FN(riot_mem_stream_read_s16, s16, 16)
+MAKE_READ_FN(riot_mem_stream_read_s32, s32, 32)
+MAKE_READ_FN(riot_mem_stream_read_s64, s64, 64)
+MAKE_READ_FN(riot_mem_stream_read_u8, u8, 8)
+MAKE_READ_FN(riot_mem_stream_read_u16, u16, 16)
+MAKE_READ_FN(riot_mem_stream_read_u32, u32, 32)
+MAKE_READ_FN(riot_mem_stream_read_u64, u64, 64)
+MAKE_READ_FN(riot_mem_stream_read_fnv1a_u32, fnv1a_u32, 32)
+MAKE_READ_FN(riot_mem_stream_read_xxh64_u64, xxh64_u64, 64)
+
+#define MAKE_WRITE_FN(name, type, bits) \
 b32 name(struct mem_stream *self, type val) { \
 	assert(self); \
-	WRITE_BYTES(self, type, val) \
+	u8 *dst = riot_mem_stream_reserve(self, sizeof(type)); \
+	if (!dst) return false; \
+	riot_store_le##bits(dst, val); \
 	return true; \
 }
 
-MAKE_WRITE_FN(riot_mem_stream_write_chr8, char)
-MAKE_WRITE_FN(riot_mem_stream_write_b8, b8)
-MAKE_WRITE_FN(riot_mem_stream_write_s8, s8)
-MAKE_WRITE_FN(riot_mem_stream_write_s16, s16)
-MAKE_WRITE_FN(riot_mem_stream_write_s32, s32)
-MAKE_WRITE_FN(riot_mem_stream_write_s64, s64)
-MAKE_WRITE_FN(riot_mem_stream_write_u8, u8)
-MAKE_WRITE_FN(riot_mem_stream_write_u16, u16)
-MAKE_WRITE_FN(riot_mem_stream_write_u32, u32)
-MAKE_WRITE_FN(riot_mem_stream_write_u64, u64)
-MAKE_WRITE_FN(riot_mem_stream_write_fnv1a_u32, fnv1a_u32)
-MAKE_WRITE_FN(riot_mem_stream_write_xxh64_u64, xxh64_u64)
+MAKE_WRITE_FN(riot_mem_stream_write_chr8, char, 8)
+MAKE_WRITE_FN(riot_mem_stream_write_b8, b8, 8)
+MAKE_WRITE_FN(riot_mem_stream_write_s8, s8, 8)
+MAKE_WRITE_FN(riot_mem_stream_write_s16, s16, 16)
+MAKE_WRITE_FN(riot_mem_stream_write_s32, s32, 32)
+MAKE_WRITE_FN(riot_mem_stream_write_s64, s64, 64)
+MAKE_WRITE_FN(riot_mem_stream_write_u8, u8, 8)
+MAKE_WRITE_FN(riot_mem_stream_write_u16, u16, 16)
+MAKE_WRITE_FN(riot_mem_stream_write_u32, u32, 32)
+MAKE_WRITE_FN(riot_mem_stream_write_u64, u64, 64)
+MAKE_WRITE_FN(riot_mem_stream_write_fnv1a_u32, fnv1a_u32, 32)
+MAKE_WRITE_FN(riot_mem_stream_write_xxh64_u64, xxh64_u64, 64)
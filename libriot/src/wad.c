@@ -1,14 +1,40 @@
 #include "libriot/wad.h"
 
+#include <sys/mman.h>
+
 b32
 riot_wad_ctx_init(struct riot_wad_ctx *self) {
 	assert(self);
 
+	memset(&self->wad, 0, sizeof self->wad);
+	memset(&self->src, 0, sizeof self->src);
+	self->mapped = false;
+	self->index_count = 0;
+	self->subchunk_count = 0;
+
+	memset(&self->column_pool, 0, sizeof self->column_pool);
+	memset(&self->columns, 0, sizeof self->columns);
+
 	if (!MEM_POOL_INIT(&self->chunk_pool, struct riot_wad_chunk, RIOT_WAD_CTX_CHUNK_POOL_SZ))
 		goto chunk_pool_alloc_failure;
 
+	if (!MEM_POOL_INIT(&self->index_hash_pool, xxh64_u64, RIOT_WAD_CTX_CHUNK_POOL_SZ))
+		goto index_hash_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->index_chunk_pool, u32, RIOT_WAD_CTX_CHUNK_POOL_SZ))
+		goto index_chunk_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->subchunk_pool, struct riot_wad_subchunk, RIOT_WAD_CTX_SUBCHUNK_POOL_SZ))
+		goto subchunk_pool_alloc_failure;
+
 	return true;
 
+subchunk_pool_alloc_failure:
+	mem_pool_free(&self->index_chunk_pool);
+index_chunk_pool_alloc_failure:
+	mem_pool_free(&self->index_hash_pool);
+index_hash_pool_alloc_failure:
+	mem_pool_free(&self->chunk_pool);
 chunk_pool_alloc_failure:
 	return false;
 }
@@ -18,6 +44,13 @@ riot_wad_ctx_free(struct riot_wad_ctx *self) {
 	assert(self);
 
 	mem_pool_free(&self->chunk_pool);
+	mem_pool_free(&self->index_hash_pool);
+	mem_pool_free(&self->index_chunk_pool);
+	mem_pool_free(&self->subchunk_pool);
+	mem_pool_free(&self->column_pool);
+
+	if (self->mapped && self->src.ptr)
+		munmap(self->src.ptr, self->src.len);
 }
 
 b32
@@ -32,3 +65,23 @@ riot_wad_ctx_pushn_chunk(struct riot_wad_ctx *self, u32 count, riot_offptr_t *ou
 
 	return true;
 }
+
+b32
+riot_wad_chunk_data(struct riot_wad_ctx *ctx, struct riot_wad_chunk *chunk, struct mem_stream *out) {
+	assert(ctx);
+	assert(chunk);
+	assert(out);
+
+	if (ctx->src.len < chunk->data_offset ||
+	    ctx->src.len - chunk->data_offset < chunk->compressed_size) {
+		errlog("WAD chunk data out of bounds: offset: %u, size: %u, source size: %lu",
+		       chunk->data_offset, chunk->compressed_size, ctx->src.len);
+		return false;
+	}
+
+	out->ptr = ctx->src.ptr + chunk->data_offset;
+	out->cur = 0;
+	out->len = chunk->compressed_size;
+
+	return true;
+}
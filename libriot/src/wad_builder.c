@@ -0,0 +1,651 @@
+#include "libriot/wad.h"
+#include "libriot/trace.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zstd.h>
+
+static b32
+riot_wad_builder_flush(struct riot_wad_builder *self);
+
+static b32
+riot_wad_builder_pwrite(int fd, void const *buf, u64 len, u64 off) {
+	u64 done = 0;
+	while (done < len) {
+		ssize_t n = pwrite(fd, (u8 const *)buf + done, len - done, off + done);
+		if (n <= 0) return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+/* reads exactly `len` bytes, failing on a short file */
+static b32
+riot_wad_builder_read(int fd, void *buf, u64 len) {
+	u64 done = 0;
+	while (done < len) {
+		ssize_t n = read(fd, (u8 *)buf + done, len - done);
+		if (n <= 0) return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+b32
+riot_wad_builder_init(struct riot_wad_builder *self, int fd, u32 chunk_count,
+		      struct riot_thread_pool *workers) {
+	assert(self);
+	assert(fd >= 0);
+
+	self->fd = fd;
+	self->level = RIOT_WAD_BUILDER_DEFAULT_LEVEL;
+	self->reserved = chunk_count;
+	self->data_cur = RIOT_WAD_V3_HEADER_SZ + (u64)chunk_count * RIOT_WAD_V3_CHUNK_SZ;
+	self->workers = workers;
+	self->bank = 0;
+	self->pending = 0;
+	self->queued = 0;
+	self->write_failed = false;
+
+	if (!riot_wad_ctx_init(&self->ctx))
+		goto ctx_init_failure;
+
+	self->ctx.wad.major = 3;
+	self->ctx.wad.minor = 1;
+
+	self->cctx_count = workers ? workers->thread_count : 1;
+	self->cctxs = calloc(self->cctx_count, sizeof *self->cctxs);
+	if (!self->cctxs)
+		goto cctxs_alloc_failure;
+
+	self->checksums = calloc(self->cctx_count, sizeof *self->checksums);
+	if (!self->checksums)
+		goto checksums_alloc_failure;
+
+	for (u32 i = 0; i < self->cctx_count; i++) {
+		self->cctxs[i] = ZSTD_createCCtx();
+		self->checksums[i] = riot_wad_checksum_state_create();
+		if (!self->cctxs[i] || !self->checksums[i])
+			goto cctx_alloc_failure;
+	}
+
+	/* two banks of slots, one being compressed while the other is written */
+	self->slot_count = self->cctx_count * RIOT_WAD_BUILDER_SLOTS_PER_WORKER;
+	self->slots = calloc(2 * self->slot_count, sizeof *self->slots);
+	if (!self->slots)
+		goto cctx_alloc_failure;
+
+	u32 slots_ready = 0;
+	for (; slots_ready < 2 * self->slot_count; slots_ready++) {
+		struct riot_wad_builder_slot *slot = &self->slots[slots_ready];
+
+		if (!MEM_POOL_INIT(&slot->raw, u8, RIOT_WAD_BUILDER_SLOT_POOL_SZ))
+			goto slot_alloc_failure;
+
+		if (!MEM_POOL_INIT(&slot->packed, u8, RIOT_WAD_BUILDER_SLOT_POOL_SZ)) {
+			mem_pool_free(&slot->raw);
+			goto slot_alloc_failure;
+		}
+	}
+
+	return true;
+
+slot_alloc_failure:
+	for (u32 i = 0; i < slots_ready; i++) {
+		mem_pool_free(&self->slots[i].raw);
+		mem_pool_free(&self->slots[i].packed);
+	}
+
+	free(self->slots);
+cctx_alloc_failure:
+	for (u32 i = 0; i < self->cctx_count; i++) {
+		ZSTD_freeCCtx(self->cctxs[i]);
+		riot_wad_checksum_state_free(self->checksums[i]);
+	}
+
+	free(self->checksums);
+checksums_alloc_failure:
+	free(self->cctxs);
+cctxs_alloc_failure:
+	riot_wad_ctx_free(&self->ctx);
+ctx_init_failure:
+	return false;
+}
+
+void
+riot_wad_builder_free(struct riot_wad_builder *self) {
+	assert(self);
+
+	for (u32 i = 0; i < 2 * self->slot_count; i++) {
+		free(self->slots[i].path);
+		mem_pool_free(&self->slots[i].raw);
+		mem_pool_free(&self->slots[i].packed);
+	}
+
+	free(self->slots);
+
+	for (u32 i = 0; i < self->cctx_count; i++) {
+		ZSTD_freeCCtx(self->cctxs[i]);
+		riot_wad_checksum_state_free(self->checksums[i]);
+	}
+
+	free(self->checksums);
+	free(self->cctxs);
+
+	riot_wad_ctx_free(&self->ctx);
+}
+
+static inline struct riot_wad_builder_slot *
+riot_wad_builder_bank(struct riot_wad_builder *self, u32 bank) {
+	return &self->slots[bank * self->slot_count];
+}
+
+b32
+riot_wad_builder_add_file(struct riot_wad_builder *self, xxh64_u64 path_hash, char const *path) {
+	assert(self);
+	assert(path);
+
+	if ((u64)self->ctx.wad.chunk_count + self->queued + self->pending >= UINT32_MAX) {
+		errlog("WAD builder out of chunk slots: %s", path);
+		return false;
+	}
+
+	struct riot_wad_builder_slot *slot = &riot_wad_builder_bank(self, self->bank)[self->pending];
+
+	slot->path = strdup(path);
+	if (!slot->path) {
+		errlog("Failed to queue WAD builder file: %s", path);
+		return false;
+	}
+
+	memset(&slot->chunk, 0, sizeof slot->chunk);
+	slot->chunk.path_hash = path_hash;
+
+	if (++self->pending == self->slot_count)
+		return riot_wad_builder_flush(self);
+
+	return true;
+}
+
+static int
+riot_wad_builder_open_file(char const *path, u64 *out) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		errlog("Failed to open WAD builder file: %s", path);
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (u64)st.st_size > UINT32_MAX) {
+		errlog("Failed to stat WAD builder file, or file size unsupported: %s", path);
+		close(fd);
+		return -1;
+	}
+
+	*out = st.st_size;
+
+	return fd;
+}
+
+/* compresses a file that fits in a single block in one go */
+static b32
+riot_wad_builder_pack_whole(struct riot_wad_builder *self, struct riot_wad_builder_slot *slot, u32 worker,
+			    int fd, u64 len) {
+	u64 span = riot_trace_begin();
+
+	mem_pool_reset(&slot->raw);
+	u8 *raw = MEM_POOL_ALLOC(&slot->raw, u8, len);
+	if (len && !raw) {
+		errlog("Failed to allocate %lu bytes for WAD builder file: %s", len, slot->path);
+		return false;
+	}
+
+	if (!riot_wad_builder_read(fd, raw, len)) {
+		errlog("Failed to read WAD builder file: %s", slot->path);
+		return false;
+	}
+
+	riot_trace_end("read", span, len);
+
+	u64 bound = ZSTD_compressBound(len);
+
+	mem_pool_reset(&slot->packed);
+	u8 *packed = MEM_POOL_ALLOC(&slot->packed, u8, bound);
+	if (!packed) {
+		errlog("Failed to allocate %lu bytes for compressed WAD chunk: %s", bound, slot->path);
+		return false;
+	}
+
+	span = riot_trace_begin();
+
+	size_t res = ZSTD_compressCCtx(self->cctxs[worker], packed, bound, raw, len, self->level);
+
+	riot_trace_end("compress", span, len);
+
+	if (!ZSTD_isError(res) && res < len) {
+		slot->stored = packed;
+		slot->chunk.compression = RIOT_WAD_COMPRESSION_ZSTD;
+		slot->chunk.compressed_size = res;
+	} else {
+		slot->stored = raw;
+		slot->chunk.compression = RIOT_WAD_COMPRESSION_NONE;
+		slot->chunk.compressed_size = len;
+	}
+
+	slot->chunk.checksum = riot_wad_checksum(slot->stored, slot->chunk.compressed_size);
+
+	return true;
+}
+
+/* reads and compresses a single queued file. the file is stored raw when
+ * compression fails to shrink it. files larger than a block are only
+ * checked here, and compressed as they are written out
+ */
+static void
+riot_wad_builder_pack(struct riot_wad_builder *self, struct riot_wad_builder_slot *slot, u32 worker) {
+	slot->failed = true;
+
+	u64 len;
+	int fd = riot_wad_builder_open_file(slot->path, &len);
+	if (fd < 0) return;
+
+	slot->stored = NULL;
+
+	b32 res = len > RIOT_WAD_BUILDER_BLOCK_SZ || riot_wad_builder_pack_whole(self, slot, worker, fd, len);
+
+	close(fd);
+
+	if (!res) return;
+
+	slot->chunk.decompressed_size = len;
+	slot->failed = false;
+}
+
+/* copies a file over raw from the start, a block at a time, hashing it on
+ * the way
+ */
+static b32
+riot_wad_builder_copy_file(struct riot_wad_builder *self, struct riot_wad_builder_slot *slot, u32 worker,
+			   int fd, u8 *block) {
+	struct riot_wad_checksum_state *checksum = self->checksums[worker];
+	riot_wad_checksum_reset(checksum);
+
+	u64 len = slot->chunk.decompressed_size;
+
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		errlog("Failed to rewind WAD builder file: %s", slot->path);
+		return false;
+	}
+
+	for (u64 off = 0; off < len;) {
+		u64 n = MIN(len - off, RIOT_WAD_BUILDER_BLOCK_SZ);
+
+		if (!riot_wad_builder_read(fd, block, n)) {
+			errlog("Failed to read WAD builder file: %s", slot->path);
+			return false;
+		}
+
+		if (!riot_wad_builder_pwrite(self->fd, block, n, self->data_cur + off)) {
+			errlog("Failed to write WAD chunk data: %s", slot->path);
+			return false;
+		}
+
+		riot_wad_checksum_update(checksum, block, n);
+		off += n;
+	}
+
+	slot->chunk.compression = RIOT_WAD_COMPRESSION_NONE;
+	slot->chunk.compressed_size = len;
+	slot->chunk.checksum = riot_wad_checksum_digest(checksum);
+
+	return true;
+}
+
+/* streams a large file through the compressor a block at a time, writing
+ * compressed output to its place in the archive as soon as the compressor
+ * hands it back, so that neither the file nor its compressed form is held
+ * in full. compression is abandoned once the output would catch up with the
+ * input, and the file is then copied over raw in its place
+ */
+static b32
+riot_wad_builder_stream_file(struct riot_wad_builder *self, struct riot_wad_builder_slot *slot, u32 worker) {
+	struct ZSTD_CCtx_s *cctx = self->cctxs[worker];
+	struct riot_wad_checksum_state *checksum = self->checksums[worker];
+
+	u64 len;
+	int fd = riot_wad_builder_open_file(slot->path, &len);
+	if (fd < 0) return false;
+
+	b32 res = false;
+
+	if (len != slot->chunk.decompressed_size) {
+		errlog("WAD builder file changed while packing: %s", slot->path);
+		goto cleanup;
+	}
+
+	ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, self->level)) ||
+	    ZSTD_isError(ZSTD_CCtx_setPledgedSrcSize(cctx, len))) {
+		errlog("Failed to set up compression for WAD builder file: %s", slot->path);
+		goto cleanup;
+	}
+
+	riot_wad_checksum_reset(checksum);
+
+	u64 out_cap = ZSTD_CStreamOutSize();
+
+	mem_pool_reset(&slot->raw);
+	mem_pool_reset(&slot->packed);
+	u8 *block = MEM_POOL_ALLOC(&slot->raw, u8, RIOT_WAD_BUILDER_BLOCK_SZ);
+	u8 *packed = MEM_POOL_ALLOC(&slot->packed, u8, out_cap);
+	if (!block || !packed) {
+		errlog("Failed to allocate blocks for WAD builder file: %s", slot->path);
+		goto cleanup;
+	}
+
+	u64 written = 0;
+	b32 compressing = true;
+
+	for (u64 off = 0; compressing && off < len;) {
+		u64 n = MIN(len - off, RIOT_WAD_BUILDER_BLOCK_SZ);
+
+		u64 span = riot_trace_begin();
+
+		if (!riot_wad_builder_read(fd, block, n)) {
+			errlog("Failed to read WAD builder file: %s", slot->path);
+			goto cleanup;
+		}
+
+		riot_trace_end("read", span, n);
+
+		off += n;
+
+		span = riot_trace_begin();
+
+		ZSTD_EndDirective mode = off == len ? ZSTD_e_end : ZSTD_e_continue;
+		ZSTD_inBuffer in = { .src = block, .size = n, .pos = 0, };
+
+		size_t rem;
+		do {
+			ZSTD_outBuffer out = { .dst = packed, .size = out_cap, .pos = 0, };
+
+			rem = ZSTD_compressStream2(cctx, &out, &in, mode);
+			if (ZSTD_isError(rem)) {
+				errlog("Failed to compress WAD builder file: %s: %s", slot->path, ZSTD_getErrorName(rem));
+				goto cleanup;
+			}
+
+			if (written + out.pos >= len) {
+				compressing = false;
+				break;
+			}
+
+			if (!riot_wad_builder_pwrite(self->fd, packed, out.pos, self->data_cur + written)) {
+				errlog("Failed to write WAD chunk data: %s", slot->path);
+				goto cleanup;
+			}
+
+			riot_wad_checksum_update(checksum, packed, out.pos);
+			written += out.pos;
+		} while (mode == ZSTD_e_end ? rem != 0 : in.pos < in.size);
+
+		riot_trace_end("compress", span, n);
+	}
+
+	if (!compressing) {
+		res = riot_wad_builder_copy_file(self, slot, worker, fd, block);
+		goto cleanup;
+	}
+
+	slot->chunk.compression = RIOT_WAD_COMPRESSION_ZSTD;
+	slot->chunk.compressed_size = written;
+	slot->chunk.checksum = riot_wad_checksum_digest(checksum);
+
+	res = true;
+
+cleanup:
+	close(fd);
+
+	return res;
+}
+
+/* appends the queued bank to the output, in order */
+static b32
+riot_wad_builder_write(struct riot_wad_builder *self, u32 worker) {
+	struct riot_wad_builder_slot *slots = riot_wad_builder_bank(self, self->bank ^ 1);
+
+	u64 span = riot_trace_begin(), data_start = self->data_cur;
+
+	riot_offptr_t first;
+	if (!riot_wad_ctx_pushn_chunk(&self->ctx, self->queued, &first)) {
+		errlog("Failed to allocate %u WAD chunks", self->queued);
+		return false;
+	}
+
+	for (u32 i = 0; i < self->queued; i++) {
+		struct riot_wad_builder_slot *slot = &slots[i];
+
+		/* the reason was logged when the file was packed, during the
+		 * previous flush, so name the file again here
+		 */
+		if (slot->failed) {
+			errlog("Failed to pack WAD builder file: %s", slot->path);
+			return false;
+		}
+
+		if (slot->stored) {
+			if (!riot_wad_builder_pwrite(self->fd, slot->stored, slot->chunk.compressed_size, self->data_cur)) {
+				errlog("Failed to write WAD chunk data: %s", slot->path);
+				return false;
+			}
+		} else if (!riot_wad_builder_stream_file(self, slot, worker)) {
+			return false;
+		}
+
+		u64 size = slot->chunk.compressed_size;
+		if (self->data_cur + size > UINT32_MAX) {
+			errlog("WAD data exceeds the 4 GiB offset limit: %s", slot->path);
+			return false;
+		}
+
+		slot->chunk.data_offset = self->data_cur;
+		self->data_cur += size;
+
+		struct riot_wad_chunk *chunk = (struct riot_wad_chunk *)self->ctx.chunk_pool.ptr + first + i;
+		*chunk = slot->chunk;
+	}
+
+	self->ctx.wad.chunk_count += self->queued;
+
+	riot_trace_end("write", span, self->data_cur - data_start);
+
+	return true;
+}
+
+/* task 0 writes the queued bank out, while the others compress the files
+ * of the bank being filled. indices are dealt out from the lowest, so the
+ * write starts right away
+ */
+static void
+riot_wad_builder_task(void *arg, u32 worker, u64 idx) {
+	struct riot_wad_builder *self = arg;
+
+	if (self->queued && idx-- == 0) {
+		self->write_failed = !riot_wad_builder_write(self, worker);
+		return;
+	}
+
+	riot_wad_builder_pack(self, &riot_wad_builder_bank(self, self->bank)[idx], worker);
+}
+
+/* shrinks the buffers of a slot back to their initial size after a file
+ * that grew them, so that a few large files do not pin block-sized buffers
+ * in every slot for the rest of the build. a failed shrink keeps the larger
+ * buffer, which is still usable
+ */
+static void
+riot_wad_builder_slot_trim(struct riot_wad_builder_slot *slot) {
+	if (slot->raw.cap > RIOT_WAD_BUILDER_SLOT_POOL_SZ)
+		mem_pool_resize(&slot->raw, 1, RIOT_WAD_BUILDER_SLOT_POOL_SZ);
+
+	if (slot->packed.cap > RIOT_WAD_BUILDER_SLOT_POOL_SZ)
+		mem_pool_resize(&slot->packed, 1, RIOT_WAD_BUILDER_SLOT_POOL_SZ);
+}
+
+/* compresses the pending bank while writing the queued one, then queues the
+ * pending bank for the next flush
+ */
+static b32
+riot_wad_builder_flush(struct riot_wad_builder *self) {
+	assert(self);
+
+	u32 count = self->pending + (self->queued ? 1 : 0);
+	if (!count) return true;
+
+	self->write_failed = false;
+
+	if (self->workers) {
+		riot_thread_pool_run(self->workers, count, riot_wad_builder_task, self);
+	} else {
+		for (u32 i = 0; i < count; i++)
+			riot_wad_builder_task(self, 0, i);
+	}
+
+	b32 res = !self->write_failed;
+
+	struct riot_wad_builder_slot *queued = riot_wad_builder_bank(self, self->bank ^ 1);
+	for (u32 i = 0; i < self->queued; i++) {
+		free(queued[i].path);
+		queued[i].path = NULL;
+
+		riot_wad_builder_slot_trim(&queued[i]);
+	}
+
+	self->queued = self->pending;
+	self->pending = 0;
+	self->bank ^= 1;
+
+	return res;
+}
+
+/* moves the payloads that a table of contents grown past the reserved space
+ * would overwrite to the end of the file. payloads are laid out in order
+ * from the start of the data, so only a prefix of them ever needs moving
+ */
+static b32
+riot_wad_builder_relocate(struct riot_wad_builder *self, u64 toc_end) {
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)self->ctx.chunk_pool.ptr;
+
+	struct mem_pool *scratch = &self->slots[0].raw;
+	mem_pool_reset(scratch);
+	u8 *block = MEM_POOL_ALLOC(scratch, u8, RIOT_WAD_BUILDER_BLOCK_SZ);
+	if (!block) {
+		errlog("Failed to allocate WAD builder relocation buffer");
+		return false;
+	}
+
+	for (u32 i = 0; i < self->ctx.wad.chunk_count; i++) {
+		struct riot_wad_chunk *chunk = &chunks[i];
+		if (chunk->data_offset >= toc_end) continue;
+
+		u64 size = chunk->compressed_size;
+		if (self->data_cur + size > UINT32_MAX) {
+			errlog("WAD data exceeds the 4 GiB offset limit: %016lx", chunk->path_hash);
+			return false;
+		}
+
+		for (u64 off = 0; off < size;) {
+			u64 n = MIN(size - off, RIOT_WAD_BUILDER_BLOCK_SZ);
+
+			if (pread(self->fd, block, n, chunk->data_offset + off) != (ssize_t)n ||
+			    !riot_wad_builder_pwrite(self->fd, block, n, self->data_cur + off)) {
+				errlog("Failed to relocate WAD chunk data: %016lx", chunk->path_hash);
+				return false;
+			}
+
+			off += n;
+		}
+
+		dbglog("Relocated WAD chunk %016lx: %u -> %lu", chunk->path_hash, chunk->data_offset, self->data_cur);
+
+		chunk->data_offset = self->data_cur;
+		self->data_cur += size;
+	}
+
+	return true;
+}
+
+static int
+riot_wad_builder_chunk_cmp(void const *lhs, void const *rhs) {
+	struct riot_wad_chunk const *a = lhs, *b = rhs;
+
+	return (a->path_hash > b->path_hash) - (a->path_hash < b->path_hash);
+}
+
+b32
+riot_wad_builder_finish(struct riot_wad_builder *self) {
+	assert(self);
+
+	/* once to compress the last files, and once more to write them out */
+	if (!riot_wad_builder_flush(self) || !riot_wad_builder_flush(self))
+		return false;
+
+	struct riot_wad_ctx *ctx = &self->ctx;
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+
+	u64 toc_len = RIOT_WAD_V3_HEADER_SZ + (u64)ctx->wad.chunk_count * RIOT_WAD_V3_CHUNK_SZ;
+
+	/* with fewer chunks than reserved, the rest of the reserved space is
+	 * left as slack between the table of contents and the data
+	 */
+	if (ctx->wad.chunk_count > self->reserved && !riot_wad_builder_relocate(self, toc_len))
+		return false;
+
+	qsort(chunks, ctx->wad.chunk_count, sizeof *chunks, riot_wad_builder_chunk_cmp);
+
+	for (u32 i = 1; i < ctx->wad.chunk_count; i++) {
+		if (chunks[i - 1].path_hash == chunks[i].path_hash) {
+			errlog("Duplicate WAD path hash: %016lx", chunks[i].path_hash);
+			return false;
+		}
+	}
+
+	struct mem_stream toc = {
+		.ptr = malloc(toc_len),
+		.len = toc_len,
+		.cur = 0,
+	};
+
+	if (!toc.ptr) {
+		errlog("Failed to allocate WAD table of contents (%lu bytes)", toc_len);
+		return false;
+	}
+
+	b32 res = false;
+
+	if (!riot_wad_write_toc(ctx, &toc))
+		goto cleanup;
+
+	if (!riot_wad_builder_pwrite(self->fd, toc.ptr, toc.cur, 0)) {
+		errlog("Failed to write WAD table of contents");
+		goto cleanup;
+	}
+
+	if (!riot_wad_ctx_build_index(ctx))
+		goto cleanup;
+
+	dbglog("Built WAD with %u chunks (%lu bytes)", ctx->wad.chunk_count, self->data_cur);
+
+	res = true;
+
+cleanup:
+	free(toc.ptr);
+
+	return res;
+}
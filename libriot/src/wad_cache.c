@@ -0,0 +1,192 @@
+#include "libriot/wad.h"
+#include "libriot/stats.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static char const riot_wad_cache_magic[4] = { 'R', 'W', 'I', 'C', };
+
+static u64
+riot_wad_cache_len(u32 chunk_count) {
+	return sizeof(struct riot_wad_cache_header) +
+		(u64)chunk_count * (sizeof(struct riot_wad_chunk) + sizeof(xxh64_u64) + sizeof(u32));
+}
+
+static void
+riot_wad_cache_key(struct mem_stream *archive, struct stat const *st, struct riot_wad_cache_header *out) {
+	memset(out, 0, sizeof *out);
+
+	memcpy(out->magic, riot_wad_cache_magic, sizeof out->magic);
+	out->version = RIOT_WAD_CACHE_VERSION;
+	out->chunk_sz = sizeof(struct riot_wad_chunk);
+	out->archive_size = st->st_size;
+	out->mtime_sec = st->st_mtim.tv_sec;
+	out->mtime_nsec = st->st_mtim.tv_nsec;
+	out->header_checksum = riot_wad_checksum(archive->ptr, MIN(archive->len, RIOT_WAD_V3_HEADER_SZ));
+}
+
+/* fills the ctx from a mapped sidecar, if it was written for the archive
+ * described by `key`
+ */
+static b32
+riot_wad_cache_load(struct riot_wad_ctx *ctx, struct riot_wad_cache_header const *key, char const *cache_path) {
+	struct mem_stream src;
+	if (!riot_mem_stream_map_file(&src, cache_path, NULL)) return false;
+
+	b32 res = false;
+
+	struct riot_wad_cache_header const *header = (void *)src.ptr;
+	if (src.len < sizeof *header ||
+	    memcmp(header->magic, key->magic, sizeof key->magic) != 0 ||
+	    header->version != key->version ||
+	    header->chunk_sz != key->chunk_sz ||
+	    header->archive_size != key->archive_size ||
+	    header->mtime_sec != key->mtime_sec ||
+	    header->mtime_nsec != key->mtime_nsec ||
+	    header->header_checksum != key->header_checksum ||
+	    src.len != riot_wad_cache_len(header->chunk_count))
+		goto cleanup;
+
+	u32 count = header->chunk_count;
+
+	u8 const *chunks = (u8 const *)(header + 1);
+	u8 const *hashes = chunks + (u64)count * sizeof(struct riot_wad_chunk);
+	u8 const *indices = hashes + (u64)count * sizeof(xxh64_u64);
+
+	mem_pool_reset(&ctx->chunk_pool);
+	mem_pool_reset(&ctx->index_hash_pool);
+	mem_pool_reset(&ctx->index_chunk_pool);
+
+	struct riot_wad_chunk *chunk_table = MEM_POOL_ALLOC(&ctx->chunk_pool, struct riot_wad_chunk, count);
+	xxh64_u64 *index_hashes = MEM_POOL_ALLOC(&ctx->index_hash_pool, xxh64_u64, count);
+	u32 *index_chunks = MEM_POOL_ALLOC(&ctx->index_chunk_pool, u32, count);
+	if (count && (!chunk_table || !index_hashes || !index_chunks))
+		goto cleanup;
+
+	memcpy(chunk_table, chunks, (u64)count * sizeof *chunk_table);
+	memcpy(index_hashes, hashes, (u64)count * sizeof *index_hashes);
+	memcpy(index_chunks, indices, (u64)count * sizeof *index_chunks);
+
+	/* the key only ties the sidecar to the archive, so a damaged (or
+	 * hand-edited) index could still send lookups out of bounds. reject
+	 * it unless it is sorted and agrees with the table it indexes
+	 */
+	for (u32 i = 0; i < count; i++) {
+		if (index_chunks[i] >= count ||
+		    index_hashes[i] != chunk_table[index_chunks[i]].path_hash ||
+		    (i && index_hashes[i - 1] > index_hashes[i]))
+			goto cleanup;
+	}
+
+	ctx->wad.major = header->major;
+	ctx->wad.minor = header->minor;
+	ctx->wad.chunk_count = count;
+	ctx->wad.data_start = header->data_start;
+	ctx->index_count = count;
+
+	res = true;
+
+cleanup:
+	/* leave the pools empty for the parse we fall back on */
+	if (!res) {
+		mem_pool_reset(&ctx->chunk_pool);
+		mem_pool_reset(&ctx->index_hash_pool);
+		mem_pool_reset(&ctx->index_chunk_pool);
+	}
+
+	riot_mem_stream_unmap(&src);
+
+	return res;
+}
+
+/* writes the sidecar to a temporary file first, and renames it into place,
+ * so that concurrent readers never observe a partial sidecar
+ */
+static b32
+riot_wad_cache_store(struct riot_wad_ctx *ctx, struct riot_wad_cache_header const *key, char const *cache_path) {
+	u32 count = ctx->wad.chunk_count;
+
+	struct riot_wad_cache_header header = *key;
+	header.chunk_count = count;
+	header.major = ctx->wad.major;
+	header.minor = ctx->wad.minor;
+	header.data_start = ctx->wad.data_start;
+
+	if (ctx->index_count != count) return false;
+
+	char tmp_path[PATH_MAX];
+	if ((u64)snprintf(tmp_path, sizeof tmp_path, "%s.%d.%lx.tmp", cache_path, getpid(), (u64)(uintptr_t)ctx) >=
+	    sizeof tmp_path)
+		return false;
+
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) return false;
+
+	b32 res = false;
+
+	if (!riot_writer_push(&out, &header, sizeof header) ||
+	    !riot_writer_push_ref(&out, ctx->chunk_pool.ptr, (u64)count * sizeof(struct riot_wad_chunk)) ||
+	    !riot_writer_push_ref(&out, ctx->index_hash_pool.ptr, (u64)count * sizeof(xxh64_u64)) ||
+	    !riot_writer_push_ref(&out, ctx->index_chunk_pool.ptr, (u64)count * sizeof(u32)))
+		goto writer_cleanup;
+
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) goto writer_cleanup;
+
+	b32 flushed = riot_writer_flush(&out, fd);
+	if (close(fd) < 0 || !flushed || rename(tmp_path, cache_path) < 0) {
+		unlink(tmp_path);
+		goto writer_cleanup;
+	}
+
+	res = true;
+
+writer_cleanup:
+	riot_writer_free(&out);
+
+	return res;
+}
+
+b32
+riot_wad_open_cached(struct riot_wad_ctx *ctx, char const *path, char const *cache_path) {
+	assert(ctx);
+	assert(path);
+	assert(cache_path);
+
+	struct stat st;
+	struct mem_stream stream;
+	if (!riot_mem_stream_map_file(&stream, path, &st)) {
+		errlog("Failed to map WAD file: %s", path);
+		return false;
+	}
+
+	struct riot_wad_cache_header key;
+	riot_wad_cache_key(&stream, &st, &key);
+
+	if (riot_wad_cache_load(ctx, &key, cache_path)) {
+		dbglog("Loaded WAD table of contents from cache: %s (%u chunks)", cache_path, ctx->wad.chunk_count);
+		riot_stats_add(RIOT_STAT_WAD_TOC_CACHE_HITS, 1);
+
+		ctx->src = stream;
+		ctx->mapped = true;
+
+		return true;
+	}
+
+	riot_stats_add(RIOT_STAT_WAD_TOC_CACHE_MISSES, 1);
+
+	if (!riot_wad_read(ctx, stream)) {
+		riot_mem_stream_unmap(&stream);
+		ctx->src.ptr = NULL;
+		ctx->src.len = 0;
+		return false;
+	}
+
+	ctx->mapped = true;
+
+	if (!riot_wad_cache_store(ctx, &key, cache_path)) {
+		dbglog("Failed to write WAD table of contents cache: %s", cache_path);
+	}
+
+	return true;
+}
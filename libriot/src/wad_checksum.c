@@ -0,0 +1,177 @@
+#include "libriot/wad.h"
+#include "libriot/stats.h"
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+u64
+riot_wad_checksum(void const *data, u64 len) {
+	return XXH3_64bits(data, len);
+}
+
+struct riot_wad_checksum_state {
+	XXH3_state_t xxh;
+};
+
+struct riot_wad_checksum_state *
+riot_wad_checksum_state_create(void) {
+	struct riot_wad_checksum_state *state = aligned_alloc(alignof(struct riot_wad_checksum_state), sizeof *state);
+	if (state) riot_wad_checksum_reset(state);
+
+	return state;
+}
+
+void
+riot_wad_checksum_state_free(struct riot_wad_checksum_state *state) {
+	free(state);
+}
+
+void
+riot_wad_checksum_reset(struct riot_wad_checksum_state *state) {
+	assert(state);
+
+	XXH3_64bits_reset(&state->xxh);
+}
+
+void
+riot_wad_checksum_update(struct riot_wad_checksum_state *state, void const *data, u64 len) {
+	assert(state);
+	assert(data || !len);
+
+	XXH3_64bits_update(&state->xxh, data, len);
+}
+
+u64
+riot_wad_checksum_digest(struct riot_wad_checksum_state *state) {
+	assert(state);
+
+	return XXH3_64bits_digest(&state->xxh);
+}
+
+xxh64_u64
+riot_wad_path_hash(char const *path, u64 len) {
+	assert(path || !len);
+
+	XXH64_state_t state;
+	XXH64_reset(&state, 0);
+
+	char buf[256];
+	for (u64 i = 0; i < len; i += sizeof buf) {
+		u64 n = MIN(len - i, sizeof buf);
+		for (u64 j = 0; j < n; j++) {
+			char c = path[i + j];
+			buf[j] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+		}
+
+		XXH64_update(&state, buf, n);
+	}
+
+	return XXH64_digest(&state);
+}
+
+/* a single pass over the chunk table shared by checksum generation and
+ * verification: chunk `i` is hashed over `base[data_offset - base_off]`, and
+ * the result is either stored into the chunk or compared against it
+ */
+struct riot_wad_checksum_job {
+	struct riot_wad_chunk *chunks;
+	u8 const *base;
+	u64 base_off, len;
+	b8 verify;
+	u64 *computed;
+	atomic_uint mismatches;
+	atomic_bool failed;
+};
+
+static void
+riot_wad_checksum_task(void *arg, u32 worker, u64 idx) {
+	struct riot_wad_checksum_job *job = arg;
+
+	(void) worker;
+
+	struct riot_wad_chunk *chunk = &job->chunks[idx];
+
+	if (chunk->data_offset < job->base_off ||
+	    job->len < chunk->data_offset - job->base_off ||
+	    job->len - (chunk->data_offset - job->base_off) < chunk->compressed_size) {
+		errlog("WAD chunk data out of bounds: offset: %u, size: %u", chunk->data_offset, chunk->compressed_size);
+		atomic_store_explicit(&job->failed, true, memory_order_relaxed);
+		return;
+	}
+
+	u64 checksum = riot_wad_checksum(job->base + (chunk->data_offset - job->base_off), chunk->compressed_size);
+	riot_stats_add(RIOT_STAT_WAD_CHECKSUM_BYTES, chunk->compressed_size);
+
+	if (job->computed)
+		job->computed[idx] = checksum;
+
+	if (!job->verify) {
+		chunk->checksum = checksum;
+	} else if (chunk->checksum != checksum) {
+		atomic_fetch_add_explicit(&job->mismatches, 1, memory_order_relaxed);
+	}
+}
+
+static b32
+riot_wad_checksum_run(struct riot_wad_ctx *ctx, struct riot_wad_checksum_job *job,
+		      struct riot_thread_pool *workers) {
+	assert(ctx);
+	assert(job);
+
+	job->chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	atomic_init(&job->mismatches, 0);
+	atomic_init(&job->failed, false);
+
+	if (workers) {
+		riot_thread_pool_run(workers, ctx->wad.chunk_count, riot_wad_checksum_task, job);
+	} else {
+		for (u32 i = 0; i < ctx->wad.chunk_count; i++)
+			riot_wad_checksum_task(job, 0, i);
+	}
+
+	return !atomic_load(&job->failed);
+}
+
+b32
+riot_wad_ctx_compute_checksums(struct riot_wad_ctx *ctx, void *data, u64 len,
+			       struct riot_thread_pool *workers) {
+	assert(ctx);
+	assert(data || !len);
+
+	struct riot_wad_checksum_job job = {
+		.base = data,
+		.base_off = ctx->wad.data_start,
+		.len = len,
+		.verify = false,
+		.computed = NULL,
+	};
+
+	return riot_wad_checksum_run(ctx, &job, workers);
+}
+
+b32
+riot_wad_verify_checksums(struct riot_wad_ctx *ctx, struct riot_thread_pool *workers,
+			  u64 *computed, u32 *mismatches) {
+	assert(ctx);
+	assert(mismatches);
+
+	if (!riot_wad_version_has_xxh3_checksums(ctx->wad.major, ctx->wad.minor)) {
+		errlog("WAD v%u.%u does not store xxh3 chunk checksums", ctx->wad.major, ctx->wad.minor);
+		return false;
+	}
+
+	struct riot_wad_checksum_job job = {
+		.base = ctx->src.ptr,
+		.base_off = 0,
+		.len = ctx->src.len,
+		.verify = true,
+		.computed = computed,
+	};
+
+	if (!riot_wad_checksum_run(ctx, &job, workers))
+		return false;
+
+	*mismatches = atomic_load(&job.mismatches);
+
+	return true;
+}
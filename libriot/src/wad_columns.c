@@ -0,0 +1,187 @@
+#include "libriot/wad.h"
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+b32
+riot_wad_ctx_build_columns(struct riot_wad_ctx *self) {
+	assert(self);
+
+	u32 count = self->wad.chunk_count;
+
+	/* all columns are carved out of a single allocation, so that growing
+	 * the pool cannot invalidate columns that were already placed
+	 */
+	u64 hash_sz = count * sizeof(xxh64_u64), word_sz = count * sizeof(u32);
+	u64 len = hash_sz + 3 * word_sz + count;
+
+	mem_pool_reset(&self->column_pool);
+	memset(&self->columns, 0, sizeof self->columns);
+
+	if (!count) return true;
+
+	u8 *ptr = MEM_POOL_ALLOC(&self->column_pool, u8, len);
+	if (!ptr) {
+		errlog("Failed to allocate WAD chunk columns (%lu bytes)", len);
+		return false;
+	}
+
+	struct riot_wad_columns *columns = &self->columns;
+	columns->path_hash = (xxh64_u64 *)ptr;
+	columns->data_offset = (u32 *)(ptr + hash_sz);
+	columns->compressed_size = (u32 *)(ptr + hash_sz + word_sz);
+	columns->decompressed_size = (u32 *)(ptr + hash_sz + 2 * word_sz);
+	columns->compression = ptr + hash_sz + 3 * word_sz;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)self->chunk_pool.ptr;
+	for (u32 i = 0; i < count; i++) {
+		columns->path_hash[i] = chunks[i].path_hash;
+		columns->data_offset[i] = chunks[i].data_offset;
+		columns->compressed_size[i] = chunks[i].compressed_size;
+		columns->decompressed_size[i] = chunks[i].decompressed_size;
+		columns->compression[i] = chunks[i].compression;
+	}
+
+	columns->count = count;
+
+	dbglog("Built WAD chunk columns over %u chunks", count);
+
+	return true;
+}
+
+static inline b32
+riot_wad_column_query_match(struct riot_wad_column_query const *query, u8 compression, u32 size, u32 offset) {
+	return (compression < 32 && (query->compression_mask >> compression) & 1) &&
+		size - query->size_min <= query->size_max - query->size_min &&
+		offset - query->offset_min <= query->offset_max - query->offset_min;
+}
+
+#if defined(__SSE2__)
+/* unsigned `lo <= x <= hi` over four lanes, as the single unsigned compare
+ * `x - lo <= hi - lo`. sse2 only has signed compares, so both sides are
+ * biased by the sign bit first
+ */
+static inline __m128i
+riot_wad_columns_in_range(__m128i x, __m128i lo, __m128i span) {
+	__m128i bias = _mm_set1_epi32(INT32_MIN);
+	__m128i rel = _mm_xor_si128(_mm_sub_epi32(x, lo), bias);
+
+	return _mm_andnot_si128(_mm_cmpgt_epi32(rel, span), _mm_set1_epi32(-1));
+}
+#endif
+
+u32
+riot_wad_columns_select(struct riot_wad_columns const *columns, struct riot_wad_column_query const *query,
+			u32 *out) {
+	assert(columns);
+	assert(query);
+	assert(out || !columns->count);
+
+	if (query->size_min > query->size_max || query->offset_min > query->offset_max)
+		return 0;
+
+	u32 found = 0, i = 0;
+
+#if defined(__SSE2__)
+	__m128i bias = _mm_set1_epi32(INT32_MIN);
+
+	__m128i size_min = _mm_set1_epi32(query->size_min);
+	__m128i size_span = _mm_xor_si128(_mm_set1_epi32(query->size_max - query->size_min), bias);
+
+	__m128i offset_min = _mm_set1_epi32(query->offset_min);
+	__m128i offset_span = _mm_xor_si128(_mm_set1_epi32(query->offset_max - query->offset_min), bias);
+
+	/* compression types are tested by comparing against every type set in
+	 * the mask, as sse2 has no per-lane variable shift
+	 */
+	u32 types[32], type_count = 0;
+	for (u32 t = 0; t < 32; t++) {
+		if ((query->compression_mask >> t) & 1) types[type_count++] = t;
+	}
+
+	b32 any_type = type_count == 32;
+
+	for (; i + 4 <= columns->count; i += 4) {
+		__m128i size = _mm_loadu_si128((__m128i const *)(columns->decompressed_size + i));
+		__m128i offset = _mm_loadu_si128((__m128i const *)(columns->data_offset + i));
+
+		__m128i match = _mm_and_si128(riot_wad_columns_in_range(size, size_min, size_span),
+					      riot_wad_columns_in_range(offset, offset_min, offset_span));
+
+		if (!any_type) {
+			s32 packed;
+			memcpy(&packed, columns->compression + i, sizeof packed);
+
+			__m128i zero = _mm_setzero_si128();
+			__m128i compression = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+
+			__m128i type_match = zero;
+			for (u32 t = 0; t < type_count; t++)
+				type_match = _mm_or_si128(type_match, _mm_cmpeq_epi32(compression, _mm_set1_epi32(types[t])));
+
+			match = _mm_and_si128(match, type_match);
+		}
+
+		u32 bits = _mm_movemask_ps(_mm_castsi128_ps(match));
+		while (bits) {
+			out[found++] = i + __builtin_ctz(bits);
+			bits &= bits - 1;
+		}
+	}
+#endif
+
+	for (; i < columns->count; i++) {
+		b32 hit = riot_wad_column_query_match(query, columns->compression[i],
+						      columns->decompressed_size[i], columns->data_offset[i]);
+
+		/* branch-free append: the index is always written, and only kept
+		 * when it matched
+		 */
+		out[found] = i;
+		found += hit;
+	}
+
+	return found;
+}
+
+void
+riot_wad_columns_totals(struct riot_wad_columns const *columns, struct riot_wad_column_totals *out) {
+	assert(columns);
+	assert(out);
+
+	u64 compressed = 0, decompressed = 0;
+	u32 i = 0;
+
+#if defined(__SSE2__)
+	/* widen each group of four u32 sizes into two pairs of u64 lanes, and
+	 * accumulate those, so that the sums cannot overflow
+	 */
+	__m128i zero = _mm_setzero_si128();
+	__m128i compressed_acc = zero, decompressed_acc = zero;
+
+	for (; i + 4 <= columns->count; i += 4) {
+		__m128i c = _mm_loadu_si128((__m128i const *)(columns->compressed_size + i));
+		__m128i d = _mm_loadu_si128((__m128i const *)(columns->decompressed_size + i));
+
+		compressed_acc = _mm_add_epi64(compressed_acc, _mm_unpacklo_epi32(c, zero));
+		compressed_acc = _mm_add_epi64(compressed_acc, _mm_unpackhi_epi32(c, zero));
+		decompressed_acc = _mm_add_epi64(decompressed_acc, _mm_unpacklo_epi32(d, zero));
+		decompressed_acc = _mm_add_epi64(decompressed_acc, _mm_unpackhi_epi32(d, zero));
+	}
+
+	u64 lanes[2];
+	_mm_storeu_si128((__m128i *)lanes, compressed_acc);
+	compressed = lanes[0] + lanes[1];
+	_mm_storeu_si128((__m128i *)lanes, decompressed_acc);
+	decompressed = lanes[0] + lanes[1];
+#endif
+
+	for (; i < columns->count; i++) {
+		compressed += columns->compressed_size[i];
+		decompressed += columns->decompressed_size[i];
+	}
+
+	out->compressed_size = compressed;
+	out->decompressed_size = decompressed;
+}
@@ -0,0 +1,458 @@
+#include "libriot/wad.h"
+#include "libriot/stats.h"
+#include "libriot/trace.h"
+
+#include <strings.h>
+#include <zstd.h>
+
+/* location of a single sub-chunk, both within the stored chunk data and
+ * within the decompressed output
+ */
+struct riot_wad_subchunk_span {
+	u64 src_off, dst_off;
+	u32 src_len, dst_len;
+};
+
+b32
+riot_wad_decompressor_init(struct riot_wad_decompressor *self) {
+	assert(self);
+
+	self->workers = NULL;
+	self->worker_dctxs = NULL;
+
+	self->zstd_dctx = ZSTD_createDCtx();
+	if (!self->zstd_dctx)
+		goto zstd_dctx_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->buf_pool, u8, RIOT_WAD_DECOMPRESSOR_BUF_POOL_SZ))
+		goto buf_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->span_pool, struct riot_wad_subchunk_span, RIOT_WAD_DECOMPRESSOR_SPAN_POOL_SZ))
+		goto span_pool_alloc_failure;
+
+	return true;
+
+span_pool_alloc_failure:
+	mem_pool_free(&self->buf_pool);
+buf_pool_alloc_failure:
+	ZSTD_freeDCtx(self->zstd_dctx);
+zstd_dctx_alloc_failure:
+	return false;
+}
+
+static void
+riot_wad_decompressor_free_workers(struct riot_wad_decompressor *self) {
+	assert(self);
+
+	if (!self->worker_dctxs) return;
+
+	/* worker 0 is the calling thread, which shares the main decoder */
+	for (u32 i = 1; i < self->workers->thread_count; i++)
+		ZSTD_freeDCtx(self->worker_dctxs[i]);
+
+	free(self->worker_dctxs);
+
+	self->workers = NULL;
+	self->worker_dctxs = NULL;
+}
+
+void
+riot_wad_decompressor_free(struct riot_wad_decompressor *self) {
+	assert(self);
+
+	riot_wad_decompressor_free_workers(self);
+
+	ZSTD_freeDCtx(self->zstd_dctx);
+	mem_pool_free(&self->buf_pool);
+	mem_pool_free(&self->span_pool);
+}
+
+b32
+riot_wad_decompressor_set_workers(struct riot_wad_decompressor *self, struct riot_thread_pool *workers) {
+	assert(self);
+
+	riot_wad_decompressor_free_workers(self);
+
+	if (!workers) return true;
+
+	self->worker_dctxs = calloc(workers->thread_count, sizeof *self->worker_dctxs);
+	if (!self->worker_dctxs) return false;
+
+	self->workers = workers;
+	self->worker_dctxs[0] = self->zstd_dctx;
+
+	for (u32 i = 1; i < workers->thread_count; i++) {
+		self->worker_dctxs[i] = ZSTD_createDCtx();
+		if (!self->worker_dctxs[i]) {
+			errlog("Failed to create decoder context for worker %u", i);
+			riot_wad_decompressor_free_workers(self);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static b32
+riot_wad_decompress_zstd(struct ZSTD_DCtx_s *dctx, u8 const *src, u64 src_len, u8 *dst, u64 dst_len) {
+	assert(dctx);
+
+	size_t res = ZSTD_decompressDCtx(dctx, dst, dst_len, src, src_len);
+	if (ZSTD_isError(res)) {
+		errlog("Failed to decompress zstd data: %s", ZSTD_getErrorName(res));
+		return false;
+	}
+
+	if (res != dst_len) {
+		errlog("Decompressed zstd size mismatch: expected %lu, got %zu", dst_len, res);
+		return false;
+	}
+
+	return true;
+}
+
+xxh64_u64
+riot_wad_subchunk_toc_path_hash(char const *path) {
+	assert(path);
+
+	/* outside of a game directory, the file name is all there is to go by */
+	char const *start = strrchr(path, '/');
+	start = start ? start + 1 : path;
+
+	for (char const *it = path; *it; it++) {
+		if ((it == path || it[-1] == '/') && strncasecmp(it, "data/", 5) == 0)
+			start = it;
+	}
+
+	u64 len = strlen(start);
+	if (len >= 7 && strcasecmp(start + len - 7, ".client") == 0)
+		len -= 7;
+
+	char buf[PATH_MAX];
+	if (len + sizeof ".subchunktoc" > sizeof buf) {
+		errlog("WAD path too long: %s", path);
+		return 0;
+	}
+
+	memcpy(buf, start, len);
+	memcpy(buf + len, ".subchunktoc", sizeof ".subchunktoc" - 1);
+
+	return riot_wad_path_hash(buf, len + sizeof ".subchunktoc" - 1);
+}
+
+b32
+riot_wad_ctx_read_subchunk_toc(struct riot_wad_ctx *ctx, struct mem_stream toc) {
+	assert(ctx);
+
+	u32 count = toc.len / RIOT_WAD_SUBCHUNK_SZ;
+
+	mem_pool_reset(&ctx->subchunk_pool);
+	ctx->subchunk_count = 0;
+
+	struct riot_wad_subchunk *subchunks = MEM_POOL_ALLOC(&ctx->subchunk_pool, struct riot_wad_subchunk, count);
+	if (!subchunks && count) {
+		errlog("Failed to preallocate %u WAD sub-chunks", count);
+		return false;
+	}
+
+	/* `count` was derived from the table length, so a single bounds check
+	 * covers every record
+	 */
+	u8 const *records = riot_mem_stream_take(&toc, (u64)count * RIOT_WAD_SUBCHUNK_SZ);
+	if (!records) {
+		errlog("Failed to read %u WAD sub-chunks", count);
+		return false;
+	}
+
+	for (u32 i = 0; i < count; i++) {
+		u8 const *record = records + (u64)i * RIOT_WAD_SUBCHUNK_SZ;
+
+		subchunks[i].compressed_size = riot_load_le32(record + 0);
+		subchunks[i].decompressed_size = riot_load_le32(record + 4);
+		subchunks[i].checksum = riot_load_le64(record + 8);
+	}
+
+	ctx->subchunk_count = count;
+
+	dbglog("Loaded %u WAD sub-chunks", count);
+
+	return true;
+}
+
+b32
+riot_wad_ctx_load_subchunk_toc(struct riot_wad_ctx *ctx, struct riot_wad_decompressor *dec,
+			       xxh64_u64 toc_path_hash) {
+	assert(ctx);
+	assert(dec);
+
+	struct riot_wad_chunk *toc_chunk = riot_wad_find_chunk(ctx, toc_path_hash);
+	if (!toc_chunk) {
+		errlog("WAD sub-chunk table of contents not found: 0x%016lx", toc_path_hash);
+		return false;
+	}
+
+	struct mem_stream toc;
+	if (!riot_wad_chunk_decompress(dec, ctx, toc_chunk, NULL, 0, &toc)) {
+		errlog("Failed to decompress WAD sub-chunk table of contents");
+		return false;
+	}
+
+	return riot_wad_ctx_read_subchunk_toc(ctx, toc);
+}
+
+static b32
+riot_wad_chunk_resolve_subchunks(struct riot_wad_decompressor *dec, struct riot_wad_ctx *ctx,
+				 struct riot_wad_chunk *chunk, struct mem_stream src, u32 *out) {
+	assert(dec);
+	assert(ctx);
+	assert(chunk);
+	assert(out);
+
+	mem_pool_reset(&dec->span_pool);
+
+	u64 src_off = 0, dst_off = 0;
+	u32 count = 0;
+
+	if (ctx->subchunk_count) {
+		if ((u32)chunk->sub_chunk_start + chunk->sub_chunk_count > ctx->subchunk_count) {
+			errlog("WAD chunk sub-chunks out of bounds: start: %u, count: %u, table size: %u",
+			       chunk->sub_chunk_start, chunk->sub_chunk_count, ctx->subchunk_count);
+			return false;
+		}
+
+		struct riot_wad_subchunk *subchunks = (struct riot_wad_subchunk *)ctx->subchunk_pool.ptr + chunk->sub_chunk_start;
+
+		count = chunk->sub_chunk_count;
+		struct riot_wad_subchunk_span *spans = MEM_POOL_ALLOC(&dec->span_pool, struct riot_wad_subchunk_span, count);
+		if (!spans && count) return false;
+
+		for (u32 i = 0; i < count; i++) {
+			spans[i].src_off = src_off;
+			spans[i].dst_off = dst_off;
+			spans[i].src_len = subchunks[i].compressed_size;
+			spans[i].dst_len = subchunks[i].decompressed_size;
+
+			src_off += spans[i].src_len;
+			dst_off += spans[i].dst_len;
+		}
+	} else {
+		/* without a sub-chunk table, recover the layout from the zstd
+		 * frame headers, which requires every sub-chunk to be a frame
+		 * that records its content size. raw-stored sub-chunks carry no
+		 * header, and can only be resolved through the table
+		 */
+		while (src_off < src.len) {
+			u8 const *frame = src.ptr + src_off;
+			u64 remaining = src.len - src_off;
+
+			size_t frame_len = ZSTD_findFrameCompressedSize(frame, remaining);
+			unsigned long long content_len = ZSTD_getFrameContentSize(frame, remaining);
+			if (ZSTD_isError(frame_len) ||
+			    content_len == ZSTD_CONTENTSIZE_UNKNOWN ||
+			    content_len == ZSTD_CONTENTSIZE_ERROR) {
+				errlog("Failed to resolve WAD sub-chunk %u without a sub-chunk table: not a zstd frame "
+				       "with a content size", count);
+				return false;
+			}
+
+			struct riot_wad_subchunk_span *span = MEM_POOL_ALLOC(&dec->span_pool, struct riot_wad_subchunk_span, 1);
+			if (!span) return false;
+
+			span->src_off = src_off;
+			span->dst_off = dst_off;
+			span->src_len = frame_len;
+			span->dst_len = content_len;
+
+			src_off += frame_len;
+			dst_off += content_len;
+			count++;
+		}
+	}
+
+	if (src_off != src.len || dst_off != chunk->decompressed_size) {
+		errlog("WAD sub-chunk sizes do not match chunk: stored %lu/%lu, decompressed %lu/%u",
+		       src_off, src.len, dst_off, chunk->decompressed_size);
+		return false;
+	}
+
+	*out = count;
+
+	return true;
+}
+
+static b32
+riot_wad_subchunk_decompress(struct ZSTD_DCtx_s *dctx, struct riot_wad_subchunk_span *span,
+			     u8 const *src, u8 *dst) {
+	assert(span);
+
+	if (span->src_len == span->dst_len) {
+		memcpy(dst + span->dst_off, src + span->src_off, span->src_len);
+		return true;
+	}
+
+	return riot_wad_decompress_zstd(dctx, src + span->src_off, span->src_len,
+					dst + span->dst_off, span->dst_len);
+}
+
+struct riot_wad_subchunk_job {
+	struct riot_wad_decompressor *dec;
+	struct riot_wad_subchunk_span *spans;
+	u8 const *src;
+	u8 *dst;
+	atomic_bool failed;
+};
+
+static void
+riot_wad_subchunk_task(void *arg, u32 worker, u64 idx) {
+	struct riot_wad_subchunk_job *job = arg;
+
+	if (atomic_load_explicit(&job->failed, memory_order_relaxed)) return;
+
+	if (!riot_wad_subchunk_decompress(job->dec->worker_dctxs[worker], &job->spans[idx], job->src, job->dst))
+		atomic_store_explicit(&job->failed, true, memory_order_relaxed);
+}
+
+static b32
+riot_wad_chunk_decompress_subchunks(struct riot_wad_decompressor *dec, struct riot_wad_ctx *ctx,
+				    struct riot_wad_chunk *chunk, struct mem_stream src, u8 *dst) {
+	assert(dec);
+	assert(ctx);
+	assert(chunk);
+	assert(dst);
+
+	u32 count;
+	if (!riot_wad_chunk_resolve_subchunks(dec, ctx, chunk, src, &count))
+		return false;
+
+	struct riot_wad_subchunk_span *spans = (struct riot_wad_subchunk_span *)dec->span_pool.ptr;
+
+	if (dec->workers && count > 1 && riot_wad_chunk_decompresses_in_parallel(chunk)) {
+		struct riot_wad_subchunk_job job = {
+			.dec = dec,
+			.spans = spans,
+			.src = src.ptr,
+			.dst = dst,
+		};
+
+		atomic_init(&job.failed, false);
+
+		riot_thread_pool_run(dec->workers, count, riot_wad_subchunk_task, &job);
+
+		return !atomic_load(&job.failed);
+	}
+
+	for (u32 i = 0; i < count; i++) {
+		if (!riot_wad_subchunk_decompress(dec->zstd_dctx, &spans[i], src.ptr, dst))
+			return false;
+	}
+
+	return true;
+}
+
+b32
+riot_wad_chunk_decompress(struct riot_wad_decompressor *dec, struct riot_wad_ctx *ctx,
+			  struct riot_wad_chunk *chunk, u8 *buf, u64 len,
+			  struct mem_stream *out) {
+	assert(dec);
+	assert(ctx);
+	assert(chunk);
+	assert(out);
+
+	struct mem_stream src;
+	if (!riot_wad_chunk_data(ctx, chunk, &src))
+		return false;
+
+	return riot_wad_chunk_decompress_data(dec, ctx, chunk, src, buf, len, out);
+}
+
+static void
+riot_wad_decompress_count(u8 compression, u64 len, u64 start) {
+	enum riot_stat base;
+	switch (compression) {
+	case RIOT_WAD_COMPRESSION_NONE: base = RIOT_STAT_DECOMPRESS_NONE_CHUNKS; break;
+	case RIOT_WAD_COMPRESSION_ZSTD: base = RIOT_STAT_DECOMPRESS_ZSTD_CHUNKS; break;
+	case RIOT_WAD_COMPRESSION_ZSTD_CHUNK: base = RIOT_STAT_DECOMPRESS_ZSTD_CHUNK_CHUNKS; break;
+	default: return;
+	}
+
+	riot_stats_add(base, 1);
+	riot_stats_add(base + 1, len);
+	riot_stats_time(base + 2, start);
+}
+
+b32
+riot_wad_chunk_decompress_data(struct riot_wad_decompressor *dec, struct riot_wad_ctx *ctx,
+			       struct riot_wad_chunk *chunk, struct mem_stream src, u8 *buf, u64 len,
+			       struct mem_stream *out) {
+	assert(dec);
+	assert(ctx);
+	assert(chunk);
+	assert(out);
+
+	if (src.len != chunk->compressed_size) {
+		errlog("WAD chunk data size mismatch: %lu bytes, expected %u", src.len, chunk->compressed_size);
+		return false;
+	}
+
+	u64 start = riot_stats_clock(), span = riot_trace_begin();
+
+	if (chunk->compression == RIOT_WAD_COMPRESSION_NONE && !buf) {
+		riot_wad_decompress_count(chunk->compression, src.len, start);
+		riot_trace_end("decompress", span, src.len);
+
+		*out = src;
+		return true;
+	}
+
+	if (buf && len < chunk->decompressed_size) {
+		errlog("Decompression buffer too small: %lu bytes, need %u", len, chunk->decompressed_size);
+		return false;
+	}
+
+	if (!buf) {
+		mem_pool_reset(&dec->buf_pool);
+
+		buf = MEM_POOL_ALLOC(&dec->buf_pool, u8, chunk->decompressed_size);
+		if (!buf && chunk->decompressed_size) {
+			errlog("Failed to allocate decompression buffer (%u bytes)", chunk->decompressed_size);
+			return false;
+		}
+	}
+
+	switch (chunk->compression) {
+	case RIOT_WAD_COMPRESSION_NONE:
+		if (src.len != chunk->decompressed_size) {
+			errlog("Uncompressed chunk size mismatch: stored %lu, expected %u",
+			       src.len, chunk->decompressed_size);
+			return false;
+		}
+
+		memcpy(buf, src.ptr, src.len);
+		break;
+
+	case RIOT_WAD_COMPRESSION_ZSTD:
+		if (!riot_wad_decompress_zstd(dec->zstd_dctx, src.ptr, src.len, buf, chunk->decompressed_size))
+			return false;
+		break;
+
+	case RIOT_WAD_COMPRESSION_ZSTD_CHUNK:
+		if (!riot_wad_chunk_decompress_subchunks(dec, ctx, chunk, src, buf))
+			return false;
+		break;
+
+	case RIOT_WAD_COMPRESSION_GZIP:
+	case RIOT_WAD_COMPRESSION_SATELLITE:
+	default:
+		errlog("Unsupported WAD chunk compression: %u", chunk->compression);
+		return false;
+	}
+
+	riot_wad_decompress_count(chunk->compression, chunk->decompressed_size, start);
+	riot_trace_end("decompress", span, chunk->decompressed_size);
+
+	out->ptr = buf;
+	out->cur = 0;
+	out->len = chunk->decompressed_size;
+
+	return true;
+}
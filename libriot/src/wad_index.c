@@ -0,0 +1,126 @@
+#include "libriot/wad.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define PREFETCH(addr) __builtin_prefetch((addr))
+#else
+	#define PREFETCH(addr) ((void)(addr))
+#endif
+
+/* number of lookups interleaved by `riot_wad_find_chunks()`. every search
+ * over the same index takes the same number of steps (see
+ * `riot_hash_search()`), so the lanes advance in lockstep and their cache
+ * misses overlap instead of serialising
+ */
+#define RIOT_WAD_FIND_BATCH_SZ 16
+
+struct riot_wad_index_entry {
+	xxh64_u64 path_hash;
+	u32 chunk;
+};
+
+static int
+riot_wad_index_entry_cmp(void const *lhs, void const *rhs) {
+	struct riot_wad_index_entry const *a = lhs, *b = rhs;
+
+	return (a->path_hash > b->path_hash) - (a->path_hash < b->path_hash);
+}
+
+b32
+riot_wad_ctx_build_index(struct riot_wad_ctx *self) {
+	assert(self);
+
+	u32 count = self->wad.chunk_count;
+
+	mem_pool_reset(&self->index_hash_pool);
+	mem_pool_reset(&self->index_chunk_pool);
+	self->index_count = 0;
+
+	if (!count) return true;
+
+	xxh64_u64 *hashes = MEM_POOL_ALLOC(&self->index_hash_pool, xxh64_u64, count);
+	u32 *chunks = MEM_POOL_ALLOC(&self->index_chunk_pool, u32, count);
+	if (!hashes || !chunks) return false;
+
+	struct riot_wad_index_entry *entries = malloc(count * sizeof *entries);
+	if (!entries) return false;
+
+	struct riot_wad_chunk *chunk_table = (struct riot_wad_chunk *)self->chunk_pool.ptr;
+	for (u32 i = 0; i < count; i++) {
+		entries[i].path_hash = chunk_table[i].path_hash;
+		entries[i].chunk = i;
+	}
+
+	qsort(entries, count, sizeof *entries, riot_wad_index_entry_cmp);
+
+	for (u32 i = 0; i < count; i++) {
+		hashes[i] = entries[i].path_hash;
+		chunks[i] = entries[i].chunk;
+	}
+
+	free(entries);
+
+	self->index_count = count;
+
+	dbglog("Built WAD chunk index over %u chunks", count);
+
+	return true;
+}
+
+struct riot_wad_chunk *
+riot_wad_find_chunk(struct riot_wad_ctx *ctx, xxh64_u64 path_hash) {
+	assert(ctx);
+
+	if (!ctx->index_count) return NULL;
+
+	xxh64_u64 *hashes = (xxh64_u64 *)ctx->index_hash_pool.ptr;
+	u32 *chunks = (u32 *)ctx->index_chunk_pool.ptr;
+
+	u32 idx = riot_hash_search(hashes, ctx->index_count, path_hash);
+	if (hashes[idx] != path_hash) return NULL;
+
+	return (struct riot_wad_chunk *)ctx->chunk_pool.ptr + chunks[idx];
+}
+
+u32
+riot_wad_find_chunks(struct riot_wad_ctx *ctx, xxh64_u64 const *path_hashes, u32 count,
+		     struct riot_wad_chunk **out) {
+	assert(ctx);
+	assert(path_hashes || !count);
+	assert(out || !count);
+
+	if (!ctx->index_count) {
+		if (count) memset(out, 0, count * sizeof *out);
+		return 0;
+	}
+
+	xxh64_u64 *hashes = (xxh64_u64 *)ctx->index_hash_pool.ptr;
+	u32 *chunks = (u32 *)ctx->index_chunk_pool.ptr;
+	struct riot_wad_chunk *chunk_table = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+
+	u32 found = 0;
+	for (u32 i = 0; i < count; i += RIOT_WAD_FIND_BATCH_SZ) {
+		u32 lanes = MIN(count - i, RIOT_WAD_FIND_BATCH_SZ);
+		u32 base[RIOT_WAD_FIND_BATCH_SZ] = {0};
+
+		u32 len = ctx->index_count;
+		while (len > 1) {
+			u32 half = len / 2, next_half = (len - half) / 2;
+
+			for (u32 j = 0; j < lanes; j++) {
+				base[j] = (hashes[base[j] + half] <= path_hashes[i + j]) ? base[j] + half : base[j];
+
+				PREFETCH(&hashes[base[j] + next_half]);
+			}
+
+			len -= half;
+		}
+
+		for (u32 j = 0; j < lanes; j++) {
+			b32 hit = hashes[base[j]] == path_hashes[i + j];
+			out[i + j] = hit ? chunk_table + chunks[base[j]] : NULL;
+			found += hit;
+		}
+	}
+
+	return found;
+}
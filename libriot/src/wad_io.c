@@ -0,0 +1,500 @@
+/* syscall() and MAP_POPULATE are not part of posix */
+#define _DEFAULT_SOURCE
+
+#include "libriot/wad_io.h"
+#include "libriot/stats.h"
+#include "libriot/trace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+/* the ring is driven through the raw syscalls, so as not to depend on
+ * liburing. a kernel too old for io_uring (or a sandbox that filters it)
+ * fails `io_uring_setup`, and the pread path is used instead
+ */
+static int
+riot_io_uring_setup(u32 entries, struct io_uring_params *params) {
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+riot_io_uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static b32
+riot_wad_io_ring_init(struct riot_wad_io_ring *self, u32 entries) {
+	assert(self);
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof params);
+
+	self->fd = riot_io_uring_setup(entries, &params);
+	if (self->fd < 0) {
+		dbglog("io_uring unavailable (errno %d), falling back to pread", errno);
+		return false;
+	}
+
+	/* IORING_OP_READ arrived together with IORING_FEAT_RW_CUR_POS, and
+	 * single-mmap rings before either
+	 */
+	if (!(params.features & IORING_FEAT_RW_CUR_POS) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+		dbglog("io_uring lacks IORING_OP_READ support, falling back to pread");
+		goto ring_failure;
+	}
+
+	self->entries = params.sq_entries;
+
+	self->sq_len = params.sq_off.array + params.sq_entries * sizeof(u32);
+	self->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	self->sq_len = self->cq_len = MAX(self->sq_len, self->cq_len);
+
+	self->sq_ptr = mmap(NULL, self->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			    self->fd, IORING_OFF_SQ_RING);
+	if (self->sq_ptr == MAP_FAILED)
+		goto ring_failure;
+
+	self->cq_ptr = self->sq_ptr;
+
+	self->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	self->sqes = mmap(NULL, self->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  self->fd, IORING_OFF_SQES);
+	if (self->sqes == MAP_FAILED)
+		goto sq_map_failure;
+
+	u8 *sq = self->sq_ptr, *cq = self->cq_ptr;
+
+	self->sq_head = (u32 *)(sq + params.sq_off.head);
+	self->sq_tail = (u32 *)(sq + params.sq_off.tail);
+	self->sq_mask = (u32 *)(sq + params.sq_off.ring_mask);
+	self->sq_array = (u32 *)(sq + params.sq_off.array);
+
+	self->cq_head = (u32 *)(cq + params.cq_off.head);
+	self->cq_tail = (u32 *)(cq + params.cq_off.tail);
+	self->cq_mask = (u32 *)(cq + params.cq_off.ring_mask);
+	self->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	dbglog("io_uring set up with %u entries", self->entries);
+
+	return true;
+
+sq_map_failure:
+	munmap(self->sq_ptr, self->sq_len);
+ring_failure:
+	close(self->fd);
+	self->fd = -1;
+
+	return false;
+}
+
+static void
+riot_wad_io_ring_free(struct riot_wad_io_ring *self) {
+	assert(self);
+
+	munmap(self->sqes, self->sqes_len);
+	munmap(self->sq_ptr, self->sq_len);
+	close(self->fd);
+}
+
+static b32
+riot_wad_io_pread(int fd, u8 *dst, u64 len, u64 off) {
+	u64 cur = 0;
+	while (cur < len) {
+		ssize_t res = pread(fd, dst + cur, len - cur, off + cur);
+		if (res < 0 && errno == EINTR) continue;
+		if (res <= 0) return false;
+
+		cur += res;
+	}
+
+	return true;
+}
+
+/* reads the header and table of contents, whose length is only known once
+ * enough of the header has been read. returns the number of bytes needed to
+ * make progress: more than `len` while the prefix is too short, and the end
+ * of the table of contents once it is not
+ */
+static u64
+riot_wad_io_toc_len(u8 const *ptr, u64 len) {
+	if (len < 4) return 4;
+
+	switch (ptr[2]) {
+	case 1: {
+		u64 header_sz = 12;
+		if (len < header_sz) return header_sz;
+
+		return header_sz + (u64)riot_load_le32(ptr + 8) * (RIOT_WAD_V3_CHUNK_SZ - sizeof(u64));
+	}
+
+	case 2: {
+		if (len < 8) return 8;
+
+		u64 header_sz = 8 + (u64)riot_load_le32(ptr + 4) + 8 + 4 + 4;
+		if (len < header_sz) return header_sz;
+
+		return header_sz + (u64)riot_load_le32(ptr + header_sz - 4) * (RIOT_WAD_V3_CHUNK_SZ - sizeof(u64));
+	}
+
+	default: {
+		u64 header_sz = RIOT_WAD_V3_HEADER_SZ;
+		if (len < header_sz) return header_sz;
+
+		return header_sz + (u64)riot_load_le32(ptr + header_sz - 4) * RIOT_WAD_V3_CHUNK_SZ;
+	}
+	}
+}
+
+b32
+riot_wad_io_open(struct riot_wad_io *self, struct riot_wad_ctx *ctx, char const *path, u32 depth,
+		 struct riot_thread_pool *workers) {
+	assert(self);
+	assert(ctx);
+	assert(path);
+
+	self->workers = workers;
+	self->uring = false;
+
+	self->fd = open(path, O_RDONLY);
+	if (self->fd < 0) {
+		errlog("Failed to open WAD file: %s", path);
+		goto open_failure;
+	}
+
+	struct stat st;
+	if (fstat(self->fd, &st) < 0 || st.st_size == 0) {
+		errlog("Failed to stat WAD file: %s", path);
+		goto stat_failure;
+	}
+
+	self->size = st.st_size;
+
+	if (!MEM_POOL_INIT(&self->toc_pool, u8, 4 * KiB))
+		goto stat_failure;
+
+	if (!MEM_POOL_INIT(&self->key_pool, u64, RIOT_WAD_IO_POOL_SZ))
+		goto key_pool_failure;
+
+	if (!MEM_POOL_INIT(&self->run_pool, struct riot_wad_io_run, RIOT_WAD_IO_POOL_SZ))
+		goto run_pool_failure;
+
+	if (!MEM_POOL_INIT(&self->buf_pool, u8, RIOT_WAD_IO_POOL_SZ))
+		goto buf_pool_failure;
+
+	u64 need = MIN(self->size, 4 * KiB), len;
+	for (;;) {
+		mem_pool_reset(&self->toc_pool);
+
+		u8 *ptr = MEM_POOL_ALLOC(&self->toc_pool, u8, need);
+		if (!ptr || !riot_wad_io_pread(self->fd, ptr, need, 0)) {
+			errlog("Failed to read WAD table of contents (%lu bytes)", need);
+			goto read_failure;
+		}
+
+		len = riot_wad_io_toc_len(ptr, need);
+		if (len <= need) break;
+
+		if (len > self->size) {
+			errlog("Truncated WAD table of contents: need %lu bytes, file has %lu", len, self->size);
+			goto read_failure;
+		}
+
+		need = len;
+	}
+
+	struct mem_stream stream = {
+		.ptr = self->toc_pool.ptr,
+		.len = len,
+		.cur = 0,
+	};
+
+	/* the table of contents buffer is ours, and is reused (and freed) on
+	 * close, so the ctx must not keep pointing into it: chunk data is only
+	 * ever fetched through the descriptor
+	 */
+	b32 parsed = riot_wad_read(ctx, stream);
+	memset(&ctx->src, 0, sizeof ctx->src);
+
+	if (!parsed)
+		goto read_failure;
+
+	if (depth)
+		self->uring = riot_wad_io_ring_init(&self->ring, depth);
+
+	return true;
+
+read_failure:
+	mem_pool_free(&self->buf_pool);
+buf_pool_failure:
+	mem_pool_free(&self->run_pool);
+run_pool_failure:
+	mem_pool_free(&self->key_pool);
+key_pool_failure:
+	mem_pool_free(&self->toc_pool);
+stat_failure:
+	close(self->fd);
+open_failure:
+	return false;
+}
+
+void
+riot_wad_io_close(struct riot_wad_io *self) {
+	assert(self);
+
+	if (self->uring)
+		riot_wad_io_ring_free(&self->ring);
+
+	mem_pool_free(&self->buf_pool);
+	mem_pool_free(&self->run_pool);
+	mem_pool_free(&self->key_pool);
+	mem_pool_free(&self->toc_pool);
+
+	close(self->fd);
+}
+
+static void
+riot_wad_io_ring_push(struct riot_wad_io_ring *ring, int fd, struct riot_wad_io_run *run, u8 *buf, u64 idx) {
+	u32 tail = *ring->sq_tail, slot = tail & *ring->sq_mask;
+
+	struct io_uring_sqe *sqe = &ring->sqes[slot];
+	memset(sqe, 0, sizeof *sqe);
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->off = run->off + run->cur;
+	sqe->addr = (u64)(uintptr_t)(buf + run->buf_off + run->cur);
+	sqe->len = run->len - run->cur;
+	sqe->user_data = idx;
+
+	ring->sq_array[slot] = slot;
+
+	/* the entry must be visible to the kernel before the tail that
+	 * publishes it
+	 */
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static b32
+riot_wad_io_ring_read(struct riot_wad_io *self, struct riot_wad_io_run *runs, u64 count, u8 *buf) {
+	struct riot_wad_io_ring *ring = &self->ring;
+
+	u64 next = 0, done = 0;
+	u32 inflight = 0, queued = 0;
+	b32 failed = false;
+
+	while (done < count) {
+		while (!failed && next < count && inflight + queued < ring->entries) {
+			/* empty payloads have nothing to read, and a zero-length
+			 * read would be taken for end of file
+			 */
+			if (!runs[next].len) {
+				next++;
+				done++;
+				continue;
+			}
+
+			riot_wad_io_ring_push(ring, self->fd, &runs[next], buf, next);
+			next++;
+			queued++;
+		}
+
+		if (!inflight && !queued) break;
+
+		int res = riot_io_uring_enter(ring->fd, queued, 1, IORING_ENTER_GETEVENTS);
+		if (res < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+
+			errlog("io_uring_enter failed (errno %d)", errno);
+			return false;
+		}
+
+		inflight += res;
+		queued -= res;
+
+		u32 head = *ring->cq_head;
+		u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+			struct riot_wad_io_run *run = &runs[cqe->user_data];
+
+			inflight--;
+
+			if (cqe->res == -EAGAIN || cqe->res == -EINTR) {
+				riot_wad_io_ring_push(ring, self->fd, run, buf, cqe->user_data);
+				queued++;
+				continue;
+			}
+
+			if (cqe->res <= 0) {
+				errlog("Failed to read WAD data: offset: %lu, size: %lu (res %d)",
+				       run->off + run->cur, run->len - run->cur, cqe->res);
+				failed = true;
+				done++;
+				continue;
+			}
+
+			/* short reads are resubmitted for the remainder of the run */
+			run->cur += cqe->res;
+			if (run->cur < run->len) {
+				riot_wad_io_ring_push(ring, self->fd, run, buf, cqe->user_data);
+				queued++;
+				continue;
+			}
+
+			done++;
+		}
+
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+		if (failed && !inflight && !queued) break;
+	}
+
+	return !failed;
+}
+
+struct riot_wad_io_pread_job {
+	struct riot_wad_io *io;
+	struct riot_wad_io_run *runs;
+	u8 *buf;
+	atomic_uint failures;
+};
+
+static void
+riot_wad_io_pread_task(void *arg, u32 worker, u64 idx) {
+	struct riot_wad_io_pread_job *job = arg;
+	struct riot_wad_io_run *run = &job->runs[idx];
+
+	(void) worker;
+
+	if (!riot_wad_io_pread(job->io->fd, job->buf + run->buf_off, run->len, run->off)) {
+		errlog("Failed to read WAD data: offset: %lu, size: %lu", run->off, run->len);
+		atomic_fetch_add(&job->failures, 1);
+	}
+}
+
+static int
+riot_wad_io_key_cmp(void const *lhs, void const *rhs) {
+	u64 a = *(u64 const *)lhs, b = *(u64 const *)rhs;
+
+	return (a > b) - (a < b);
+}
+
+b32
+riot_wad_io_read(struct riot_wad_io *self, struct riot_wad_ctx *ctx, u32 const *chunks, u32 count,
+		 struct mem_stream *out) {
+	assert(self);
+	assert(ctx);
+	assert(chunks || !count);
+	assert(out || !count);
+
+	if (!count) return true;
+
+	mem_pool_reset(&self->key_pool);
+	mem_pool_reset(&self->run_pool);
+	mem_pool_reset(&self->buf_pool);
+
+	u64 *keys = MEM_POOL_ALLOC(&self->key_pool, u64, count);
+	struct riot_wad_io_run *runs = MEM_POOL_ALLOC(&self->run_pool, struct riot_wad_io_run, count);
+	if (!keys || !runs) {
+		errlog("Failed to allocate WAD read batch (%u chunks)", count);
+		return false;
+	}
+
+	/* the sort key packs the data offset above the position in the batch */
+	struct riot_wad_chunk *table = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	for (u32 i = 0; i < count; i++) {
+		struct riot_wad_chunk *chunk = &table[chunks[i]];
+		if (chunk->data_offset > self->size || self->size - chunk->data_offset < chunk->compressed_size) {
+			errlog("WAD chunk data out of bounds: offset: %u, size: %u, source size: %lu",
+			       chunk->data_offset, chunk->compressed_size, self->size);
+			return false;
+		}
+
+		keys[i] = ((u64)chunk->data_offset << 32) | i;
+	}
+
+	qsort(keys, count, sizeof *keys, riot_wad_io_key_cmp);
+
+	/* payloads that touch or overlap (as duplicated chunks do) are merged
+	 * into one run, and each chunk records where in the buffer it lands
+	 */
+	u64 run_count = 0, buf_len = 0;
+	for (u32 i = 0; i < count; i++) {
+		u32 pos = (u32)keys[i];
+		struct riot_wad_chunk *chunk = &table[chunks[pos]];
+
+		u64 off = chunk->data_offset, end = off + chunk->compressed_size;
+
+		struct riot_wad_io_run *run = run_count ? &runs[run_count - 1] : NULL;
+		if (!run || off > run->off + run->len || end - run->off > RIOT_WAD_IO_MAX_RUN_SZ) {
+			run = &runs[run_count++];
+			run->off = off;
+			run->len = 0;
+			run->cur = 0;
+			run->buf_off = buf_len;
+		}
+
+		if (end > run->off + run->len) {
+			buf_len += end - (run->off + run->len);
+			run->len = end - run->off;
+		}
+
+		/* only the offset is known until the buffer is allocated */
+		out[pos].ptr = NULL;
+		out[pos].cur = run->buf_off + (off - run->off);
+		out[pos].len = chunk->compressed_size;
+	}
+
+	u8 *buf = MEM_POOL_ALLOC(&self->buf_pool, u8, buf_len);
+	if (!buf && buf_len) {
+		errlog("Failed to allocate WAD read buffer (%lu bytes)", buf_len);
+		return false;
+	}
+
+	u64 start = riot_stats_clock(), span = riot_trace_begin();
+
+	b32 res;
+	if (self->uring) {
+		res = riot_wad_io_ring_read(self, runs, run_count, buf);
+	} else {
+		struct riot_wad_io_pread_job job = {
+			.io = self,
+			.runs = runs,
+			.buf = buf,
+		};
+
+		atomic_init(&job.failures, 0);
+
+		if (self->workers) {
+			riot_thread_pool_run(self->workers, run_count, riot_wad_io_pread_task, &job);
+		} else {
+			for (u64 i = 0; i < run_count; i++)
+				riot_wad_io_pread_task(&job, 0, i);
+		}
+
+		res = !atomic_load(&job.failures);
+	}
+
+	if (!res) return false;
+
+	riot_stats_add(RIOT_STAT_IO_READS, run_count);
+	riot_stats_add(RIOT_STAT_IO_BYTES, buf_len);
+	riot_stats_time(RIOT_STAT_IO_NS, start);
+	riot_trace_end("read", span, buf_len);
+
+	for (u32 i = 0; i < count; i++) {
+		out[i].ptr = buf + out[i].cur;
+		out[i].cur = 0;
+	}
+
+	dbglog("Read %u WAD chunks in %lu runs (%lu bytes, %s)", count, run_count, buf_len,
+	       self->uring ? "io_uring" : "pread");
+
+	return true;
+}
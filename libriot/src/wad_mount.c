@@ -0,0 +1,374 @@
+#include "libriot/wad_mount.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+struct riot_wad_mount_entry {
+	xxh64_u64 path_hash;
+	struct riot_wad_mount_ref ref;
+};
+
+struct riot_wad_mount_job {
+	struct riot_wad_mount *mount;
+	atomic_uint failures;
+};
+
+b32
+riot_wad_mount_init(struct riot_wad_mount *self) {
+	assert(self);
+
+	self->archives = NULL;
+	self->paths = NULL;
+	self->archive_count = 0;
+	self->cache_dir = NULL;
+	self->index_count = 0;
+
+	if (!MEM_POOL_INIT(&self->index_hash_pool, xxh64_u64, RIOT_WAD_MOUNT_POOL_SZ))
+		goto index_hash_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->index_ref_pool, struct riot_wad_mount_ref, RIOT_WAD_MOUNT_POOL_SZ))
+		goto index_ref_pool_alloc_failure;
+
+	return true;
+
+index_ref_pool_alloc_failure:
+	mem_pool_free(&self->index_hash_pool);
+index_hash_pool_alloc_failure:
+	return false;
+}
+
+void
+riot_wad_mount_free(struct riot_wad_mount *self) {
+	assert(self);
+
+	for (u32 i = 0; i < self->archive_count; i++) {
+		riot_wad_ctx_free(&self->archives[i]);
+		free(self->paths[i]);
+	}
+
+	free(self->archives);
+	free(self->paths);
+
+	mem_pool_free(&self->index_hash_pool);
+	mem_pool_free(&self->index_ref_pool);
+}
+
+static void
+riot_wad_mount_open_task(void *arg, u32 worker, u64 idx) {
+	struct riot_wad_mount_job *job = arg;
+	struct riot_wad_mount *mount = job->mount;
+
+	(void) worker;
+
+	b32 ok;
+	if (mount->cache_dir) {
+		/* sidecars are keyed by the archive path, so that archives of the
+		 * same name in different directories do not evict each other
+		 */
+		char cache_path[PATH_MAX];
+		u64 path_hash = riot_wad_checksum(mount->paths[idx], strlen(mount->paths[idx]));
+		snprintf(cache_path, sizeof cache_path, "%s/%016lx.idx", mount->cache_dir, path_hash);
+
+		ok = riot_wad_open_cached(&mount->archives[idx], mount->paths[idx], cache_path);
+	} else {
+		ok = riot_wad_open_mapped(&mount->archives[idx], mount->paths[idx]);
+	}
+
+	if (!ok) {
+		errlog("Failed to mount WAD file: %s", mount->paths[idx]);
+		atomic_fetch_add(&job->failures, 1);
+	}
+}
+
+static int
+riot_wad_mount_entry_cmp(void const *lhs, void const *rhs) {
+	struct riot_wad_mount_entry const *a = lhs, *b = rhs;
+
+	if (a->path_hash != b->path_hash)
+		return (a->path_hash > b->path_hash) - (a->path_hash < b->path_hash);
+
+	return (a->ref.archive > b->ref.archive) - (a->ref.archive < b->ref.archive);
+}
+
+static b32
+riot_wad_mount_build_index(struct riot_wad_mount *self) {
+	u64 total = 0;
+	for (u32 i = 0; i < self->archive_count; i++)
+		total += self->archives[i].wad.chunk_count;
+
+	if (total > UINT32_MAX) {
+		errlog("Too many chunks in WAD mount set: %lu", total);
+		return false;
+	}
+
+	mem_pool_reset(&self->index_hash_pool);
+	mem_pool_reset(&self->index_ref_pool);
+	self->index_count = 0;
+
+	if (!total) return true;
+
+	struct riot_wad_mount_entry *entries = malloc(total * sizeof *entries);
+	if (!entries) {
+		errlog("Failed to allocate WAD mount index (%lu entries)", total);
+		return false;
+	}
+
+	u64 count = 0;
+	for (u32 i = 0; i < self->archive_count; i++) {
+		struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)self->archives[i].chunk_pool.ptr;
+		for (u32 j = 0; j < self->archives[i].wad.chunk_count; j++) {
+			entries[count].path_hash = chunks[j].path_hash;
+			entries[count].ref.archive = i;
+			entries[count].ref.chunk = j;
+			count++;
+		}
+	}
+
+	qsort(entries, count, sizeof *entries, riot_wad_mount_entry_cmp);
+
+	b32 res = false;
+
+	xxh64_u64 *hashes = MEM_POOL_ALLOC(&self->index_hash_pool, xxh64_u64, count);
+	struct riot_wad_mount_ref *refs = MEM_POOL_ALLOC(&self->index_ref_pool, struct riot_wad_mount_ref, count);
+	if (!hashes || !refs) {
+		errlog("Failed to allocate WAD mount index (%lu entries)", count);
+		goto cleanup;
+	}
+
+	/* entries of equal hash are ordered by archive, so the last of each run
+	 * is the one with the highest precedence
+	 */
+	u32 unique = 0;
+	for (u64 i = 0; i < count; i++) {
+		if (i + 1 < count && entries[i + 1].path_hash == entries[i].path_hash) continue;
+
+		hashes[unique] = entries[i].path_hash;
+		refs[unique] = entries[i].ref;
+		unique++;
+	}
+
+	self->index_count = unique;
+
+	dbglog("Built WAD mount index: %u paths, %lu overridden", unique, count - unique);
+
+	res = true;
+
+cleanup:
+	free(entries);
+
+	return res;
+}
+
+b32
+riot_wad_mount_open(struct riot_wad_mount *self, char const **paths, u32 count,
+		    struct riot_thread_pool *workers) {
+	assert(self);
+	assert(paths || !count);
+	assert(!self->archive_count);
+
+	self->archives = calloc(count, sizeof *self->archives);
+	self->paths = calloc(count, sizeof *self->paths);
+	if (count && (!self->archives || !self->paths)) {
+		errlog("Failed to allocate WAD mount set (%u archives)", count);
+		goto alloc_failure;
+	}
+
+	for (; self->archive_count < count; self->archive_count++) {
+		u32 i = self->archive_count;
+
+		self->paths[i] = strdup(paths[i]);
+		if (!self->paths[i])
+			goto archive_init_failure;
+
+		if (!riot_wad_ctx_init(&self->archives[i])) {
+			free(self->paths[i]);
+			goto archive_init_failure;
+		}
+	}
+
+	struct riot_wad_mount_job job = { .mount = self, };
+	atomic_init(&job.failures, 0);
+
+	if (workers) {
+		riot_thread_pool_run(workers, count, riot_wad_mount_open_task, &job);
+	} else {
+		for (u32 i = 0; i < count; i++)
+			riot_wad_mount_open_task(&job, 0, i);
+	}
+
+	u32 failures = atomic_load(&job.failures);
+	if (failures) {
+		errlog("Failed to mount %u/%u WAD files", failures, count);
+		goto archive_init_failure;
+	}
+
+	if (!riot_wad_mount_build_index(self))
+		goto archive_init_failure;
+
+	dbglog("Mounted %u WAD files", count);
+
+	return true;
+
+archive_init_failure:
+	for (u32 i = 0; i < self->archive_count; i++) {
+		riot_wad_ctx_free(&self->archives[i]);
+		free(self->paths[i]);
+	}
+
+	self->archive_count = 0;
+alloc_failure:
+	free(self->archives);
+	free(self->paths);
+	self->archives = NULL;
+	self->paths = NULL;
+
+	return false;
+}
+
+struct riot_wad_mount_paths {
+	char **ptr;
+	u32 count, cap;
+};
+
+static b32
+riot_wad_mount_is_wad(char const *name) {
+	static char const *suffixes[] = { ".wad", ".wad.client", };
+
+	u64 len = strlen(name);
+	for (u32 i = 0; i < sizeof suffixes / sizeof *suffixes; i++) {
+		u64 suffix_len = strlen(suffixes[i]);
+		if (len > suffix_len && strcmp(name + len - suffix_len, suffixes[i]) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static b32
+riot_wad_mount_scan(char const *dir, struct riot_wad_mount_paths *out) {
+	DIR *d = opendir(dir);
+	if (!d) {
+		errlog("Failed to open directory: %s", dir);
+		return false;
+	}
+
+	b32 res = false;
+
+	struct dirent *entry;
+	while ((entry = readdir(d))) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+		u64 len = strlen(dir) + 1 + strlen(entry->d_name) + 1;
+		char *path = malloc(len);
+		if (!path) goto cleanup;
+
+		snprintf(path, len, "%s/%s", dir, entry->d_name);
+
+		struct stat st;
+		if (stat(path, &st) < 0) {
+			free(path);
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			b32 ok = riot_wad_mount_scan(path, out);
+			free(path);
+
+			if (!ok) goto cleanup;
+			continue;
+		}
+
+		if (!S_ISREG(st.st_mode) || !riot_wad_mount_is_wad(entry->d_name)) {
+			free(path);
+			continue;
+		}
+
+		if (out->count == out->cap) {
+			u32 cap = out->cap ? out->cap * 2 : 64;
+			char **ptr = realloc(out->ptr, cap * sizeof *ptr);
+			if (!ptr) {
+				free(path);
+				goto cleanup;
+			}
+
+			out->ptr = ptr;
+			out->cap = cap;
+		}
+
+		out->ptr[out->count++] = path;
+	}
+
+	res = true;
+
+cleanup:
+	closedir(d);
+
+	return res;
+}
+
+static int
+riot_wad_mount_path_cmp(void const *lhs, void const *rhs) {
+	return strcmp(*(char * const *)lhs, *(char * const *)rhs);
+}
+
+b32
+riot_wad_mount_open_dir(struct riot_wad_mount *self, char const *dir, struct riot_thread_pool *workers) {
+	assert(self);
+	assert(dir);
+
+	struct riot_wad_mount_paths paths = {0};
+
+	b32 res = false;
+
+	if (!riot_wad_mount_scan(dir, &paths)) {
+		errlog("Failed to scan WAD directory: %s", dir);
+		goto cleanup;
+	}
+
+	qsort(paths.ptr, paths.count, sizeof *paths.ptr, riot_wad_mount_path_cmp);
+
+	res = riot_wad_mount_open(self, (char const **)paths.ptr, paths.count, workers);
+
+cleanup:
+	for (u32 i = 0; i < paths.count; i++)
+		free(paths.ptr[i]);
+
+	free(paths.ptr);
+
+	return res;
+}
+
+struct riot_wad_chunk *
+riot_wad_mount_find(struct riot_wad_mount *self, xxh64_u64 path_hash, struct riot_wad_ctx **archive) {
+	assert(self);
+
+	if (!self->index_count) return NULL;
+
+	xxh64_u64 *hashes = (xxh64_u64 *)self->index_hash_pool.ptr;
+	struct riot_wad_mount_ref *refs = (struct riot_wad_mount_ref *)self->index_ref_pool.ptr;
+
+	u32 idx = riot_hash_search(hashes, self->index_count, path_hash);
+	if (hashes[idx] != path_hash) return NULL;
+
+	struct riot_wad_ctx *ctx = &self->archives[refs[idx].archive];
+	if (archive) *archive = ctx;
+
+	return (struct riot_wad_chunk *)ctx->chunk_pool.ptr + refs[idx].chunk;
+}
+
+b32
+riot_wad_mount_read(struct riot_wad_mount *self, struct riot_wad_decompressor *dec, xxh64_u64 path_hash,
+		    u8 *buf, u64 len, struct mem_stream *out) {
+	assert(self);
+	assert(dec);
+	assert(out);
+
+	struct riot_wad_ctx *archive;
+	struct riot_wad_chunk *chunk = riot_wad_mount_find(self, path_hash, &archive);
+	if (!chunk) {
+		errlog("No such path in WAD mount set: %016lx", path_hash);
+		return false;
+	}
+
+	return riot_wad_chunk_decompress(dec, archive, chunk, buf, len, out);
+}
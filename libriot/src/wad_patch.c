@@ -0,0 +1,502 @@
+#include "libriot/wad.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zstd.h>
+
+#define RIOT_WAD_PATCH_TOC_END(count) (RIOT_WAD_V3_HEADER_SZ + (u64)(count) * RIOT_WAD_V3_CHUNK_SZ)
+
+static b32
+riot_wad_patch_pread(int fd, void *buf, u64 len, u64 off) {
+	u64 done = 0;
+	while (done < len) {
+		ssize_t n = pread(fd, (u8 *)buf + done, len - done, off + done);
+		if (n <= 0) return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+static b32
+riot_wad_patch_pwrite(int fd, void const *buf, u64 len, u64 off) {
+	u64 done = 0;
+	while (done < len) {
+		ssize_t n = pwrite(fd, (u8 const *)buf + done, len - done, off + done);
+		if (n <= 0) return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+static int
+riot_wad_extent_cmp(void const *lhs, void const *rhs) {
+	struct riot_wad_extent const *a = lhs, *b = rhs;
+
+	return (a->off > b->off) - (a->off < b->off);
+}
+
+static b32
+riot_wad_patch_push_extent(struct mem_pool *pool, u32 *count, u64 off, u64 len) {
+	struct riot_wad_extent *extent = MEM_POOL_ALLOC(pool, struct riot_wad_extent, 1);
+	if (!extent) {
+		errlog("Failed to allocate WAD extent");
+		return false;
+	}
+
+	extent->off = off;
+	extent->len = len;
+	(*count)++;
+
+	return true;
+}
+
+/* every byte past the table of contents that no chunk references */
+static b32
+riot_wad_patch_find_free_extents(struct riot_wad_patch *self) {
+	struct riot_wad_ctx *ctx = &self->ctx;
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+
+	struct riot_wad_extent *used = malloc((ctx->wad.chunk_count + 1) * sizeof *used);
+	if (!used) {
+		errlog("Failed to allocate WAD extent table");
+		return false;
+	}
+
+	u32 used_count = 0;
+	for (u32 i = 0; i < ctx->wad.chunk_count; i++) {
+		if (!chunks[i].compressed_size) continue;
+
+		used[used_count].off = chunks[i].data_offset;
+		used[used_count].len = chunks[i].compressed_size;
+		used_count++;
+	}
+
+	qsort(used, used_count, sizeof *used, riot_wad_extent_cmp);
+
+	b32 res = false;
+
+	u64 cur = RIOT_WAD_PATCH_TOC_END(ctx->wad.chunk_count);
+	for (u32 i = 0; i < used_count; i++) {
+		if (used[i].off > cur &&
+		    !riot_wad_patch_push_extent(&self->free_pool, &self->free_count, cur, used[i].off - cur))
+			goto cleanup;
+
+		cur = MAX(cur, used[i].off + used[i].len);
+	}
+
+	if (cur > self->file_len) {
+		errlog("WAD chunk data extends past the end of the file (%lu > %lu bytes)", cur, self->file_len);
+		goto cleanup;
+	}
+
+	if (self->file_len > cur &&
+	    !riot_wad_patch_push_extent(&self->free_pool, &self->free_count, cur, self->file_len - cur))
+		goto cleanup;
+
+	res = true;
+
+cleanup:
+	free(used);
+
+	return res;
+}
+
+b32
+riot_wad_patch_open(struct riot_wad_patch *self, char const *path) {
+	assert(self);
+	assert(path);
+
+	self->level = RIOT_WAD_BUILDER_DEFAULT_LEVEL;
+	self->free_count = self->released_count = 0;
+
+	if (!riot_wad_ctx_init(&self->ctx))
+		goto ctx_init_failure;
+
+	self->fd = open(path, O_RDWR);
+	if (self->fd < 0) {
+		errlog("Failed to open WAD file for patching: %s", path);
+		goto open_failure;
+	}
+
+	struct stat st;
+	if (fstat(self->fd, &st) < 0 || (u64)st.st_size > UINT32_MAX) {
+		errlog("Failed to stat WAD file, or file size unsupported: %s", path);
+		goto header_failure;
+	}
+
+	self->file_len = st.st_size;
+
+	u8 header[RIOT_WAD_V3_HEADER_SZ];
+	if (self->file_len < sizeof header || !riot_wad_patch_pread(self->fd, header, sizeof header, 0)) {
+		errlog("Failed to read WAD header: %s", path);
+		goto header_failure;
+	}
+
+	/* patched chunks are given xxh3 checksums, which v3.0 readers would
+	 * reject
+	 */
+	if (header[0] != 'R' || header[1] != 'W' || header[2] != 3 ||
+	    !riot_wad_version_has_xxh3_checksums(header[2], header[3])) {
+		errlog("Only v3.1+ WAD files can be patched in place: %s", path);
+		goto header_failure;
+	}
+
+	struct mem_stream count_stream = {
+		.ptr = header,
+		.len = sizeof header,
+		.cur = sizeof header - sizeof(u32),
+	};
+
+	u32 chunk_count;
+	riot_mem_stream_read_u32(&count_stream, &chunk_count);
+
+	u64 toc_len = RIOT_WAD_PATCH_TOC_END(chunk_count);
+	if (toc_len > self->file_len) {
+		errlog("WAD table of contents extends past the end of the file: %s", path);
+		goto header_failure;
+	}
+
+	struct mem_stream toc = {
+		.ptr = malloc(toc_len),
+		.len = toc_len,
+		.cur = 0,
+	};
+
+	if (!toc.ptr || !riot_wad_patch_pread(self->fd, toc.ptr, toc_len, 0)) {
+		errlog("Failed to read WAD table of contents (%lu bytes): %s", toc_len, path);
+		free(toc.ptr);
+		goto header_failure;
+	}
+
+	b32 read = riot_wad_read(&self->ctx, toc);
+
+	/* only the table of contents is held in memory, payloads are always
+	 * accessed through the file descriptor
+	 */
+	free(toc.ptr);
+	memset(&self->ctx.src, 0, sizeof self->ctx.src);
+
+	if (!read) {
+		errlog("Failed to read WAD table of contents: %s", path);
+		goto header_failure;
+	}
+
+	self->cctx = ZSTD_createCCtx();
+	if (!self->cctx)
+		goto header_failure;
+
+	if (!MEM_POOL_INIT(&self->scratch_pool, u8, RIOT_WAD_PATCH_SCRATCH_POOL_SZ))
+		goto scratch_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->free_pool, struct riot_wad_extent, RIOT_WAD_PATCH_EXTENT_POOL_SZ))
+		goto free_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->released_pool, struct riot_wad_extent, RIOT_WAD_PATCH_EXTENT_POOL_SZ))
+		goto released_pool_alloc_failure;
+
+	if (!riot_wad_patch_find_free_extents(self))
+		goto extents_failure;
+
+	dbglog("Opened WAD for patching: %u chunks, %u free extents", self->ctx.wad.chunk_count, self->free_count);
+
+	return true;
+
+extents_failure:
+	mem_pool_free(&self->released_pool);
+released_pool_alloc_failure:
+	mem_pool_free(&self->free_pool);
+free_pool_alloc_failure:
+	mem_pool_free(&self->scratch_pool);
+scratch_pool_alloc_failure:
+	ZSTD_freeCCtx(self->cctx);
+header_failure:
+	close(self->fd);
+open_failure:
+	riot_wad_ctx_free(&self->ctx);
+ctx_init_failure:
+	return false;
+}
+
+void
+riot_wad_patch_close(struct riot_wad_patch *self) {
+	assert(self);
+
+	mem_pool_free(&self->released_pool);
+	mem_pool_free(&self->free_pool);
+	mem_pool_free(&self->scratch_pool);
+	ZSTD_freeCCtx(self->cctx);
+	close(self->fd);
+	riot_wad_ctx_free(&self->ctx);
+}
+
+/* best fit over the free extents past the table of contents of a wad with
+ * `chunk_count` chunks, falling back to the end of the file
+ */
+static b32
+riot_wad_patch_alloc(struct riot_wad_patch *self, u64 len, u32 chunk_count, u64 *out) {
+	u64 floor = RIOT_WAD_PATCH_TOC_END(chunk_count);
+
+	struct riot_wad_extent *extents = (struct riot_wad_extent *)self->free_pool.ptr, *best = NULL;
+	for (u32 i = 0; i < self->free_count; i++) {
+		struct riot_wad_extent *extent = &extents[i];
+
+		if (extent->off < floor) {
+			u64 overlap = MIN(floor - extent->off, extent->len);
+			extent->off += overlap;
+			extent->len -= overlap;
+		}
+
+		if (extent->len >= len && (!best || extent->len < best->len))
+			best = extent;
+	}
+
+	u64 off;
+	if (len && best) {
+		off = best->off;
+		best->off += len;
+		best->len -= len;
+	} else {
+		off = MAX(self->file_len, floor);
+	}
+
+	if (off + len > UINT32_MAX) {
+		errlog("WAD data exceeds the 4 GiB offset limit (%lu bytes)", off + len);
+		return false;
+	}
+
+	self->file_len = MAX(self->file_len, off + len);
+
+	*out = off;
+
+	return true;
+}
+
+/* queues the payload of a chunk for reuse once the next table of contents
+ * has been committed, unless another (duplicated) chunk still refers to it
+ */
+static b32
+riot_wad_patch_release(struct riot_wad_patch *self, struct riot_wad_chunk *chunk) {
+	if (!chunk->compressed_size) return true;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)self->ctx.chunk_pool.ptr;
+	for (u32 i = 0; i < self->ctx.wad.chunk_count; i++) {
+		if (&chunks[i] != chunk && chunks[i].compressed_size && chunks[i].data_offset == chunk->data_offset)
+			return true;
+	}
+
+	return riot_wad_patch_push_extent(&self->released_pool, &self->released_count,
+					  chunk->data_offset, chunk->compressed_size);
+}
+
+b32
+riot_wad_patch_put(struct riot_wad_patch *self, xxh64_u64 path_hash, void const *data, u64 len) {
+	assert(self);
+	assert(data || !len);
+
+	if (len > UINT32_MAX) {
+		errlog("WAD chunk too large: %016lx (%lu bytes)", path_hash, len);
+		return false;
+	}
+
+	u64 bound = ZSTD_compressBound(len);
+
+	mem_pool_reset(&self->scratch_pool);
+	u8 *packed = MEM_POOL_ALLOC(&self->scratch_pool, u8, bound);
+	if (!packed) {
+		errlog("Failed to allocate %lu bytes for compressed WAD chunk", bound);
+		return false;
+	}
+
+	size_t packed_len = ZSTD_compressCCtx(self->cctx, packed, bound, data, len, self->level);
+
+	b32 compressed = !ZSTD_isError(packed_len) && packed_len < len;
+	void const *stored = compressed ? packed : data;
+	u64 stored_len = compressed ? packed_len : len;
+
+	struct riot_wad_chunk *chunk = riot_wad_find_chunk(&self->ctx, path_hash);
+	u32 chunk_count = self->ctx.wad.chunk_count + !chunk;
+
+	u64 off;
+	if (!riot_wad_patch_alloc(self, stored_len, chunk_count, &off))
+		return false;
+
+	if (!riot_wad_patch_pwrite(self->fd, stored, stored_len, off)) {
+		errlog("Failed to write WAD chunk data: %016lx", path_hash);
+		return false;
+	}
+
+	if (chunk) {
+		if (!riot_wad_patch_release(self, chunk))
+			return false;
+	} else {
+		riot_offptr_t offptr;
+		if (!riot_wad_ctx_pushn_chunk(&self->ctx, 1, &offptr)) {
+			errlog("Failed to allocate WAD chunk");
+			return false;
+		}
+
+		chunk = (struct riot_wad_chunk *)self->ctx.chunk_pool.ptr + offptr;
+		self->ctx.wad.chunk_count++;
+	}
+
+	memset(chunk, 0, sizeof *chunk);
+	chunk->path_hash = path_hash;
+	chunk->data_offset = off;
+	chunk->compressed_size = stored_len;
+	chunk->decompressed_size = len;
+	chunk->compression = compressed ? RIOT_WAD_COMPRESSION_ZSTD : RIOT_WAD_COMPRESSION_NONE;
+	chunk->checksum = riot_wad_checksum(stored, stored_len);
+
+	if (chunk_count != self->ctx.index_count && !riot_wad_ctx_build_index(&self->ctx)) {
+		errlog("Failed to rebuild WAD chunk index");
+		return false;
+	}
+
+	return true;
+}
+
+b32
+riot_wad_patch_remove(struct riot_wad_patch *self, xxh64_u64 path_hash) {
+	assert(self);
+
+	struct riot_wad_chunk *chunk = riot_wad_find_chunk(&self->ctx, path_hash);
+	if (!chunk) {
+		errlog("No such WAD chunk: %016lx", path_hash);
+		return false;
+	}
+
+	if (!riot_wad_patch_release(self, chunk))
+		return false;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)self->ctx.chunk_pool.ptr;
+	*chunk = chunks[--self->ctx.wad.chunk_count];
+	self->ctx.chunk_pool.len -= sizeof *chunk;
+
+	if (!riot_wad_ctx_build_index(&self->ctx)) {
+		errlog("Failed to rebuild WAD chunk index");
+		return false;
+	}
+
+	return true;
+}
+
+/* moves payloads that the grown table of contents would overwrite */
+static b32
+riot_wad_patch_relocate(struct riot_wad_patch *self, u64 toc_end) {
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)self->ctx.chunk_pool.ptr;
+	u32 count = self->ctx.wad.chunk_count;
+
+	for (u32 i = 0; i < count; i++) {
+		if (chunks[i].data_offset >= toc_end) continue;
+
+		if (!chunks[i].compressed_size) {
+			chunks[i].data_offset = toc_end;
+			continue;
+		}
+
+		u32 old_off = chunks[i].data_offset, len = chunks[i].compressed_size;
+
+		mem_pool_reset(&self->scratch_pool);
+		u8 *buf = MEM_POOL_ALLOC(&self->scratch_pool, u8, len);
+		if (!buf || !riot_wad_patch_pread(self->fd, buf, len, old_off)) {
+			errlog("Failed to read WAD chunk data for relocation: %016lx", chunks[i].path_hash);
+			return false;
+		}
+
+		u64 off;
+		if (!riot_wad_patch_alloc(self, len, count, &off))
+			return false;
+
+		if (!riot_wad_patch_pwrite(self->fd, buf, len, off)) {
+			errlog("Failed to write relocated WAD chunk data: %016lx", chunks[i].path_hash);
+			return false;
+		}
+
+		for (u32 j = i; j < count; j++) {
+			if (chunks[j].data_offset == old_off && chunks[j].compressed_size)
+				chunks[j].data_offset = off;
+		}
+
+		dbglog("Relocated WAD chunk %016lx: %u -> %lu", chunks[i].path_hash, old_off, off);
+	}
+
+	return true;
+}
+
+static int
+riot_wad_patch_chunk_cmp(void const *lhs, void const *rhs) {
+	struct riot_wad_chunk const *a = lhs, *b = rhs;
+
+	return (a->path_hash > b->path_hash) - (a->path_hash < b->path_hash);
+}
+
+b32
+riot_wad_patch_commit(struct riot_wad_patch *self) {
+	assert(self);
+
+	struct riot_wad_ctx *ctx = &self->ctx;
+	u64 toc_end = RIOT_WAD_PATCH_TOC_END(ctx->wad.chunk_count);
+
+	if (!riot_wad_patch_relocate(self, toc_end))
+		return false;
+
+	/* payloads must be durable before any table of contents refers to them */
+	if (fdatasync(self->fd) < 0) {
+		errlog("Failed to sync WAD chunk data");
+		return false;
+	}
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	qsort(chunks, ctx->wad.chunk_count, sizeof *chunks, riot_wad_patch_chunk_cmp);
+
+	struct mem_stream toc = {
+		.ptr = malloc(toc_end),
+		.len = toc_end,
+		.cur = 0,
+	};
+
+	if (!toc.ptr) {
+		errlog("Failed to allocate WAD table of contents (%lu bytes)", toc_end);
+		return false;
+	}
+
+	b32 res = false;
+
+	if (!riot_wad_write_toc(ctx, &toc))
+		goto cleanup;
+
+	if (!riot_wad_patch_pwrite(self->fd, toc.ptr, toc.cur, 0) || fdatasync(self->fd) < 0) {
+		errlog("Failed to write WAD table of contents");
+		goto cleanup;
+	}
+
+	self->file_len = MAX(self->file_len, toc_end);
+
+	struct riot_wad_extent *released = (struct riot_wad_extent *)self->released_pool.ptr;
+	for (u32 i = 0; i < self->released_count; i++) {
+		if (!riot_wad_patch_push_extent(&self->free_pool, &self->free_count, released[i].off, released[i].len))
+			goto cleanup;
+	}
+
+	mem_pool_reset(&self->released_pool);
+	self->released_count = 0;
+
+	if (!riot_wad_ctx_build_index(ctx))
+		goto cleanup;
+
+	dbglog("Committed WAD patch: %u chunks, %u free extents, %lu bytes",
+	       ctx->wad.chunk_count, self->free_count, self->file_len);
+
+	res = true;
+
+cleanup:
+	free(toc.ptr);
+
+	return res;
+}
@@ -1,10 +1,10 @@
 #include "libriot/wad.h"
 
 static void
-riot_wad_chunk_print(struct riot_wad_chunk *chunk, FILE *f);
+riot_wad_chunk_print(struct riot_wad_chunk *chunk, struct riot_hash_dict *names, FILE *f);
 
 void
-riot_wad_print(struct riot_wad_ctx *ctx, FILE *f) {
+riot_wad_print(struct riot_wad_ctx *ctx, struct riot_hash_dict *names, FILE *f) {
 	assert(ctx);
 	assert(f);
 
@@ -14,7 +14,7 @@ riot_wad_print(struct riot_wad_ctx *ctx, FILE *f) {
 	for (u32 i = 0; i < ctx->wad.chunk_count; i++) {
 		struct riot_wad_chunk *chunk = ((struct riot_wad_chunk *)ctx->chunk_pool.ptr) + i;
 		fprintf(f, "\t");
-		riot_wad_chunk_print(chunk, f);
+		riot_wad_chunk_print(chunk, names, f);
 		fprintf(f, "\n");
 	}
 
@@ -22,11 +22,18 @@ riot_wad_print(struct riot_wad_ctx *ctx, FILE *f) {
 }
 
 static void
-riot_wad_chunk_print(struct riot_wad_chunk *chunk, FILE *f) {
+riot_wad_chunk_print(struct riot_wad_chunk *chunk, struct riot_hash_dict *names, FILE *f) {
 	assert(chunk);
 	assert(f);
 
-	fprintf(f, "WADChunk(path_hash=0x%08lx,data_offset=0x%08lx,compressed_size=%lu,decompressed_size=%lu,compression=%u,duplicated=%u,sub_chunk_count=%u,sub_chunk_start=%u,checksum=0x%08lx)",
+	struct str_view path;
+	if (names && riot_hash_dict_find(names, chunk->path_hash, &path)) {
+		fprintf(f, "WADChunk(path=%.*s,", (int)path.len, path.ptr);
+	} else {
+		fprintf(f, "WADChunk(");
+	}
+
+	fprintf(f, "path_hash=0x%08lx,data_offset=0x%08x,compressed_size=%u,decompressed_size=%u,compression=%u,duplicated=%u,sub_chunk_count=%u,sub_chunk_start=%u,checksum=0x%08lx)",
 			chunk->path_hash, chunk->data_offset, chunk->compressed_size,
 			chunk->decompressed_size, chunk->compression, chunk->duplicated,
 			chunk->sub_chunk_count, chunk->sub_chunk_start, chunk->checksum);
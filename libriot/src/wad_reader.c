@@ -1,4 +1,6 @@
 #include "libriot/wad.h"
+#include "libriot/stats.h"
+#include "libriot/trace.h"
 
 static b32
 riot_wad_chunk_read(struct riot_wad_ctx *ctx, struct mem_stream *stream, struct riot_wad_chunk *chunk);
@@ -7,6 +9,10 @@ b32
 riot_wad_read(struct riot_wad_ctx *ctx, struct mem_stream stream) {
 	assert(ctx);
 
+	u64 start = riot_stats_clock(), span = riot_trace_begin();
+
+	ctx->src = stream;
+
 	char magic[2] = { 'R', 'W', }, buf[sizeof(magic)];
 	if (!mem_stream_consume(&stream, buf, sizeof magic)) {
 		errlog("Failed to read WAD magic");
@@ -54,7 +60,9 @@ riot_wad_read(struct riot_wad_ctx *ctx, struct mem_stream stream) {
 
 		dbglog("WAD v2 signature: length: %u, checksum: %lu", ecdsa_signature_length, checksum);
 
-		// TODO: check signature and checksum values
+		/* neither value can be checked here: the signature is made with
+		 * Riot's private key, and the checksum algorithm is undocumented
+		 */
 	} break;
 
 	case 3: {
@@ -72,12 +80,15 @@ riot_wad_read(struct riot_wad_ctx *ctx, struct mem_stream stream) {
 
 		dbglog("WAD v3 signature: length: %u, checksum: %lu", ecdsa_signature_length, checksum);
 
-		// TODO: check signature and checksum values
+		/* as for v2, and libriot writes both zeroed. the integrity of
+		 * v3.1+ archives is instead checked per chunk, by
+		 * `riot_wad_verify_checksums()`
+		 */
 	} break;
 
 	default:
-		unreachable("Unknown WAD major version: %u", ctx->wad.major);
-		break;
+		errlog("Unsupported WAD major version: %u", ctx->wad.major);
+		return false;
 	}
 
 	if (ctx->wad.major <= 2) {
@@ -107,12 +118,14 @@ riot_wad_read(struct riot_wad_ctx *ctx, struct mem_stream stream) {
 
 	riot_offptr_t chunk_offptr;
 	if (!riot_wad_ctx_pushn_chunk(ctx, ctx->wad.chunk_count, &chunk_offptr)) {
-		errlog("Failed to preallocate %u WAD chunks");
+		errlog("Failed to preallocate %u WAD chunks", ctx->wad.chunk_count);
 		return false;
 	}
 
 	(void) chunk_offptr;
 
+	ctx->wad.data_start = ctx->wad.chunk_count ? UINT32_MAX : stream.cur;
+
 	for (u32 i = 0; i < ctx->wad.chunk_count; i++) {
 		struct riot_wad_chunk *chunk = (struct riot_wad_chunk *)ctx->chunk_pool.ptr + i;
 		if (!riot_wad_chunk_read(ctx, &stream, chunk)) {
@@ -121,68 +134,82 @@ riot_wad_read(struct riot_wad_ctx *ctx, struct mem_stream stream) {
 		}
 	}
 
+	if (!riot_wad_ctx_build_index(ctx)) {
+		errlog("Failed to build WAD chunk index");
+		return false;
+	}
+
 	dbglog("Read %u WAD chunks", ctx->wad.chunk_count);
-	dbglog("WAD chunk segment end: %lu", stream.cur, stream.len);
-	dbglog("WAD data segment start: %lu", ctx->wad.data_start);
+	dbglog("WAD chunk segment end: %lu/%lu", stream.cur, stream.len);
+	dbglog("WAD data segment start: %u", ctx->wad.data_start);
 	dbglog("WAD ctx chunk pool size: %lu/%lu bytes", ctx->chunk_pool.len, ctx->chunk_pool.cap);
 
+	riot_stats_add(RIOT_STAT_WAD_TOC_PARSES, 1);
+	riot_stats_add(RIOT_STAT_WAD_TOC_BYTES, stream.cur);
+	riot_stats_add(RIOT_STAT_WAD_TOC_CHUNKS, ctx->wad.chunk_count);
+	riot_stats_time(RIOT_STAT_WAD_TOC_NS, start);
+	riot_trace_end("parse", span, stream.cur);
+
 	return true;
 }
 
-static b32
-riot_wad_chunk_read(struct riot_wad_ctx *ctx, struct mem_stream *stream, struct riot_wad_chunk *chunk) {
+b32
+riot_wad_open_mapped(struct riot_wad_ctx *ctx, char const *path) {
 	assert(ctx);
-	assert(stream);
-	assert(chunk);
-
-	if (!riot_mem_stream_read_xxh64_u64(stream, &chunk->path_hash)) {
-		errlog("Failed to read WAD chunk path hash");
+	assert(path);
+
+	/* pages are only faulted in as the reader (or a chunk consumer) touches
+	 * them
+	 */
+	struct mem_stream stream;
+	if (!riot_mem_stream_map_file(&stream, path, NULL)) {
+		errlog("Failed to map WAD file: %s", path);
 		return false;
 	}
 
-	if (!riot_mem_stream_read_u32(stream, &chunk->data_offset)) {
-		errlog("Failed to read WAD chunk data offset");
+	if (!riot_wad_read(ctx, stream)) {
+		riot_mem_stream_unmap(&stream);
+		ctx->src.ptr = NULL;
+		ctx->src.len = 0;
 		return false;
 	}
 
-	if (chunk->data_offset < ctx->wad.data_start)
-		ctx->wad.data_start = chunk->data_offset;
+	ctx->mapped = true;
 
-	if (!riot_mem_stream_read_u32(stream, &chunk->compressed_size)) {
-		errlog("Failed to read WAD chunk compressed data size");
-		return false;
-	}
+	return true;
+}
 
-	if (!riot_mem_stream_read_u32(stream, &chunk->decompressed_size)) {
-		errlog("Failed to read WAD chunk decompressed data size");
-		return false;
-	}
+static b32
+riot_wad_chunk_read(struct riot_wad_ctx *ctx, struct mem_stream *stream, struct riot_wad_chunk *chunk) {
+	assert(ctx);
+	assert(stream);
+	assert(chunk);
 
-	u8 sub_chunk_count_and_compression_type;
-	if (!riot_mem_stream_read_u8(stream, &sub_chunk_count_and_compression_type)) {
-		errlog("Failed to read WAD chunk sub-chunk count and compression type byte");
+	/* v3 appends a checksum to the otherwise unchanged v1/v2 entry */
+	b32 has_checksum = ctx->wad.major > 2;
+	u64 record_sz = has_checksum ? RIOT_WAD_V3_CHUNK_SZ : RIOT_WAD_V3_CHUNK_SZ - sizeof(u64);
+
+	u8 const *record = riot_mem_stream_take(stream, record_sz);
+	if (!record) {
+		errlog("Failed to read WAD chunk (%lu bytes)", record_sz);
 		return false;
 	}
 
+	chunk->path_hash = riot_load_le64(record + 0);
+	chunk->data_offset = riot_load_le32(record + 8);
+	chunk->compressed_size = riot_load_le32(record + 12);
+	chunk->decompressed_size = riot_load_le32(record + 16);
+
+	u8 sub_chunk_count_and_compression_type = riot_load_le8(record + 20);
 	chunk->compression = (enum riot_wad_compression)sub_chunk_count_and_compression_type & 0xf;
 	chunk->sub_chunk_count = sub_chunk_count_and_compression_type >> 4;
 
-	if (!riot_mem_stream_read_b8(stream, &chunk->duplicated)) {
-		errlog("Failed to read WAD chunk duplication flag");
-		return false;
-	}
-
-	if (!riot_mem_stream_read_u16(stream, &chunk->sub_chunk_start)) {
-		errlog("Failed to read WAD sub-chunk start");
-		return false;
-	}
+	chunk->duplicated = riot_load_le8(record + 21);
+	chunk->sub_chunk_start = riot_load_le16(record + 22);
+	chunk->checksum = has_checksum ? riot_load_le64(record + 24) : 0;
 
-	if (ctx->wad.major > 2) {
-		if (!riot_mem_stream_read_u64(stream, &chunk->checksum)) {
-			errlog("Failed to read WAD chunk checksum");
-			return false;
-		}
-	}
+	if (chunk->data_offset < ctx->wad.data_start)
+		ctx->wad.data_start = chunk->data_offset;
 
 	return true;
 }
@@ -1,112 +1,263 @@
 #include "libriot/wad.h"
 
+static b32
+riot_wad_header_write(u32 chunk_count, struct mem_stream *stream);
+
 static b32
 riot_wad_chunk_write(struct riot_wad_ctx *ctx, struct riot_wad_chunk *chunk, struct mem_stream *stream);
 
+/* sort key grouping chunks with identical payloads, with the first such
+ * chunk in table order leading each group
+ */
+struct riot_wad_dedup_key {
+	u64 checksum;
+	u32 size, idx;
+};
+
+static int
+riot_wad_dedup_key_cmp(void const *lhs, void const *rhs) {
+	struct riot_wad_dedup_key const *a = lhs, *b = rhs;
+
+	if (a->checksum != b->checksum)
+		return (a->checksum > b->checksum) - (a->checksum < b->checksum);
+
+	if (a->size != b->size)
+		return (a->size > b->size) - (a->size < b->size);
+
+	return (a->idx > b->idx) - (a->idx < b->idx);
+}
+
+/* assigns every chunk the output offset of its payload, storing each distinct
+ * payload once. chunks are grouped by their (already computed) checksum and
+ * size, and confirmed byte-for-byte against the first chunk of their group
+ * before being pointed at its payload. `owner[i]` receives the index of the
+ * chunk whose payload chunk `i` shares, which is `i` for stored payloads
+ */
+static b32
+riot_wad_dedup_plan(struct riot_wad_ctx *ctx, u8 const *data, u64 data_start_out,
+		    u32 *owner, u32 *offsets, u64 *stored_len) {
+	assert(ctx);
+	assert(owner);
+	assert(offsets);
+	assert(stored_len);
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	u32 count = ctx->wad.chunk_count;
+
+	struct riot_wad_dedup_key *keys = malloc(count * sizeof *keys);
+	if (!keys && count) return false;
+
+	for (u32 i = 0; i < count; i++) {
+		keys[i].checksum = chunks[i].checksum;
+		keys[i].size = chunks[i].compressed_size;
+		keys[i].idx = i;
+	}
+
+	qsort(keys, count, sizeof *keys, riot_wad_dedup_key_cmp);
+
+	for (u32 i = 0, lead = 0; i < count; i++) {
+		if (keys[lead].checksum != keys[i].checksum || keys[lead].size != keys[i].size)
+			lead = i;
+
+		struct riot_wad_chunk *lead_chunk = &chunks[keys[lead].idx], *chunk = &chunks[keys[i].idx];
+		b32 same = lead != i &&
+			memcmp(data + (lead_chunk->data_offset - ctx->wad.data_start),
+			       data + (chunk->data_offset - ctx->wad.data_start),
+			       chunk->compressed_size) == 0;
+
+		owner[keys[i].idx] = same ? keys[lead].idx : keys[i].idx;
+	}
+
+	free(keys);
+
+	u64 cur = data_start_out;
+	for (u32 i = 0; i < count; i++) {
+		if (owner[i] != i) {
+			offsets[i] = offsets[owner[i]];
+			continue;
+		}
+
+		if (cur + chunks[i].compressed_size > UINT32_MAX) {
+			errlog("WAD data segment exceeds 4 GiB");
+			return false;
+		}
+
+		offsets[i] = cur;
+		cur += chunks[i].compressed_size;
+	}
+
+	*stored_len = cur - data_start_out;
+
+	return true;
+}
+
 b32
-riot_wad_write(struct riot_wad_ctx *ctx, void *data, u64 len, struct mem_stream stream) {
+riot_wad_write(struct riot_wad_ctx *ctx, void *data, u64 len, struct riot_thread_pool *workers,
+	       struct riot_writer *out) {
 	assert(ctx);
+	assert(out);
 
-	char magic[2] = { 'R', 'W', };
-	if (!mem_stream_push(&stream, magic, sizeof magic)) {
-		errlog("Failed to write WAD magic");
+	if (!riot_wad_ctx_compute_checksums(ctx, data, len, workers)) {
+		errlog("Failed to compute WAD chunk checksums");
 		return false;
 	}
 
-	if (!riot_mem_stream_write_u8(&stream, 3)) {
-		errlog("Failed to write WAD version major");
-		return false;
+	b32 res = false;
+
+	u32 count = ctx->wad.chunk_count;
+	u32 *owner = malloc(count * sizeof *owner);
+	u32 *offsets = malloc(count * sizeof *offsets);
+	if (count && (!owner || !offsets)) {
+		errlog("Failed to allocate WAD deduplication state");
+		goto cleanup;
 	}
 
-	if (!riot_mem_stream_write_u8(&stream, 1)) {
-		errlog("Failed to write WAD version minor");
-		return false;
+	u64 data_start_out = RIOT_WAD_V3_HEADER_SZ + (u64)count * RIOT_WAD_V3_CHUNK_SZ;
+
+	u64 stored_len;
+	if (!riot_wad_dedup_plan(ctx, data, data_start_out, owner, offsets, &stored_len)) {
+		errlog("Failed to deduplicate WAD chunk data");
+		goto cleanup;
 	}
 
-	u32 ecdsa_signature_length = 256;
-	u8 signature[ecdsa_signature_length];
-	memset(signature, 0, ecdsa_signature_length);
-	if (!mem_stream_push(&stream, signature, ecdsa_signature_length)) {
-		errlog("Failed to write v3 signature (%u bytes)", ecdsa_signature_length);
-		return false;
+	/* the header and table of contents are encoded in place, into owned
+	 * bytes of the writer, while chunk payloads are only referenced
+	 */
+	struct mem_stream toc = {
+		.ptr = riot_writer_reserve(out, data_start_out),
+		.len = data_start_out,
+		.cur = 0,
+	};
+
+	if (!toc.ptr) {
+		errlog("Failed to allocate WAD table of contents (%lu bytes)", data_start_out);
+		goto cleanup;
 	}
 
-	u64 checksum = 0;
-	if (!riot_mem_stream_write_u64(&stream, checksum)) {
-		errlog("Failed to write v3 signature checksum");
-		return false;
+	if (!riot_wad_header_write(count, &toc))
+		goto cleanup;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	for (u32 i = 0; i < count; i++) {
+		struct riot_wad_chunk chunk = chunks[i];
+		chunk.data_offset = offsets[i];
+		chunk.duplicated = owner[i] != i;
+
+		if (!riot_wad_chunk_write(ctx, &chunk, &toc)) {
+			errlog("Failed to write WAD chunk %u/%u", i + 1, count);
+			goto cleanup;
+		}
 	}
 
-	if (!riot_mem_stream_write_u32(&stream, ctx->wad.chunk_count)) {
-		errlog("Failed to write WAD chunk count");
-		return false;
+	assert(toc.cur == data_start_out);
+
+	for (u32 i = 0; i < count; i++) {
+		if (owner[i] != i || !chunks[i].compressed_size) continue;
+
+		if (!riot_writer_push_ref(out, (u8 *)data + (chunks[i].data_offset - ctx->wad.data_start),
+					  chunks[i].compressed_size)) {
+			errlog("Failed to write WAD chunk data %u/%u", i + 1, count);
+			goto cleanup;
+		}
 	}
 
+	dbglog("WAD data segment: %lu bytes stored, source data segment: %lu bytes", stored_len, len);
+
+	res = true;
+
+cleanup:
+	free(offsets);
+	free(owner);
+
+	return res;
+}
+
+b32
+riot_wad_write_toc(struct riot_wad_ctx *ctx, struct mem_stream *stream) {
+	assert(ctx);
+	assert(stream);
+
+	if (!riot_wad_header_write(ctx->wad.chunk_count, stream))
+		return false;
+
 	for (u32 i = 0; i < ctx->wad.chunk_count; i++) {
 		struct riot_wad_chunk *chunk = (struct riot_wad_chunk *)ctx->chunk_pool.ptr + i;
-		if (!riot_wad_chunk_write(ctx, chunk, &stream)) {
+		if (!riot_wad_chunk_write(ctx, chunk, stream)) {
 			errlog("Failed to write WAD chunk %u/%u", i + 1, ctx->wad.chunk_count);
 			return false;
 		}
 	}
 
-	if (!mem_stream_push(&stream, data, len)) {
-		errlog("Failed to write WAD data segment");
-		return false;
-	}
-
 	return true;
 }
 
 static b32
-riot_wad_chunk_write(struct riot_wad_ctx *ctx, struct riot_wad_chunk *chunk, struct mem_stream *stream) {
-	assert(ctx);
-	assert(chunk);
+riot_wad_header_write(u32 chunk_count, struct mem_stream *stream) {
 	assert(stream);
 
-	if (!riot_mem_stream_write_xxh64_u64(stream, chunk->path_hash)) {
-		errlog("Failed to write WAD chunk path hash");
+	char magic[2] = { 'R', 'W', };
+	if (!mem_stream_push(stream, magic, sizeof magic)) {
+		errlog("Failed to write WAD magic");
 		return false;
 	}
 
-	if (!riot_mem_stream_write_u32(stream, chunk->data_offset)) {
-		errlog("Failed to write WAD chunk data offset");
+	if (!riot_mem_stream_write_u8(stream, 3)) {
+		errlog("Failed to write WAD version major");
 		return false;
 	}
 
-	if (!riot_mem_stream_write_u32(stream, chunk->compressed_size)) {
-		errlog("Failed to write WAD chunk compressed data size");
+	if (!riot_mem_stream_write_u8(stream, 1)) {
+		errlog("Failed to write WAD version minor");
 		return false;
 	}
 
-	if (!riot_mem_stream_write_u32(stream, chunk->decompressed_size)) {
-		errlog("Failed to write WAD chunk decompressed data size");
+	u8 signature[256] = {0};
+	u32 ecdsa_signature_length = sizeof signature;
+	if (!mem_stream_push(stream, signature, ecdsa_signature_length)) {
+		errlog("Failed to write v3 signature (%u bytes)", ecdsa_signature_length);
 		return false;
 	}
 
-	u8 sub_chunk_count_and_compression_type = 0;
-	sub_chunk_count_and_compression_type |= (chunk->sub_chunk_count << 4);
-	sub_chunk_count_and_compression_type |= (u8)chunk->compression & 0xf;
-	if (!riot_mem_stream_write_u8(stream, sub_chunk_count_and_compression_type)) {
-		errlog("Failed to write WAD chunk sub-chunk count and compression type byte");
+	u64 checksum = 0;
+	if (!riot_mem_stream_write_u64(stream, checksum)) {
+		errlog("Failed to write v3 signature checksum");
 		return false;
 	}
 
-	if (!riot_mem_stream_write_b8(stream, chunk->duplicated)) {
-		errlog("Failed to write WAD chunk duplicated flag");
+	if (!riot_mem_stream_write_u32(stream, chunk_count)) {
+		errlog("Failed to write WAD chunk count");
 		return false;
 	}
 
-	if (!riot_mem_stream_write_u16(stream, chunk->sub_chunk_start)) {
-		errlog("Failed to write WAD chunk sub-chunk start");
-		return false;
-	}
+	return true;
+}
 
-	u64 checksum = 0;
-	if (!riot_mem_stream_write_u64(stream, checksum)) {
-		errlog("Failed to write WAD chunk checksum");
+static b32
+riot_wad_chunk_write(struct riot_wad_ctx *ctx, struct riot_wad_chunk *chunk, struct mem_stream *stream) {
+	assert(ctx);
+	assert(chunk);
+	assert(stream);
+
+	(void) ctx;
+
+	u8 *record = riot_mem_stream_reserve(stream, RIOT_WAD_V3_CHUNK_SZ);
+	if (!record) {
+		errlog("Failed to write WAD chunk (%u bytes)", RIOT_WAD_V3_CHUNK_SZ);
 		return false;
 	}
 
+	u8 sub_chunk_count_and_compression_type = 0;
+	sub_chunk_count_and_compression_type |= (chunk->sub_chunk_count << 4);
+	sub_chunk_count_and_compression_type |= (u8)chunk->compression & 0xf;
+
+	riot_store_le64(record + 0, chunk->path_hash);
+	riot_store_le32(record + 8, chunk->data_offset);
+	riot_store_le32(record + 12, chunk->compressed_size);
+	riot_store_le32(record + 16, chunk->decompressed_size);
+	riot_store_le8(record + 20, sub_chunk_count_and_compression_type);
+	riot_store_le8(record + 21, chunk->duplicated);
+	riot_store_le16(record + 22, chunk->sub_chunk_start);
+	riot_store_le64(record + 24, chunk->checksum);
+
 	return true;
 }
@@ -0,0 +1,181 @@
+#include "libriot/writer.h"
+#include "libriot/stats.h"
+#include "libriot/trace.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+b32
+riot_writer_init(struct riot_writer *self) {
+	assert(self);
+
+	self->segment_count = 0;
+	self->len = 0;
+
+	if (!MEM_POOL_INIT(&self->buf_pool, u8, RIOT_WRITER_BUF_POOL_SZ))
+		goto buf_pool_alloc_failure;
+
+	if (!MEM_POOL_INIT(&self->segment_pool, struct riot_writer_segment, RIOT_WRITER_SEGMENT_POOL_SZ))
+		goto segment_pool_alloc_failure;
+
+	return true;
+
+segment_pool_alloc_failure:
+	mem_pool_free(&self->buf_pool);
+buf_pool_alloc_failure:
+	return false;
+}
+
+void
+riot_writer_free(struct riot_writer *self) {
+	assert(self);
+
+	mem_pool_free(&self->buf_pool);
+	mem_pool_free(&self->segment_pool);
+}
+
+void
+riot_writer_reset(struct riot_writer *self) {
+	assert(self);
+
+	mem_pool_reset(&self->buf_pool);
+	mem_pool_reset(&self->segment_pool);
+	self->segment_count = 0;
+	self->len = 0;
+}
+
+static struct riot_writer_segment *
+riot_writer_segment_push(struct riot_writer *self) {
+	struct riot_writer_segment *segment = MEM_POOL_ALLOC(&self->segment_pool, struct riot_writer_segment, 1);
+	if (!segment) return NULL;
+
+	self->segment_count++;
+
+	return segment;
+}
+
+u8 *
+riot_writer_reserve(struct riot_writer *self, u64 len) {
+	assert(self);
+
+	u64 off = self->buf_pool.len;
+
+	u8 *ptr = MEM_POOL_ALLOC(&self->buf_pool, u8, len);
+	if (!ptr) return NULL;
+
+	/* consecutive owned runs are coalesced into a single segment */
+	struct riot_writer_segment *last = self->segment_count
+		? (struct riot_writer_segment *)self->segment_pool.ptr + self->segment_count - 1
+		: NULL;
+
+	if (last && !last->ptr && last->off + last->len == off) {
+		last->len += len;
+	} else {
+		struct riot_writer_segment *segment = riot_writer_segment_push(self);
+		if (!segment) {
+			self->buf_pool.len = off;
+			return NULL;
+		}
+
+		segment->ptr = NULL;
+		segment->off = off;
+		segment->len = len;
+	}
+
+	self->len += len;
+
+	return ptr;
+}
+
+b32
+riot_writer_push(struct riot_writer *self, void const *buf, u64 len) {
+	assert(self);
+	assert(buf || !len);
+
+	u8 *ptr = riot_writer_reserve(self, len);
+	if (!ptr) return false;
+
+	if (len) memcpy(ptr, buf, len);
+
+	return true;
+}
+
+b32
+riot_writer_push_ref(struct riot_writer *self, void const *buf, u64 len) {
+	assert(self);
+	assert(buf || !len);
+
+	if (!len) return true;
+
+	struct riot_writer_segment *segment = riot_writer_segment_push(self);
+	if (!segment) return false;
+
+	segment->ptr = buf;
+	segment->off = 0;
+	segment->len = len;
+
+	self->len += len;
+
+	return true;
+}
+
+b32
+riot_writer_flush(struct riot_writer *self, int fd) {
+	assert(self);
+
+	struct riot_writer_segment *segments = (struct riot_writer_segment *)self->segment_pool.ptr;
+
+	struct iovec iov[IOV_MAX < 1024 ? IOV_MAX : 1024];
+	u32 iov_cap = sizeof iov / sizeof *iov;
+
+	/* segments are handed to writev() a batch at a time. a short write
+	 * resumes from the first segment not written out in full, at the
+	 * offset it was cut at
+	 */
+	u64 start = riot_stats_clock(), span = riot_trace_begin(), total = 0;
+
+	u32 next = 0;
+	u64 skip = 0;
+	while (next < self->segment_count) {
+		u32 iov_count = 0;
+		for (u32 i = next; i < self->segment_count && iov_count < iov_cap; i++, iov_count++) {
+			struct riot_writer_segment *segment = &segments[i];
+			u8 const *base = segment->ptr ? segment->ptr : self->buf_pool.ptr + segment->off;
+			u64 off = i == next ? skip : 0;
+
+			iov[iov_count].iov_base = (void *)(base + off);
+			iov[iov_count].iov_len = segment->len - off;
+		}
+
+		u64 batch_len = 0;
+		for (u32 i = 0; i < iov_count; i++)
+			batch_len += iov[i].iov_len;
+
+		ssize_t written = writev(fd, iov, iov_count);
+		if (written < 0 && errno == EINTR) continue;
+
+		if (written < 0 || (written == 0 && batch_len)) {
+			errlog("Failed to write %u output segments (%lu bytes)", iov_count, batch_len);
+			return false;
+		}
+
+		total += written;
+
+		u64 remaining = written;
+		while (next < self->segment_count && remaining >= segments[next].len - skip) {
+			remaining -= segments[next].len - skip;
+			skip = 0;
+			next++;
+		}
+
+		skip += remaining;
+	}
+
+	riot_stats_add(RIOT_STAT_WRITER_BYTES, total);
+	riot_stats_time(RIOT_STAT_WRITER_NS, start);
+	riot_trace_end("write", span, total);
+
+	riot_writer_reset(self);
+
+	return true;
+}
@@ -0,0 +1,146 @@
+#include "test.h"
+
+#include "libriot/chunk_cache.h"
+
+/* every entry of these tests lands in the single shard, whose budget holds
+ * exactly `TEST_CACHE_ENTRIES` of them
+ */
+#define TEST_CACHE_ENTRY_SZ 100
+#define TEST_CACHE_ENTRIES 4
+
+static b32
+test_cache_put(struct riot_chunk_cache *cache, xxh64_u64 path_hash) {
+	u8 data[TEST_CACHE_ENTRY_SZ];
+	memset(data, (u8)path_hash, sizeof data);
+
+	struct riot_chunk_cache_entry *entry = riot_chunk_cache_put(cache, path_hash, data, sizeof data);
+	if (!entry) return false;
+
+	riot_chunk_cache_release(cache, entry);
+
+	return true;
+}
+
+static b32
+test_cache_contains(struct riot_chunk_cache *cache, xxh64_u64 path_hash) {
+	struct riot_chunk_cache_entry *entry = riot_chunk_cache_get(cache, path_hash);
+	if (!entry) return false;
+
+	riot_chunk_cache_release(cache, entry);
+
+	return true;
+}
+
+/* an entry hit again is protected, and outlives newer entries that were
+ * only ever inserted
+ */
+static s32
+test_chunk_cache_slru_eviction(void) {
+	struct riot_chunk_cache cache;
+	TEST_ASSERT(riot_chunk_cache_init(&cache, TEST_CACHE_ENTRIES * TEST_CACHE_ENTRY_SZ, 1),
+		    "failed to initialise cache");
+
+	TEST_ASSERT(test_cache_put(&cache, 1) && test_cache_put(&cache, 2) && test_cache_put(&cache, 3),
+		    "failed to insert entries");
+
+	/* promotes 1 out of probation */
+	TEST_ASSERT(test_cache_contains(&cache, 1), "inserted entry missing");
+
+	TEST_ASSERT(test_cache_put(&cache, 4) && test_cache_put(&cache, 5), "failed to insert entries");
+
+	struct riot_chunk_cache_stats stats;
+	riot_chunk_cache_get_stats(&cache, &stats);
+	TEST_ASSERT(stats.evictions == 1, "wrong eviction count");
+	TEST_ASSERT(stats.len == TEST_CACHE_ENTRIES * TEST_CACHE_ENTRY_SZ, "cache over budget");
+
+	/* the oldest probationary entry goes first */
+	TEST_ASSERT(!test_cache_contains(&cache, 2), "least recently used entry not evicted");
+	TEST_ASSERT(test_cache_contains(&cache, 1), "protected entry evicted");
+	TEST_ASSERT(test_cache_contains(&cache, 3), "probationary entry evicted out of order");
+
+	/* a scan of one-off entries only displaces probationary ones */
+	for (xxh64_u64 i = 100; i < 100 + 4 * TEST_CACHE_ENTRIES; i++)
+		TEST_ASSERT(test_cache_put(&cache, i), "failed to insert entry");
+
+	TEST_ASSERT(test_cache_contains(&cache, 1), "protected entry evicted by a scan");
+	TEST_ASSERT(!test_cache_contains(&cache, 5), "probationary entry survived a scan");
+
+	riot_chunk_cache_free(&cache);
+	TEST_PASS()
+}
+
+/* an entry evicted while referenced stays valid until released */
+static s32
+test_chunk_cache_referenced_eviction(void) {
+	struct riot_chunk_cache cache;
+	TEST_ASSERT(riot_chunk_cache_init(&cache, TEST_CACHE_ENTRIES * TEST_CACHE_ENTRY_SZ, 1),
+		    "failed to initialise cache");
+
+	u8 data[TEST_CACHE_ENTRY_SZ];
+	memset(data, 0x5a, sizeof data);
+
+	struct riot_chunk_cache_entry *held = riot_chunk_cache_put(&cache, 1, data, sizeof data);
+	TEST_ASSERT(held, "failed to insert entry");
+	TEST_ASSERT(held->cached && held->refs == 1, "inserted entry not referenced");
+
+	for (xxh64_u64 i = 2; i < 2 + 2 * TEST_CACHE_ENTRIES; i++)
+		TEST_ASSERT(test_cache_put(&cache, i), "failed to insert entry");
+
+	TEST_ASSERT(!held->cached, "referenced entry not evicted");
+	TEST_ASSERT(!test_cache_contains(&cache, 1), "evicted entry still cached");
+	TEST_ASSERT(held->len == sizeof data && memcmp(held->data, data, sizeof data) == 0,
+		    "referenced entry clobbered by eviction");
+
+	/* freed here, rather than on eviction */
+	riot_chunk_cache_release(&cache, held);
+
+	struct riot_chunk_cache_stats stats;
+	riot_chunk_cache_get_stats(&cache, &stats);
+	TEST_ASSERT(stats.count == TEST_CACHE_ENTRIES, "wrong entry count");
+
+	riot_chunk_cache_free(&cache);
+	TEST_PASS()
+}
+
+/* an entry larger than the budget is handed back uncached, and leaves the
+ * cached ones in place
+ */
+static s32
+test_chunk_cache_oversized(void) {
+	struct riot_chunk_cache cache;
+	TEST_ASSERT(riot_chunk_cache_init(&cache, TEST_CACHE_ENTRIES * TEST_CACHE_ENTRY_SZ, 1),
+		    "failed to initialise cache");
+
+	TEST_ASSERT(test_cache_put(&cache, 1), "failed to insert entry");
+
+	u8 data[(TEST_CACHE_ENTRIES + 1) * TEST_CACHE_ENTRY_SZ];
+	memset(data, 0xa5, sizeof data);
+
+	struct riot_chunk_cache_entry *entry = riot_chunk_cache_put(&cache, 2, data, sizeof data);
+	TEST_ASSERT(entry, "failed to return oversized entry");
+	TEST_ASSERT(!entry->cached && entry->len == sizeof data && memcmp(entry->data, data, sizeof data) == 0,
+		    "oversized entry cached");
+
+	riot_chunk_cache_release(&cache, entry);
+
+	TEST_ASSERT(!test_cache_contains(&cache, 2), "oversized entry cached");
+	TEST_ASSERT(test_cache_contains(&cache, 1), "entry evicted by an oversized one");
+
+	struct riot_chunk_cache_stats stats;
+	riot_chunk_cache_get_stats(&cache, &stats);
+	TEST_ASSERT(stats.count == 1 && stats.evictions == 0, "oversized entry counted");
+
+	riot_chunk_cache_free(&cache);
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_chunk_cache_slru_eviction)
+	TEST_RUN(test_chunk_cache_referenced_eviction)
+	TEST_RUN(test_chunk_cache_oversized)
+
+	TESTS_END()
+}
@@ -0,0 +1,140 @@
+#include "test.h"
+
+#include "libriot/hash_dict.h"
+#include "libriot/thread_pool.h"
+
+#include <unistd.h>
+
+#define TEST_LINES 5000
+
+static u64
+test_hash(u32 i) {
+	/* spread over the full 64 bits, in no particular order */
+	return (i + 1) * 0x9e3779b97f4a7c15ULL;
+}
+
+/* writes a hash list of `TEST_LINES` entries to a temporary file, mixing in
+ * CRLF line ends, malformed lines and, for every tenth entry, a later
+ * duplicate of its hash under another name. the last line has no line break
+ */
+static b32
+test_hash_list(char *path) {
+	s32 fd = mkstemp(path);
+	if (fd < 0) return false;
+
+	FILE *fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		return false;
+	}
+
+	for (u32 i = 0; i < TEST_LINES; i++) {
+		fprintf(fp, "%016lx data/entry_%u.bin%s\n", test_hash(i), i, i % 7 ? "" : "\r");
+
+		if (i % 10 == 0)
+			fprintf(fp, "%lx data/duplicate_%u.bin\n", test_hash(i / 2), i);
+
+		if (i % 500 == 0)
+			fprintf(fp, "not a hash line\n\n%016lx \n", test_hash(i));
+	}
+
+	fprintf(fp, "%lx data/last.bin", test_hash(TEST_LINES));
+
+	return fclose(fp) == 0;
+}
+
+static b32
+test_hash_dict_matches(struct riot_hash_dict *dict) {
+	if (dict->count != TEST_LINES + 1) return false;
+
+	char expected[64];
+	struct str_view name;
+
+	for (u32 i = 0; i < TEST_LINES; i++) {
+		s32 len = snprintf(expected, sizeof expected, "data/entry_%u.bin", i);
+
+		if (!riot_hash_dict_find(dict, test_hash(i), &name)) return false;
+		if (name.len != (u64)len || memcmp(name.ptr, expected, len) != 0) return false;
+	}
+
+	if (!riot_hash_dict_find(dict, test_hash(TEST_LINES), &name)) return false;
+	if (name.len != strlen("data/last.bin") || memcmp(name.ptr, "data/last.bin", name.len) != 0) return false;
+
+	return !riot_hash_dict_find(dict, 0, &name) && !riot_hash_dict_find(dict, test_hash(TEST_LINES + 1), &name);
+}
+
+/* every segment split and merge order yields the dictionary of a serial
+ * load, down to which of two duplicate lines is kept
+ */
+static s32
+test_hash_dict_load_segments(void) {
+	char path[] = "/tmp/libriot-hash_dict-XXXXXX";
+	TEST_ASSERT(test_hash_list(path), "failed to write hash list");
+
+	struct riot_hash_dict dict;
+	TEST_ASSERT(riot_hash_dict_init(&dict), "failed to initialise dictionary");
+	TEST_ASSERT(riot_hash_dict_load(&dict, path, NULL), "failed to load serially");
+	TEST_ASSERT(test_hash_dict_matches(&dict), "wrong serial dictionary");
+	riot_hash_dict_free(&dict);
+
+	/* odd counts leave an unpaired segment in some merge rounds */
+	u32 const thread_counts[] = { 1, 2, 3, 4, 7, 8, };
+
+	for (u32 i = 0; i < ARRLEN(thread_counts); i++) {
+		struct riot_thread_pool pool;
+		TEST_ASSERT(riot_thread_pool_init(&pool, thread_counts[i]), "failed to initialise thread pool");
+
+		TEST_ASSERT(riot_hash_dict_init(&dict), "failed to initialise dictionary");
+		TEST_ASSERT(riot_hash_dict_load(&dict, path, &pool), "failed to load in parallel");
+		TEST_ASSERT(test_hash_dict_matches(&dict), "wrong parallel dictionary");
+		riot_hash_dict_free(&dict);
+
+		riot_thread_pool_free(&pool);
+	}
+
+	unlink(path);
+
+	TEST_PASS()
+}
+
+/* more segments than lines leaves some of them empty */
+static s32
+test_hash_dict_load_short(void) {
+	char path[] = "/tmp/libriot-hash_dict-XXXXXX";
+	s32 fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0, "failed to create hash list");
+
+	char const list[] = "1 a\n2 b\n1 c\n";
+	TEST_ASSERT(write(fd, list, sizeof list - 1) == sizeof list - 1, "failed to write hash list");
+	close(fd);
+
+	struct riot_thread_pool pool;
+	TEST_ASSERT(riot_thread_pool_init(&pool, 8), "failed to initialise thread pool");
+
+	struct riot_hash_dict dict;
+	TEST_ASSERT(riot_hash_dict_init(&dict), "failed to initialise dictionary");
+	TEST_ASSERT(riot_hash_dict_load(&dict, path, &pool), "failed to load");
+	TEST_ASSERT(dict.count == 2, "wrong entry count");
+
+	struct str_view name;
+	TEST_ASSERT(riot_hash_dict_find(&dict, 1, &name) && name.len == 1 && name.ptr[0] == 'a',
+		    "first duplicate not kept");
+	TEST_ASSERT(riot_hash_dict_find(&dict, 2, &name) && name.len == 1 && name.ptr[0] == 'b',
+		    "entry not found");
+
+	riot_hash_dict_free(&dict);
+	riot_thread_pool_free(&pool);
+	unlink(path);
+
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_hash_dict_load_segments)
+	TEST_RUN(test_hash_dict_load_short)
+
+	TESTS_END()
+}
@@ -0,0 +1,535 @@
+#include "test.h"
+
+#include "libriot/inibin.h"
+#include "libriot/writer.h"
+
+#include <unistd.h>
+
+#define TEST_INIBIN_ENTRIES 96
+#define TEST_INIBIN_THREADS 4
+
+/* generates a property file covering every container type, nested, and
+ * strings on both sides of `RIOT_INIBIN_STR_REF_MIN`
+ */
+struct test_inibin_gen {
+	struct mem_stream out;
+	u64 state;
+	b32 failed;
+};
+
+static u32
+test_inibin_rand(struct test_inibin_gen *gen) {
+	gen->state = gen->state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return gen->state >> 33;
+}
+
+static void
+test_inibin_emit(struct test_inibin_gen *gen, void const *buf, u64 len) {
+	u8 *dst = riot_mem_stream_reserve(&gen->out, len);
+	if (!dst) {
+		gen->failed = true;
+		return;
+	}
+
+	memcpy(dst, buf, len);
+}
+
+static void
+test_inibin_emit_u8(struct test_inibin_gen *gen, u8 val) {
+	gen->failed |= !riot_mem_stream_write_u8(&gen->out, val);
+}
+
+static void
+test_inibin_emit_u16(struct test_inibin_gen *gen, u16 val) {
+	gen->failed |= !riot_mem_stream_write_u16(&gen->out, val);
+}
+
+static void
+test_inibin_emit_u32(struct test_inibin_gen *gen, u32 val) {
+	gen->failed |= !riot_mem_stream_write_u32(&gen->out, val);
+}
+
+static void
+test_inibin_emit_str(struct test_inibin_gen *gen, u16 len) {
+	test_inibin_emit_u16(gen, len);
+	for (u16 i = 0; i < len; i++)
+		test_inibin_emit_u8(gen, 'a' + test_inibin_rand(gen) % 26);
+}
+
+static u64
+test_inibin_size_begin(struct test_inibin_gen *gen) {
+	u64 pos = gen->out.cur;
+	test_inibin_emit_u32(gen, 0);
+
+	return pos;
+}
+
+static void
+test_inibin_size_end(struct test_inibin_gen *gen, u64 pos) {
+	if (!gen->failed)
+		riot_store_le32(gen->out.ptr + pos, gen->out.cur - pos - sizeof(u32));
+}
+
+static void
+test_inibin_emit_fields(struct test_inibin_gen *gen, u16 count, u32 depth);
+
+static void
+test_inibin_emit_value(struct test_inibin_gen *gen, u8 type, u32 depth) {
+	switch (type) {
+	case RIOT_INIBIN_NODE_U32:
+	case RIOT_INIBIN_NODE_HASH:
+		test_inibin_emit_u32(gen, test_inibin_rand(gen));
+		break;
+
+	case RIOT_INIBIN_NODE_FVEC3:
+		for (u32 i = 0; i < 3; i++) {
+			f32 val = (f32)test_inibin_rand(gen) / 1024.0f;
+			test_inibin_emit(gen, &val, sizeof val);
+		}
+		break;
+
+	case RIOT_INIBIN_NODE_STR:
+		test_inibin_emit_str(gen, test_inibin_rand(gen) % (2 * RIOT_INIBIN_STR_REF_MIN));
+		break;
+
+	case RIOT_INIBIN_NODE_LIST2: {
+		u32 count = test_inibin_rand(gen) % 4;
+
+		test_inibin_emit_u8(gen, RIOT_INIBIN_NODE_EMBED);
+		u64 pos = test_inibin_size_begin(gen);
+		test_inibin_emit_u32(gen, count);
+		for (u32 i = 0; i < count; i++)
+			test_inibin_emit_value(gen, RIOT_INIBIN_NODE_EMBED, depth + 1);
+		test_inibin_size_end(gen, pos);
+	} break;
+
+	case RIOT_INIBIN_NODE_EMBED:
+	case RIOT_INIBIN_NODE_PTR: {
+		/* some pointers are null */
+		u32 class_hash = type == RIOT_INIBIN_NODE_PTR && test_inibin_rand(gen) % 3 == 0 ?
+			0 : 0x1000 + test_inibin_rand(gen) % 16;
+
+		test_inibin_emit_u32(gen, class_hash);
+		if (!class_hash) break;
+
+		u64 pos = test_inibin_size_begin(gen);
+		test_inibin_emit_fields(gen, 1 + test_inibin_rand(gen) % 4, depth + 1);
+		test_inibin_size_end(gen, pos);
+	} break;
+
+	case RIOT_INIBIN_NODE_OPT: {
+		b8 exists = test_inibin_rand(gen) % 2;
+
+		test_inibin_emit_u8(gen, RIOT_INIBIN_NODE_STR);
+		test_inibin_emit_u8(gen, exists);
+		if (exists) test_inibin_emit_value(gen, RIOT_INIBIN_NODE_STR, depth + 1);
+	} break;
+
+	case RIOT_INIBIN_NODE_MAP: {
+		u32 count = test_inibin_rand(gen) % 4;
+
+		test_inibin_emit_u8(gen, RIOT_INIBIN_NODE_HASH);
+		test_inibin_emit_u8(gen, RIOT_INIBIN_NODE_PTR);
+		u64 pos = test_inibin_size_begin(gen);
+		test_inibin_emit_u32(gen, count);
+		for (u32 i = 0; i < count; i++) {
+			test_inibin_emit_value(gen, RIOT_INIBIN_NODE_HASH, depth + 1);
+			test_inibin_emit_value(gen, RIOT_INIBIN_NODE_PTR, depth + 1);
+		}
+		test_inibin_size_end(gen, pos);
+	} break;
+	}
+}
+
+static void
+test_inibin_emit_fields(struct test_inibin_gen *gen, u16 count, u32 depth) {
+	static u8 const leaves[] = {
+		RIOT_INIBIN_NODE_U32, RIOT_INIBIN_NODE_HASH, RIOT_INIBIN_NODE_FVEC3,
+		RIOT_INIBIN_NODE_STR, RIOT_INIBIN_NODE_OPT,
+	};
+	static u8 const containers[] = {
+		RIOT_INIBIN_NODE_LIST2, RIOT_INIBIN_NODE_EMBED, RIOT_INIBIN_NODE_PTR, RIOT_INIBIN_NODE_MAP,
+	};
+
+	test_inibin_emit_u16(gen, count);
+
+	for (u16 i = 0; i < count; i++) {
+		u32 pick = test_inibin_rand(gen);
+		u8 type = depth < 3 && pick % 3 == 0 ?
+			containers[(pick / 3) % sizeof containers] : leaves[(pick / 3) % sizeof leaves];
+
+		test_inibin_emit_u32(gen, 0x100 * (depth + 1) + i);
+		test_inibin_emit_u8(gen, type);
+		test_inibin_emit_value(gen, type, depth);
+	}
+}
+
+static b32
+test_inibin_generate(struct mem_stream *out) {
+	struct test_inibin_gen gen = { .state = 1, };
+
+	test_inibin_emit(&gen, "PROP", 4);
+	test_inibin_emit_u32(&gen, 3);
+
+	test_inibin_emit_u32(&gen, 2);
+	test_inibin_emit_str(&gen, 12);
+	test_inibin_emit_str(&gen, 2 * RIOT_INIBIN_STR_REF_MIN);
+
+	test_inibin_emit_u32(&gen, TEST_INIBIN_ENTRIES);
+	for (u32 i = 0; i < TEST_INIBIN_ENTRIES; i++)
+		test_inibin_emit_u32(&gen, 0x2000 + i % 8);
+
+	for (u32 i = 0; i < TEST_INIBIN_ENTRIES; i++) {
+		u64 pos = test_inibin_size_begin(&gen);
+
+		/* some field lists large enough to be indexed */
+		u16 fields = i % 16 == 0 ? RIOT_INIBIN_FIELD_INDEX_MIN + 8 : 1 + test_inibin_rand(&gen) % 8;
+
+		test_inibin_emit_u32(&gen, test_inibin_rand(&gen));
+		test_inibin_emit_fields(&gen, fields, 0);
+		test_inibin_size_end(&gen, pos);
+	}
+
+	*out = gen.out;
+	out->len = out->cur;
+	out->cur = 0;
+
+	return !gen.failed;
+}
+
+static b32
+test_inibin_fields_eq(struct riot_inibin_ctx *a, struct riot_inibin_field_list const *la,
+		      struct riot_inibin_ctx *b, struct riot_inibin_field_list const *lb);
+
+static b32
+test_inibin_node_eq(struct riot_inibin_ctx *a, struct riot_inibin_node *na,
+		    struct riot_inibin_ctx *b, struct riot_inibin_node *nb) {
+	if (na->type != nb->type) return false;
+
+	union riot_inibin_node_tag *ta = &na->tag, *tb = &nb->tag;
+
+	switch (na->type) {
+	case RIOT_INIBIN_NODE_U32:
+	case RIOT_INIBIN_NODE_HASH:
+		return ta->node_u32 == tb->node_u32;
+
+	case RIOT_INIBIN_NODE_FVEC3:
+		return memcmp(ta->node_fvec3.vs, tb->node_fvec3.vs, sizeof ta->node_fvec3.vs) == 0;
+
+	case RIOT_INIBIN_NODE_STR: {
+		struct str_view sa = riot_inibin_ctx_str(a, &ta->node_str), sb = riot_inibin_ctx_str(b, &tb->node_str);
+		return sa.len == sb.len && memcmp(sa.ptr, sb.ptr, sa.len) == 0;
+	}
+
+	case RIOT_INIBIN_NODE_LIST:
+	case RIOT_INIBIN_NODE_LIST2:
+		if (ta->node_list.type != tb->node_list.type || ta->node_list.count != tb->node_list.count)
+			return false;
+
+		for (u32 i = 0; i < ta->node_list.count; i++) {
+			if (!test_inibin_node_eq(a, riot_inibin_ctx_node(a, ta->node_list.root_node + i),
+						 b, riot_inibin_ctx_node(b, tb->node_list.root_node + i)))
+				return false;
+		}
+
+		return true;
+
+	case RIOT_INIBIN_NODE_PTR:
+	case RIOT_INIBIN_NODE_EMBED:
+		return test_inibin_fields_eq(a, &ta->node_ptr, b, &tb->node_ptr);
+
+	case RIOT_INIBIN_NODE_OPT:
+		if (ta->node_opt.type != tb->node_opt.type || ta->node_opt.exists != tb->node_opt.exists)
+			return false;
+
+		return !ta->node_opt.exists || test_inibin_node_eq(
+			a, RELPTR_REL2ABS(struct riot_inibin_node *, riot_relptr_t, na, ta->node_opt.value),
+			b, RELPTR_REL2ABS(struct riot_inibin_node *, riot_relptr_t, nb, tb->node_opt.value));
+
+	case RIOT_INIBIN_NODE_MAP:
+		if (ta->node_map.key_type != tb->node_map.key_type || ta->node_map.val_type != tb->node_map.val_type ||
+		    ta->node_map.count != tb->node_map.count)
+			return false;
+
+		for (u32 i = 0; i < ta->node_map.count; i++) {
+			struct riot_inibin_pair *pa = riot_inibin_ctx_pair(a, ta->node_map.root_pair + i);
+			struct riot_inibin_pair *pb = riot_inibin_ctx_pair(b, tb->node_map.root_pair + i);
+
+			if (!test_inibin_node_eq(a, riot_inibin_ctx_node(a, pa->key), b, riot_inibin_ctx_node(b, pb->key)) ||
+			    !test_inibin_node_eq(a, riot_inibin_ctx_node(a, pa->val), b, riot_inibin_ctx_node(b, pb->val)))
+				return false;
+		}
+
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static b32
+test_inibin_fields_eq(struct riot_inibin_ctx *a, struct riot_inibin_field_list const *la,
+		      struct riot_inibin_ctx *b, struct riot_inibin_field_list const *lb) {
+	if (la->name_hash != lb->name_hash || la->count != lb->count) return false;
+
+	for (u16 i = 0; i < la->count; i++) {
+		struct riot_inibin_field *fa = riot_inibin_ctx_field(a, la->root_field + i);
+		struct riot_inibin_field *fb = riot_inibin_ctx_field(b, lb->root_field + i);
+
+		if (fa->name_hash != fb->name_hash ||
+		    !test_inibin_node_eq(a, riot_inibin_ctx_node(a, fa->value), b, riot_inibin_ctx_node(b, fb->value)))
+			return false;
+
+		/* indexed lookups land on the same field */
+		struct riot_inibin_field *found_a = riot_inibin_ctx_find_field(a, la, fa->name_hash);
+		struct riot_inibin_field *found_b = riot_inibin_ctx_find_field(b, lb, fb->name_hash);
+		if (!found_a || !found_b ||
+		    found_a - riot_inibin_ctx_field(a, la->root_field) != found_b - riot_inibin_ctx_field(b, lb->root_field))
+			return false;
+	}
+
+	return true;
+}
+
+static b32
+test_inibin_ctx_eq(struct riot_inibin_ctx *a, struct riot_inibin_ctx *b) {
+	if (a->version != b->version || a->link_count != b->link_count || a->entry_count != b->entry_count)
+		return false;
+
+	for (u32 i = 0; i < a->link_count; i++) {
+		struct str_view la = riot_inibin_ctx_str(a, riot_inibin_ctx_link(a, i));
+		struct str_view lb = riot_inibin_ctx_str(b, riot_inibin_ctx_link(b, i));
+
+		if (la.len != lb.len || memcmp(la.ptr, lb.ptr, la.len) != 0)
+			return false;
+	}
+
+	for (u32 i = 0; i < a->entry_count; i++) {
+		struct riot_inibin_entry *ea = riot_inibin_ctx_entry(a, i), *eb = riot_inibin_ctx_entry(b, i);
+
+		if (ea->path_hash != eb->path_hash || !test_inibin_fields_eq(a, &ea->fields, b, &eb->fields))
+			return false;
+
+		if (riot_inibin_ctx_find_entry(a, ea->path_hash) - riot_inibin_ctx_entry(a, 0) !=
+		    riot_inibin_ctx_find_entry(b, eb->path_hash) - riot_inibin_ctx_entry(b, 0))
+			return false;
+	}
+
+	return true;
+}
+
+static s32
+test_inibin_read_parallel_borrow(b32 borrow) {
+	struct mem_stream src;
+	TEST_ASSERT(test_inibin_generate(&src), "failed to generate property file");
+
+	struct riot_thread_pool workers;
+	TEST_ASSERT(riot_thread_pool_init(&workers, TEST_INIBIN_THREADS), "failed to initialise workers");
+
+	struct riot_inibin_ctx serial, parallel, fallback;
+	TEST_ASSERT(riot_inibin_ctx_init(&serial) && riot_inibin_ctx_init(&parallel) &&
+		    riot_inibin_ctx_init(&fallback), "failed to initialise ctx");
+
+	TEST_ASSERT(riot_inibin_read(&serial, src), "failed to read property file");
+	TEST_ASSERT(riot_inibin_read_parallel(&parallel, src, borrow, &workers),
+		    "failed to read property file in parallel");
+
+	/* and without workers, serially */
+	TEST_ASSERT(riot_inibin_read_parallel(&fallback, src, borrow, NULL),
+		    "failed to read property file without workers");
+
+	TEST_ASSERT(serial.entry_count == TEST_INIBIN_ENTRIES, "wrong entry count");
+	b32 eq = test_inibin_ctx_eq(&serial, &parallel) && test_inibin_ctx_eq(&serial, &fallback);
+
+	riot_inibin_ctx_free(&fallback);
+	riot_inibin_ctx_free(&parallel);
+	riot_inibin_ctx_free(&serial);
+	riot_thread_pool_free(&workers);
+	free(src.ptr);
+
+	TEST_ASSERT(eq, "parallel read differs from serial read");
+	TEST_PASS()
+}
+
+static s32
+test_inibin_read_parallel_copied(void) {
+	return test_inibin_read_parallel_borrow(false);
+}
+
+static s32
+test_inibin_read_parallel_borrowed(void) {
+	return test_inibin_read_parallel_borrow(true);
+}
+
+/* writes the ctx out through a writer, and reads the bytes back in */
+static b32
+test_inibin_write(struct riot_inibin_ctx *ctx, struct mem_stream *out) {
+	struct riot_writer writer;
+	if (!riot_writer_init(&writer)) return false;
+
+	b32 res = false;
+
+	FILE *f = tmpfile();
+	if (!f) goto writer_cleanup;
+
+	u64 len = 0;
+	if (!riot_inibin_write(ctx, &writer) || !(len = writer.len) || !riot_writer_flush(&writer, fileno(f)))
+		goto file_cleanup;
+
+	out->ptr = malloc(len);
+	out->len = len;
+	out->cur = 0;
+
+	res = out->ptr && pread(fileno(f), out->ptr, len, 0) == (ssize_t)len;
+
+file_cleanup:
+	fclose(f);
+writer_cleanup:
+	riot_writer_free(&writer);
+
+	return res;
+}
+
+/* a read file written back out is read back to the same tree, and written
+ * out to the very bytes it was read from
+ */
+static s32
+test_inibin_write_roundtrip_borrow(b32 borrow) {
+	struct mem_stream src;
+	TEST_ASSERT(test_inibin_generate(&src), "failed to generate property file");
+
+	struct riot_inibin_ctx ctx, reread;
+	TEST_ASSERT(riot_inibin_ctx_init(&ctx) && riot_inibin_ctx_init(&reread), "failed to initialise ctx");
+
+	TEST_ASSERT(borrow ? riot_inibin_read_borrowed(&ctx, src) : riot_inibin_read(&ctx, src),
+		    "failed to read property file");
+
+	struct mem_stream written;
+	TEST_ASSERT(test_inibin_write(&ctx, &written), "failed to write property file");
+	TEST_ASSERT(written.len == src.len && memcmp(written.ptr, src.ptr, src.len) == 0,
+		    "written property file differs from its source");
+
+	TEST_ASSERT(riot_inibin_read(&reread, written), "failed to read written property file");
+	b32 eq = test_inibin_ctx_eq(&ctx, &reread);
+
+	riot_inibin_ctx_free(&reread);
+	riot_inibin_ctx_free(&ctx);
+	free(written.ptr);
+	free(src.ptr);
+
+	TEST_ASSERT(eq, "written property file reads back differently");
+	TEST_PASS()
+}
+
+static s32
+test_inibin_write_roundtrip_copied(void) {
+	return test_inibin_write_roundtrip_borrow(false);
+}
+
+static s32
+test_inibin_write_roundtrip_borrowed(void) {
+	return test_inibin_write_roundtrip_borrow(true);
+}
+
+/* a lazily opened file loads entries on lookup, or all at once, to the same
+ * tree as a full read
+ */
+static s32
+test_inibin_open_lazy(void) {
+	struct mem_stream src;
+	TEST_ASSERT(test_inibin_generate(&src), "failed to generate property file");
+
+	struct riot_inibin_ctx ctx, lazy;
+	TEST_ASSERT(riot_inibin_ctx_init(&ctx) && riot_inibin_ctx_init(&lazy), "failed to initialise ctx");
+
+	TEST_ASSERT(riot_inibin_read(&ctx, src), "failed to read property file");
+	TEST_ASSERT(riot_inibin_open_lazy(&lazy, src), "failed to open property file lazily");
+	TEST_ASSERT(lazy.entry_count == TEST_INIBIN_ENTRIES, "wrong entry count");
+
+	for (u32 i = 0; i < lazy.entry_count; i++) {
+		TEST_ASSERT(!riot_inibin_ctx_entry(&lazy, i)->loaded, "entry loaded on open");
+	}
+
+	/* looked up entries are loaded, and only those */
+	struct riot_inibin_entry *entry = riot_inibin_ctx_entry(&lazy, 5);
+	TEST_ASSERT(riot_inibin_ctx_find_entry(&lazy, entry->path_hash) == entry && entry->loaded,
+		    "entry not loaded on lookup");
+	TEST_ASSERT(!riot_inibin_ctx_entry(&lazy, 4)->loaded && !riot_inibin_ctx_entry(&lazy, 6)->loaded,
+		    "neighbouring entries loaded");
+	TEST_ASSERT(test_inibin_fields_eq(&ctx, &riot_inibin_ctx_entry(&ctx, 5)->fields, &lazy, &entry->fields),
+		    "entry loaded on lookup differs");
+
+	TEST_ASSERT(riot_inibin_ctx_load_entries(&lazy), "failed to load entries");
+	b32 eq = test_inibin_ctx_eq(&ctx, &lazy);
+
+	riot_inibin_ctx_free(&lazy);
+	riot_inibin_ctx_free(&ctx);
+	free(src.ptr);
+
+	TEST_ASSERT(eq, "lazily loaded property file differs");
+	TEST_PASS()
+}
+
+/* an entry that fails to load leaves no elements behind, and the ctx remains
+ * usable: here, an entry made to end one byte short, failing in its last
+ * field, and one byte late, failing on the trailing byte
+ */
+static s32
+test_inibin_load_rollback(void) {
+	struct mem_stream src;
+	TEST_ASSERT(test_inibin_generate(&src), "failed to generate property file");
+
+	struct riot_inibin_ctx ctx, lazy;
+	TEST_ASSERT(riot_inibin_ctx_init(&ctx) && riot_inibin_ctx_init(&lazy), "failed to initialise ctx");
+
+	TEST_ASSERT(riot_inibin_read(&ctx, src), "failed to read property file");
+	TEST_ASSERT(riot_inibin_open_lazy(&lazy, src), "failed to open property file lazily");
+
+	/* one entry in, so that the pools already hold elements to keep */
+	TEST_ASSERT(riot_inibin_ctx_load_entry(&lazy, riot_inibin_ctx_entry(&lazy, 0)), "failed to load entry");
+
+	/* large enough to be indexed */
+	struct riot_inibin_entry *entry = riot_inibin_ctx_entry(&lazy, 16);
+	s32 const skews[] = { -1, 1, };
+
+	for (u32 i = 0; i < ARRLEN(skews); i++) {
+		u64 str_len = lazy.str_pool.len, field_len = lazy.field_pool.len;
+		u64 pair_len = lazy.pair_pool.len, node_len = lazy.node_pool.len;
+		u64 key_len = lazy.key_pool.len;
+
+		entry->size += skews[i];
+
+		TEST_ASSERT(!riot_inibin_ctx_load_entry(&lazy, entry), "damaged entry loaded");
+		TEST_ASSERT(!riot_inibin_ctx_find_entry(&lazy, entry->path_hash), "damaged entry found");
+		TEST_ASSERT(!entry->loaded && entry->fields.count == 0, "damaged entry left partially loaded");
+		TEST_ASSERT(lazy.str_pool.len == str_len && lazy.field_pool.len == field_len &&
+			    lazy.pair_pool.len == pair_len && lazy.node_pool.len == node_len &&
+			    lazy.key_pool.len == key_len, "damaged entry left elements behind");
+
+		entry->size -= skews[i];
+	}
+
+	TEST_ASSERT(riot_inibin_ctx_load_entries(&lazy), "failed to load entries");
+	b32 eq = test_inibin_ctx_eq(&ctx, &lazy);
+
+	riot_inibin_ctx_free(&lazy);
+	riot_inibin_ctx_free(&ctx);
+	free(src.ptr);
+
+	TEST_ASSERT(eq, "property file differs after a failed load");
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_inibin_read_parallel_copied)
+	TEST_RUN(test_inibin_read_parallel_borrowed)
+	TEST_RUN(test_inibin_write_roundtrip_copied)
+	TEST_RUN(test_inibin_write_roundtrip_borrowed)
+	TEST_RUN(test_inibin_open_lazy)
+	TEST_RUN(test_inibin_load_rollback)
+
+	TESTS_END()
+}
@@ -0,0 +1,144 @@
+#include "test.h"
+
+#include "libriot.h"
+#include "libriot/inibin.h"
+#include "libriot/wad.h"
+
+static u64 const wad_hashes[] = { 0x10, 0x20, 0x20, 0x30, 0x40, };
+static u32 const wad_count = sizeof wad_hashes / sizeof wad_hashes[0];
+
+static fnv1a_u32 const inibin_hashes[] = { 0x10, 0x20, 0x20, 0x20, 0x30, 0xffffffff, };
+static u32 const inibin_count = sizeof inibin_hashes / sizeof inibin_hashes[0];
+
+static s32
+test_hash_search_empty(void) {
+	TEST_ASSERT(riot_hash_search(NULL, 0, 0x10) == 0, "empty table searched");
+	TEST_PASS()
+}
+
+static s32
+test_hash_search_edges(void) {
+	TEST_ASSERT(riot_hash_search(wad_hashes, wad_count, 0x10) == 0, "first key not found");
+	TEST_ASSERT(riot_hash_search(wad_hashes, wad_count, 0x40) == wad_count - 1, "last key not found");
+	TEST_ASSERT(riot_hash_search(wad_hashes, wad_count, 0x30) == 3, "inner key not found");
+
+	/* the last of equal keys */
+	TEST_ASSERT(riot_hash_search(wad_hashes, wad_count, 0x20) == 2, "duplicate key not found");
+
+	TEST_ASSERT(riot_hash_search(wad_hashes, 1, 0x10) == 0, "single key not found");
+	TEST_PASS()
+}
+
+static s32
+test_hash_search_absent(void) {
+	u32 idx = riot_hash_search(wad_hashes, wad_count, 0x08);
+	TEST_ASSERT(idx == 0 && wad_hashes[idx] != 0x08, "key below the first matched");
+
+	idx = riot_hash_search(wad_hashes, wad_count, 0x38);
+	TEST_ASSERT(idx == 3 && wad_hashes[idx] != 0x38, "inner absent key matched");
+
+	idx = riot_hash_search(wad_hashes, wad_count, 0x48);
+	TEST_ASSERT(idx == wad_count - 1 && wad_hashes[idx] != 0x48, "key above the last matched");
+	TEST_PASS()
+}
+
+/* the first element not less than the key, wherever it falls */
+static s32
+test_hash_lower_bound(void) {
+	TEST_ASSERT(riot_inibin_hash_lower_bound(NULL, 0, 0x10) == 0, "empty table searched");
+
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, inibin_count, 0x10) == 0, "first key not found");
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, inibin_count, 0x30) == 4, "inner key not found");
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, inibin_count, 0xffffffff) == inibin_count - 1,
+		    "last key not found");
+
+	/* the first of equal keys */
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, inibin_count, 0x20) == 1, "duplicate key not found");
+
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, inibin_count, 0) == 0, "key below the first");
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, inibin_count, 0x28) == 4, "inner absent key");
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, inibin_count - 1, 0x40) == inibin_count - 1,
+		    "key above the last");
+
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, 1, 0x10) == 0, "single key not found");
+	TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, 1, 0x11) == 1, "key above a single one");
+
+	/* against a linear scan, over every prefix of the table */
+	for (u32 count = 0; count <= inibin_count; count++) {
+		for (u32 i = 0; i < inibin_count; i++) {
+			for (s32 skew = -1; skew <= 1; skew++) {
+				fnv1a_u32 key = inibin_hashes[i] + skew;
+
+				u32 expected = 0;
+				while (expected < count && inibin_hashes[expected] < key)
+					expected++;
+
+				TEST_ASSERT(riot_inibin_hash_lower_bound(inibin_hashes, count, key) == expected,
+					    "lower bound disagrees with a linear scan");
+			}
+		}
+	}
+
+	TEST_PASS()
+}
+
+/* the batched lookup agrees with one search per key, past a batch boundary */
+static s32
+test_wad_find_chunks(void) {
+	struct riot_wad_ctx ctx;
+	TEST_ASSERT(riot_wad_ctx_init(&ctx), "failed to initialise wad ctx");
+
+	struct riot_wad_chunk *found[40];
+	xxh64_u64 keys[40];
+
+	/* nothing to find in an empty index, nor anything to write */
+	TEST_ASSERT(riot_wad_find_chunks(&ctx, NULL, 0, NULL) == 0, "chunk found in an empty index");
+
+	keys[0] = 0x10;
+	found[0] = &(struct riot_wad_chunk){0};
+	TEST_ASSERT(riot_wad_find_chunks(&ctx, keys, 1, found) == 0 && !found[0],
+		    "chunk found in an empty index");
+
+	u32 count = 33;
+	riot_offptr_t offptr;
+	TEST_ASSERT(riot_wad_ctx_pushn_chunk(&ctx, count, &offptr), "failed to push chunks");
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx.chunk_pool.ptr + offptr;
+	for (u32 i = 0; i < count; i++) {
+		memset(&chunks[i], 0, sizeof chunks[i]);
+		chunks[i].path_hash = (xxh64_u64)(count - i) * 0x100;
+	}
+
+	ctx.wad.chunk_count = count;
+	TEST_ASSERT(riot_wad_ctx_build_index(&ctx), "failed to build index");
+
+	/* present keys interleaved with absent ones below, between and above */
+	for (u32 i = 0; i < 40; i++)
+		keys[i] = (xxh64_u64)(i + 1) * 0x80;
+
+	u32 hits = riot_wad_find_chunks(&ctx, keys, 40, found), expected = 0;
+	for (u32 i = 0; i < 40; i++) {
+		struct riot_wad_chunk *chunk = riot_wad_find_chunk(&ctx, keys[i]);
+		TEST_ASSERT(found[i] == chunk, "batched lookup disagrees with a single one");
+		TEST_ASSERT(!chunk || chunk->path_hash == keys[i], "wrong chunk found");
+		expected += chunk != NULL;
+	}
+
+	TEST_ASSERT(hits == expected && expected == 20, "wrong hit count");
+
+	riot_wad_ctx_free(&ctx);
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_hash_search_empty)
+	TEST_RUN(test_hash_search_edges)
+	TEST_RUN(test_hash_search_absent)
+	TEST_RUN(test_hash_lower_bound)
+	TEST_RUN(test_wad_find_chunks)
+
+	TESTS_END()
+}
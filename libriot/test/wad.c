@@ -0,0 +1,304 @@
+#include "test.h"
+
+#include "libriot/wad.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TEST_WAD_PATH "/tmp/libriot-test-wad-XXXXXX"
+
+/* a chunk of a test wad: `len` bytes of `fill`, stored raw */
+struct test_wad_chunk {
+	char const *path;
+	u8 fill;
+	u32 len;
+};
+
+static xxh64_u64
+test_wad_path_hash(char const *path) {
+	return riot_wad_path_hash(path, strlen(path));
+}
+
+static void
+test_wad_payload(u8 *buf, u8 fill, u32 len) {
+	/* compressible, but not uniform */
+	for (u32 i = 0; i < len; i++)
+		buf[i] = fill + (i % 7);
+}
+
+/* writes a v3.1 wad of raw chunks to `path` through `riot_wad_write()` */
+static b32
+test_wad_create(char const *path, struct test_wad_chunk const *src, u32 count) {
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx)) return false;
+
+	b32 res = false;
+
+	struct mem_stream data = {0};
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) goto ctx_cleanup;
+
+	riot_offptr_t offptr;
+	if (!riot_wad_ctx_pushn_chunk(&ctx, count, &offptr))
+		goto writer_cleanup;
+
+	ctx.wad.major = 3;
+	ctx.wad.minor = 1;
+	ctx.wad.chunk_count = count;
+	ctx.wad.data_start = 0;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx.chunk_pool.ptr + offptr;
+	for (u32 i = 0; i < count; i++) {
+		struct riot_wad_chunk *chunk = &chunks[i];
+		memset(chunk, 0, sizeof *chunk);
+
+		chunk->path_hash = test_wad_path_hash(src[i].path);
+		chunk->data_offset = data.cur;
+		chunk->compressed_size = chunk->decompressed_size = src[i].len;
+		chunk->compression = RIOT_WAD_COMPRESSION_NONE;
+
+		u8 *payload = riot_mem_stream_reserve(&data, src[i].len);
+		if (!payload && src[i].len) goto writer_cleanup;
+
+		test_wad_payload(payload, src[i].fill, src[i].len);
+	}
+
+	if (!riot_wad_write(&ctx, data.ptr, data.cur, NULL, &out))
+		goto writer_cleanup;
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) goto writer_cleanup;
+
+	b32 flushed = riot_writer_flush(&out, fd);
+	res = close(fd) == 0 && flushed;
+
+writer_cleanup:
+	riot_writer_free(&out);
+	free(data.ptr);
+ctx_cleanup:
+	riot_wad_ctx_free(&ctx);
+
+	return res;
+}
+
+/* checks that the chunk at `path` decompresses to `len` bytes of `fill` */
+static b32
+test_wad_chunk_matches(struct riot_wad_ctx *ctx, struct riot_wad_decompressor *dec,
+		       char const *path, u8 fill, u32 len) {
+	struct riot_wad_chunk *chunk = riot_wad_find_chunk(ctx, test_wad_path_hash(path));
+	if (!chunk || chunk->decompressed_size != len) return false;
+
+	struct mem_stream data;
+	if (!riot_wad_chunk_decompress(dec, ctx, chunk, NULL, 0, &data) || data.len != len)
+		return false;
+
+	u8 *expected = malloc(len + 1);
+	if (!expected) return false;
+
+	test_wad_payload(expected, fill, len);
+	b32 res = memcmp(data.ptr, expected, len) == 0;
+
+	free(expected);
+
+	return res;
+}
+
+static s32
+test_wad_write_dedup(void) {
+	struct test_wad_chunk const src[] = {
+		{ "data/a.bin", 'a', 300, },
+		{ "data/b.bin", 'b', 200, },
+		{ "data/c.bin", 'a', 300, },
+		{ "data/d.bin", 'a', 299, },
+		{ "data/e.bin", 'b', 200, },
+	};
+	u32 count = ARRLEN(src);
+
+	char path[] = TEST_WAD_PATH;
+	int fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0, "failed to create temporary file");
+	close(fd);
+
+	TEST_ASSERT(test_wad_create(path, src, count), "failed to write wad");
+
+	struct riot_wad_ctx ctx;
+	TEST_ASSERT(riot_wad_ctx_init(&ctx), "failed to initialise wad ctx");
+	TEST_ASSERT(riot_wad_open_mapped(&ctx, path), "failed to read written wad");
+
+	struct riot_wad_chunk *chunks[ARRLEN(src)];
+	for (u32 i = 0; i < count; i++) {
+		chunks[i] = riot_wad_find_chunk(&ctx, test_wad_path_hash(src[i].path));
+		TEST_ASSERT(chunks[i], "written chunk missing");
+	}
+
+	/* identical payloads share the offset of the first one */
+	TEST_ASSERT(!chunks[0]->duplicated && !chunks[1]->duplicated && !chunks[3]->duplicated,
+		    "distinct payload flagged as duplicated");
+	TEST_ASSERT(chunks[2]->duplicated && chunks[4]->duplicated, "duplicate payload not flagged");
+	TEST_ASSERT(chunks[2]->data_offset == chunks[0]->data_offset, "duplicate payload stored twice");
+	TEST_ASSERT(chunks[4]->data_offset == chunks[1]->data_offset, "duplicate payload stored twice");
+
+	/* a prefix of another payload is a payload of its own */
+	TEST_ASSERT(chunks[3]->data_offset != chunks[0]->data_offset, "distinct payloads merged");
+
+	u64 toc_end = RIOT_WAD_V3_HEADER_SZ + count * RIOT_WAD_V3_CHUNK_SZ;
+	TEST_ASSERT(ctx.src.len == toc_end + 300 + 200 + 299, "duplicate payloads stored");
+
+	b32 verified = true;
+	for (u32 i = 0; i < count; i++) {
+		struct mem_stream data;
+		u8 expected[300];
+		test_wad_payload(expected, src[i].fill, src[i].len);
+
+		verified = verified && riot_wad_chunk_data(&ctx, chunks[i], &data) && data.len == src[i].len &&
+			memcmp(data.ptr, expected, src[i].len) == 0;
+	}
+
+	TEST_ASSERT(verified, "chunk payload mismatch");
+
+	u32 mismatches;
+	TEST_ASSERT(riot_wad_verify_checksums(&ctx, NULL, NULL, &mismatches) && !mismatches,
+		    "chunk checksum mismatch");
+
+	riot_wad_ctx_free(&ctx);
+	unlink(path);
+
+	TEST_PASS()
+}
+
+static s32
+test_wad_patch_put(void) {
+	struct test_wad_chunk const src[] = {
+		{ "data/a.bin", 'a', 4096, },
+		{ "data/b.bin", 'b', 100, },
+		{ "data/c.bin", 'c', 2048, },
+	};
+	u32 count = ARRLEN(src);
+
+	char path[] = TEST_WAD_PATH;
+	int fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0, "failed to create temporary file");
+	close(fd);
+
+	TEST_ASSERT(test_wad_create(path, src, count), "failed to write wad");
+
+	u8 replaced[8192], added[512];
+	test_wad_payload(replaced, 'x', sizeof replaced);
+	test_wad_payload(added, 'y', sizeof added);
+
+	struct riot_wad_patch patch;
+	TEST_ASSERT(riot_wad_patch_open(&patch, path), "failed to open wad for patching");
+
+	b32 patched = riot_wad_patch_put(&patch, test_wad_path_hash("data/b.bin"), replaced, sizeof replaced) &&
+		riot_wad_patch_put(&patch, test_wad_path_hash("data/d.bin"), added, sizeof added) &&
+		riot_wad_patch_remove(&patch, test_wad_path_hash("data/c.bin")) &&
+		riot_wad_patch_commit(&patch);
+
+	riot_wad_patch_close(&patch);
+	TEST_ASSERT(patched, "failed to patch wad");
+
+	struct riot_wad_ctx ctx;
+	TEST_ASSERT(riot_wad_ctx_init(&ctx), "failed to initialise wad ctx");
+	TEST_ASSERT(riot_wad_open_mapped(&ctx, path), "failed to read patched wad");
+
+	struct riot_wad_decompressor dec;
+	TEST_ASSERT(riot_wad_decompressor_init(&dec), "failed to initialise decompressor");
+
+	TEST_ASSERT(ctx.wad.chunk_count == 3, "wrong chunk count");
+	TEST_ASSERT(!riot_wad_find_chunk(&ctx, test_wad_path_hash("data/c.bin")), "removed chunk present");
+
+	b32 matches = ctx.wad.chunk_count == 3 &&
+		test_wad_chunk_matches(&ctx, &dec, "data/a.bin", 'a', 4096) &&
+		test_wad_chunk_matches(&ctx, &dec, "data/b.bin", 'x', sizeof replaced) &&
+		test_wad_chunk_matches(&ctx, &dec, "data/d.bin", 'y', sizeof added);
+
+	u32 mismatches;
+	TEST_ASSERT(riot_wad_verify_checksums(&ctx, NULL, NULL, &mismatches) && !mismatches,
+		    "chunk checksum mismatch");
+
+	riot_wad_decompressor_free(&dec);
+	riot_wad_ctx_free(&ctx);
+	unlink(path);
+
+	TEST_ASSERT(matches, "patched chunk mismatch");
+	TEST_PASS()
+}
+
+/* the table of contents grows over the payloads right after it, which are
+ * moved out of its way on commit
+ */
+static s32
+test_wad_patch_toc_growth(void) {
+	struct test_wad_chunk const src[] = {
+		{ "data/a.bin", 'a', 64, },
+		{ "data/b.bin", 'b', 1000, },
+	};
+	u32 count = ARRLEN(src);
+
+	char path[] = TEST_WAD_PATH;
+	int fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0, "failed to create temporary file");
+	close(fd);
+
+	TEST_ASSERT(test_wad_create(path, src, count), "failed to write wad");
+
+	u32 added = 40;
+	u8 payload[256];
+
+	struct riot_wad_patch patch;
+	TEST_ASSERT(riot_wad_patch_open(&patch, path), "failed to open wad for patching");
+
+	b32 patched = true;
+	for (u32 i = 0; patched && i < added; i++) {
+		char chunk_path[32];
+		snprintf(chunk_path, sizeof chunk_path, "data/new/%02u.bin", i);
+
+		test_wad_payload(payload, i, sizeof payload);
+		patched = riot_wad_patch_put(&patch, test_wad_path_hash(chunk_path), payload, sizeof payload);
+	}
+
+	patched = patched && riot_wad_patch_commit(&patch);
+
+	riot_wad_patch_close(&patch);
+	TEST_ASSERT(patched, "failed to patch wad");
+
+	struct riot_wad_ctx ctx;
+	TEST_ASSERT(riot_wad_ctx_init(&ctx), "failed to initialise wad ctx");
+	TEST_ASSERT(riot_wad_open_mapped(&ctx, path), "failed to read patched wad");
+
+	struct riot_wad_decompressor dec;
+	TEST_ASSERT(riot_wad_decompressor_init(&dec), "failed to initialise decompressor");
+
+	TEST_ASSERT(ctx.wad.chunk_count == count + added, "wrong chunk count");
+
+	u64 toc_end = RIOT_WAD_V3_HEADER_SZ + (u64)ctx.wad.chunk_count * RIOT_WAD_V3_CHUNK_SZ;
+	TEST_ASSERT(ctx.wad.data_start >= toc_end, "payload overlaps the table of contents");
+
+	b32 matches = test_wad_chunk_matches(&ctx, &dec, "data/a.bin", 'a', 64) &&
+		test_wad_chunk_matches(&ctx, &dec, "data/b.bin", 'b', 1000);
+
+	for (u32 i = 0; matches && i < added; i++) {
+		char chunk_path[32];
+		snprintf(chunk_path, sizeof chunk_path, "data/new/%02u.bin", i);
+
+		matches = test_wad_chunk_matches(&ctx, &dec, chunk_path, i, sizeof payload);
+	}
+
+	riot_wad_decompressor_free(&dec);
+	riot_wad_ctx_free(&ctx);
+	unlink(path);
+
+	TEST_ASSERT(matches, "relocated chunk mismatch");
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_wad_write_dedup)
+	TEST_RUN(test_wad_patch_put)
+	TEST_RUN(test_wad_patch_toc_growth)
+
+	TESTS_END()
+}
@@ -0,0 +1,234 @@
+#include "test.h"
+
+#include "libriot/wad.h"
+#include "libriot/thread_pool.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_DIR_PATH "/tmp/libriot-test-wad_builder-XXXXXX"
+
+/* a source file of the build: `len` bytes, compressible unless `noise` */
+struct test_file {
+	char const *name;
+	u32 len;
+	b8 noise;
+};
+
+/* on both sides of the block size, so that small files are compressed in
+ * one go and large ones streamed, with and without the raw fallback
+ */
+static struct test_file const test_files[] = {
+	{ "empty.bin", 0, false, },
+	{ "small.bin", 1000, false, },
+	{ "small_noise.bin", 3000, true, },
+	{ "block.bin", RIOT_WAD_BUILDER_BLOCK_SZ, false, },
+	{ "large.bin", 2 * RIOT_WAD_BUILDER_BLOCK_SZ + 123, false, },
+	{ "large_noise.bin", RIOT_WAD_BUILDER_BLOCK_SZ + 4567, true, },
+	{ "tail.bin", 300, false, },
+};
+
+static void
+test_file_payload(u8 *buf, u32 len, u32 seed, b32 noise) {
+	u64 state = 0x9e3779b97f4a7c15ULL * (seed + 1);
+
+	for (u32 i = 0; i < len; i++) {
+		if (noise) {
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			buf[i] = (u8)state;
+		} else {
+			buf[i] = (u8)(seed + i / 5 + (i % 13));
+		}
+	}
+}
+
+static b32
+test_file_create(char const *dir, u32 idx, char *path, u64 len) {
+	struct test_file const *file = &test_files[idx];
+
+	if ((u64)snprintf(path, len, "%s/%s", dir, file->name) >= len) return false;
+
+	u8 *buf = malloc(file->len + 1);
+	if (!buf) return false;
+
+	test_file_payload(buf, file->len, idx, file->noise);
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	b32 res = fd >= 0 && write(fd, buf, file->len) == (ssize_t)file->len;
+
+	if (fd >= 0) close(fd);
+	free(buf);
+
+	return res;
+}
+
+static b32
+test_wad_matches(char const *path) {
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx)) return false;
+
+	struct riot_wad_decompressor dec;
+	if (!riot_wad_decompressor_init(&dec)) {
+		riot_wad_ctx_free(&ctx);
+		return false;
+	}
+
+	b32 res = riot_wad_open_mapped(&ctx, path) && ctx.wad.chunk_count == ARRLEN(test_files);
+
+	u32 mismatches;
+	res = res && riot_wad_verify_checksums(&ctx, NULL, NULL, &mismatches) && !mismatches;
+
+	for (u32 i = 0; res && i < ARRLEN(test_files); i++) {
+		struct test_file const *file = &test_files[i];
+
+		struct riot_wad_chunk *chunk = riot_wad_find_chunk(&ctx, i + 1);
+
+		/* incompressible files are stored raw, whichever path packed them */
+		res = chunk && chunk->decompressed_size == file->len && (!file->len ||
+			chunk->compression == (file->noise ? RIOT_WAD_COMPRESSION_NONE : RIOT_WAD_COMPRESSION_ZSTD));
+
+		struct mem_stream data;
+		res = res && riot_wad_chunk_decompress(&dec, &ctx, chunk, NULL, 0, &data) && data.len == file->len;
+
+		u8 *expected = res ? malloc(file->len + 1) : NULL;
+		if (!expected) {
+			res = false;
+			break;
+		}
+
+		test_file_payload(expected, file->len, i, file->noise);
+		res = memcmp(data.ptr, expected, file->len) == 0;
+
+		free(expected);
+	}
+
+	riot_wad_decompressor_free(&dec);
+	riot_wad_ctx_free(&ctx);
+
+	return res;
+}
+
+/* builds the test files into a wad, reserving `reserved` table of contents
+ * entries
+ */
+static b32
+test_wad_build(char const *dir, char const *path, u32 reserved, struct riot_thread_pool *pool) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) return false;
+
+	struct riot_wad_builder builder;
+	if (!riot_wad_builder_init(&builder, fd, reserved, pool)) {
+		close(fd);
+		return false;
+	}
+
+	b32 res = true;
+	for (u32 i = 0; res && i < ARRLEN(test_files); i++) {
+		char file_path[PATH_MAX];
+		res = (u64)snprintf(file_path, sizeof file_path, "%s/%s", dir, test_files[i].name) < sizeof file_path &&
+			riot_wad_builder_add_file(&builder, i + 1, file_path);
+	}
+
+	res = res && riot_wad_builder_finish(&builder);
+
+	/* the buffers grown by the large files are given back once written,
+	 * except the one the table of contents relocation borrows
+	 */
+	for (u32 i = 1; res && i < 2 * builder.slot_count; i++) {
+		res = builder.slots[i].raw.cap <= RIOT_WAD_BUILDER_SLOT_POOL_SZ &&
+			builder.slots[i].packed.cap <= RIOT_WAD_BUILDER_SLOT_POOL_SZ;
+	}
+
+	riot_wad_builder_free(&builder);
+	close(fd);
+
+	return res;
+}
+
+static s32
+test_wad_builder_roundtrip(void) {
+	char dir[] = TEST_DIR_PATH;
+	TEST_ASSERT(mkdtemp(dir), "failed to create temporary directory");
+
+	char path[PATH_MAX];
+	for (u32 i = 0; i < ARRLEN(test_files); i++) {
+		TEST_ASSERT(test_file_create(dir, i, path, sizeof path), "failed to create source file");
+	}
+
+	char wad_path[PATH_MAX];
+	snprintf(wad_path, sizeof wad_path, "%s.wad", dir);
+
+	/* serially, with exactly as many entries reserved as there are files */
+	TEST_ASSERT(test_wad_build(dir, wad_path, ARRLEN(test_files), NULL), "failed to build wad serially");
+	TEST_ASSERT(test_wad_matches(wad_path), "serially built wad mismatch");
+
+	struct riot_thread_pool pool;
+	TEST_ASSERT(riot_thread_pool_init(&pool, 3), "failed to initialise thread pool");
+
+	/* and in parallel, relocating the payloads the table of contents
+	 * grows over
+	 */
+	TEST_ASSERT(test_wad_build(dir, wad_path, 1, &pool), "failed to build wad in parallel");
+	TEST_ASSERT(test_wad_matches(wad_path), "wad built in parallel mismatch");
+
+	riot_thread_pool_free(&pool);
+
+	for (u32 i = 0; i < ARRLEN(test_files); i++) {
+		snprintf(path, sizeof path, "%s/%s", dir, test_files[i].name);
+		unlink(path);
+	}
+
+	unlink(wad_path);
+	rmdir(dir);
+
+	TEST_PASS()
+}
+
+/* a file that cannot be read fails the build, whether it is the last one
+ * added or not
+ */
+static s32
+test_wad_builder_missing(void) {
+	char dir[] = TEST_DIR_PATH;
+	TEST_ASSERT(mkdtemp(dir), "failed to create temporary directory");
+
+	char path[PATH_MAX], missing[PATH_MAX], wad_path[PATH_MAX];
+	TEST_ASSERT(test_file_create(dir, 1, path, sizeof path), "failed to create source file");
+	snprintf(missing, sizeof missing, "%s/missing.bin", dir);
+	snprintf(wad_path, sizeof wad_path, "%s.wad", dir);
+
+	int fd = open(wad_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	TEST_ASSERT(fd >= 0, "failed to create wad");
+
+	struct riot_wad_builder builder;
+	TEST_ASSERT(riot_wad_builder_init(&builder, fd, 4, NULL), "failed to initialise builder");
+
+	b32 added = riot_wad_builder_add_file(&builder, 1, missing);
+	for (u32 i = 0; added && i < 2 * builder.slot_count; i++)
+		added = riot_wad_builder_add_file(&builder, i + 2, path);
+
+	b32 finished = added && riot_wad_builder_finish(&builder);
+
+	riot_wad_builder_free(&builder);
+	close(fd);
+
+	unlink(path);
+	unlink(wad_path);
+	rmdir(dir);
+
+	TEST_ASSERT(!added && !finished, "missing file packed");
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_wad_builder_roundtrip)
+	TEST_RUN(test_wad_builder_missing)
+
+	TESTS_END()
+}
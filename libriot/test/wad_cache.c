@@ -0,0 +1,291 @@
+#include "test.h"
+
+#include "libriot/wad.h"
+#include "libriot/stats.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_DIR_PATH "/tmp/libriot-test-wad_cache-XXXXXX"
+
+/* a raw chunk of a test wad: `len` bytes of `fill` */
+struct test_wad_chunk {
+	xxh64_u64 path_hash;
+	u8 fill;
+	u32 len;
+};
+
+/* unsorted, so that the index differs from the chunk table */
+static struct test_wad_chunk const test_chunks[] = {
+	{ 30, 'a', 100, },
+	{ 10, 'b', 200, },
+	{ 40, 'c', 300, },
+	{ 20, 'd', 400, },
+};
+
+/* writes a v3.1 wad of raw chunks to `path` */
+static b32
+test_wad_create(char const *path, struct test_wad_chunk const *src, u32 count) {
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx)) return false;
+
+	b32 res = false;
+
+	struct mem_stream data = {0};
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) goto ctx_cleanup;
+
+	riot_offptr_t offptr;
+	if (!riot_wad_ctx_pushn_chunk(&ctx, count, &offptr))
+		goto writer_cleanup;
+
+	ctx.wad.major = 3;
+	ctx.wad.minor = 1;
+	ctx.wad.chunk_count = count;
+	ctx.wad.data_start = 0;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx.chunk_pool.ptr + offptr;
+	for (u32 i = 0; i < count; i++) {
+		memset(&chunks[i], 0, sizeof chunks[i]);
+
+		chunks[i].path_hash = src[i].path_hash;
+		chunks[i].data_offset = data.cur;
+		chunks[i].compressed_size = chunks[i].decompressed_size = src[i].len;
+		chunks[i].compression = RIOT_WAD_COMPRESSION_NONE;
+
+		u8 *payload = riot_mem_stream_reserve(&data, src[i].len);
+		if (!payload) goto writer_cleanup;
+
+		memset(payload, src[i].fill, src[i].len);
+	}
+
+	if (!riot_wad_write(&ctx, data.ptr, data.cur, NULL, &out))
+		goto writer_cleanup;
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) goto writer_cleanup;
+
+	b32 flushed = riot_writer_flush(&out, fd);
+	res = close(fd) == 0 && flushed;
+
+writer_cleanup:
+	riot_writer_free(&out);
+	free(data.ptr);
+ctx_cleanup:
+	riot_wad_ctx_free(&ctx);
+
+	return res;
+}
+
+static b32
+test_file_create(char const *path, void const *buf, u64 len) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) return false;
+
+	b32 res = write(fd, buf, len) == (ssize_t)len;
+
+	return close(fd) == 0 && res;
+}
+
+/* reads all of `path` into a fresh allocation */
+static u8 *
+test_file_read(char const *path, u64 *len) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat st;
+	u8 *buf = fstat(fd, &st) == 0 ? malloc(st.st_size + 1) : NULL;
+
+	if (buf && pread(fd, buf, st.st_size, 0) != st.st_size) {
+		free(buf);
+		buf = NULL;
+	}
+
+	*len = buf ? (u64)st.st_size : 0;
+	close(fd);
+
+	return buf;
+}
+
+/* opens the test wad through its sidecar, and checks that the sidecar was
+ * taken (or not) as `hit` says, and that every chunk is found either way
+ */
+static b32
+test_open_cached(char const *path, char const *cache_path, b32 hit) {
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx)) return false;
+
+	u64 hits = riot_stats_get(RIOT_STAT_WAD_TOC_CACHE_HITS);
+	u64 misses = riot_stats_get(RIOT_STAT_WAD_TOC_CACHE_MISSES);
+
+	b32 res = riot_wad_open_cached(&ctx, path, cache_path) &&
+		riot_stats_get(RIOT_STAT_WAD_TOC_CACHE_HITS) - hits == (hit ? 1 : 0) &&
+		riot_stats_get(RIOT_STAT_WAD_TOC_CACHE_MISSES) - misses == (hit ? 0 : 1) &&
+		ctx.wad.chunk_count == ARRLEN(test_chunks) &&
+		ctx.index_count == ARRLEN(test_chunks);
+
+	for (u32 i = 0; res && i < ARRLEN(test_chunks); i++) {
+		struct riot_wad_chunk *chunk = riot_wad_find_chunk(&ctx, test_chunks[i].path_hash);
+
+		res = chunk && chunk->decompressed_size == test_chunks[i].len &&
+			ctx.src.ptr[chunk->data_offset] == test_chunks[i].fill;
+	}
+
+	res = res && !riot_wad_find_chunk(&ctx, 50);
+
+	riot_wad_ctx_free(&ctx);
+
+	return res;
+}
+
+static s32
+test_wad_cache_roundtrip(void) {
+	char dir[] = TEST_DIR_PATH;
+	TEST_ASSERT(mkdtemp(dir), "failed to create temporary directory");
+
+	char path[PATH_MAX], cache_path[PATH_MAX];
+	snprintf(path, sizeof path, "%s/test.wad", dir);
+	snprintf(cache_path, sizeof cache_path, "%s/test.wad.toc", dir);
+
+	TEST_ASSERT(test_wad_create(path, test_chunks, ARRLEN(test_chunks)), "failed to write wad");
+
+	/* the first open parses the archive and writes the sidecar, which
+	 * the second one then takes
+	 */
+	TEST_ASSERT(test_open_cached(path, cache_path, false), "failed to open wad without a sidecar");
+	TEST_ASSERT(access(cache_path, F_OK) == 0, "sidecar not written");
+	TEST_ASSERT(test_open_cached(path, cache_path, true), "failed to open wad through its sidecar");
+
+	unlink(cache_path);
+	unlink(path);
+	rmdir(dir);
+
+	TEST_PASS()
+}
+
+/* ways of damaging a sidecar, each of which has to be caught */
+enum test_damage {
+	TEST_DAMAGE_TRUNCATED,
+	TEST_DAMAGE_MAGIC,
+	TEST_DAMAGE_MTIME,
+	TEST_DAMAGE_CHUNK_SZ,
+	TEST_DAMAGE_INDEX_HASH,
+	TEST_DAMAGE_INDEX_ORDER,
+	TEST_DAMAGE_INDEX_BOUNDS,
+
+	TEST_DAMAGE_COUNT,
+};
+
+static void
+test_damage(u8 *buf, u64 *len, enum test_damage damage) {
+	struct riot_wad_cache_header *header = (void *)buf;
+
+	u32 count = header->chunk_count;
+
+	u8 *hashes = buf + sizeof *header + (u64)count * sizeof(struct riot_wad_chunk);
+	u8 *indices = hashes + (u64)count * sizeof(xxh64_u64);
+
+	xxh64_u64 hash[2];
+	u32 index[2];
+
+	switch (damage) {
+	case TEST_DAMAGE_TRUNCATED:
+		*len -= sizeof(u32);
+		break;
+	case TEST_DAMAGE_MAGIC:
+		header->magic[0] ^= 0xff;
+		break;
+	case TEST_DAMAGE_MTIME:
+		header->mtime_nsec += 1;
+		break;
+	case TEST_DAMAGE_CHUNK_SZ:
+		header->chunk_sz += 1;
+		break;
+	case TEST_DAMAGE_INDEX_HASH:
+		memcpy(hash, hashes, sizeof hash[0]);
+		hash[0] += 1;
+		memcpy(hashes, hash, sizeof hash[0]);
+		break;
+	case TEST_DAMAGE_INDEX_ORDER:
+		/* consistent pairs, out of order */
+		memcpy(hash, hashes, sizeof hash);
+		memcpy(index, indices, sizeof index);
+		memcpy(hashes, &hash[1], sizeof hash[1]);
+		memcpy(hashes + sizeof hash[1], &hash[0], sizeof hash[0]);
+		memcpy(indices, &index[1], sizeof index[1]);
+		memcpy(indices + sizeof index[1], &index[0], sizeof index[0]);
+		break;
+	case TEST_DAMAGE_INDEX_BOUNDS:
+		index[0] = count;
+		memcpy(indices, &index[0], sizeof index[0]);
+		break;
+	default:
+		break;
+	}
+}
+
+/* a damaged or stale sidecar is ignored: the archive is parsed instead, and
+ * the sidecar rewritten to what it should have held
+ */
+static s32
+test_wad_cache_rejected(void) {
+	char dir[] = TEST_DIR_PATH;
+	TEST_ASSERT(mkdtemp(dir), "failed to create temporary directory");
+
+	char path[PATH_MAX], cache_path[PATH_MAX];
+	snprintf(path, sizeof path, "%s/test.wad", dir);
+	snprintf(cache_path, sizeof cache_path, "%s/test.wad.toc", dir);
+
+	TEST_ASSERT(test_wad_create(path, test_chunks, ARRLEN(test_chunks)), "failed to write wad");
+	TEST_ASSERT(test_open_cached(path, cache_path, false), "failed to open wad without a sidecar");
+
+	u64 good_len;
+	u8 *good = test_file_read(cache_path, &good_len);
+	TEST_ASSERT(good, "failed to read sidecar");
+
+	u8 *buf = malloc(good_len);
+	TEST_ASSERT(buf, "failed to allocate sidecar copy");
+
+	for (u32 i = 0; i < TEST_DAMAGE_COUNT; i++) {
+		u64 len = good_len;
+		memcpy(buf, good, len);
+		test_damage(buf, &len, i);
+
+		TEST_ASSERT(test_file_create(cache_path, buf, len), "failed to write damaged sidecar");
+		TEST_ASSERT(test_open_cached(path, cache_path, false), "damaged sidecar taken");
+
+		u64 rewritten_len;
+		u8 *rewritten = test_file_read(cache_path, &rewritten_len);
+		TEST_ASSERT(rewritten, "failed to read rewritten sidecar");
+		TEST_ASSERT(rewritten_len == good_len && !memcmp(rewritten, good, good_len), "sidecar not rewritten");
+		free(rewritten);
+
+		TEST_ASSERT(test_open_cached(path, cache_path, true), "rewritten sidecar not taken");
+	}
+
+	/* touching the archive leaves the old sidecar stale */
+	struct timespec times[2] = { { 0, UTIME_OMIT, }, { 1000000000, 0, }, };
+	TEST_ASSERT(utimensat(AT_FDCWD, path, times, 0) == 0, "failed to set modification time");
+	TEST_ASSERT(test_open_cached(path, cache_path, false), "stale sidecar taken");
+	TEST_ASSERT(test_open_cached(path, cache_path, true), "refreshed sidecar not taken");
+
+	free(buf);
+	free(good);
+
+	unlink(cache_path);
+	unlink(path);
+	rmdir(dir);
+
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_wad_cache_roundtrip)
+	TEST_RUN(test_wad_cache_rejected)
+
+	TESTS_END()
+}
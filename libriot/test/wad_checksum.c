@@ -0,0 +1,168 @@
+#include "test.h"
+
+#include "libriot/wad.h"
+#include "libriot/thread_pool.h"
+
+#define TEST_CHUNKS 64
+
+/* a v3.1 ctx over an in-memory data segment of `TEST_CHUNKS` chunks of
+ * varying sizes, placed back to back from offset 0
+ */
+struct test_wad {
+	struct riot_wad_ctx ctx;
+	u8 *data;
+	u64 len;
+};
+
+static b32
+test_wad_init(struct test_wad *self) {
+	if (!riot_wad_ctx_init(&self->ctx)) return false;
+
+	self->len = 0;
+	for (u32 i = 0; i < TEST_CHUNKS; i++)
+		self->len += 1 + i * 37;
+
+	self->data = malloc(self->len);
+	if (!self->data) return false;
+
+	riot_offptr_t offptr;
+	if (!riot_wad_ctx_pushn_chunk(&self->ctx, TEST_CHUNKS, &offptr)) return false;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)self->ctx.chunk_pool.ptr + offptr;
+
+	u64 off = 0;
+	for (u32 i = 0; i < TEST_CHUNKS; i++) {
+		memset(&chunks[i], 0, sizeof chunks[i]);
+
+		chunks[i].path_hash = i + 1;
+		chunks[i].data_offset = off;
+		chunks[i].compressed_size = chunks[i].decompressed_size = 1 + i * 37;
+
+		for (u32 j = 0; j < chunks[i].compressed_size; j++)
+			self->data[off + j] = (u8)(i * 7 + j);
+
+		off += chunks[i].compressed_size;
+	}
+
+	self->ctx.wad.major = 3;
+	self->ctx.wad.minor = 1;
+	self->ctx.wad.chunk_count = TEST_CHUNKS;
+	self->ctx.wad.data_start = 0;
+	self->ctx.src = (struct mem_stream){ .ptr = self->data, .len = self->len, };
+
+	return true;
+}
+
+static void
+test_wad_free(struct test_wad *self) {
+	/* not a mapping, so the ctx must not unmap it */
+	self->ctx.src = (struct mem_stream){0};
+
+	riot_wad_ctx_free(&self->ctx);
+	free(self->data);
+}
+
+static s32
+test_checksum_incremental(void) {
+	u8 buf[1000];
+	for (u32 i = 0; i < sizeof buf; i++)
+		buf[i] = (u8)(i * 13);
+
+	struct riot_wad_checksum_state *state = riot_wad_checksum_state_create();
+	TEST_ASSERT(state, "failed to create checksum state");
+
+	/* uneven pieces hash to the one-shot checksum */
+	riot_wad_checksum_update(state, buf, 1);
+	riot_wad_checksum_update(state, buf + 1, 600);
+	riot_wad_checksum_update(state, buf + 601, sizeof buf - 601);
+	TEST_ASSERT(riot_wad_checksum_digest(state) == riot_wad_checksum(buf, sizeof buf),
+		    "incremental checksum mismatch");
+
+	riot_wad_checksum_reset(state);
+	TEST_ASSERT(riot_wad_checksum_digest(state) == riot_wad_checksum(NULL, 0), "reset state not empty");
+
+	riot_wad_checksum_state_free(state);
+	TEST_PASS()
+}
+
+/* generation and verification agree, serially and across a pool, and a
+ * corrupt chunk is the only one reported
+ */
+static s32
+test_checksum_verify(void) {
+	struct test_wad wad;
+	TEST_ASSERT(test_wad_init(&wad), "failed to build wad");
+
+	struct riot_thread_pool pool;
+	TEST_ASSERT(riot_thread_pool_init(&pool, 4), "failed to initialise thread pool");
+
+	TEST_ASSERT(riot_wad_ctx_compute_checksums(&wad.ctx, wad.data, wad.len, &pool),
+		    "failed to compute checksums");
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)wad.ctx.chunk_pool.ptr;
+	for (u32 i = 0; i < TEST_CHUNKS; i++) {
+		TEST_ASSERT(chunks[i].checksum == riot_wad_checksum(wad.data + chunks[i].data_offset,
+								    chunks[i].compressed_size),
+			    "wrong chunk checksum");
+	}
+
+	u64 computed[TEST_CHUNKS];
+	u32 mismatches;
+	TEST_ASSERT(riot_wad_verify_checksums(&wad.ctx, &pool, computed, &mismatches) && !mismatches,
+		    "intact chunks reported");
+	TEST_ASSERT(riot_wad_verify_checksums(&wad.ctx, NULL, NULL, &mismatches) && !mismatches,
+		    "intact chunks reported serially");
+
+	/* a single flipped bit in the middle of one payload */
+	u32 corrupt = TEST_CHUNKS / 2;
+	wad.data[chunks[corrupt].data_offset + chunks[corrupt].compressed_size / 2] ^= 0x10;
+
+	TEST_ASSERT(riot_wad_verify_checksums(&wad.ctx, &pool, computed, &mismatches), "failed to verify");
+	TEST_ASSERT(mismatches == 1, "wrong mismatch count");
+
+	for (u32 i = 0; i < TEST_CHUNKS; i++) {
+		TEST_ASSERT((computed[i] != chunks[i].checksum) == (i == corrupt), "wrong chunk reported");
+	}
+
+	TEST_ASSERT(riot_wad_verify_checksums(&wad.ctx, NULL, NULL, &mismatches) && mismatches == 1,
+		    "wrong serial mismatch count");
+
+	riot_thread_pool_free(&pool);
+	test_wad_free(&wad);
+
+	TEST_PASS()
+}
+
+static s32
+test_checksum_verify_invalid(void) {
+	struct test_wad wad;
+	TEST_ASSERT(test_wad_init(&wad), "failed to build wad");
+	TEST_ASSERT(riot_wad_ctx_compute_checksums(&wad.ctx, wad.data, wad.len, NULL),
+		    "failed to compute checksums");
+
+	/* v3.0 checksums are of another algorithm */
+	u32 mismatches;
+	wad.ctx.wad.minor = 0;
+	TEST_ASSERT(!riot_wad_verify_checksums(&wad.ctx, NULL, NULL, &mismatches), "v3.0 checksums verified");
+
+	/* a chunk past the end of the archive cannot be checked at all */
+	wad.ctx.wad.minor = 1;
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)wad.ctx.chunk_pool.ptr;
+	chunks[TEST_CHUNKS - 1].compressed_size++;
+	TEST_ASSERT(!riot_wad_verify_checksums(&wad.ctx, NULL, NULL, &mismatches), "truncated chunk verified");
+
+	test_wad_free(&wad);
+
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_checksum_incremental)
+	TEST_RUN(test_checksum_verify)
+	TEST_RUN(test_checksum_verify_invalid)
+
+	TESTS_END()
+}
@@ -0,0 +1,192 @@
+#include "test.h"
+
+#include "libriot/wad.h"
+
+/* not a multiple of the vector width, so that the scalar tail runs too */
+#define TEST_CHUNKS 1003
+
+static u64
+test_rng_next(u64 *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+
+	return *state;
+}
+
+/* values clustered at both ends of the u32 range and around the sign bit,
+ * where a signed compare would go wrong
+ */
+static u32
+test_rng_u32(u64 *state) {
+	u32 base[] = { 0, INT32_MAX - 64, UINT32_MAX - 128, 4096, };
+	u64 r = test_rng_next(state);
+
+	return base[r % ARRLEN(base)] + (u32)((r >> 8) % 129);
+}
+
+static b32
+test_ctx_init(struct riot_wad_ctx *ctx, u32 count) {
+	if (!riot_wad_ctx_init(ctx)) return false;
+
+	riot_offptr_t offptr;
+	if (count && !riot_wad_ctx_pushn_chunk(ctx, count, &offptr)) {
+		riot_wad_ctx_free(ctx);
+		return false;
+	}
+
+	u64 state = 0x636f6c756d6e73ull;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+	for (u32 i = 0; i < count; i++) {
+		memset(&chunks[i], 0, sizeof chunks[i]);
+
+		chunks[i].path_hash = test_rng_next(&state);
+		chunks[i].data_offset = test_rng_u32(&state);
+		chunks[i].compressed_size = test_rng_u32(&state);
+		chunks[i].decompressed_size = test_rng_u32(&state);
+		chunks[i].compression = test_rng_next(&state) % 5;
+	}
+
+	ctx->wad.chunk_count = count;
+
+	return riot_wad_ctx_build_columns(ctx);
+}
+
+static u32
+test_select_reference(struct riot_wad_ctx *ctx, struct riot_wad_column_query const *query, u32 *out) {
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+
+	u32 found = 0;
+	for (u32 i = 0; i < ctx->wad.chunk_count; i++) {
+		struct riot_wad_chunk *chunk = &chunks[i];
+
+		if (((query->compression_mask >> chunk->compression) & 1) &&
+		    query->size_min <= chunk->decompressed_size && chunk->decompressed_size <= query->size_max &&
+		    query->offset_min <= chunk->data_offset && chunk->data_offset <= query->offset_max)
+			out[found++] = i;
+	}
+
+	return found;
+}
+
+static s32
+test_columns_build(void) {
+	struct riot_wad_ctx ctx;
+	TEST_ASSERT(test_ctx_init(&ctx, TEST_CHUNKS), "failed to build columns");
+
+	struct riot_wad_columns *columns = &ctx.columns;
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx.chunk_pool.ptr;
+
+	TEST_ASSERT(columns->count == TEST_CHUNKS, "wrong column count");
+
+	for (u32 i = 0; i < TEST_CHUNKS; i++) {
+		TEST_ASSERT(columns->path_hash[i] == chunks[i].path_hash &&
+			    columns->data_offset[i] == chunks[i].data_offset &&
+			    columns->compressed_size[i] == chunks[i].compressed_size &&
+			    columns->decompressed_size[i] == chunks[i].decompressed_size &&
+			    columns->compression[i] == chunks[i].compression,
+			    "column does not mirror its chunk");
+	}
+
+	riot_wad_ctx_free(&ctx);
+
+	TEST_PASS()
+}
+
+static s32
+test_columns_select(void) {
+	struct riot_wad_ctx ctx;
+	TEST_ASSERT(test_ctx_init(&ctx, TEST_CHUNKS), "failed to build columns");
+
+	u32 const mid = INT32_MAX;
+
+	/* ranges straddling the sign bit and both ends of the u32 range,
+	 * empty and single-value ranges, and compression type subsets
+	 */
+	struct riot_wad_column_query const queries[] = {
+		RIOT_WAD_COLUMN_QUERY_ALL,
+		{ UINT32_MAX, 0, 4096 + 64, 0, UINT32_MAX, },
+		{ UINT32_MAX, mid - 32, mid + 32, 0, UINT32_MAX, },
+		{ UINT32_MAX, 0, UINT32_MAX, mid + 1, UINT32_MAX, },
+		{ UINT32_MAX, UINT32_MAX - 64, UINT32_MAX, 0, mid, },
+		{ UINT32_MAX, 4100, 4100, 0, UINT32_MAX, },
+		{ UINT32_MAX, 10, 9, 0, UINT32_MAX, },
+		{ 1 << RIOT_WAD_COMPRESSION_ZSTD, 0, UINT32_MAX, 0, UINT32_MAX, },
+		{ (1 << RIOT_WAD_COMPRESSION_NONE) | (1 << 4), 0, mid, 4096, UINT32_MAX - 100, },
+		{ 0, 0, UINT32_MAX, 0, UINT32_MAX, },
+		{ 1u << 31, 0, UINT32_MAX, 0, UINT32_MAX, },
+	};
+
+	u32 found[TEST_CHUNKS], expected[TEST_CHUNKS];
+
+	for (u32 q = 0; q < ARRLEN(queries); q++) {
+		u32 count = riot_wad_columns_select(&ctx.columns, &queries[q], found);
+		u32 expected_count = test_select_reference(&ctx, &queries[q], expected);
+
+		TEST_ASSERT(count == expected_count, "wrong match count");
+		TEST_ASSERT(!memcmp(found, expected, count * sizeof *found), "wrong matches");
+	}
+
+	riot_wad_ctx_free(&ctx);
+
+	TEST_PASS()
+}
+
+static s32
+test_columns_totals(void) {
+	struct riot_wad_ctx ctx;
+	TEST_ASSERT(test_ctx_init(&ctx, TEST_CHUNKS), "failed to build columns");
+
+	u64 compressed = 0, decompressed = 0;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx.chunk_pool.ptr;
+	for (u32 i = 0; i < TEST_CHUNKS; i++) {
+		compressed += chunks[i].compressed_size;
+		decompressed += chunks[i].decompressed_size;
+	}
+
+	/* well past what a u32 accumulator would hold */
+	TEST_ASSERT(compressed > 16ull * UINT32_MAX, "test sizes too small");
+
+	struct riot_wad_column_totals totals;
+	riot_wad_columns_totals(&ctx.columns, &totals);
+
+	TEST_ASSERT(totals.compressed_size == compressed, "wrong compressed total");
+	TEST_ASSERT(totals.decompressed_size == decompressed, "wrong decompressed total");
+
+	riot_wad_ctx_free(&ctx);
+
+	TEST_PASS()
+}
+
+static s32
+test_columns_empty(void) {
+	struct riot_wad_ctx ctx;
+	TEST_ASSERT(test_ctx_init(&ctx, 0), "failed to build columns");
+
+	TEST_ASSERT(ctx.columns.count == 0, "columns of an empty table");
+
+	struct riot_wad_column_query query = RIOT_WAD_COLUMN_QUERY_ALL;
+	TEST_ASSERT(riot_wad_columns_select(&ctx.columns, &query, NULL) == 0, "matches in an empty table");
+
+	struct riot_wad_column_totals totals;
+	riot_wad_columns_totals(&ctx.columns, &totals);
+	TEST_ASSERT(!totals.compressed_size && !totals.decompressed_size, "totals of an empty table");
+
+	riot_wad_ctx_free(&ctx);
+
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_columns_build)
+	TEST_RUN(test_columns_select)
+	TEST_RUN(test_columns_totals)
+	TEST_RUN(test_columns_empty)
+
+	TESTS_END()
+}
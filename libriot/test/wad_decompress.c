@@ -0,0 +1,509 @@
+#include "test.h"
+
+#include "libriot/wad.h"
+#include "libriot/thread_pool.h"
+#include "libriot/trace.h"
+
+#include <zstd.h>
+
+/* a ctx over an in-memory archive body, whose chunks are pushed one at a
+ * time along with their stored bytes
+ */
+struct test_wad {
+	struct riot_wad_ctx ctx;
+	struct mem_stream data;
+};
+
+static b32
+test_wad_init(struct test_wad *self) {
+	memset(&self->data, 0, sizeof self->data);
+
+	return riot_wad_ctx_init(&self->ctx);
+}
+
+static void
+test_wad_free(struct test_wad *self) {
+	/* not a mapping, so the ctx must not unmap it */
+	self->ctx.src = (struct mem_stream){0};
+
+	riot_wad_ctx_free(&self->ctx);
+	free(self->data.ptr);
+}
+
+static struct riot_wad_chunk *
+test_wad_push(struct test_wad *self, enum riot_wad_compression compression, void const *stored,
+	      u32 stored_len, u32 decompressed_len) {
+	riot_offptr_t offptr;
+	if (!riot_wad_ctx_pushn_chunk(&self->ctx, 1, &offptr)) return NULL;
+
+	u8 *dst = riot_mem_stream_reserve(&self->data, stored_len);
+	if (!dst && stored_len) return NULL;
+
+	struct riot_wad_chunk *chunk = (struct riot_wad_chunk *)self->ctx.chunk_pool.ptr + offptr;
+	memset(chunk, 0, sizeof *chunk);
+
+	chunk->path_hash = offptr + 1;
+	chunk->data_offset = self->data.cur - stored_len;
+	chunk->compressed_size = stored_len;
+	chunk->decompressed_size = decompressed_len;
+	chunk->compression = compression;
+
+	memcpy(dst, stored, stored_len);
+
+	self->ctx.wad.chunk_count++;
+	self->ctx.src = (struct mem_stream){ .ptr = self->data.ptr, .len = self->data.cur, };
+
+	return chunk;
+}
+
+static void
+test_payload(u8 *buf, u32 len, u32 seed) {
+	/* compressible, but not uniform */
+	for (u32 i = 0; i < len; i++)
+		buf[i] = (u8)(seed + i / 3 + (i % 11));
+}
+
+/* zstd-compresses `len` bytes of `src` into a fresh buffer */
+static u8 *
+test_zstd(void const *src, u32 len, u32 *out_len) {
+	size_t cap = ZSTD_compressBound(len);
+	u8 *dst = malloc(cap);
+	if (!dst) return NULL;
+
+	size_t res = ZSTD_compress(dst, cap, src, len, 3);
+	if (ZSTD_isError(res)) {
+		free(dst);
+		return NULL;
+	}
+
+	*out_len = res;
+	return dst;
+}
+
+static s32
+test_decompress_zstd(void) {
+	struct test_wad wad;
+	TEST_ASSERT(test_wad_init(&wad), "failed to initialise wad ctx");
+
+	struct riot_wad_decompressor dec;
+	TEST_ASSERT(riot_wad_decompressor_init(&dec), "failed to initialise decompressor");
+
+	/* larger than the pooled buffer starts out as */
+	u32 lens[] = { 1000, 3 * RIOT_WAD_DECOMPRESSOR_BUF_POOL_SZ, 17, };
+	u8 *payloads[3];
+
+	for (u32 i = 0; i < 3; i++) {
+		payloads[i] = malloc(lens[i]);
+		TEST_ASSERT(payloads[i], "failed to allocate payload");
+		test_payload(payloads[i], lens[i], i);
+
+		u32 stored_len;
+		u8 *stored = test_zstd(payloads[i], lens[i], &stored_len);
+		TEST_ASSERT(stored, "failed to compress payload");
+		TEST_ASSERT(test_wad_push(&wad, RIOT_WAD_COMPRESSION_ZSTD, stored, stored_len, lens[i]),
+			    "failed to push chunk");
+		free(stored);
+	}
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)wad.ctx.chunk_pool.ptr;
+
+	/* the pooled buffer is reused by every call on the decompressor */
+	for (u32 i = 0; i < 3; i++) {
+		struct mem_stream out;
+		TEST_ASSERT(riot_wad_chunk_decompress(&dec, &wad.ctx, &chunks[i], NULL, 0, &out),
+			    "failed to decompress into the pooled buffer");
+		TEST_ASSERT(out.len == lens[i] && memcmp(out.ptr, payloads[i], lens[i]) == 0,
+			    "pooled decompression mismatch");
+		TEST_ASSERT(out.ptr == dec.buf_pool.ptr, "pooled data not in the decompressor's buffer");
+	}
+
+	/* into a caller's buffer, larger than needed */
+	u8 *buf = malloc(lens[0] + 64);
+	TEST_ASSERT(buf, "failed to allocate buffer");
+
+	struct mem_stream out;
+	TEST_ASSERT(riot_wad_chunk_decompress(&dec, &wad.ctx, &chunks[0], buf, lens[0] + 64, &out),
+		    "failed to decompress into a caller buffer");
+	TEST_ASSERT(out.ptr == buf && out.len == lens[0] && memcmp(buf, payloads[0], lens[0]) == 0,
+		    "caller buffer decompression mismatch");
+
+	TEST_ASSERT(!riot_wad_chunk_decompress(&dec, &wad.ctx, &chunks[0], buf, lens[0] - 1, &out),
+		    "decompressed into a buffer too small");
+
+	free(buf);
+	for (u32 i = 0; i < 3; i++)
+		free(payloads[i]);
+
+	riot_wad_decompressor_free(&dec);
+	test_wad_free(&wad);
+
+	TEST_PASS()
+}
+
+static s32
+test_decompress_none(void) {
+	struct test_wad wad;
+	TEST_ASSERT(test_wad_init(&wad), "failed to initialise wad ctx");
+
+	struct riot_wad_decompressor dec;
+	TEST_ASSERT(riot_wad_decompressor_init(&dec), "failed to initialise decompressor");
+
+	u8 payload[300];
+	test_payload(payload, sizeof payload, 7);
+
+	struct riot_wad_chunk *chunk = test_wad_push(&wad, RIOT_WAD_COMPRESSION_NONE, payload, sizeof payload,
+						     sizeof payload);
+	TEST_ASSERT(chunk, "failed to push chunk");
+
+	/* borrowed straight from the source buffer, without a copy */
+	struct mem_stream out;
+	TEST_ASSERT(riot_wad_chunk_decompress(&dec, &wad.ctx, chunk, NULL, 0, &out), "failed to read chunk");
+	TEST_ASSERT(out.ptr == wad.ctx.src.ptr + chunk->data_offset && out.len == sizeof payload,
+		    "stored chunk not borrowed");
+
+	u8 buf[sizeof payload];
+	TEST_ASSERT(riot_wad_chunk_decompress(&dec, &wad.ctx, chunk, buf, sizeof buf, &out),
+		    "failed to copy chunk");
+	TEST_ASSERT(out.ptr == buf && memcmp(buf, payload, sizeof payload) == 0, "stored chunk copy mismatch");
+
+	/* as read in by other means */
+	struct mem_stream src = { .ptr = payload, .len = sizeof payload, };
+	TEST_ASSERT(riot_wad_chunk_decompress_data(&dec, &wad.ctx, chunk, src, NULL, 0, &out) &&
+		    out.ptr == payload, "stored chunk data not borrowed");
+
+	src.len--;
+	TEST_ASSERT(!riot_wad_chunk_decompress_data(&dec, &wad.ctx, chunk, src, NULL, 0, &out),
+		    "short chunk data accepted");
+
+	riot_wad_decompressor_free(&dec);
+	test_wad_free(&wad);
+
+	TEST_PASS()
+}
+
+/* borrowed chunks are traced like decompressed ones */
+static s32
+test_decompress_none_traced(void) {
+	struct test_wad wad;
+	TEST_ASSERT(test_wad_init(&wad), "failed to initialise wad ctx");
+
+	struct riot_wad_decompressor dec;
+	TEST_ASSERT(riot_wad_decompressor_init(&dec), "failed to initialise decompressor");
+
+	u8 payload[300];
+	test_payload(payload, sizeof payload, 9);
+
+	struct riot_wad_chunk *chunk = test_wad_push(&wad, RIOT_WAD_COMPRESSION_NONE, payload, sizeof payload,
+						     sizeof payload);
+	TEST_ASSERT(chunk, "failed to push chunk");
+
+	TEST_ASSERT(riot_trace_start(), "failed to start tracing");
+
+	u8 buf[sizeof payload];
+	struct mem_stream out;
+	b32 borrowed = riot_wad_chunk_decompress(&dec, &wad.ctx, chunk, NULL, 0, &out);
+	b32 copied = riot_wad_chunk_decompress(&dec, &wad.ctx, chunk, buf, sizeof buf, &out);
+
+	riot_trace_stop();
+
+	TEST_ASSERT(borrowed && copied, "failed to read chunk");
+
+	char *json = NULL;
+	size_t json_len = 0;
+	FILE *fp = open_memstream(&json, &json_len);
+	TEST_ASSERT(fp, "failed to open memory stream");
+
+	b32 written = riot_trace_write_json(fp);
+	fclose(fp);
+	TEST_ASSERT(written, "failed to write trace");
+
+	u32 spans = 0;
+	for (char const *cur = json; (cur = strstr(cur, "\"name\":\"decompress\"")); cur++)
+		spans++;
+
+	free(json);
+
+	TEST_ASSERT(spans == 2, "chunk reads not traced");
+
+	riot_wad_decompressor_free(&dec);
+	test_wad_free(&wad);
+
+	TEST_PASS()
+}
+
+static s32
+test_decompress_zstd_corrupt(void) {
+	struct test_wad wad;
+	TEST_ASSERT(test_wad_init(&wad), "failed to initialise wad ctx");
+
+	struct riot_wad_decompressor dec;
+	TEST_ASSERT(riot_wad_decompressor_init(&dec), "failed to initialise decompressor");
+
+	u8 payload[4096];
+	test_payload(payload, sizeof payload, 3);
+
+	u32 stored_len;
+	u8 *stored = test_zstd(payload, sizeof payload, &stored_len);
+	TEST_ASSERT(stored, "failed to compress payload");
+
+	/* a truncated frame, one recording the wrong size, and a bad codec */
+	struct riot_wad_chunk *truncated = test_wad_push(&wad, RIOT_WAD_COMPRESSION_ZSTD, stored, stored_len / 2,
+							 sizeof payload);
+	struct riot_wad_chunk *oversized = test_wad_push(&wad, RIOT_WAD_COMPRESSION_ZSTD, stored, stored_len,
+							 sizeof payload + 1);
+	struct riot_wad_chunk *gzip = test_wad_push(&wad, RIOT_WAD_COMPRESSION_GZIP, stored, stored_len,
+						    sizeof payload);
+	TEST_ASSERT(truncated && oversized && gzip, "failed to push chunks");
+
+	free(stored);
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)wad.ctx.chunk_pool.ptr;
+
+	struct mem_stream out;
+	TEST_ASSERT(!riot_wad_chunk_decompress(&dec, &wad.ctx, &chunks[0], NULL, 0, &out),
+		    "truncated frame decompressed");
+	TEST_ASSERT(!riot_wad_chunk_decompress(&dec, &wad.ctx, &chunks[1], NULL, 0, &out),
+		    "size mismatch accepted");
+	TEST_ASSERT(!riot_wad_chunk_decompress(&dec, &wad.ctx, &chunks[2], NULL, 0, &out),
+		    "unsupported compression accepted");
+
+	/* out of the source buffer */
+	chunks[0].data_offset = wad.ctx.src.len;
+	TEST_ASSERT(!riot_wad_chunk_decompress(&dec, &wad.ctx, &chunks[0], NULL, 0, &out),
+		    "chunk out of bounds decompressed");
+
+	riot_wad_decompressor_free(&dec);
+	test_wad_free(&wad);
+
+	TEST_PASS()
+}
+
+/* a zstd-chunked entry of `TEST_SUBCHUNKS` sub-chunks, large enough to be
+ * decoded in parallel. every third sub-chunk is incompressible, and stored
+ * raw
+ */
+#define TEST_SUBCHUNKS 12
+#define TEST_SUBCHUNK_SZ 64 * KiB
+
+struct test_subchunked {
+	u8 *payload, *stored;
+	u32 payload_len, stored_len;
+	u8 toc[TEST_SUBCHUNKS * RIOT_WAD_SUBCHUNK_SZ];
+};
+
+static b32
+test_subchunked_init(struct test_subchunked *self, b32 with_raw) {
+	self->payload_len = TEST_SUBCHUNKS * TEST_SUBCHUNK_SZ;
+	self->payload = malloc(self->payload_len);
+	self->stored = malloc(TEST_SUBCHUNKS * ZSTD_compressBound(TEST_SUBCHUNK_SZ));
+	self->stored_len = 0;
+
+	if (!self->payload || !self->stored) return false;
+
+	u32 lcg = 12345;
+	for (u32 i = 0; i < TEST_SUBCHUNKS; i++) {
+		u8 *src = self->payload + i * TEST_SUBCHUNK_SZ;
+		b32 raw = with_raw && i % 3 == 2;
+
+		if (raw) {
+			for (u32 j = 0; j < TEST_SUBCHUNK_SZ; j++) {
+				lcg = lcg * 1664525 + 1013904223;
+				src[j] = lcg >> 24;
+			}
+		} else {
+			test_payload(src, TEST_SUBCHUNK_SZ, i);
+		}
+
+		u8 *dst = self->stored + self->stored_len;
+		u64 len = TEST_SUBCHUNK_SZ;
+
+		if (raw) {
+			memcpy(dst, src, len);
+		} else {
+			len = ZSTD_compress(dst, ZSTD_compressBound(TEST_SUBCHUNK_SZ), src, TEST_SUBCHUNK_SZ, 1);
+			if (ZSTD_isError(len)) return false;
+		}
+
+		u8 *record = self->toc + i * RIOT_WAD_SUBCHUNK_SZ;
+		riot_store_le32(record + 0, len);
+		riot_store_le32(record + 4, TEST_SUBCHUNK_SZ);
+		riot_store_le64(record + 8, riot_wad_checksum(dst, len));
+
+		self->stored_len += len;
+	}
+
+	return true;
+}
+
+static void
+test_subchunked_free(struct test_subchunked *self) {
+	free(self->payload);
+	free(self->stored);
+}
+
+static struct riot_wad_chunk *
+test_subchunked_push(struct test_subchunked *self, struct test_wad *wad) {
+	struct riot_wad_chunk *chunk = test_wad_push(wad, RIOT_WAD_COMPRESSION_ZSTD_CHUNK, self->stored,
+						     self->stored_len, self->payload_len);
+	if (!chunk) return NULL;
+
+	chunk->sub_chunk_start = 0;
+	chunk->sub_chunk_count = TEST_SUBCHUNKS;
+
+	return chunk;
+}
+
+/* decodes `chunk` into a fresh buffer through `dec`, and compares it */
+static b32
+test_subchunked_matches(struct test_subchunked *self, struct test_wad *wad, struct riot_wad_decompressor *dec,
+			struct riot_wad_chunk *chunk) {
+	u8 *buf = malloc(self->payload_len);
+	if (!buf) return false;
+
+	/* stale contents must all be overwritten */
+	memset(buf, 0xcd, self->payload_len);
+
+	struct mem_stream out;
+	b32 res = riot_wad_chunk_decompress(dec, &wad->ctx, chunk, buf, self->payload_len, &out) &&
+		out.len == self->payload_len && memcmp(buf, self->payload, self->payload_len) == 0;
+
+	free(buf);
+
+	return res;
+}
+
+/* the parallel path decodes to exactly what the serial one does, raw-stored
+ * sub-chunks being located through the sub-chunk table
+ */
+static s32
+test_decompress_subchunks_parallel(void) {
+	struct test_subchunked src;
+	TEST_ASSERT(test_subchunked_init(&src, true), "failed to build sub-chunks");
+	TEST_ASSERT(src.payload_len >= RIOT_WAD_DECOMPRESSOR_PARALLEL_MIN_SZ, "entry too small for the parallel path");
+
+	struct test_wad wad;
+	TEST_ASSERT(test_wad_init(&wad), "failed to initialise wad ctx");
+
+	struct riot_wad_chunk *chunk = test_subchunked_push(&src, &wad);
+	TEST_ASSERT(chunk, "failed to push chunk");
+	TEST_ASSERT(riot_wad_chunk_decompresses_in_parallel(chunk), "entry not decoded in parallel");
+
+	struct riot_wad_chunk *toc = test_wad_push(&wad, RIOT_WAD_COMPRESSION_NONE, src.toc, sizeof src.toc,
+						   sizeof src.toc);
+	TEST_ASSERT(toc, "failed to push sub-chunk table");
+
+	xxh64_u64 toc_path_hash = riot_wad_subchunk_toc_path_hash("DATA/FINAL/Test.wad.client");
+	toc->path_hash = toc_path_hash;
+	chunk = (struct riot_wad_chunk *)wad.ctx.chunk_pool.ptr;
+
+	TEST_ASSERT(riot_wad_ctx_build_index(&wad.ctx), "failed to build index");
+
+	struct riot_wad_decompressor serial, parallel;
+	TEST_ASSERT(riot_wad_decompressor_init(&serial) && riot_wad_decompressor_init(&parallel),
+		    "failed to initialise decompressors");
+
+	/* without the table, raw-stored sub-chunks cannot be located */
+	TEST_ASSERT(!test_subchunked_matches(&src, &wad, &serial, chunk), "raw sub-chunks resolved without a table");
+
+	TEST_ASSERT(riot_wad_ctx_load_subchunk_toc(&wad.ctx, &serial, toc_path_hash), "failed to load sub-chunk table");
+	TEST_ASSERT(wad.ctx.subchunk_count == TEST_SUBCHUNKS, "wrong sub-chunk count");
+
+	struct riot_thread_pool pool;
+	TEST_ASSERT(riot_thread_pool_init(&pool, 4), "failed to initialise thread pool");
+	TEST_ASSERT(riot_wad_decompressor_set_workers(&parallel, &pool), "failed to set decompressor workers");
+
+	TEST_ASSERT(test_subchunked_matches(&src, &wad, &serial, chunk), "serial decode mismatch");
+	TEST_ASSERT(test_subchunked_matches(&src, &wad, &parallel, chunk), "parallel decode mismatch");
+
+	/* the workers keep their decoder contexts across entries */
+	TEST_ASSERT(test_subchunked_matches(&src, &wad, &parallel, chunk), "repeated parallel decode mismatch");
+
+	/* a corrupt sub-chunk fails the whole entry, whichever worker sees it */
+	struct riot_wad_subchunk *subchunks = (struct riot_wad_subchunk *)wad.ctx.subchunk_pool.ptr;
+	u64 off = subchunks[0].compressed_size + subchunks[1].compressed_size;
+	u8 saved = wad.data.ptr[chunk->data_offset + off + 8];
+	wad.data.ptr[chunk->data_offset + off + 8] ^= 0xff;
+
+	TEST_ASSERT(!test_subchunked_matches(&src, &wad, &parallel, chunk), "corrupt sub-chunk decoded in parallel");
+	TEST_ASSERT(!test_subchunked_matches(&src, &wad, &serial, chunk), "corrupt sub-chunk decoded serially");
+
+	wad.data.ptr[chunk->data_offset + off + 8] = saved;
+
+	riot_wad_decompressor_free(&parallel);
+	riot_wad_decompressor_free(&serial);
+	riot_thread_pool_free(&pool);
+	test_wad_free(&wad);
+	test_subchunked_free(&src);
+
+	TEST_PASS()
+}
+
+/* entries made only of zstd frames resolve from the frame headers alone */
+static s32
+test_decompress_subchunks_frames(void) {
+	struct test_subchunked src;
+	TEST_ASSERT(test_subchunked_init(&src, false), "failed to build sub-chunks");
+
+	struct test_wad wad;
+	TEST_ASSERT(test_wad_init(&wad), "failed to initialise wad ctx");
+
+	struct riot_wad_chunk *chunk = test_subchunked_push(&src, &wad);
+	TEST_ASSERT(chunk, "failed to push chunk");
+
+	struct riot_wad_decompressor serial, parallel;
+	TEST_ASSERT(riot_wad_decompressor_init(&serial) && riot_wad_decompressor_init(&parallel),
+		    "failed to initialise decompressors");
+
+	struct riot_thread_pool pool;
+	TEST_ASSERT(riot_thread_pool_init(&pool, 3), "failed to initialise thread pool");
+	TEST_ASSERT(riot_wad_decompressor_set_workers(&parallel, &pool), "failed to set decompressor workers");
+
+	TEST_ASSERT(test_subchunked_matches(&src, &wad, &serial, chunk), "serial decode mismatch");
+	TEST_ASSERT(test_subchunked_matches(&src, &wad, &parallel, chunk), "parallel decode mismatch");
+
+	/* a table that does not cover the entry is rejected */
+	struct mem_stream toc = { .ptr = src.toc, .len = (TEST_SUBCHUNKS - 1) * RIOT_WAD_SUBCHUNK_SZ, };
+	TEST_ASSERT(riot_wad_ctx_read_subchunk_toc(&wad.ctx, toc), "failed to read sub-chunk table");
+	TEST_ASSERT(!test_subchunked_matches(&src, &wad, &serial, chunk), "sub-chunks out of bounds decoded");
+
+	riot_wad_decompressor_free(&parallel);
+	riot_wad_decompressor_free(&serial);
+	riot_thread_pool_free(&pool);
+	test_wad_free(&wad);
+	test_subchunked_free(&src);
+
+	TEST_PASS()
+}
+
+static s32
+test_subchunk_toc_path_hash(void) {
+	char const *cases[][2] = {
+		{ "/games/League/Game/DATA/FINAL/Champions/Aatrox.wad.client",
+		  "data/final/champions/aatrox.wad.subchunktoc", },
+		{ "DATA/FINAL/UI.wad.client", "data/final/ui.wad.subchunktoc", },
+		{ "/tmp/metadata/Maps.wad.client", "maps.wad.subchunktoc", },
+		{ "Common.wad", "common.wad.subchunktoc", },
+	};
+
+	for (u32 i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+		xxh64_u64 expected = riot_wad_path_hash(cases[i][1], strlen(cases[i][1]));
+		TEST_ASSERT(riot_wad_subchunk_toc_path_hash(cases[i][0]) == expected, cases[i][0]);
+	}
+
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_decompress_zstd)
+	TEST_RUN(test_decompress_none)
+	TEST_RUN(test_decompress_none_traced)
+	TEST_RUN(test_decompress_zstd_corrupt)
+	TEST_RUN(test_decompress_subchunks_parallel)
+	TEST_RUN(test_decompress_subchunks_frames)
+	TEST_RUN(test_subchunk_toc_path_hash)
+
+	TESTS_END()
+}
@@ -0,0 +1,175 @@
+#include "test.h"
+
+#include "libriot/wad.h"
+#include "libriot/wad_io.h"
+#include "libriot/stats.h"
+#include "libriot/thread_pool.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_WAD_PATH "/tmp/libriot-test-wad_io-XXXXXX"
+
+/* a raw chunk of a test wad: `len` bytes of `fill` */
+struct test_wad_chunk {
+	xxh64_u64 path_hash;
+	u8 fill;
+	u32 len;
+};
+
+/* laid out back to back, in order, except for the last chunk, which shares
+ * the payload of the second
+ */
+static struct test_wad_chunk const test_chunks[] = {
+	{ 1, 'a', 100, },
+	{ 2, 'b', 2000, },
+	{ 3, 'c', 30, },
+	{ 4, 'd', 0, },
+	{ 5, 'e', 5000, },
+	{ 6, 'f', 60, },
+	{ 7, 'b', 2000, },
+};
+
+/* writes a v3.1 wad of raw chunks to the descriptor `fd` */
+static b32
+test_wad_create(int fd, struct test_wad_chunk const *src, u32 count) {
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx)) return false;
+
+	b32 res = false;
+
+	struct mem_stream data = {0};
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) goto ctx_cleanup;
+
+	riot_offptr_t offptr;
+	if (!riot_wad_ctx_pushn_chunk(&ctx, count, &offptr))
+		goto writer_cleanup;
+
+	ctx.wad.major = 3;
+	ctx.wad.minor = 1;
+	ctx.wad.chunk_count = count;
+	ctx.wad.data_start = 0;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx.chunk_pool.ptr + offptr;
+	for (u32 i = 0; i < count; i++) {
+		memset(&chunks[i], 0, sizeof chunks[i]);
+
+		chunks[i].path_hash = src[i].path_hash;
+		chunks[i].data_offset = data.cur;
+		chunks[i].compressed_size = chunks[i].decompressed_size = src[i].len;
+		chunks[i].compression = RIOT_WAD_COMPRESSION_NONE;
+
+		u8 *payload = riot_mem_stream_reserve(&data, src[i].len);
+		if (!payload) goto writer_cleanup;
+
+		memset(payload, src[i].fill, src[i].len);
+	}
+
+	res = riot_wad_write(&ctx, data.ptr, data.cur, NULL, &out) && riot_writer_flush(&out, fd);
+
+writer_cleanup:
+	riot_writer_free(&out);
+	free(data.ptr);
+ctx_cleanup:
+	riot_wad_ctx_free(&ctx);
+
+	return res;
+}
+
+/* reads the chunks `idx` in one batch, and checks both their payloads and
+ * the number of reads they were coalesced into
+ */
+static b32
+test_io_batch(struct riot_wad_io *io, struct riot_wad_ctx *ctx, u32 const *idx, u32 count, u64 reads) {
+	struct mem_stream out[ARRLEN(test_chunks)];
+	struct riot_wad_chunk *table = (struct riot_wad_chunk *)ctx->chunk_pool.ptr;
+
+	u64 before = riot_stats_get(RIOT_STAT_IO_READS);
+
+	if (!riot_wad_io_read(io, ctx, idx, count, out) || riot_stats_get(RIOT_STAT_IO_READS) - before != reads)
+		return false;
+
+	for (u32 i = 0; i < count; i++) {
+		struct test_wad_chunk const *src = NULL;
+		for (u32 j = 0; j < ARRLEN(test_chunks); j++) {
+			if (test_chunks[j].path_hash == table[idx[i]].path_hash) src = &test_chunks[j];
+		}
+
+		if (!src || out[i].len != src->len) return false;
+
+		for (u32 j = 0; j < src->len; j++) {
+			if (out[i].ptr[j] != src->fill) return false;
+		}
+	}
+
+	return true;
+}
+
+static s32
+test_wad_io_read(void) {
+	char path[] = TEST_WAD_PATH;
+	int fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0, "failed to create temporary file");
+	TEST_ASSERT(test_wad_create(fd, test_chunks, ARRLEN(test_chunks)), "failed to write wad");
+	close(fd);
+
+	struct riot_thread_pool pool;
+	TEST_ASSERT(riot_thread_pool_init(&pool, 3), "failed to initialise thread pool");
+
+	/* an io_uring where the kernel allows one, and preads otherwise: both
+	 * serially and across the pool
+	 */
+	struct { u32 depth; struct riot_thread_pool *workers; } const modes[] = {
+		{ RIOT_WAD_IO_DEFAULT_DEPTH, NULL, },
+		{ 2, NULL, },
+		{ 0, NULL, },
+		{ 0, &pool, },
+	};
+
+	for (u32 i = 0; i < ARRLEN(modes); i++) {
+		struct riot_wad_ctx ctx;
+		TEST_ASSERT(riot_wad_ctx_init(&ctx), "failed to initialise ctx");
+
+		struct riot_wad_io io;
+		TEST_ASSERT(riot_wad_io_open(&io, &ctx, path, modes[i].depth, modes[i].workers), "failed to open wad");
+		TEST_ASSERT(!ctx.src.ptr && !ctx.src.len, "ctx points into the io table of contents");
+		TEST_ASSERT(ctx.wad.chunk_count == ARRLEN(test_chunks), "wrong chunk count");
+		TEST_ASSERT(modes[i].depth || !io.uring, "io_uring set up for a depth of 0");
+
+		/* everything, in reverse: one run over the whole data segment */
+		u32 all[ARRLEN(test_chunks)];
+		for (u32 j = 0; j < ARRLEN(all); j++)
+			all[j] = ARRLEN(all) - 1 - j;
+
+		TEST_ASSERT(test_io_batch(&io, &ctx, all, ARRLEN(all), 1), "wrong full batch");
+
+		/* the payload shared by chunks 1 and 6 is read once, and the gap
+		 * left by chunk 2 splits the rest into two runs
+		 */
+		u32 const gaps[] = { 5, 6, 1, 0, 4, };
+		TEST_ASSERT(test_io_batch(&io, &ctx, gaps, ARRLEN(gaps), 2), "wrong gapped batch");
+
+		u32 const single[] = { 6, };
+		TEST_ASSERT(test_io_batch(&io, &ctx, single, ARRLEN(single), 1), "wrong single chunk batch");
+		TEST_ASSERT(riot_wad_io_read(&io, &ctx, NULL, 0, NULL), "failed to read an empty batch");
+
+		riot_wad_io_close(&io);
+		riot_wad_ctx_free(&ctx);
+	}
+
+	riot_thread_pool_free(&pool);
+	unlink(path);
+
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_wad_io_read)
+
+	TESTS_END()
+}
@@ -0,0 +1,226 @@
+#include "test.h"
+
+#include "libriot/wad.h"
+#include "libriot/wad_mount.h"
+#include "libriot/thread_pool.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_DIR_PATH "/tmp/libriot-test-wad_mount-XXXXXX"
+
+/* a raw chunk of a test wad: `len` bytes of `fill` */
+struct test_wad_chunk {
+	xxh64_u64 path_hash;
+	u8 fill;
+	u32 len;
+};
+
+/* writes a v3.1 wad of raw chunks to `path` */
+static b32
+test_wad_create(char const *path, struct test_wad_chunk const *src, u32 count) {
+	struct riot_wad_ctx ctx;
+	if (!riot_wad_ctx_init(&ctx)) return false;
+
+	b32 res = false;
+
+	struct mem_stream data = {0};
+	struct riot_writer out;
+	if (!riot_writer_init(&out)) goto ctx_cleanup;
+
+	riot_offptr_t offptr;
+	if (!riot_wad_ctx_pushn_chunk(&ctx, count, &offptr))
+		goto writer_cleanup;
+
+	ctx.wad.major = 3;
+	ctx.wad.minor = 1;
+	ctx.wad.chunk_count = count;
+	ctx.wad.data_start = 0;
+
+	struct riot_wad_chunk *chunks = (struct riot_wad_chunk *)ctx.chunk_pool.ptr + offptr;
+	for (u32 i = 0; i < count; i++) {
+		memset(&chunks[i], 0, sizeof chunks[i]);
+
+		chunks[i].path_hash = src[i].path_hash;
+		chunks[i].data_offset = data.cur;
+		chunks[i].compressed_size = chunks[i].decompressed_size = src[i].len;
+		chunks[i].compression = RIOT_WAD_COMPRESSION_NONE;
+
+		u8 *payload = riot_mem_stream_reserve(&data, src[i].len);
+		if (!payload) goto writer_cleanup;
+
+		memset(payload, src[i].fill, src[i].len);
+	}
+
+	if (!riot_wad_write(&ctx, data.ptr, data.cur, NULL, &out))
+		goto writer_cleanup;
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) goto writer_cleanup;
+
+	b32 flushed = riot_writer_flush(&out, fd);
+	res = close(fd) == 0 && flushed;
+
+writer_cleanup:
+	riot_writer_free(&out);
+	free(data.ptr);
+ctx_cleanup:
+	riot_wad_ctx_free(&ctx);
+
+	return res;
+}
+
+static b32
+test_file_create(char const *path, void const *buf, u64 len) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) return false;
+
+	b32 res = write(fd, buf, len) == (ssize_t)len;
+
+	return close(fd) == 0 && res;
+}
+
+/* checks that `path_hash` resolves to archive `archive` of the mount set,
+ * and reads back as `len` bytes of `fill`
+ */
+static b32
+test_mount_resolves(struct riot_wad_mount *mount, struct riot_wad_decompressor *dec, xxh64_u64 path_hash,
+		    u32 archive, u8 fill, u32 len) {
+	struct riot_wad_ctx *ctx;
+	if (!riot_wad_mount_find(mount, path_hash, &ctx) || ctx != &mount->archives[archive])
+		return false;
+
+	struct mem_stream data;
+	if (!riot_wad_mount_read(mount, dec, path_hash, NULL, 0, &data) || data.len != len)
+		return false;
+
+	for (u32 i = 0; i < len; i++) {
+		if (data.ptr[i] != fill) return false;
+	}
+
+	return true;
+}
+
+/* shared by two archives: `1` only in the first, `2` in both, `3` only in
+ * the second
+ */
+static struct test_wad_chunk const test_base[] = {
+	{ 1, 'a', 100, },
+	{ 2, 'a', 200, },
+};
+
+static struct test_wad_chunk const test_patch[] = {
+	{ 2, 'b', 300, },
+	{ 3, 'b', 400, },
+};
+
+static s32
+test_mount_precedence(void) {
+	char dir[] = TEST_DIR_PATH;
+	TEST_ASSERT(mkdtemp(dir), "failed to create temporary directory");
+
+	char base[PATH_MAX], patch[PATH_MAX];
+	snprintf(base, sizeof base, "%s/base.wad", dir);
+	snprintf(patch, sizeof patch, "%s/patch.wad.client", dir);
+
+	TEST_ASSERT(test_wad_create(base, test_base, ARRLEN(test_base)), "failed to write wad");
+	TEST_ASSERT(test_wad_create(patch, test_patch, ARRLEN(test_patch)), "failed to write wad");
+
+	struct riot_thread_pool pool;
+	TEST_ASSERT(riot_thread_pool_init(&pool, 2), "failed to initialise thread pool");
+
+	struct riot_wad_decompressor dec;
+	TEST_ASSERT(riot_wad_decompressor_init(&dec), "failed to initialise decompressor");
+
+	/* the archive mounted last wins, in either order */
+	char const *orders[2][2] = { { base, patch, }, { patch, base, }, };
+
+	for (u32 i = 0; i < ARRLEN(orders); i++) {
+		struct riot_wad_mount mount;
+		TEST_ASSERT(riot_wad_mount_init(&mount), "failed to initialise mount set");
+		TEST_ASSERT(riot_wad_mount_open(&mount, orders[i], 2, i ? &pool : NULL), "failed to mount");
+
+		u32 base_idx = i, patch_idx = i ^ 1;
+
+		TEST_ASSERT(mount.index_count == 3, "wrong merged index size");
+		TEST_ASSERT(test_mount_resolves(&mount, &dec, 1, base_idx, 'a', 100), "wrong chunk 1");
+		TEST_ASSERT(test_mount_resolves(&mount, &dec, 3, patch_idx, 'b', 400), "wrong chunk 3");
+		TEST_ASSERT(i == 0 ? test_mount_resolves(&mount, &dec, 2, patch_idx, 'b', 300)
+				   : test_mount_resolves(&mount, &dec, 2, base_idx, 'a', 200),
+			    "shadowed chunk resolved");
+		TEST_ASSERT(!riot_wad_mount_find(&mount, 4, NULL), "missing chunk found");
+
+		riot_wad_mount_free(&mount);
+	}
+
+	/* a directory mounts in ascending path order, skipping other files */
+	char other[PATH_MAX];
+	snprintf(other, sizeof other, "%s/notes.txt", dir);
+	TEST_ASSERT(test_file_create(other, "RW", 2), "failed to write file");
+
+	struct riot_wad_mount mount;
+	TEST_ASSERT(riot_wad_mount_init(&mount), "failed to initialise mount set");
+	TEST_ASSERT(riot_wad_mount_open_dir(&mount, dir, &pool), "failed to mount directory");
+	TEST_ASSERT(mount.archive_count == 2, "wrong archive count");
+	TEST_ASSERT(test_mount_resolves(&mount, &dec, 2, 1, 'b', 300), "wrong directory precedence");
+	riot_wad_mount_free(&mount);
+
+	riot_wad_decompressor_free(&dec);
+	riot_thread_pool_free(&pool);
+
+	unlink(other);
+	unlink(patch);
+	unlink(base);
+	rmdir(dir);
+
+	TEST_PASS()
+}
+
+/* an archive of an unknown version fails the whole mount, rather than the
+ * process
+ */
+static s32
+test_mount_bad_archive(void) {
+	char dir[] = TEST_DIR_PATH;
+	TEST_ASSERT(mkdtemp(dir), "failed to create temporary directory");
+
+	char base[PATH_MAX], bad[PATH_MAX];
+	snprintf(base, sizeof base, "%s/base.wad", dir);
+	snprintf(bad, sizeof bad, "%s/bad.wad", dir);
+
+	u8 const header[12] = { 'R', 'W', 4, };
+	TEST_ASSERT(test_wad_create(base, test_base, ARRLEN(test_base)), "failed to write wad");
+	TEST_ASSERT(test_file_create(bad, header, sizeof header), "failed to write file");
+
+	struct riot_thread_pool pool;
+	TEST_ASSERT(riot_thread_pool_init(&pool, 2), "failed to initialise thread pool");
+
+	char const *paths[] = { base, bad, };
+
+	for (u32 i = 0; i < 2; i++) {
+		struct riot_wad_mount mount;
+		TEST_ASSERT(riot_wad_mount_init(&mount), "failed to initialise mount set");
+		TEST_ASSERT(!riot_wad_mount_open(&mount, paths, ARRLEN(paths), i ? &pool : NULL),
+			    "bad archive mounted");
+		riot_wad_mount_free(&mount);
+	}
+
+	riot_thread_pool_free(&pool);
+
+	unlink(bad);
+	unlink(base);
+	rmdir(dir);
+
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_mount_precedence)
+	TEST_RUN(test_mount_bad_archive)
+
+	TESTS_END()
+}
@@ -0,0 +1,145 @@
+#include "test.h"
+
+#include "libriot/writer.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define TEST_WRITER_ROUNDS 1500
+#define TEST_WRITER_REF_SZ 100
+
+static u32 test_writev_calls;
+
+/* stands in for the libc writev() the writer links against: it writes out
+ * at most a few thousand bytes a call, cutting segments anywhere, and fails
+ * every fifth call with EINTR, so that flushes have to resume from the
+ * middle of a segment
+ */
+ssize_t
+writev(int fd, struct iovec const *iov, int count) {
+	if (++test_writev_calls % 5 == 0) {
+		errno = EINTR;
+		return -1;
+	}
+
+	u64 budget = 1 + (test_writev_calls * 7919u) % 3000, total = 0;
+
+	for (s32 i = 0; i < count && budget; i++) {
+		u64 n = MIN(iov[i].iov_len, budget);
+
+		ssize_t res = write(fd, iov[i].iov_base, n);
+		if (res < 0) return total ? (ssize_t)total : -1;
+
+		total += res;
+		budget -= res;
+
+		if ((u64)res < n) break;
+	}
+
+	return total;
+}
+
+/* fills the writer with owned and borrowed runs in turn, well past the
+ * writev() batch size, and `expected` with the bytes they amount to
+ */
+static b32
+test_writer_fill(struct riot_writer *writer, u8 const *ref, struct mem_stream *expected) {
+	for (u32 i = 0; i < TEST_WRITER_ROUNDS; i++) {
+		u8 owned[4] = { (u8)i, (u8)(i >> 8), 0xaa, 0x55, };
+
+		u8 *reserved = riot_writer_reserve(writer, 3);
+		if (!reserved) return false;
+
+		memset(reserved, (u8)(i * 3), 3);
+
+		u64 ref_len = i % 7 ? TEST_WRITER_REF_SZ - i % 7 : 0;
+
+		if (!riot_writer_push(writer, owned, sizeof owned) || !riot_writer_push_ref(writer, ref, ref_len))
+			return false;
+
+		u8 *dst = riot_mem_stream_reserve(expected, 3 + sizeof owned + ref_len);
+		if (!dst) return false;
+
+		memset(dst, (u8)(i * 3), 3);
+		memcpy(dst + 3, owned, sizeof owned);
+		memcpy(dst + 3 + sizeof owned, ref, ref_len);
+	}
+
+	return true;
+}
+
+static b32
+test_writer_file_matches(FILE *f, struct mem_stream *expected) {
+	u8 *buf = malloc(expected->cur + 1);
+	if (!buf) return false;
+
+	b32 res = pread(fileno(f), buf, expected->cur + 1, 0) == (ssize_t)expected->cur &&
+		memcmp(buf, expected->ptr, expected->cur) == 0;
+
+	free(buf);
+
+	return res;
+}
+
+static s32
+test_writer_flush_short_writes(void) {
+	u8 ref[TEST_WRITER_REF_SZ];
+	for (u32 i = 0; i < sizeof ref; i++)
+		ref[i] = (u8)(i * 31 + 7);
+
+	struct riot_writer writer;
+	TEST_ASSERT(riot_writer_init(&writer), "failed to initialise writer");
+
+	struct mem_stream expected = {0};
+	TEST_ASSERT(test_writer_fill(&writer, ref, &expected), "failed to fill writer");
+	TEST_ASSERT(writer.len == expected.cur, "wrong writer length");
+	TEST_ASSERT(writer.segment_count > 1024, "too few segments for several batches");
+
+	FILE *f = tmpfile();
+	TEST_ASSERT(f, "failed to create temporary file");
+
+	test_writev_calls = 0;
+	TEST_ASSERT(riot_writer_flush(&writer, fileno(f)), "failed to flush writer");
+	TEST_ASSERT(test_writev_calls > expected.cur / 3000, "writes were not cut short");
+	TEST_ASSERT(test_writer_file_matches(f, &expected), "flushed output mismatch");
+
+	/* the flush resets the writer for reuse */
+	TEST_ASSERT(writer.len == 0 && writer.segment_count == 0, "writer not reset");
+
+	expected.cur = 0;
+	TEST_ASSERT(ftruncate(fileno(f), 0) == 0 && lseek(fileno(f), 0, SEEK_SET) == 0,
+		    "failed to truncate temporary file");
+	TEST_ASSERT(test_writer_fill(&writer, ref, &expected), "failed to refill writer");
+	TEST_ASSERT(riot_writer_flush(&writer, fileno(f)), "failed to flush reused writer");
+	TEST_ASSERT(test_writer_file_matches(f, &expected), "reused writer output mismatch");
+
+	fclose(f);
+	free(expected.ptr);
+	riot_writer_free(&writer);
+
+	TEST_PASS()
+}
+
+static s32
+test_writer_flush_failure(void) {
+	struct riot_writer writer;
+	TEST_ASSERT(riot_writer_init(&writer), "failed to initialise writer");
+	TEST_ASSERT(riot_writer_push(&writer, "data", 4), "failed to push");
+
+	/* every call but the interrupted ones fails outright */
+	TEST_ASSERT(!riot_writer_flush(&writer, -1), "flush to a bad descriptor succeeded");
+
+	riot_writer_free(&writer);
+
+	TEST_PASS()
+}
+
+s32
+main(void) {
+	TESTS_BEGIN()
+
+	TEST_RUN(test_writer_flush_short_writes)
+	TEST_RUN(test_writer_flush_failure)
+
+	TESTS_END()
+}